@@ -0,0 +1,171 @@
+# Lists the tests affected by a set of changed files, so only those need to be rebuilt and rerun:
+#
+#   python affected.py common/common.c tests/gpu/commands/shared.cpp
+#   python affected.py --git origin/master... | python runtests.py --tests-from -
+#   make -j8 TESTS="$(python affected.py --dirs --git origin/master...)"
+#
+# Dependencies come from the tests' Makefiles and .compile files (EXTRA_OBJS and friends, via the
+# manifest), the compiler's .d files where tests have been built, and #includes otherwise.
+
+# Note: This is a Python3 file.
+
+import sys
+import os
+import re
+import subprocess
+import genmanifest
+
+TEST_ROOT = genmanifest.TEST_ROOT
+COMMON_DIR = "common/"
+# libcommon.a and libcommon_kernel.a, which every test links (build.php compiles common.c itself.)
+COMMON_SOURCES = ["common.c", "vram.c", "sysmem-imports.S"]
+# Changing how everything is built affects everything.
+BUILD_FILES = [COMMON_DIR + "common.mk", COMMON_DIR + "Makefile", TEST_ROOT + "build.php", TEST_ROOT + "build_utils.php"]
+SOURCE_EXTENSIONS = [".c", ".cpp", ".S"]
+
+include_re = re.compile(r'^\s*#\s*include\s*([<"])([^>"]+)[>"]', re.M)
+include_memo = {}
+
+def norm(path):
+  return os.path.normpath(path).replace("\\", "/")
+
+def read_depfile(path):
+  """Returns the prerequisites of the object in a gcc -MMD .d file, relative to its directory."""
+  deps = []
+  text = open(path, "rt", encoding="utf-8", errors="replace").read().replace("\\\n", " ")
+  for line in text.split("\n"):
+    target, sep, rest = line.partition(": ")
+    # -MP adds an empty rule for each header, which says nothing new.
+    if sep and target.strip().endswith(".o"):
+      deps += rest.split()
+  return [norm(os.path.join(os.path.dirname(path), dep)) for dep in deps]
+
+def scan_includes(path, include_dirs):
+  """Follows #includes from path, for sources that haven't been built with -MMD yet."""
+  if path in include_memo:
+    return include_memo[path]
+  include_memo[path] = set()
+  if not os.path.isfile(path):
+    return include_memo[path]
+
+  result = set()
+  for quote, name in include_re.findall(open(path, "rt", encoding="utf-8", errors="replace").read()):
+    # System headers aren't found, and don't matter.
+    for dir in ([os.path.dirname(path)] if quote == '"' else []) + include_dirs:
+      header = norm(os.path.join(dir, name))
+      if os.path.isfile(header):
+        result.add(header)
+        result |= scan_includes(header, include_dirs)
+        break
+  include_memo[path] = result
+  return result
+
+def source_deps(path, include_dirs):
+  """An object or source's source file and everything it includes."""
+  base, ext = os.path.splitext(path)
+  if ext == ".o" or ext == "":
+    sources = [base + e for e in SOURCE_EXTENSIONS if os.path.isfile(base + e)]
+  else:
+    sources = [path]
+  if os.path.isfile(base + ".d"):
+    # The .d file also names the source itself.
+    return set(read_depfile(base + ".d")) | set(sources)
+
+  deps = set(sources)
+  for source in sources:
+    deps |= scan_includes(source, include_dirs)
+  return deps
+
+def build_graph(manifest):
+  """Returns ({file: tests that must be rebuilt}, {file: tests that only need to rerun}.)"""
+  rebuild = {}
+  rerun = {}
+  def add(graph, path, test):
+    graph.setdefault(norm(path), set()).add(test)
+
+  common_deps = set(BUILD_FILES)
+  for source in COMMON_SOURCES:
+    common_deps |= source_deps(COMMON_DIR + source, [COMMON_DIR])
+
+  for test, info in manifest.items():
+    dir = os.path.dirname(TEST_ROOT + info["expected"])
+    include_dirs = [dir, COMMON_DIR]
+    deps = set(common_deps)
+    if info["source"] != None:
+      deps |= source_deps(TEST_ROOT + info["source"], include_dirs)
+    for obj in info["build"]["objs"]:
+      deps |= source_deps(TEST_ROOT + obj, include_dirs)
+    if info["build"]["system"] == "make":
+      deps.add(dir + "/Makefile")
+    else:
+      deps.add(TEST_ROOT + test + ".compile")
+    for path in deps:
+      add(rebuild, path, test)
+
+    for path in [info["prx"], info["expected"], info["expected_bmp"]] + info["data"]:
+      if path != None:
+        add(rerun, TEST_ROOT + path, test)
+  return rebuild, rerun
+
+def git_changed_files(range):
+  c = subprocess.run(["git", "diff", "--name-only", range], stdout=subprocess.PIPE, universal_newlines=True)
+  if c.returncode != 0:
+    return None
+  return [line for line in c.stdout.split("\n") if line]
+
+def main():
+  changed = []
+  print_dirs = False
+  print_rebuild = False
+  it = iter(sys.argv[1:])
+  for arg in it:
+    if arg == "-h" or arg == "--help":
+      print("Usage: %s [options] FILE...\n" % (os.path.basename(sys.argv[0])))
+      print("Prints the tests affected by changes to FILEs (paths from the top directory.)\n")
+      print("Options:")
+      print("  -g, --git RANGE       also use the files changed in RANGE, like origin/master...")
+      print("                        or HEAD for uncommitted changes")
+      print("  -b, --rebuild         only tests that need rebuilding, not just rerunning")
+      print("  -d, --dirs            print test directories to rebuild, for make TESTS=")
+      return 0
+    elif arg == "-g" or arg == "--git":
+      files = git_changed_files(next(it))
+      if files == None:
+        return 1
+      changed += files
+    elif arg == "-b" or arg == "--rebuild":
+      print_rebuild = True
+    elif arg == "-d" or arg == "--dirs":
+      print_dirs = True
+    elif arg[0] == "-":
+      print("Unknown option: %s" % (arg))
+      return 1
+    else:
+      changed.append(norm(os.path.relpath(arg)))
+
+  manifest = genmanifest.load_manifest()
+  if manifest == None:
+    manifest = genmanifest.generate()
+  rebuild_graph, rerun_graph = build_graph(manifest)
+
+  rebuild = set()
+  rerun = set()
+  for path in changed:
+    path = norm(path)
+    if path == genmanifest.MANIFEST or path == genmanifest.NOT_WORKING:
+      continue
+    rebuild |= rebuild_graph.get(path, set())
+    rerun |= rerun_graph.get(path, set())
+    if path not in rebuild_graph and path not in rerun_graph and (path.startswith(TEST_ROOT) or path.startswith(COMMON_DIR)):
+      sys.stderr.write("Not used by any test: %s\n" % (path))
+
+  if print_dirs:
+    for dir in sorted(set(os.path.dirname(TEST_ROOT + test) for test in rebuild)):
+      print(dir)
+  else:
+    for test in sorted(rebuild if print_rebuild else rebuild | rerun):
+      print(test)
+  return 0
+
+if __name__ == "__main__":
+  sys.exit(main())
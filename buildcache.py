@@ -0,0 +1,244 @@
+# Caches test build outputs by a hash of their inputs, so a fresh checkout or another worktree
+# doesn't have to compile everything again.  common.mk runs the compiler and psp-prxgen through
+# this when make is run with BUILDCACHE=1:
+#
+#   make -j8 BUILDCACHE=1
+#   python buildcache.py --stats
+#
+# The cache lives in $PSPAUTOTESTS_CACHE (default ~/.cache/pspautotests), shared by all checkouts.
+
+# Note: This is a Python3 file.
+
+import sys
+import os
+import hashlib
+import shutil
+import subprocess
+import tempfile
+
+CACHE_DIR = os.environ.get("PSPAUTOTESTS_CACHE", os.path.join(os.path.expanduser("~"), ".cache", "pspautotests"))
+STATS_FILE = "stats.log"
+# Change to invalidate everything cached by an older version of this script.
+CACHE_FORMAT = "1"
+
+# Flags that only say where dependency output goes, and don't change the object.
+DEP_FLAGS = ["-MMD", "-MD", "-MP"]
+DEP_FLAGS_WITH_ARG = ["-MF", "-MT", "-MQ"]
+
+def file_hash(path):
+  h = hashlib.sha256()
+  with open(path, "rb") as f:
+    data = f.read()
+  if data.startswith(b"!<arch>\n"):
+    # Archives have timestamps in each member header, so only hash the names and contents.
+    pos = 8
+    while pos + 60 <= len(data):
+      header = data[pos:pos + 60]
+      size = int(header[48:58].strip() or b"0")
+      h.update(header[0:16])
+      h.update(data[pos + 60:pos + 60 + size])
+      pos += 60 + size + (size & 1)
+  else:
+    h.update(data)
+  return h.hexdigest()
+
+def tool_hash(tool):
+  """Identifies a tool by its binary (and version, for compilers), remembered by path and mtime."""
+  path = shutil.which(tool) or tool
+  if not os.path.exists(path):
+    return tool
+  st = os.stat(path)
+  memo_key = hashlib.sha256(("%s|%d|%d" % (os.path.abspath(path), st.st_size, st.st_mtime_ns)).encode("utf-8")).hexdigest()
+  memo_path = os.path.join(CACHE_DIR, "tools", memo_key)
+  if os.path.exists(memo_path):
+    return open(memo_path, "rt").read()
+
+  h = hashlib.sha256(file_hash(path).encode("utf-8"))
+  if tool.endswith("gcc") or tool.endswith("g++"):
+    # The driver alone doesn't say which cc1 and binutils it runs.
+    for flag in ["-dumpversion", "-dumpmachine", "-print-prog-name=cc1", "-print-libgcc-file-name"]:
+      c = subprocess.run([tool, flag], stdout=subprocess.PIPE, stderr=subprocess.DEVNULL)
+      h.update(c.stdout)
+  result = h.hexdigest()
+  write_atomic(memo_path, result.encode("utf-8"))
+  return result
+
+def write_atomic(path, data):
+  os.makedirs(os.path.dirname(path), exist_ok=True)
+  fd, tmp = tempfile.mkstemp(dir=os.path.dirname(path))
+  with os.fdopen(fd, "wb") as f:
+    f.write(data)
+  os.replace(tmp, path)
+
+def arg_value(args, flag):
+  for i, arg in enumerate(args):
+    if arg == flag and i + 1 < len(args):
+      return args[i + 1]
+  return None
+
+def without_output_flags(args):
+  result = []
+  skip = False
+  for arg in args:
+    if skip:
+      skip = False
+    elif arg == "-o" or arg in DEP_FLAGS_WITH_ARG:
+      skip = True
+    elif arg != "-c" and arg not in DEP_FLAGS:
+      result.append(arg)
+  return result
+
+def compile_outputs(args, output):
+  outputs = [output]
+  if "-MMD" in args or "-MD" in args:
+    outputs.append(arg_value(args, "-MF") or os.path.splitext(output)[0] + ".d")
+  return outputs
+
+def compile_key(tool, args):
+  """Hashes the preprocessed source and flags, so only changes that matter miss."""
+  pp_args = without_output_flags(args)
+  # With -g, the directory is in the output.  Leave it out so worktrees share objects (their
+  # debug info then names whichever directory compiled it first.)
+  c = subprocess.run([tool] + pp_args + ["-E", "-fno-working-directory"], stdout=subprocess.PIPE, stderr=subprocess.DEVNULL)
+  if c.returncode != 0:
+    # Let the real compile report the error.
+    return None
+
+  h = hashlib.sha256()
+  h.update(("compile|%s|%s|" % (CACHE_FORMAT, tool_hash(tool))).encode("utf-8"))
+  h.update("\0".join(pp_args).encode("utf-8"))
+  h.update(c.stdout)
+  return h.hexdigest()
+
+def find_library(name, lib_dirs):
+  for lib_dir in lib_dirs:
+    path = os.path.join(lib_dir, "lib" + name + ".a")
+    if os.path.exists(path):
+      return path
+  return None
+
+def inputs_key(kind, tool, args, output):
+  """Hashes a link or prxgen: every input file by content, everything else as given."""
+  lib_dirs = [arg[2:] for arg in args if arg.startswith("-L") and len(arg) > 2]
+  h = hashlib.sha256()
+  h.update(("%s|%s|%s|" % (kind, CACHE_FORMAT, tool_hash(tool))).encode("utf-8"))
+  for arg in args:
+    if arg == output:
+      h.update(b"<output>\0")
+      continue
+    path = None
+    if arg.startswith("-l"):
+      path = find_library(arg[2:], lib_dirs)
+    elif not arg.startswith("-") and os.path.isfile(arg):
+      path = arg
+    h.update(arg.encode("utf-8") + b"\0")
+    if path != None:
+      h.update(file_hash(path).encode("utf-8") + b"\0")
+  return h.hexdigest()
+
+def record(event):
+  try:
+    os.makedirs(CACHE_DIR, exist_ok=True)
+    # Appends of one short line don't interleave, even with make -j.
+    with open(os.path.join(CACHE_DIR, STATS_FILE), "at") as f:
+      f.write(event + "\n")
+  except OSError:
+    pass
+
+def restore(entry, outputs):
+  for i, output in enumerate(outputs):
+    if not os.path.exists(os.path.join(entry, str(i))):
+      return False
+  for i, output in enumerate(outputs):
+    shutil.copyfile(os.path.join(entry, str(i)), output)
+  return True
+
+def store(entry, outputs):
+  if os.path.exists(entry):
+    return
+  os.makedirs(os.path.dirname(entry), exist_ok=True)
+  tmp = tempfile.mkdtemp(dir=os.path.dirname(entry))
+  for i, output in enumerate(outputs):
+    shutil.copyfile(output, os.path.join(tmp, str(i)))
+  try:
+    os.replace(tmp, entry)
+  except OSError:
+    # Someone else stored it first.
+    shutil.rmtree(tmp, ignore_errors=True)
+
+def run_cached(cmd):
+  tool = cmd[0]
+  args = cmd[1:]
+  output = arg_value(args, "-o")
+  if "-c" in args and output != None:
+    key = compile_key(tool, args)
+    outputs = compile_outputs(args, output)
+  elif output != None and "-E" not in args:
+    key = inputs_key("link", tool, args, output)
+    outputs = [output]
+  elif len(args) >= 2 and os.path.isfile(args[0]):
+    # Like psp-prxgen in.elf out.prx.
+    output = args[-1]
+    key = inputs_key("tool", tool, args, output)
+    outputs = [output]
+  else:
+    return subprocess.call(cmd)
+
+  if key != None:
+    entry = os.path.join(CACHE_DIR, key[0:2], key)
+    if restore(entry, outputs):
+      record("hit")
+      print("buildcache: restored %s" % (output))
+      return 0
+
+  result = subprocess.call(cmd)
+  if result == 0 and key != None and all(os.path.exists(o) for o in outputs):
+    store(entry, outputs)
+    record("miss")
+  return result
+
+def print_stats():
+  hits = 0
+  misses = 0
+  path = os.path.join(CACHE_DIR, STATS_FILE)
+  if os.path.exists(path):
+    for line in open(path, "rt"):
+      if line.strip() == "hit":
+        hits += 1
+      elif line.strip() == "miss":
+        misses += 1
+
+  size = 0
+  entries = 0
+  for root, dirs, files in os.walk(CACHE_DIR):
+    if os.path.basename(root) == "tools":
+      continue
+    for filename in files:
+      size += os.path.getsize(os.path.join(root, filename))
+    if root != CACHE_DIR and os.path.dirname(os.path.dirname(root)) == CACHE_DIR:
+      entries += 1
+
+  total = hits + misses
+  print("Cache: %s" % (CACHE_DIR))
+  print("%d hits, %d misses (%.1f%% hit rate)" % (hits, misses, 100.0 * hits / total if total else 0))
+  print("%d entries, %.1f MB" % (entries, size / (1024.0 * 1024.0)))
+
+def main():
+  if len(sys.argv) < 2 or sys.argv[1] == "-h" or sys.argv[1] == "--help":
+    print("Usage: %s COMMAND [ARGS...]" % (os.path.basename(sys.argv[0])))
+    print("       %s --stats | --zero-stats | --clear\n" % (os.path.basename(sys.argv[0])))
+    print("Runs a compile, link, or psp-prxgen COMMAND, or restores its output from %s." % (CACHE_DIR))
+    return 0
+  if sys.argv[1] == "--stats":
+    print_stats()
+    return 0
+  if sys.argv[1] == "--zero-stats":
+    if os.path.exists(os.path.join(CACHE_DIR, STATS_FILE)):
+      os.unlink(os.path.join(CACHE_DIR, STATS_FILE))
+    return 0
+  if sys.argv[1] == "--clear":
+    shutil.rmtree(CACHE_DIR, ignore_errors=True)
+    return 0
+  return run_cached(sys.argv[1:])
+
+sys.exit(main())
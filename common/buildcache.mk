@@ -0,0 +1,10 @@
+# Runs compiles, links, and psp-prxgen through buildcache.py when make is run with BUILDCACHE=1.
+# Include after build.mak, with COMMON_DIR set.
+
+ifdef BUILDCACHE
+BUILDCACHE_PYTHON ?= python3
+BUILDCACHE_CMD = $(BUILDCACHE_PYTHON) $(COMMON_DIR)/../buildcache.py
+CC := $(BUILDCACHE_CMD) $(CC)
+CXX := $(BUILDCACHE_CMD) $(CXX)
+AS := $(BUILDCACHE_CMD) $(AS)
+endif
@@ -9,6 +9,7 @@
 #include <pspctrl.h>
 #include <pspdisplay.h>
 #include <pspiofilemgr.h>
+#include <pspintrman.h>
 //#include <pspkdebug.h>
 
 #include <stdio.h>
@@ -20,6 +21,9 @@
 //#include "local.h"
 
 #include "sysmem-imports.h"
+#include "common.h"
+// common.h renames the test's main, but this is the real one.
+#undef main
 
 /*
 enum PspThreadAttributes
@@ -57,6 +61,7 @@ PSP_MAIN_THREAD_ATTR(PSP_THREAD_ATTR_USER | PSP_THREAD_ATTR_VFPU);
 #define EMULATOR_DEVCTL__IS_EMULATOR     0x00000003
 #define EMULATOR_DEVCTL__SEND_CTRLDATA   0x00000010
 #define EMULATOR_DEVCTL__EMIT_SCREENSHOT 0x00000020
+#define EMULATOR_DEVCTL__SEND_RECORDS    0x00000040
 
 unsigned int RUNNING_ON_EMULATOR = 0;
 unsigned int CHECKPOINT_ENABLE_TIME = 0;
@@ -74,22 +79,329 @@ FILE stdout_back = {NULL};
 char schedfBuffer[65536];
 unsigned int schedfBufferPos = 0;
 
-void schedf(const char *format, ...) {
-	va_list args;
-	va_start(args, format);
+// When schedfBuffer fills past this, it's moved to a chunk in memory, so output is only written
+// (which reschedules) by flushschedf().  The slack is for tests that vsprintf() into it directly.
+#define SCHEDF_CHUNK_AT (sizeof(schedfBuffer) - 4096)
+
+typedef struct SchedfChunk {
+	struct SchedfChunk *next;
+	unsigned int size;
+	char data[1];
+} SchedfChunk;
+
+static SchedfChunk *schedfChunks = NULL;
+static SchedfChunk *schedfChunksTail = NULL;
+static unsigned int schedfChunkBytes = 0;
+static unsigned int schedfChunkCount = 0;
+static unsigned int schedfHighWaterBytes = 0;
+static unsigned int schedfHighWaterChunks = 0;
+
+// GE callbacks and code with interrupts suspended call schedf() too, but can't malloc() or write.
+// They get this chunk, allocated ahead of time, and once it's used any more output is dropped.
+static SchedfChunk *schedfSpare = NULL;
+static unsigned int schedfDropped = 0;
+
+static int schedfInInterrupt() {
+	return !sceKernelIsCpuIntrEnable();
+}
+
+static void schedfRefillSpare() {
+	if (schedfSpare == NULL && !schedfInInterrupt()) {
+		schedfSpare = (SchedfChunk *)malloc(sizeof(SchedfChunk) + sizeof(schedfBuffer));
+	}
+}
+
+static SchedfChunk *schedfNewChunk(unsigned int size) {
+	SchedfChunk *chunk;
+	if (schedfInInterrupt()) {
+		if (schedfSpare == NULL || size > sizeof(schedfBuffer)) {
+			return NULL;
+		}
+		chunk = schedfSpare;
+		schedfSpare = NULL;
+	} else {
+		chunk = (SchedfChunk *)malloc(sizeof(SchedfChunk) + size);
+		if (chunk == NULL) {
+			return NULL;
+		}
+	}
+	chunk->next = NULL;
+	chunk->size = size;
+	if (schedfChunksTail != NULL) {
+		schedfChunksTail->next = chunk;
+	} else {
+		schedfChunks = chunk;
+	}
+	schedfChunksTail = chunk;
+	schedfChunkBytes += size;
+	schedfChunkCount++;
+	return chunk;
+}
+
+// Moves schedfBuffer to a chunk to make room, or writes it out if there's no memory.
+// Returns 0 if there's no room, which only happens in interrupts.
+static int schedfMakeRoom() {
+	SchedfChunk *chunk;
+	if (schedfBufferPos == 0) {
+		return 1;
+	}
+	chunk = schedfNewChunk(schedfBufferPos);
+	if (chunk == NULL) {
+		if (schedfInInterrupt()) {
+			return 0;
+		}
+		flushschedf();
+		return 1;
+	}
+	memcpy(chunk->data, schedfBuffer, schedfBufferPos);
+	schedfBuffer[0] = '\0';
+	schedfBufferPos = 0;
+	return 1;
+}
+
+void vschedf(const char *format, va_list args) {
+	va_list copy;
+	int len;
 	if (CHECKPOINT_OUTPUT_DIRECT) {
 		// This is easier to debug in the emulator, but printf() reschedules on the real PSP.
 		vprintf(format, args);
-	} else {
-		schedfBufferPos += vsprintf(schedfBuffer + schedfBufferPos, format, args);
+		return;
+	}
+
+	va_copy(copy, args);
+	len = vsnprintf(schedfBuffer + schedfBufferPos, sizeof(schedfBuffer) - schedfBufferPos, format, copy);
+	va_end(copy);
+	if (len < 0) {
+		return;
+	}
+
+	if (schedfBufferPos + len >= sizeof(schedfBuffer)) {
+		// Didn't fit, so format it again with room.
+		if (!schedfMakeRoom()) {
+			schedfDropped += len;
+			return;
+		}
+		if (len >= sizeof(schedfBuffer)) {
+			// The chunk has a byte extra for the terminator.
+			SchedfChunk *chunk = schedfNewChunk(len);
+			if (chunk != NULL) {
+				vsnprintf(chunk->data, len + 1, format, args);
+			} else if (schedfInInterrupt()) {
+				schedfDropped += len;
+			} else {
+				// No memory to keep it, so write it out now, after everything before it.
+				flushschedf();
+				vprintf(format, args);
+			}
+			return;
+		}
+		vsnprintf(schedfBuffer + schedfBufferPos, sizeof(schedfBuffer) - schedfBufferPos, format, args);
 	}
+
+	schedfBufferPos += len;
+	if (schedfBufferPos >= SCHEDF_CHUNK_AT) {
+		schedfMakeRoom();
+	}
+}
+
+void schedf(const char *format, ...) {
+	va_list args;
+	va_start(args, format);
+	vschedf(format, args);
 	va_end(args);
 }
 
+// Bytes written to stdout so far, so records know where they go in the text.
+static unsigned int stdoutWritten = 0;
+
 void flushschedf() {
-	printf("%s", schedfBuffer);
+	if (schedfChunkBytes + schedfBufferPos > schedfHighWaterBytes) {
+		schedfHighWaterBytes = schedfChunkBytes + schedfBufferPos;
+	}
+	if (schedfChunkCount > schedfHighWaterChunks) {
+		schedfHighWaterChunks = schedfChunkCount;
+	}
+
+	while (schedfChunks != NULL) {
+		SchedfChunk *chunk = schedfChunks;
+		schedfChunks = chunk->next;
+		fwrite(chunk->data, 1, chunk->size, stdout);
+		free(chunk);
+	}
+	schedfChunksTail = NULL;
+	schedfChunkBytes = 0;
+	schedfChunkCount = 0;
+
+	// Not printf(), since schedfRaw() may have written zeros.
+	fwrite(schedfBuffer, 1, schedfBufferPos, stdout);
 	schedfBuffer[0] = '\0';
 	schedfBufferPos = 0;
+	if (schedfDropped != 0) {
+		printf("\n[schedf: %u bytes dropped, too much output with interrupts disabled]\n", schedfDropped);
+		schedfDropped = 0;
+	}
+	schedfRefillSpare();
+	flushEmit();
+}
+
+unsigned int schedfHighWater() {
+	unsigned int pending = schedfChunkBytes + schedfBufferPos;
+	return pending > schedfHighWaterBytes ? pending : schedfHighWaterBytes;
+}
+
+static const char hexDigits[] = "0123456789abcdef";
+
+// Returns where to write up to size more bytes (and a terminator), flushing first if needed.
+// NULL if there's no room, in interrupts.
+static char *schedfReserve(unsigned int size) {
+	if (schedfBufferPos + size + 1 > sizeof(schedfBuffer) && !schedfMakeRoom()) {
+		return NULL;
+	}
+	return schedfBuffer + schedfBufferPos;
+}
+
+static void schedfCommit(char *end) {
+	*end = '\0';
+	schedfBufferPos = end - schedfBuffer;
+	if (CHECKPOINT_OUTPUT_DIRECT) {
+		flushschedf();
+	} else if (schedfBufferPos >= SCHEDF_CHUNK_AT) {
+		schedfMakeRoom();
+	}
+}
+
+static inline char *writeString(char *p, const char *str) {
+	while (*str != '\0') {
+		*p++ = *str++;
+	}
+	return p;
+}
+
+static inline char *writeHex(char *p, unsigned int v, int digits) {
+	int n = 8;
+	int i;
+	// Wider than a value, so only zeros.
+	for (i = digits; i > 8; --i) {
+		*p++ = '0';
+	}
+	// Skip leading zeros beyond the minimum digits, like %0Nx.
+	while (n > 1 && n > digits && (v >> (n * 4 - 4)) == 0) {
+		--n;
+	}
+	for (i = n - 1; i >= 0; --i) {
+		*p++ = hexDigits[(v >> (i * 4)) & 0xF];
+	}
+	return p;
+}
+
+static inline char *writeDecimal(char *p, unsigned int v) {
+	char temp[10];
+	int n = 0;
+	do {
+		temp[n++] = '0' + v % 10;
+		v /= 10;
+	} while (v != 0);
+	while (n > 0) {
+		*p++ = temp[--n];
+	}
+	return p;
+}
+
+// Most that writing one value can take.
+static unsigned int hexValueSize(const SchedfHexFormat *format) {
+	unsigned int size = format->digits > 8 ? format->digits : 8;
+	if (format->zero != NULL && strlen(format->zero) > size) {
+		size = strlen(format->zero);
+	}
+	if (format->separator != NULL) {
+		size += strlen(format->separator);
+	}
+	// For schedfHexRLE32's *count.
+	return size + 11;
+}
+
+static inline char *writeHexValue(char *p, unsigned int v, int first, const SchedfHexFormat *format) {
+	if (!first && format->separator != NULL) {
+		p = writeString(p, format->separator);
+	}
+	if (v == 0 && format->zero != NULL) {
+		return writeString(p, format->zero);
+	}
+	return writeHex(p, v, format->digits);
+}
+
+#define SCHEDF_HEX_ROW(values, count, format) \
+	do { \
+		unsigned int mask = (format)->mask != 0 ? (format)->mask : 0xFFFFFFFF; \
+		unsigned int valueSize = hexValueSize(format); \
+		int i; \
+		for (i = 0; i < (count); ) { \
+			/* Format as many values as fit at once. */ \
+			char *p = schedfReserve(valueSize); \
+			char *end = schedfBuffer + sizeof(schedfBuffer) - 1 - valueSize; \
+			if (p == NULL) { \
+				schedfDropped += ((count) - i) * valueSize; \
+				break; \
+			} \
+			do { \
+				p = writeHexValue(p, (values)[i] & mask, i == 0, format); \
+				++i; \
+			} while (i < (count) && p <= end); \
+			schedfCommit(p); \
+		} \
+	} while (0)
+
+void schedfHex8(const u8 *values, int count, const SchedfHexFormat *format) {
+	SCHEDF_HEX_ROW(values, count, format);
+}
+
+void schedfHex16(const u16 *values, int count, const SchedfHexFormat *format) {
+	SCHEDF_HEX_ROW(values, count, format);
+}
+
+void schedfHex32(const u32 *values, int count, const SchedfHexFormat *format) {
+	SCHEDF_HEX_ROW(values, count, format);
+}
+
+void schedfHexRLE32(const u32 *values, int count, const SchedfHexFormat *format) {
+	unsigned int mask = format->mask != 0 ? format->mask : 0xFFFFFFFF;
+	unsigned int valueSize = hexValueSize(format);
+	int i = 0;
+	while (i < count) {
+		unsigned int v = values[i] & mask;
+		int run = 1;
+		char *p = schedfReserve(valueSize);
+		if (p == NULL) {
+			schedfDropped += (count - i) * valueSize;
+			break;
+		}
+		while (i + run < count && (values[i + run] & mask) == v) {
+			++run;
+		}
+		p = writeHexValue(p, v, i == 0, format);
+		if (run > 1) {
+			*p++ = '*';
+			p = writeDecimal(p, run);
+		}
+		schedfCommit(p);
+		i += run;
+	}
+}
+
+void schedfRaw(const void *data, unsigned int size) {
+	const char *src = (const char *)data;
+	while (size > 0) {
+		unsigned int chunk = size < sizeof(schedfBuffer) / 2 ? size : sizeof(schedfBuffer) / 2;
+		char *p = schedfReserve(chunk);
+		if (p == NULL) {
+			schedfDropped += size;
+			break;
+		}
+		memcpy(p, src, chunk);
+		schedfCommit(p + chunk);
+		src += chunk;
+		size -= chunk;
+	}
 }
 
 SceUID reschedThread;
@@ -113,12 +425,7 @@ void checkpoint(const char *format, ...) {
 	if (format != NULL) {
 		va_list args;
 		va_start(args, format);
-		if (CHECKPOINT_OUTPUT_DIRECT) {
-			// This is easier to debug in the emulator, but printf() reschedules on the real PSP.
-			vprintf(format, args);
-		} else {
-			schedfBufferPos += vsprintf(schedfBuffer + schedfBufferPos, format, args);
-		}
+		vschedf(format, args);
 		va_end(args);
 	}
 
@@ -142,21 +449,385 @@ void checkpointNext(const char *title) {
 		checkpoint(title);
 }
 
-static int writeStdoutHook(struct _reent *ptr, void *cookie, const char *buf, int buf_len) {
-	char temp[1024 + 1];
+#define PROFILE_MAX_ZONES   128
+#define PROFILE_MAX_DEPTH   16
+#define PROFILE_MAX_SAMPLES 32768
+
+typedef struct ProfileZone {
+	const char *name;
+	int parent;
+	unsigned int count;
+} ProfileZone;
+
+typedef struct ProfileSample {
+	u32 zone;
+	u32 elapsed;
+} ProfileSample;
+
+typedef struct ProfileOpen {
+	int zone;
+	u32 start;
+} ProfileOpen;
+
+static ProfileZone profileZones[PROFILE_MAX_ZONES];
+static int profileZoneCount = 0;
+static ProfileOpen profileStack[PROFILE_MAX_DEPTH];
+static int profileDepth = 0;
+// Zones begun while full (or inside one of those), which profileEnd() ends first.
+static int profileOverflow = 0;
+// Allocated by the first profileBegin(), so timing never allocates.
+static ProfileSample *profileSamples = NULL;
+static unsigned int profileSampleCount = 0;
+static unsigned int profileDropped = 0;
+
+static inline u32 profileNow() {
+#ifdef COMMON_KERNEL
+	u32 count;
+	// COP0 Count, which user mode can't read.
+	asm volatile("mfc0 %0, $9" : "=r"(count));
+	return count;
+#else
+	return sceKernelGetSystemTimeLow();
+#endif
+}
+
+static int profileFindZone(const char *name, int parent) {
+	int i;
+	for (i = 0; i < profileZoneCount; ++i) {
+		if (profileZones[i].name == name && profileZones[i].parent == parent) {
+			return i;
+		}
+	}
+	if (profileZoneCount == PROFILE_MAX_ZONES) {
+		return -1;
+	}
+	profileZones[profileZoneCount].name = name;
+	profileZones[profileZoneCount].parent = parent;
+	profileZones[profileZoneCount].count = 0;
+	return profileZoneCount++;
+}
+
+void profileBegin(const char *name) {
+	int parent = profileDepth > 0 ? profileStack[profileDepth - 1].zone : -1;
+	int zone;
+	if (profileSamples == NULL) {
+		profileSamples = (ProfileSample *)malloc(PROFILE_MAX_SAMPLES * sizeof(ProfileSample));
+	}
+	if (profileOverflow > 0 || profileDepth == PROFILE_MAX_DEPTH) {
+		profileOverflow++;
+		profileDropped++;
+		return;
+	}
+	zone = profileFindZone(name, parent);
+	if (zone < 0) {
+		profileOverflow++;
+		profileDropped++;
+		return;
+	}
+
+	profileStack[profileDepth].zone = zone;
+	profileDepth++;
+	// Last, so the time isn't spent in here.
+	profileStack[profileDepth - 1].start = profileNow();
+}
+
+void profileEnd() {
+	u32 now = profileNow();
+	ProfileOpen *open;
+	if (profileOverflow > 0) {
+		profileOverflow--;
+		return;
+	}
+	if (profileDepth == 0) {
+		return;
+	}
+
+	open = &profileStack[--profileDepth];
+	if (profileSamples == NULL || profileSampleCount == PROFILE_MAX_SAMPLES) {
+		profileDropped++;
+		return;
+	}
+	profileSamples[profileSampleCount].zone = open->zone;
+	profileSamples[profileSampleCount].elapsed = now - open->start;
+	profileSampleCount++;
+	profileZones[open->zone].count++;
+}
+
+static int compareU32(const void *a, const void *b) {
+	u32 x = *(const u32 *)a;
+	u32 y = *(const u32 *)b;
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static void profileWritePath(FILE *f, int zone) {
+	if (profileZones[zone].parent >= 0) {
+		profileWritePath(f, profileZones[zone].parent);
+		fputc('/', f);
+	}
+	fputs(profileZones[zone].name, f);
+}
+
+static void profileWriteSummary() {
+	FILE *f;
+	u32 *times;
+	int i;
+	if (profileZoneCount == 0) {
+		return;
+	}
+	f = fopen("host0:/__testprofile.txt", "wb");
+	if (f == NULL) {
+		return;
+	}
+	times = (u32 *)malloc(profileSampleCount * sizeof(u32) + 1);
+
+#ifdef COMMON_KERNEL
+	fprintf(f, "# on=%s time=cycles", RUNNING_ON_EMULATOR ? "emulator" : "psp");
+#else
+	fprintf(f, "# on=%s time=us", RUNNING_ON_EMULATOR ? "emulator" : "psp");
+#endif
+	fprintf(f, " samples=%u dropped=%u\n", profileSampleCount, profileDropped);
+	fprintf(f, "# zone count min p50 p90 p99 max mean\n");
+	for (i = 0; i < profileZoneCount && times != NULL; ++i) {
+		unsigned int n = 0;
+		unsigned int j;
+		u64 total = 0;
+		unsigned int buckets[33];
+		int b;
+		if (profileZones[i].count == 0) {
+			continue;
+		}
+		for (j = 0; j < profileSampleCount; ++j) {
+			if (profileSamples[j].zone == i) {
+				times[n++] = profileSamples[j].elapsed;
+				total += profileSamples[j].elapsed;
+			}
+		}
+		qsort(times, n, sizeof(u32), &compareU32);
+
+		profileWritePath(f, i);
+		fprintf(f, " %u %u %u %u %u %u %u\n", n, times[0], times[n / 2], times[n * 9 / 10], times[n * 99 / 100], times[n - 1], (unsigned int)(total / n));
+
+		// Powers of two: bucket b counts times from 2^(b-1) up to 2^b.
+		memset(buckets, 0, sizeof(buckets));
+		for (j = 0; j < n; ++j) {
+			b = 0;
+			while (b < 32 && (times[j] >> b) != 0) {
+				++b;
+			}
+			buckets[b]++;
+		}
+		fprintf(f, "#  histogram");
+		for (b = 0; b <= 32; ++b) {
+			if (buckets[b] != 0) {
+				fprintf(f, " <%llu:%u", 1ULL << b, buckets[b]);
+			}
+		}
+		fprintf(f, "\n");
+	}
+
+	free(times);
+	fclose(f);
+}
 
+// Record stream, decoded by decoderecords.py.  It starts with EMIT_MAGIC and EMIT_VERSION, and
+// each record is an EmitRecordHeader and its data, padded to 4 bytes.
+#define EMIT_MAGIC   0x31544D45
+#define EMIT_VERSION 1
+
+#define EMIT_RECORD_INT          1
+#define EMIT_RECORD_FLOAT        2
+#define EMIT_RECORD_STRING       3
+#define EMIT_RECORD_COMMENT      4
+#define EMIT_RECORD_HEX          5
+#define EMIT_RECORD_MEMORY_BLOCK 6
+#define EMIT_RECORD_CHECKPOINT   7
+#define EMIT_RECORD_SCREENSHOT   8
+
+#define EMIT_CHECKPOINT_RESCHED 1
+#define EMIT_CHECKPOINT_TIME    2
+#define EMIT_CHECKPOINT_TITLE   4
+
+typedef struct EmitRecordHeader {
+	u16 type;
+	u16 reserved;
+	// Of the data, not counting the header or padding.
+	u32 size;
+	// Bytes of stdout text before this record.
+	u32 textPos;
+} EmitRecordHeader;
+
+static u32 emitBuffer[4096];
+static unsigned int emitBufferPos = 0;
+static int emitStarted = 0;
+// Older emulators don't know EMULATOR_DEVCTL__SEND_RECORDS, so they use the file too.
+static int emitUseFile = 0;
+static SceUID emitFile = -1;
+
+static void emitSend(const void *data, unsigned int size) {
+	if (RUNNING_ON_EMULATOR && !emitUseFile) {
+		if (sceIoDevctl("emulator:", EMULATOR_DEVCTL__SEND_RECORDS, (void *)data, size, NULL, 0) >= 0) {
+			return;
+		}
+		emitUseFile = 1;
+	}
+	if (emitFile < 0) {
+		emitFile = sceIoOpen("host0:/__testrecords.bin", PSP_O_CREAT | PSP_O_WRONLY | PSP_O_TRUNC, 0777);
+	}
+	if (emitFile >= 0) {
+		sceIoWrite(emitFile, data, size);
+	}
+}
+
+void flushEmit() {
+	if (emitBufferPos != 0) {
+		emitSend(emitBuffer, emitBufferPos);
+		emitBufferPos = 0;
+	}
+}
+
+static void emitAppend(const void *data, unsigned int size) {
+	const char *src = (const char *)data;
+	while (size > 0) {
+		unsigned int chunk = sizeof(emitBuffer) - emitBufferPos;
+		if (chunk == 0) {
+			flushEmit();
+			continue;
+		}
+		if (chunk > size) {
+			chunk = size;
+		}
+		memcpy((char *)emitBuffer + emitBufferPos, src, chunk);
+		emitBufferPos += chunk;
+		src += chunk;
+		size -= chunk;
+	}
+}
+
+static void emitRecord(int type, const void *data1, unsigned int size1, const void *data2, unsigned int size2) {
+	static const u32 zeros = 0;
+	EmitRecordHeader header;
+	if (!emitStarted) {
+		u32 start[2] = { EMIT_MAGIC, EMIT_VERSION };
+		emitAppend(start, sizeof(start));
+		emitStarted = 1;
+	}
+
+	header.type = type;
+	header.reserved = 0;
+	header.size = size1 + size2;
+	// Anything schedf() hasn't written yet comes before this.
+	header.textPos = stdoutWritten + schedfChunkBytes + schedfBufferPos;
+	emitAppend(&header, sizeof(header));
+	emitAppend(data1, size1);
+	emitAppend(data2, size2);
+	emitAppend(&zeros, (4 - (header.size & 3)) & 3);
+
+	if (CHECKPOINT_OUTPUT_DIRECT) {
+		flushEmit();
+	}
+}
+
+void emitInt(int v) {
+	emitRecord(EMIT_RECORD_INT, &v, sizeof(v), NULL, 0);
+}
+
+void emitFloat(float v) {
+	emitRecord(EMIT_RECORD_FLOAT, &v, sizeof(v), NULL, 0);
+}
+
+void emitString(const char *v) {
+	emitRecord(EMIT_RECORD_STRING, v, strlen(v), NULL, 0);
+}
+
+void emitComment(const char *v) {
+	emitRecord(EMIT_RECORD_COMMENT, v, strlen(v), NULL, 0);
+}
+
+void emitHex(const void *address, unsigned int size) {
+	emitRecord(EMIT_RECORD_HEX, address, size, NULL, 0);
+}
+
+void emitMemoryBlock(const void *address, unsigned int size) {
+	u32 addr = (u32)address;
+	emitRecord(EMIT_RECORD_MEMORY_BLOCK, &addr, sizeof(addr), address, size);
+}
+
+void emitCheckpoint(const char *title) {
+	u64 currentCheckpoint = sceKernelGetSystemTimeWide();
+	u32 info[3];
+	s64 elapsed = currentCheckpoint - lastCheckpoint;
+	info[0] = (didResched ? EMIT_CHECKPOINT_RESCHED : 0) | (CHECKPOINT_ENABLE_TIME ? EMIT_CHECKPOINT_TIME : 0) | (title != NULL ? EMIT_CHECKPOINT_TITLE : 0);
+	memcpy(&info[1], &elapsed, sizeof(elapsed));
+
+	sceKernelTerminateThread(reschedThread);
+	emitRecord(EMIT_RECORD_CHECKPOINT, info, sizeof(info), title, title != NULL ? strlen(title) : 0);
+	didResched = 0;
+	sceKernelStartThread(reschedThread, 0, NULL);
+
+	lastCheckpoint = currentCheckpoint;
+}
+
+// Text for the screen, since drawing it as it's printed is slow.  It's drawn at most once per
+// vblank, and only the last screenful or so matters, so anything older is skipped.
+static char screenRing[4096];
+static unsigned int screenRingWritten = 0;
+static unsigned int screenRingDrawn = 0;
+static int screenRingVcount = -1;
+
+static void screenRingAppend(const char *buf, int len) {
+	if (len > sizeof(screenRing)) {
+		screenRingWritten += len - sizeof(screenRing);
+		buf += len - sizeof(screenRing);
+		len = sizeof(screenRing);
+	}
+	while (len > 0) {
+		unsigned int pos = screenRingWritten % sizeof(screenRing);
+		int chunk = sizeof(screenRing) - pos < len ? sizeof(screenRing) - pos : len;
+		memcpy(screenRing + pos, buf, chunk);
+		screenRingWritten += chunk;
+		buf += chunk;
+		len -= chunk;
+	}
+}
+
+static void screenRingDraw() {
+	if (screenRingWritten - screenRingDrawn > sizeof(screenRing)) {
+		// Skip to the start of a line, rather than drawing the end of one.
+		unsigned int start = screenRingWritten - sizeof(screenRing);
+		screenRingDrawn = start;
+		while (screenRingDrawn != screenRingWritten && screenRing[screenRingDrawn % sizeof(screenRing)] != '\n') {
+			screenRingDrawn++;
+		}
+		if (screenRingDrawn + 1 < screenRingWritten) {
+			screenRingDrawn++;
+		} else {
+			screenRingDrawn = start;
+		}
+	}
+	while (screenRingDrawn != screenRingWritten) {
+		unsigned int pos = screenRingDrawn % sizeof(screenRing);
+		unsigned int chunk = screenRingWritten - screenRingDrawn;
+		if (chunk > sizeof(screenRing) - pos) {
+			chunk = sizeof(screenRing) - pos;
+		}
+		pspDebugScreenPrintData(screenRing + pos, chunk);
+		screenRingDrawn += chunk;
+	}
+}
+
+static int writeStdoutHook(struct _reent *ptr, void *cookie, const char *buf, int buf_len) {
+	stdoutWritten += buf_len;
 	//if (KprintfFd > 0) sceIoWrite(KprintfFd, buf, buf_len);
 	if (RUNNING_ON_EMULATOR) {
 		sceIoDevctl("emulator:", EMULATOR_DEVCTL__SEND_OUTPUT, (void *)buf, buf_len, NULL, 0);
 	}
 
-	if (buf_len < sizeof(temp)) {
-		if (HAS_DISPLAY) {
-			memcpy(temp, buf, buf_len);
-			temp[buf_len] = 0;
-
-			//Kprintf("%s", temp);
-			pspDebugScreenPrintf("%s", temp);
+	if (HAS_DISPLAY) {
+		int vcount = sceDisplayGetVcount();
+		screenRingAppend(buf, buf_len);
+		if (vcount != screenRingVcount) {
+			screenRingDraw();
+			screenRingVcount = vcount;
 		}
 	}
 	
@@ -186,6 +857,27 @@ static SdkVerFuncTable sdkVerFuncs[] = {
 	{606, sceKernelSetCompiledSdkVersion606},
 };
 
+static void setSdkVer(u32 ver, u32 funcID) {
+	int i;
+	SdkVerFunc func = NULL;
+	for (i = 0; i < sizeof(sdkVerFuncs) / sizeof(sdkVerFuncs[0]); ++i) {
+		if (sdkVerFuncs[i].id == funcID) {
+			func = sdkVerFuncs[i].func;
+		}
+	}
+
+	if (func == NULL) {
+		fprintf(stderr, "Unknown sdkver-func value.\n");
+		exit(1);
+	}
+
+	if (ver != 0xFFFFFFFF) {
+		if (func(ver) != 0) {
+			printf("WARNING: Setting sdkver returned failure.\n");
+		}
+	}
+}
+
 static void updateSdkVer(int argc, char *argv[]) {
 	int i = 0;
 	u32 ver = 0xFFFFFFFF;
@@ -199,23 +891,58 @@ static void updateSdkVer(int argc, char *argv[]) {
 		}
 	}
 
-	SdkVerFunc func = NULL;
-	for (i = 0; i < sizeof(sdkVerFuncs) / sizeof(sdkVerFuncs[0]); ++i) {
-		if (sdkVerFuncs[i].id == funcID) {
-			func = sdkVerFuncs[i].func;
+	setSdkVer(ver, funcID);
+}
+
+static int findHeadless(int argc, char *argv[]) {
+	int i;
+	for (i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "--headless")) {
+			return 1;
 		}
 	}
+	return 0;
+}
 
-	if (func == NULL) {
-		fprintf(stderr, "Unknown sdkver-func value.\n");
-		exit(1);
+static const char *findSdkVerList(int argc, char *argv[]) {
+	int i;
+	for (i = 1; i < argc; ++i) {
+		if (!strncmp(argv[i], "--sdkver-list=", strlen("--sdkver-list="))) {
+			return argv[i] + strlen("--sdkver-list=");
+		}
 	}
+	return NULL;
+}
 
-	if (ver != 0xFFFFFFFF) {
-		if (func(ver) != 0) {
-			printf("WARNING: Setting sdkver returned failure.\n");
+// Runs the test once as compiled, and then again for each VER:FUNC in list (comma separated),
+// so gentest.py can compare versions without relaunching.  Each run's output starts with a
+// "===== sdkver=... =====" line.
+static int runSdkVerList(int argc, char *argv[], const char *list) {
+	int retval;
+	printf("===== sdkver=default =====\n");
+	flushschedf();
+	retval = test_main(argc, argv);
+	flushschedf();
+
+	while (*list != '\0') {
+		char *end;
+		u32 ver = strtoul(list, &end, 16);
+		u32 funcID = 0;
+		if (*end == ':') {
+			funcID = strtol(end + 1, &end, 10);
+		}
+
+		printf("===== sdkver=%x func=%d =====\n", (unsigned int)ver, (int)funcID);
+		setSdkVer(ver, funcID);
+		retval |= test_main(argc, argv);
+		flushschedf();
+
+		if (*end != ',') {
+			break;
 		}
+		list = end + 1;
 	}
+	return retval;
 }
 
 void test_begin() {
@@ -248,6 +975,12 @@ void test_begin() {
 
 void test_end() {
 	flushschedf();
+	if (HAS_DISPLAY) {
+		screenRingDraw();
+	}
+	if (emitFile >= 0) {
+		sceIoClose(emitFile);
+	}
 
 	fflush(stdout);
 	fflush(stderr);
@@ -255,8 +988,18 @@ void test_end() {
 	fclose(stdout);
 	fclose(stderr);
 
+	// On the emulator too, to compare with the PSP.
+	profileWriteSummary();
+
 	if (!RUNNING_ON_EMULATOR) {
-		FILE *finish = fopen("host0:/__testfinish.txt", "wb");
+		FILE *stats = fopen("host0:/__teststats.txt", "wb");
+		FILE *finish;
+		if (stats) {
+			fprintf(stats, "schedf_peak_bytes=%u\nschedf_peak_chunks=%u\n", schedfHighWaterBytes, schedfHighWaterChunks);
+			fclose(stats);
+		}
+
+		finish = fopen("host0:/__testfinish.txt", "wb");
 		if (finish)
 		{
 			fwrite("1", sizeof(char), 1, finish);
@@ -301,32 +1044,6 @@ int test_psp_setup_callbacks(void) {
 
 //#define START_WITH "ms0:/PSP/GAME/virtual"
 
-/*
-void emitInt(int v) {
-	asm("syscall 0x1010");
-}
-
-void emitFloat(float v) {
-	asm("syscall 0x1011");
-}
-
-void emitString(char *v) {
-	asm("syscall 0x1012");
-}
-
-void emitComment(char *v) {
-	asm("syscall 0x1012");
-}
-
-void emitMemoryBlock(void *address, unsigned int size) {
-	asm("syscall 0x1013");
-}
-
-void emitHex(void *address, unsigned int size) {
-	asm("syscall 0x1014");
-}
-*/
-
 unsigned char bmpHeader[54] = {
 	0x42, 0x4D, 0x38, 0x80, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x36, 0x00,
 	0x00, 0x00, 0x28, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x10, 0x01,
@@ -417,6 +1134,10 @@ static void rgab565_to_bgra8888(uint *dst, const ushort *src, int num) {
 }
 
 void emulatorEmitScreenshot() {
+	emulatorEmitScreenshotTo("host0:/__screenshot.bmp");
+}
+
+void emulatorEmitScreenshotTo(const char *filename) {
 	int file;
 
 	if (RUNNING_ON_EMULATOR) {
@@ -436,7 +1157,7 @@ void emulatorEmitScreenshot() {
             topaddr |= 0x40000000;
         }
 	
-		if ((file = sceIoOpen("host0:/__screenshot.bmp", PSP_O_CREAT | PSP_O_WRONLY | PSP_O_TRUNC, 0777)) >= 0) {
+		if ((file = sceIoOpen(filename, PSP_O_CREAT | PSP_O_WRONLY | PSP_O_TRUNC, 0777)) >= 0) {
 			int y;
 			uint* vram_row;
 			uint* row_buf = (uint *)malloc(512 * 4);
@@ -465,6 +1186,11 @@ void emulatorEmitScreenshot() {
 	}
 }
 
+void emitScreenshot(const char *filename) {
+	emitRecord(EMIT_RECORD_SCREENSHOT, filename, strlen(filename), NULL, 0);
+	emulatorEmitScreenshotTo(filename);
+}
+
 void emulatorSendSceCtrlData(SceCtrlData* pad_data) {
 	sceIoDevctl("kemulator:", EMULATOR_DEVCTL__SEND_CTRLDATA, pad_data, sizeof(SceCtrlData), NULL, 0);
 }
@@ -490,6 +1216,11 @@ int main(int argc, char *argv[]) {
 		HAS_DISPLAY = 0;
 	#endif
 
+	// Nothing on the screen, even on a PSP, so no time goes to drawing it.
+	if (findHeadless(argc, argv)) {
+		HAS_DISPLAY = 0;
+	}
+
 	//if (strncmp(argv[0], START_WITH, strlen(START_WITH)) == 0) RUNNING_ON_EMULATOR = 1;
 
 	if (!RUNNING_ON_EMULATOR) {
@@ -497,12 +1228,20 @@ int main(int argc, char *argv[]) {
 	}
 	atexit(sceKernelExitGame);
 
+	// Before anything can call schedf() from an interrupt.
+	schedfRefillSpare();
 	test_begin();
 	{
-		pspDebugScreenPrintf("RUNNING_ON_EMULATOR: %s - %s\n", RUNNING_ON_EMULATOR ? "yes" : "no", argv[0]);
-		updateSdkVer(argc, argv);
-
-		retval = test_main(argc, argv);
+		const char *sdkVerList = findSdkVerList(argc, argv);
+		if (HAS_DISPLAY) {
+			pspDebugScreenPrintf("RUNNING_ON_EMULATOR: %s - %s\n", RUNNING_ON_EMULATOR ? "yes" : "no", argv[0]);
+		}
+		if (sdkVerList != NULL) {
+			retval = runSdkVerList(argc, argv, sdkVerList);
+		} else {
+			updateSdkVer(argc, argv);
+			retval = test_main(argc, argv);
+		}
 	}
 	test_end();
 	
@@ -25,6 +25,7 @@ void __va_end(va_list);
 #endif
 #endif
 
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
@@ -42,26 +43,75 @@ extern unsigned int CHECKPOINT_OUTPUT_DIRECT;
 extern char schedfBuffer[65536];
 extern unsigned int schedfBufferPos;
 
+// Output is kept in memory (without rescheduling) until flushschedf(), checkpointNext(), or the
+// end of the test, however much there is.  Safe in GE callbacks and with interrupts suspended, up
+// to about 64 KB more output before the next flush, after which it's dropped (and says so.)
 void schedf(const char *format, ...);
+void vschedf(const char *format, va_list args);
 void flushschedf();
+// Peak output kept in memory, in bytes, since the test started.  Also in host0:/__teststats.txt.
+unsigned int schedfHighWater();
 int reschedFunc(SceSize argc, void *argp);
 void checkpoint(const char *format, ...);
 void checkpointNext(const char *title);
 
+// How schedfHex8/16/32 write each value.  Zero-initialize for plain %x with nothing between.
+typedef struct SchedfHexFormat {
+	// Minimum digits, zero padded, like %08x.  0 is the same as 1, like %x.
+	int digits;
+	// Written between values, or NULL for nothing.
+	const char *separator;
+	// Written instead of values that are zero (after masking), or NULL to write them normally.
+	const char *zero;
+	// Bits of each value to keep, or 0 for all of them.
+	u32 mask;
+} SchedfHexFormat;
+
+// Write a row of values like a schedf() per value, but much faster.  The output is the same.
+void schedfHex8(const u8 *values, int count, const SchedfHexFormat *format);
+void schedfHex16(const u16 *values, int count, const SchedfHexFormat *format);
+void schedfHex32(const u32 *values, int count, const SchedfHexFormat *format);
+// Like schedfHex32, but repeated values are written once followed by *count, like "ff*480".
+void schedfHexRLE32(const u32 *values, int count, const SchedfHexFormat *format);
+// Writes bytes to the output as they are, which may include zeros.
+void schedfRaw(const void *data, unsigned int size);
+
+// Named timing zones, for comparing how long things take on an emulator and a PSP.  Zones nest,
+// and a zone inside another is counted separately from the same name elsewhere.  Times are kept
+// in memory (so timing doesn't reschedule) and at test_end() summarized per zone to
+// host0:/__testprofile.txt, without affecting the output.  Names are compared as pointers, so
+// use string literals.  Times are in CPU cycles with COMMON_KERNEL, otherwise microseconds.
+// Zones past 16 deep or 128 in total, and any inside them, are only counted as dropped.
+void profileBegin(const char *name);
+// Ends the innermost zone.
+void profileEnd();
+
 #define ARRAY_SIZE(a) (sizeof((a)) / (sizeof((a)[0])))
 
 void emulatorEmitScreenshot();
+// On the emulator, the screenshot goes wherever it decides instead.
+void emulatorEmitScreenshotTo(const char *filename);
 void emulatorSendSceCtrlData(SceCtrlData* pad_data);
 
-/*
+// Typed output records, which the host renders as text in their place in the output (see
+// decoderecords.py.)  Cheaper than formatting on the PSP, and floats keep their exact bits.
+// Buffered like schedf(), and sent by flushschedf() or when the buffer fills.
 void emitInt(int v);
+// Rendered like %f, but compared by its bits.
 void emitFloat(float v);
-void emitString(char *v);
-void emitComment(char *v);
-void emitMemoryBlock(void *address, unsigned int size);
-void emitHex(void *address, unsigned int size);
-#define emitStringf(format, ...) { char temp[1024]; sprintf(temp, format, __VA_ARGS__); emitString(temp); }
-*/
+void emitString(const char *v);
+// Not part of the output, only shown by decoderecords.py --comments.
+void emitComment(const char *v);
+// Each byte as %02x, with nothing between.
+void emitHex(const void *address, unsigned int size);
+// 16 bytes per line, after the address.
+void emitMemoryBlock(const void *address, unsigned int size);
+// Like checkpoint("%s", title).
+void emitCheckpoint(const char *title);
+// Like emulatorEmitScreenshotTo(), also recording where in the output it was taken.
+void emitScreenshot(const char *filename);
+void flushEmit();
+#define emitStringf(format, ...) { char temp[1024]; snprintf(temp, sizeof(temp), format, __VA_ARGS__); emitString(temp); }
 
 #ifdef __cplusplus
 }
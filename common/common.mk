@@ -36,21 +36,40 @@ ifdef EXTRA_LIBS
 LIBS := $(LIBS) $(EXTRA_LIBS)
 endif
 
+# Rebuild when included headers or libcommon change, not only the test's own source.
+CFLAGS := $(CFLAGS) -MMD -MP
+CXXFLAGS := $(CXXFLAGS) -MMD -MP
+ifdef COMMON_KERNEL
+COMMON_LIB = $(COMMON_DIR)/libcommon_kernel.a
+else
+COMMON_LIB = $(COMMON_DIR)/libcommon.a
+endif
+
 TARGET = $(firstword $(TARGETS))
 OBJS = $(firstword $(TARGETS)).o $(EXTRA_OBJS)
 
 PSPSDK = $(shell psp-config --pspsdk-path)
 include $(PSPSDK)/lib/build.mak
+include $(COMMON_DIR)/buildcache.mk
 
 %.elf: %.o $(EXTRA_OBJS) $(EXPORT_OBJ)
-	$(LINK.c) $^ $(LIBS) -o $@
+	$(LINK.c) $(filter-out $(COMMON_LIB),$^) $(LIBS) -o $@
 	$(FIXUP) $@
 
 %.prx: %.elf
-	psp-prxgen $< $@
+	$(BUILDCACHE_CMD) psp-prxgen $< $@
 
 %.o: %.S
 	$(AS) $(ASFLAGS) -c -o $@ $<
 
+# Also applies to build.mak's rule for the first target, which links it twice (harmless.)
+$(TARGETS:=.elf): $(COMMON_LIB)
+# The top-level Makefile builds tests without a Makefile from their .compile file.  On the
+# object, since the links above use $^.
+$(TARGETS:=.o): $(wildcard $(TARGETS:=.compile))
+
 all: $(TARGETS:=.prx)
 clean: EXTRA_TARGETS:=$(EXTRA_TARGETS) $(TARGETS:=.prx)
+EXTRA_CLEAN := $(EXTRA_CLEAN) $(wildcard *.d)
+
+-include $(wildcard *.d)
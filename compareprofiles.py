@@ -0,0 +1,79 @@
+# Compares the profile zone summaries (from profileBegin() and profileEnd() in common.h) of a
+# test run on a PSP and on an emulator, or two runs of either:
+#
+#   python gentest.py --profile-dir psp audio/atrac/stream
+#   python compareprofiles.py psp/audio_atrac_stream.profile.txt emu/audio_atrac_stream.profile.txt
+
+# Note: This is a Python3 file.
+
+import sys
+import os
+
+COLUMNS = ["count", "min", "p50", "p90", "p99", "max", "mean"]
+
+def read_profile(path):
+  """Returns ({zone: {column: value}}, the time unit.)"""
+  zones = {}
+  unit = None
+  for line in open(path, "rt"):
+    fields = line.split()
+    if len(fields) == 0:
+      continue
+    if fields[0] == "#":
+      for field in fields[1:]:
+        if field.startswith("time="):
+          unit = field[len("time="):]
+      continue
+    if len(fields) != len(COLUMNS) + 1:
+      continue
+    zones[fields[0]] = dict(zip(COLUMNS, [int(v) for v in fields[1:]]))
+  return zones, unit
+
+def ratio(a, b):
+  if a == 0:
+    return "-"
+  return "%.2fx" % (float(b) / a)
+
+def main():
+  column = "p50"
+  files = []
+  it = iter(sys.argv[1:])
+  for arg in it:
+    if arg == "-h" or arg == "--help":
+      print("Usage: %s [options] BASELINE OTHER\n" % (os.path.basename(sys.argv[0])))
+      print("Prints each zone's time in both profiles, and how much slower OTHER is.\n")
+      print("Options:")
+      print("  -c, --column NAME     compare min, p50 (default), p90, p99, max, or mean")
+      return 0
+    elif arg == "-c" or arg == "--column":
+      column = next(it)
+      if column not in COLUMNS[1:]:
+        print("Unknown column: %s" % (column))
+        return 1
+    elif arg[0] == "-":
+      print("Unknown option: %s" % (arg))
+      return 1
+    else:
+      files.append(arg)
+
+  if len(files) != 2:
+    print("Specify two profiles to compare.")
+    return 1
+
+  base, base_unit = read_profile(files[0])
+  other, other_unit = read_profile(files[1])
+  if base_unit != other_unit:
+    print("Warning: times are in %s and %s, so the ratios are meaningless." % (base_unit, other_unit))
+
+  print("%-40s %10s %10s %8s" % ("zone (" + column + ")", "baseline", "other", "ratio"))
+  for zone in sorted(set(base.keys()) | set(other.keys())):
+    if zone not in base or zone not in other:
+      print("%-40s %s" % (zone, "only in baseline" if zone in base else "only in other"))
+      continue
+    a = base[zone][column]
+    b = other[zone][column]
+    print("%-40s %10d %10d %8s" % (zone, a, b, ratio(a, b)))
+  return 0
+
+if __name__ == "__main__":
+  sys.exit(main())
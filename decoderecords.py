@@ -0,0 +1,190 @@
+# Decodes the typed records from emitInt(), emitFloat(), etc. in common.c, and renders them into
+# the test's text output where they were emitted, the same as if it had printed them:
+#
+#   python decoderecords.py __testrecords.bin __testoutput.txt    the whole output, as text
+#   python decoderecords.py --dump __testrecords.bin              each record, with float bits
+#   python decoderecords.py --compare a.bin b.bin                 compare records, floats by bits
+#
+# Records come from the EMULATOR_DEVCTL__SEND_RECORDS devctl, or host0:/__testrecords.bin.
+
+# Note: This is a Python3 file.
+
+import sys
+import os
+import struct
+
+MAGIC = 0x31544D45
+VERSION = 1
+
+RECORD_INT = 1
+RECORD_FLOAT = 2
+RECORD_STRING = 3
+RECORD_COMMENT = 4
+RECORD_HEX = 5
+RECORD_MEMORY_BLOCK = 6
+RECORD_CHECKPOINT = 7
+RECORD_SCREENSHOT = 8
+
+RECORD_NAMES = {
+  RECORD_INT: "int",
+  RECORD_FLOAT: "float",
+  RECORD_STRING: "string",
+  RECORD_COMMENT: "comment",
+  RECORD_HEX: "hex",
+  RECORD_MEMORY_BLOCK: "memory",
+  RECORD_CHECKPOINT: "checkpoint",
+  RECORD_SCREENSHOT: "screenshot",
+}
+
+CHECKPOINT_RESCHED = 1
+CHECKPOINT_TIME = 2
+CHECKPOINT_TITLE = 4
+
+class Record:
+  def __init__(self, type, text_pos, data):
+    self.type = type
+    self.text_pos = text_pos
+    self.data = data
+
+def parse(data):
+  """Returns the records in a stream, raising ValueError if it's not one."""
+  if len(data) < 8:
+    raise ValueError("too short for a record stream")
+  magic, version = struct.unpack_from("<II", data, 0)
+  if magic != MAGIC:
+    raise ValueError("not a record stream")
+  if version != VERSION:
+    raise ValueError("unknown record stream version %d" % (version))
+
+  records = []
+  pos = 8
+  while pos + 12 <= len(data):
+    type, size, text_pos = struct.unpack_from("<HxxII", data, pos)
+    pos += 12
+    if pos + size > len(data):
+      # The test probably crashed while writing it.
+      sys.stderr.write("Warning: truncated record at offset %d\n" % (pos - 12))
+      break
+    records.append(Record(type, text_pos, data[pos:pos + size]))
+    pos += (size + 3) & ~3
+  return records
+
+def render(record, comments = False):
+  """Returns the record as the text it stands for."""
+  data = record.data
+  if record.type == RECORD_INT:
+    return "%d" % struct.unpack("<i", data)
+  elif record.type == RECORD_FLOAT:
+    # The PSP's printf promotes to double too, so %f matches.
+    return "%f" % struct.unpack("<f", data)
+  elif record.type == RECORD_STRING:
+    return data.decode("utf-8", "replace")
+  elif record.type == RECORD_COMMENT:
+    return "# " + data.decode("utf-8", "replace") + "\n" if comments else ""
+  elif record.type == RECORD_HEX:
+    return data.hex()
+  elif record.type == RECORD_MEMORY_BLOCK:
+    address = struct.unpack_from("<I", data, 0)[0]
+    lines = []
+    for offset in range(4, len(data), 16):
+      lines.append("%08x: %s\n" % (address + offset - 4, " ".join("%02x" % b for b in data[offset:offset + 16])))
+    return "".join(lines)
+  elif record.type == RECORD_CHECKPOINT:
+    flags, elapsed = struct.unpack_from("<Iq", data, 0)
+    resched = "r" if flags & CHECKPOINT_RESCHED else "x"
+    if flags & CHECKPOINT_TIME:
+      text = "[%s/%d] " % (resched, elapsed)
+    else:
+      text = "[%s] " % (resched)
+    if flags & CHECKPOINT_TITLE:
+      text += data[12:].decode("utf-8", "replace") + "\n"
+    return text
+  elif record.type == RECORD_SCREENSHOT:
+    return ""
+  raise ValueError("unknown record type %d" % (record.type))
+
+def merge(text, records, comments = False):
+  """Puts the rendered records into the text output (bytes), returning text."""
+  result = []
+  pos = 0
+  for record in records:
+    # Records are in order, but clamp in case the text was cut short.
+    text_pos = min(max(record.text_pos, pos), len(text))
+    result.append(text[pos:text_pos].decode("utf-8", "replace"))
+    result.append(render(record, comments))
+    pos = text_pos
+  result.append(text[pos:].decode("utf-8", "replace"))
+  return "".join(result)
+
+def describe(record):
+  name = RECORD_NAMES.get(record.type, "type%d" % (record.type))
+  if record.type == RECORD_FLOAT:
+    return "%s@%d 0x%08x %r" % (name, record.text_pos, struct.unpack("<I", record.data)[0], render(record))
+  elif record.type == RECORD_SCREENSHOT:
+    return "%s@%d %s" % (name, record.text_pos, record.data.decode("utf-8", "replace"))
+  return "%s@%d %r" % (name, record.text_pos, render(record, True))
+
+def compare(a, b):
+  """Returns a list of differences between two record lists, comparing data exactly."""
+  diffs = []
+  for i in range(max(len(a), len(b))):
+    if i >= len(a):
+      diffs.append("#%d: only in second: %s" % (i, describe(b[i])))
+    elif i >= len(b):
+      diffs.append("#%d: only in first: %s" % (i, describe(a[i])))
+    elif a[i].type != b[i].type or a[i].data != b[i].data:
+      diffs.append("#%d: %s != %s" % (i, describe(a[i]), describe(b[i])))
+  return diffs
+
+def main():
+  dump = False
+  comments = False
+  compare_with = None
+  args = []
+  it = iter(sys.argv[1:])
+  for arg in it:
+    if arg == "-h" or arg == "--help":
+      print("Usage: %s [options] RECORDS [TEXT]\n" % (os.path.basename(sys.argv[0])))
+      print("Prints the test's output with the records rendered where they were emitted.\n")
+      print("Options:")
+      print("  -c, --comments        include emitComment() text, as # lines")
+      print("  -d, --dump            list the records instead, with float bits")
+      print("      --compare OTHER   compare with another record file, floats by bits")
+      return 0
+    elif arg == "-c" or arg == "--comments":
+      comments = True
+    elif arg == "-d" or arg == "--dump":
+      dump = True
+    elif arg == "--compare":
+      compare_with = next(it)
+    elif arg[0] == "-":
+      print("Unknown option: %s" % (arg))
+      return 1
+    else:
+      args.append(arg)
+
+  if len(args) < 1 or len(args) > 2:
+    print("Specify a record file, and optionally the text output.")
+    return 1
+
+  try:
+    records = parse(open(args[0], "rb").read())
+    if compare_with != None:
+      diffs = compare(records, parse(open(compare_with, "rb").read()))
+      for diff in diffs:
+        print(diff)
+      return 1 if len(diffs) != 0 else 0
+  except (IOError, ValueError) as e:
+    print("ERROR: %s" % (e))
+    return 1
+
+  if dump:
+    for record in records:
+      print(describe(record))
+  else:
+    text = open(args[1], "rb").read() if len(args) > 1 else b""
+    sys.stdout.write(merge(text, records, comments))
+  return 0
+
+if __name__ == "__main__":
+  sys.exit(main())
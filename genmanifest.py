@@ -0,0 +1,190 @@
+# Writes tests/manifest.json, an index of every test: its files, how it's built, and whether it
+# runs on a real PSP.  runtests.py and build.php read it instead of walking tests/ each time.
+#
+#   python genmanifest.py            regenerate after adding or moving tests
+#   python genmanifest.py --check    fail if the manifest is out of date
+
+# Note: This is a Python3 file.
+
+import sys
+import os
+import re
+import json
+
+TEST_ROOT = "tests/"
+MANIFEST = TEST_ROOT + "manifest.json"
+NOT_WORKING = TEST_ROOT + "not_working_on_real_psp.txt"
+MANIFEST_VERSION = 1
+TIMEOUT = 10
+
+SOURCE_EXTENSIONS = [".c", ".cpp", ".S"]
+# Everything else in a test's directory is data it may load at runtime.
+NON_DATA_EXTENSIONS = SOURCE_EXTENSIONS + [".h", ".o", ".d", ".elf", ".prx", ".expected", ".bmp", ".compile", ".mak", ".php", ".bat", ".sh", ".txt", ".url"]
+NON_DATA_FILES = ["Makefile", "EBOOT.PBP", "PARAM.SFO"]
+
+def read_makefile(path):
+  """Returns the simple VAR = value assignments, with continuation lines joined."""
+  values = {}
+  text = open(path, "rt", encoding="utf-8", errors="replace").read().replace("\\\n", " ")
+  for line in text.split("\n"):
+    m = re.match(r"^\s*([A-Z_]+)\s*[:+]?=\s*(.*)$", line)
+    if m:
+      values[m.group(1)] = " ".join(m.group(2).split("#")[0].split())
+  return values
+
+def read_compile(path):
+  values = {}
+  for line in open(path, "rt", encoding="utf-8", errors="replace"):
+    if "=" in line:
+      key, value = line.split("=", 1)
+      values[key.strip()] = value.strip()
+  return values
+
+def read_not_working():
+  if not os.path.exists(NOT_WORKING):
+    return []
+  return [line.strip() for line in open(NOT_WORKING, "rt") if line.strip()]
+
+def tests_path(dir, path):
+  """Turns a path relative to a test directory into one relative to TEST_ROOT."""
+  return os.path.normpath(os.path.join(dir, path)).replace("\\", "/")
+
+def find_source(dir, name):
+  for ext in SOURCE_EXTENSIONS:
+    if os.path.exists(TEST_ROOT + dir + "/" + name + ext):
+      return name + ext
+  return None
+
+def data_files(dir, files):
+  result = []
+  for filename in files:
+    if filename in NON_DATA_FILES or os.path.splitext(filename)[1] in NON_DATA_EXTENSIONS:
+      continue
+    if not os.path.isfile(TEST_ROOT + dir + "/" + filename):
+      continue
+    result.append(filename)
+  return sorted(result)
+
+def build_info(dir, name, makefile, compile):
+  targets = (makefile.get("TARGETS", "") + " " + makefile.get("TARGET", "")).split() if makefile != None else []
+  if name in targets:
+    objs = makefile.get("EXTRA_OBJS", "").split()
+    return {
+      "system": "make",
+      "kernel": makefile.get("COMMON_KERNEL", "") != "",
+      "objs": [tests_path(dir, obj) for obj in objs],
+      "libs": makefile.get("EXTRA_LIBS", makefile.get("LIBS", "")).split(),
+    }
+  # Not in a Makefile, so only build.php builds it.
+  info = {"system": "build.php", "kernel": False, "objs": [], "libs": []}
+  if compile != None:
+    info["objs"] = [tests_path(dir, path) for path in compile.get("EXTRA_C_FILES", "").split()]
+    info["libs"] = ["-l" + lib for lib in compile.get("EXTRA_LIBS_PRE", "").split() + compile.get("EXTRA_LIBS", "").split()]
+  return info
+
+def import_stubs(build):
+  stubs = []
+  for obj in build["objs"]:
+    base, ext = os.path.splitext(obj)
+    if base.endswith("-imports") and ext in [".o", ".S"] and os.path.exists(TEST_ROOT + base + ".S"):
+      stubs.append(base + ".S")
+  return stubs
+
+def generate():
+  not_working = read_not_working()
+  tests = {}
+  for root, dirs, files in os.walk(TEST_ROOT):
+    dirs.sort()
+    files.sort()
+    dir = os.path.relpath(root, TEST_ROOT).replace("\\", "/")
+    makefile = read_makefile(root + "/Makefile") if "Makefile" in files else None
+    if makefile != None:
+      # Like modules/loadexec, a Makefile can run other .mak files with a TARGET each.
+      for filename in files:
+        if filename.endswith(".mak"):
+          makefile["TARGETS"] = makefile.get("TARGETS", "") + " " + read_makefile(root + "/" + filename).get("TARGET", "")
+    data = None
+    for filename in files:
+      if not filename.endswith(".expected"):
+        continue
+      name = filename[:-len(".expected")]
+      test = name if dir == "." else dir + "/" + name
+      compile_path = TEST_ROOT + test + ".compile"
+      compile = read_compile(compile_path) if os.path.exists(compile_path) else None
+      build = build_info(dir, name, makefile, compile)
+      if data == None:
+        data = data_files(dir, files)
+
+      timeout = TIMEOUT
+      if compile != None and "TIMEOUT" in compile:
+        timeout = int(compile["TIMEOUT"])
+
+      source = find_source(dir, name)
+      tests[test] = {
+        "prx": test + ".prx",
+        "source": source and dir + "/" + source,
+        "expected": test + ".expected",
+        "expected_bmp": test + ".expected.bmp" if name + ".expected.bmp" in files else None,
+        "build": build,
+        "imports": import_stubs(build),
+        "data": [dir + "/" + filename for filename in data],
+        "timeout": timeout,
+        "real_psp": not any(part in not_working for part in test.split("/")),
+      }
+  return tests
+
+def format_manifest(tests):
+  # One test per line keeps diffs of the manifest readable.
+  lines = ["{", '  "version": %d,' % (MANIFEST_VERSION), '  "root": "%s",' % (TEST_ROOT), '  "tests": {']
+  names = sorted(tests.keys())
+  for i, test in enumerate(names):
+    comma = "," if i + 1 < len(names) else ""
+    lines.append("    %s: %s%s" % (json.dumps(test), json.dumps(tests[test], sort_keys=True), comma))
+  lines.append("  }")
+  lines.append("}")
+  return "\n".join(lines) + "\n"
+
+def load_manifest(path=MANIFEST):
+  """Returns the tests from a manifest, or None if there isn't a usable one."""
+  if not os.path.exists(path):
+    return None
+  try:
+    manifest = json.load(open(path, "rt", encoding="utf-8"))
+  except ValueError:
+    print("Ignoring unreadable manifest: %s" % (path))
+    return None
+  if manifest.get("version") != MANIFEST_VERSION:
+    print("Ignoring manifest with version %s: %s" % (manifest.get("version"), path))
+    return None
+  return manifest["tests"]
+
+def main():
+  check = False
+  for arg in sys.argv[1:]:
+    if arg == "-h" or arg == "--help":
+      print("Usage: %s [--check]\n" % (os.path.basename(sys.argv[0])))
+      print("Writes %s from the tests under %s." % (MANIFEST, TEST_ROOT))
+      print("  --check    only report whether %s is up to date" % (MANIFEST))
+      return 0
+    elif arg == "--check":
+      check = True
+    else:
+      print("Unknown option: %s" % (arg))
+      return 1
+
+  tests = generate()
+  text = format_manifest(tests)
+  if check:
+    old = open(MANIFEST, "rt", encoding="utf-8").read() if os.path.exists(MANIFEST) else ""
+    if old != text:
+      print("%s is out of date, run %s" % (MANIFEST, os.path.basename(sys.argv[0])))
+      return 1
+    print("%s is up to date (%d tests)" % (MANIFEST, len(tests)))
+    return 0
+
+  open(MANIFEST, "wt", encoding="utf-8", newline="\n").write(text)
+  print("Wrote %d tests to %s" % (len(tests), MANIFEST))
+  return 0
+
+if __name__ == "__main__":
+  sys.exit(main())
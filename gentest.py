@@ -12,6 +12,11 @@ import shutil
 import time
 import re
 import socket
+import select
+import ctypes
+import queue
+import genmanifest
+import decoderecords
 
 PSPSH = "pspsh"
 HOSTFS = "usbhostfs_pc"
@@ -21,11 +26,26 @@ PORT = 3000
 OUTFILE = "__testoutput.txt"
 OUTFILE2 = "__testerror.txt"
 FINISHFILE = "__testfinish.txt"
+# From emitInt() and friends, rendered into the output.
+RECORDFILE = "__testrecords.bin"
+# Written by common.c's test_end(), like how much output it kept in memory.
+STATSFILE = "__teststats.txt"
+# From profileBegin() and profileEnd(), if the test used them.
+PROFILEFILE = "__testprofile.txt"
 SHOTFILE = "__screenshot.bmp"
 TIMEOUT = 10
 RECONNECT_TIMEOUT = 6
+# Only used where inotify isn't available.
+POLL_INTERVAL = 0.01
 
 hostfs_command = None
+pspsh_session = None
+benchmark_results = []
+# From tests/manifest.json, if present.
+manifest = None
+timeout_given = False
+# Where to keep each test's profile, if anywhere.
+profile_dir = None
 
 tests_to_generate = [
   "cpu/cpu_alu/cpu_alu",
@@ -177,12 +197,149 @@ def wait_until(predicate, timeout, interval):
     time.sleep(interval)
   return False
 
-def pspsh_is_ready():
-  c = Command([PSPSH, "-p", str(PORT), "-e", "ls"])
-  c.run(0.5)
-  if c.output == None:
+class PspshSession(object):
+  """One pspsh process kept open for all tests, instead of a new one for each command."""
+  def __init__(self):
+    self.process = None
+    self.chunks = queue.Queue()
+    # Only once the PSP has answered, pspsh starts before it's there.
+    self.connected = False
+
+  def start(self):
+    self.process = subprocess.Popen([PSPSH, "-p", str(PORT)], stdin=subprocess.PIPE, stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+    self.chunks = queue.Queue()
+    self.connected = False
+
+    def reader(process, chunks):
+      while True:
+        data = os.read(process.stdout.fileno(), 4096)
+        if not data:
+          break
+        chunks.put(data.decode("utf-8", "replace"))
+      chunks.put(None)
+
+    threading.Thread(target=reader, args=(self.process, self.chunks), daemon=True).start()
+
+  def alive(self):
+    return self.process != None and self.process.poll() == None
+
+  def command(self, cmd, done, timeout):
+    """Sends cmd, and returns its output once done(output) is true, or None on timeout."""
+    if not self.alive():
+      return None
+
+    # Throw away anything left over, like a prompt.
+    try:
+      while self.chunks.get_nowait() != None:
+        pass
+    except queue.Empty:
+      pass
+
+    try:
+      self.process.stdin.write((cmd + "\n").encode("utf-8"))
+      self.process.stdin.flush()
+    except OSError:
+      return None
+
+    output = ""
+    mustend = time.time() + timeout
+    while not done(output):
+      remaining = mustend - time.time()
+      if remaining <= 0:
+        return None
+      try:
+        chunk = self.chunks.get(timeout=remaining)
+      except queue.Empty:
+        return None
+      if chunk == None:
+        return None
+      output += chunk
+    return output
+
+  def stop(self):
+    if self.alive():
+      try:
+        self.process.stdin.close()
+        self.process.wait(1)
+      except (OSError, subprocess.TimeoutExpired):
+        self.process.terminate()
+    self.process = None
+    self.connected = False
+
+  def ready(self):
+    return self.alive() and self.connected
+
+def pspsh_output_complete(output):
+  # Some output, and then the prompt again.
+  return output.count("\n") > 2 and output.rstrip().endswith(">")
+
+def pspsh_probe():
+  """Asks the PSP for a prompt on the open session, and stops it if there's no answer."""
+  if pspsh_session.command("ls", pspsh_output_complete, 0.5) == None:
+    pspsh_session.stop()
     return False
-  return c.output.decode('utf-8').count("\n") > 2
+  pspsh_session.connected = True
+  return True
+
+def pspsh_connect():
+  global pspsh_session
+  # pspsh reconnects on its own after a test resets psplink, so try the open session first.
+  if pspsh_session != None and pspsh_session.alive():
+    return pspsh_probe()
+
+  pspsh_session = PspshSession()
+  pspsh_session.start()
+  return pspsh_probe()
+
+def pspsh_is_ready():
+  # Until a test runs, there's no need to ask the PSP again.
+  if pspsh_session != None and pspsh_session.ready():
+    return True
+  return pspsh_connect()
+
+class FinishWatcher(object):
+  """Waits for a file to be written, using inotify on Linux and polling elsewhere."""
+  IN_CLOSE_WRITE = 0x00000008
+  IN_MOVED_TO = 0x00000080
+  IN_CREATE = 0x00000100
+
+  def __init__(self, path):
+    self.path = path
+    self.fd = -1
+    if sys.platform.startswith("linux"):
+      try:
+        libc = ctypes.CDLL(None, use_errno=True)
+        fd = libc.inotify_init1(os.O_NONBLOCK | os.O_CLOEXEC)
+        directory = os.path.dirname(os.path.abspath(path)).encode(sys.getfilesystemencoding())
+        if fd >= 0 and libc.inotify_add_watch(fd, directory, self.IN_CLOSE_WRITE | self.IN_MOVED_TO | self.IN_CREATE) >= 0:
+          self.fd = fd
+        elif fd >= 0:
+          os.close(fd)
+      except (OSError, AttributeError):
+        pass
+
+  def wait(self, timeout):
+    mustend = time.time() + timeout
+    # Events are drained after each check, so nothing written in between is missed.
+    while not os.path.exists(self.path):
+      remaining = mustend - time.time()
+      if remaining <= 0:
+        return False
+      if self.fd >= 0:
+        readable, _, _ = select.select([self.fd], [], [], remaining)
+        if readable:
+          try:
+            os.read(self.fd, 4096)
+          except BlockingIOError:
+            pass
+      else:
+        time.sleep(min(POLL_INTERVAL, remaining))
+    return True
+
+  def close(self):
+    if self.fd >= 0:
+      os.close(self.fd)
+      self.fd = -1
 
 def hostfs_is_ready():
   s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
@@ -194,10 +351,13 @@ def hostfs_is_ready():
     return False
 
 def start_hostfs():
+  global hostfs_command
   hostfs_command = Command([HOSTFS, "-b", str(PORT)])
   hostfs_command.start(capture=False)
 
 def stop_hostfs():
+  if pspsh_session != None:
+    pspsh_session.stop()
   if hostfs_command != None:
     hostfs_command.stop()
 
@@ -223,7 +383,19 @@ def prepare_test(test, args):
     if make_result > 0:
       sys.exit(make_result)
 
-def gen_test(test, args):
+def read_stats():
+  stats = {}
+  if os.path.exists(STATSFILE):
+    for line in open(STATSFILE, "rt"):
+      if "=" in line:
+        key, value = line.strip().split("=", 1)
+        stats[key] = value
+  return stats
+
+def gen_test(test, args, timeout=None):
+  if timeout == None:
+    timeout = TIMEOUT
+
   if os.path.exists(OUTFILE):
     os.unlink(OUTFILE)
   if os.path.exists(OUTFILE2):
@@ -232,6 +404,12 @@ def gen_test(test, args):
     os.unlink(FINISHFILE)
   if os.path.exists(SHOTFILE):
     os.unlink(SHOTFILE)
+  if os.path.exists(RECORDFILE):
+    os.unlink(RECORDFILE)
+  if os.path.exists(STATSFILE):
+    os.unlink(STATSFILE)
+  if os.path.exists(PROFILEFILE):
+    os.unlink(PROFILEFILE)
 
   prx_path = TEST_ROOT + test + ".prx"
 
@@ -239,8 +417,10 @@ def gen_test(test, args):
     print("You must compile the test into a PRX first (" + prx_path + ")")
     return False
 
-  # Maybe we should start usbhostfs_pc for them?
-  if not hostfs_is_ready():
+  start_time = time.time()
+
+  # Maybe we should start usbhostfs_pc for them?  Once it's up, it stays up.
+  if (pspsh_session == None or not pspsh_session.ready()) and not hostfs_is_ready():
     start_hostfs()
     success = wait_until(hostfs_is_ready, RECONNECT_TIMEOUT, 0.2)
     if not success:
@@ -259,42 +439,70 @@ def gen_test(test, args):
       print("On Windows, the usb driver must be installed")
       return False
 
-  # Okay, time to run the command.
-  c = Command([PSPSH, "-p", str(PORT), "-e", prx_path + " " + " ".join(args)])
-  c.run(TIMEOUT)
-  if not re.match(r"^Load/Start [^ ]+ UID: 0x[0-9A-F]+ Name: TESTMODULE\s*$", c.output.decode('utf-8')):
-    print(c.output)
-
-  # PSPSH returns right away, though, so do the timeout here.
-  wait_until(lambda: os.path.exists(FINISHFILE), TIMEOUT, 0.1)
-
-  if not os.path.exists(FINISHFILE):
-    print("ERROR: Test timed out after %d seconds" % (TIMEOUT))
-
-    # Reset the test, it's probably dead.
-    os.system("%s -p %i -e reset" % (PSPSH, PORT))
+  # Okay, time to run the command.  Watch before starting, so the finish can't be missed.
+  watcher = FinishWatcher(FINISHFILE)
+  load_start = re.compile(r"^Load/Start [^ ]+ UID: 0x[0-9A-F]+ Name: TESTMODULE\s*$", re.MULTILINE)
+  output = pspsh_session.command(prx_path + " " + " ".join(args), lambda output: load_start.search(output) or pspsh_output_complete(output), timeout)
+  if output == None or not load_start.search(output):
+    print(output)
+  run_time = time.time()
+
+  # The module runs on its own after Load/Start, so do the timeout here.
+  finished = watcher.wait(timeout)
+  watcher.close()
+  finish_time = time.time()
+  # The test exits with sceKernelExitGame(), which resets psplink, so ask again before the next one.
+  pspsh_session.connected = False
+
+  result = False
+  if not finished:
+    print("ERROR: Test timed out after %d seconds" % (timeout))
+
+    # Reset the test, it's probably dead.  The PSP reconnects, so pspsh does too.
+    pspsh_session.command("reset", lambda output: False, 0.5)
+    pspsh_session.stop()
   elif os.path.exists(OUTFILE2) and os.path.getsize(OUTFILE2) > 0:
     print("ERROR: Script produced stderr output")
+  elif os.path.exists(RECORDFILE) and os.path.getsize(RECORDFILE) > 0:
+    try:
+      text = open(OUTFILE, "rb").read() if os.path.exists(OUTFILE) else b""
+      result = decoderecords.merge(text, decoderecords.parse(open(RECORDFILE, "rb").read()))
+    except ValueError as e:
+      print("ERROR: Bad " + RECORDFILE + ": " + str(e))
   elif os.path.exists(OUTFILE) and os.path.getsize(OUTFILE) > 0:
-    return open(OUTFILE, "rt").read()
+    result = open(OUTFILE, "rt").read()
   # It's acceptable to have a graphics-only test.
   elif os.path.exists(SHOTFILE) and os.path.getsize(SHOTFILE) > 0:
-    return ""
+    result = ""
   else:
     print("ERROR: No or empty " + OUTFILE + " was written, can't write .expected")
 
-  return False
+  stats = read_stats()
+  if int(stats.get("schedf_peak_chunks", 0)) > 0:
+    print("Output kept in memory peaked at %s bytes" % (stats["schedf_peak_bytes"]))
+  if profile_dir != None and os.path.exists(PROFILEFILE):
+    profile_path = os.path.join(profile_dir, test.replace("/", "_") + ".profile.txt")
+    shutil.copyfile(PROFILEFILE, profile_path)
+    print("Profile written: " + profile_path)
+
+  end_time = time.time()
+  benchmark_results.append((test, (run_time - start_time) + (end_time - finish_time), finish_time - run_time))
+  return result
 
 
 def gen_test_expected(test, args):
+  info = manifest.get(test) if manifest != None else None
+  if info != None and not info["real_psp"]:
+    print("Warning: " + test + " is listed in not_working_on_real_psp.txt")
   print("Running test " + test + " on the PSP...")
   prepare_test(test, args)
-  result = gen_test(test, args)
+  result = gen_test(test, args, info["timeout"] if info != None and not timeout_given else None)
 
   expected_path = TEST_ROOT + test + ".expected"
   if result != False:
-    # Normalize line endings on windows to avoid spurious git warnings.
-    if sys.platform == 'win32':
+    # Normalize line endings on windows to avoid spurious git warnings.  Records have to be
+    # rendered into the text anyway.
+    if sys.platform == 'win32' or os.path.exists(RECORDFILE):
       open(expected_path, "wt").write(result)
     else:
       shutil.copyfile(OUTFILE, expected_path)
@@ -308,11 +516,31 @@ def gen_test_expected(test, args):
 
   return False
 
-def gen_test_all_versions(test, args):
-  print("Running test " + test + " on the PSP...")
-  prepare_test(test, args)
-  standard_result = gen_test(test, args)
-
+def sdkver_list_arg():
+  # For common.c: every version as VER:FUNC, so they all run in one launch.
+  pairs = []
+  for name in all_versions:
+    ver = "0"
+    func = "0"
+    for arg in all_versions[name]:
+      if arg.startswith("--sdkver="):
+        ver = arg[len("--sdkver="):]
+      elif arg.startswith("--sdkver-func="):
+        func = arg[len("--sdkver-func="):]
+    pairs.append(ver + ":" + func)
+  return "--sdkver-list=" + ",".join(pairs)
+
+def split_sdkver_sections(output):
+  sections = []
+  for line in output.splitlines(True):
+    m = re.match(r"^===== (sdkver=.*) =====\s*$", line)
+    if m:
+      sections.append([m.group(1), ""])
+    elif sections:
+      sections[-1][1] += line
+  return sections
+
+def gen_test_each_version(test, args, standard_result):
   diff = False
   for name in all_versions:
     sys.stdout.write("Version %s... " % (name))
@@ -324,17 +552,59 @@ def gen_test_all_versions(test, args):
 
   return diff
 
+def gen_test_all_versions(test, args):
+  print("Running test " + test + " on the PSP...")
+  prepare_test(test, args)
+
+  # Each version runs in turn, so allow time for all of them.
+  names = list(all_versions)
+  result = gen_test(test, args + [sdkver_list_arg()], TIMEOUT * (len(names) + 1))
+  if result == False:
+    print("*** %s could not be run with all versions" % (test))
+    return True
+
+  sections = split_sdkver_sections(result)
+  if len(sections) != len(names) + 1:
+    # Built before common.c supported --sdkver-list, so launch once per version.
+    print("Test doesn't support --sdkver-list, running each version separately (rebuild common and the test?)")
+    return gen_test_each_version(test, args, gen_test(test, args))
+
+  standard_result = sections[0][1]
+  diff = False
+  for i, name in enumerate(names):
+    if sections[i + 1][1] != standard_result:
+      print("*** %s got a different result using %s" % (test, " ".join(all_versions[name])))
+      diff = True
+
+  return diff
+
+def print_benchmark():
+  if not benchmark_results:
+    return
+  print("\n%-40s %12s %12s" % ("Test", "Overhead ms", "Runtime ms"))
+  for test, overhead, runtime in benchmark_results:
+    print("%-40s %12.1f %12.1f" % (test, overhead * 1000, runtime * 1000))
+  total_overhead = sum(r[1] for r in benchmark_results)
+  total_runtime = sum(r[2] for r in benchmark_results)
+  print("%d runs: %.1f ms overhead (%.1f ms each), %.1f ms running tests" % (
+    len(benchmark_results), total_overhead * 1000, total_overhead * 1000 / len(benchmark_results), total_runtime * 1000))
+
 def main():
   init()
   tests = []
   args = []
   it = iter(sys.argv[1:])
-  global TIMEOUT
+  global TIMEOUT, manifest, timeout_given, profile_dir
+  manifest = genmanifest.load_manifest()
   for arg in it:
     if arg[0] == "-":
       if arg == "-t" or arg == "--timeout":
         TIMEOUT = int(next(it))
-        
+        timeout_given = True
+      elif arg == "--profile-dir":
+        profile_dir = next(it)
+        continue
+
       args.append(arg)
     else:
       tests.append(arg.replace("\\", "/"))
@@ -351,8 +621,11 @@ def main():
     print("  -k, --keep            do not run make before tests")
     print("      --sdkver=VER      use sceKernelSetCompiledSdkVersion(VER)")
     print("      --sdkver-func=### use sceKernelSetCompiledSdkVersion###(VER)")
-    print("  -a, --all-versions    run the test for all known versions")
+    print("  -a, --all-versions    run the test for all known versions in one launch")
     print("  -t, --timeout secs    set the timeout in seconds to secs")
+    print("      --headless        don't draw the output on the PSP's screen")
+    print("      --profile-dir DIR keep each test's profileBegin() zone summary in DIR")
+    print("  -b, --benchmark       report time spent in this script apart from the tests")
     return
 
   if "-a" in args or "--all-versions" in args:
@@ -368,6 +641,9 @@ def main():
     for test in tests:
       gen_test_expected(test, args)
 
+  if "-b" in args or "--benchmark" in args:
+    print_benchmark()
+
   # End usbhostfs_pc if we started it.
   stop_hostfs()
 
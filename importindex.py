@@ -0,0 +1,227 @@
+# Indexes which tests import which HLE functions, from the import tables of the built PRXs and the
+# *-imports.S stubs, so a change to one function only needs the tests that call it:
+#
+#   python importindex.py sceDmacMemcpy              tests importing sceDmacMemcpy
+#   python importindex.py 0x617F3FE6 sceAtrac3plus   by NID, or a whole library
+#   python importindex.py sceKernelCreateVpl | python runtests.py --tests-from -
+#   python importindex.py --list                     every function, with how many tests import it
+#
+# Names come from the *-imports.S stubs, and from the .elf symbols for tests that have been built.
+
+# Note: This is a Python3 file.
+
+import sys
+import os
+import re
+import json
+import struct
+import genmanifest
+
+TEST_ROOT = genmanifest.TEST_ROOT
+# Imported by every test through libcommon.
+COMMON_STUBS = ["common/sysmem-imports.S"]
+
+stub_re = re.compile(r'^\s*IMPORT_FUNC\s+"([^"]+)"\s*,\s*(0x[0-9A-Fa-f]+)\s*,\s*(\w+)', re.M)
+
+class Elf:
+  """Just enough of a little endian ELF32 to find the PSP import stubs."""
+
+  def __init__(self, path):
+    self.data = open(path, "rb").read()
+    if self.data[0:4] != b"\x7fELF" or self.data[4] != 1 or self.data[5] != 1:
+      raise ValueError("not a little endian ELF32 file")
+    e_type = struct.unpack_from("<H", self.data, 0x10)[0]
+    e_phoff, e_shoff = struct.unpack_from("<II", self.data, 0x1C)
+    e_phentsize, e_phnum, e_shentsize, e_shnum, e_shstrndx = struct.unpack_from("<HHHHH", self.data, 0x2A)
+    self.segments = []
+    self.module_info = None
+    for i in range(e_phnum):
+      p_type, p_offset, p_vaddr, p_paddr, p_filesz = struct.unpack_from("<IIIII", self.data, e_phoff + i * e_phentsize)
+      if i == 0 and e_type == 0xFFA0:
+        # PRXs point at the module info from the first program header.
+        self.module_info = p_paddr & 0x7FFFFFFF
+      if p_type == 1:
+        self.segments.append((p_vaddr, p_offset, p_filesz))
+    self.sections = {}
+    if e_shoff != 0 and e_shstrndx < e_shnum:
+      headers = [struct.unpack_from("<IIIIIIIIII", self.data, e_shoff + i * e_shentsize) for i in range(e_shnum)]
+      names = headers[e_shstrndx][4]
+      for h in headers:
+        self.sections[self.cstring(names + h[0])] = h
+
+  def cstring(self, offset):
+    return self.data[offset:self.data.index(b"\0", offset)].decode("ascii", "replace")
+
+  def offset(self, addr):
+    for vaddr, offset, size in self.segments:
+      if vaddr <= addr < vaddr + size:
+        return addr - vaddr + offset
+    raise ValueError("address 0x%08x not in the file" % (addr))
+
+  def u32(self, addr):
+    return struct.unpack_from("<I", self.data, self.offset(addr))[0]
+
+  def imports(self):
+    """Returns [(library, nid, stub address)], from the module info's stub table."""
+    if ".lib.stub" in self.sections:
+      h = self.sections[".lib.stub"]
+      stub_top, stub_end = h[3], h[3] + h[5]
+    else:
+      info = self.sections[".rodata.sceModuleInfo"][4] if ".rodata.sceModuleInfo" in self.sections else self.module_info
+      if info == None:
+        return []
+      stub_top, stub_end = struct.unpack_from("<II", self.data, info + 44)
+
+    result = []
+    addr = stub_top
+    while addr < stub_end:
+      name_addr = self.u32(addr)
+      size, vstubcount, stubcount = struct.unpack_from("<BBH", self.data, self.offset(addr + 8))
+      nid_table = self.u32(addr + 12)
+      stub_table = self.u32(addr + 16)
+      library = self.cstring(self.offset(name_addr)) if name_addr != 0 else "?"
+      for i in range(stubcount):
+        result.append((library, self.u32(nid_table + i * 4), stub_table + i * 8))
+      addr += max(size, 5) * 4
+    return result
+
+  def symbols(self):
+    """Returns {address: name} from .symtab, if it hasn't been stripped."""
+    if ".symtab" not in self.sections or ".strtab" not in self.sections:
+      return {}
+    symtab = self.sections[".symtab"]
+    strtab = self.sections[".strtab"][4]
+    result = {}
+    for offset in range(symtab[4], symtab[4] + symtab[5], 16):
+      st_name, st_value = struct.unpack_from("<II", self.data, offset)
+      if st_name != 0:
+        result[st_value] = self.cstring(strtab + st_name)
+    return result
+
+def read_stubs(path):
+  """Returns [(library, nid, name)] from an *-imports.S file."""
+  text = open(path, "rt", encoding="utf-8", errors="replace").read()
+  return [(library, int(nid, 16), name) for library, nid, name in stub_re.findall(text)]
+
+def elf_names(path, names):
+  """Names imports after the symbols at their stubs, if the ELF still has symbols."""
+  try:
+    elf = Elf(path)
+    symbols = elf.symbols()
+    for library, nid, stub in elf.imports():
+      if stub in symbols:
+        names.setdefault((library, nid), symbols[stub])
+  except (ValueError, IndexError, KeyError, struct.error):
+    pass
+
+def prx_imports(test, info):
+  """The test's imports from its PRX, or None if it isn't built."""
+  prx = TEST_ROOT + info["prx"]
+  if not os.path.exists(prx):
+    return None
+  try:
+    imports = Elf(prx).imports()
+  except (ValueError, IndexError, KeyError, struct.error) as e:
+    sys.stderr.write("Skipping %s: %s\n" % (prx, e))
+    return None
+  return [(library, nid) for library, nid, stub in imports]
+
+def build_index(manifest):
+  """Returns ({(library, nid): set of tests}, {(library, nid): name}.)"""
+  names = {}
+  stub_cache = {}
+  def stubs(path):
+    if path not in stub_cache:
+      stub_cache[path] = read_stubs(path) if os.path.exists(path) else []
+      for library, nid, name in stub_cache[path]:
+        names[(library, nid)] = name
+    return stub_cache[path]
+
+  index = {}
+  for test, info in manifest.items():
+    imports = prx_imports(test, info)
+    declared = [path for path in COMMON_STUBS] + [TEST_ROOT + path for path in info["imports"]]
+    for path in declared:
+      stubs(path)
+    if imports == None:
+      # Not built, so go by the stubs it links, which is all we know.
+      imports = [(library, nid) for path in declared for library, nid, name in stubs(path)]
+    for key in imports:
+      index.setdefault(key, set()).add(test)
+
+  # Names from stubs no test uses yet are still useful for lookups, and built ELFs (tests and
+  # demos) name the functions imported from pspsdk's libraries.
+  for root, dirs, files in os.walk("."):
+    dirs.sort()
+    for filename in sorted(files):
+      path = os.path.normpath(os.path.join(root, filename)).replace("\\", "/")
+      if filename.endswith("-imports.S"):
+        stubs(path)
+      elif filename.endswith(".elf"):
+        elf_names(path, names)
+  return index, names
+
+def function_name(key, names):
+  return names.get(key, "%s_%08X" % key)
+
+def lookup(query, index, names):
+  tests = set()
+  found = False
+  nid = None
+  if re.match(r"^(0x)?[0-9A-Fa-f]{8}$", query):
+    nid = int(query, 16)
+  for key, key_tests in index.items():
+    library, key_nid = key
+    if query == library or query == function_name(key, names) or nid == key_nid:
+      tests |= key_tests
+      found = True
+  if not found:
+    sys.stderr.write("No test imports %s\n" % (query))
+  return tests
+
+def main():
+  queries = []
+  list_all = False
+  json_path = None
+  it = iter(sys.argv[1:])
+  for arg in it:
+    if arg == "-h" or arg == "--help":
+      print("Usage: %s [options] NAME|NID|LIBRARY...\n" % (os.path.basename(sys.argv[0])))
+      print("Prints the tests that import any of the given functions or libraries.\n")
+      print("Options:")
+      print("  -l, --list            list every imported function and how many tests use it")
+      print("      --json FILE       write the whole index as JSON")
+      return 0
+    elif arg == "-l" or arg == "--list":
+      list_all = True
+    elif arg == "--json":
+      json_path = next(it)
+    elif arg[0] == "-":
+      print("Unknown option: %s" % (arg))
+      return 1
+    else:
+      queries.append(arg)
+
+  manifest = genmanifest.load_manifest()
+  if manifest == None:
+    manifest = genmanifest.generate()
+  index, names = build_index(manifest)
+
+  if json_path != None:
+    functions = []
+    for key in sorted(index.keys()):
+      functions.append({"library": key[0], "nid": "0x%08X" % (key[1]), "name": names.get(key), "tests": sorted(index[key])})
+    open(json_path, "wt", encoding="utf-8").write(json.dumps(functions, indent=1))
+  if list_all:
+    for key in sorted(index.keys(), key=lambda k: (k[0], function_name(k, names))):
+      print("%-24s 0x%08X  %-40s %d" % (key[0], key[1], function_name(key, names), len(index[key])))
+
+  tests = set()
+  for query in queries:
+    tests |= lookup(query, index, names)
+  for test in sorted(tests):
+    print(test)
+  return 0
+
+if __name__ == "__main__":
+  sys.exit(main())
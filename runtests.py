@@ -0,0 +1,282 @@
+# Runs tests against an emulator (not a PSP) and compares with the .expected files.
+# Tests run in parallel, each in its own emulator process.
+
+# Note: This is a Python3 file.
+
+import sys
+import os
+import json
+import shlex
+import subprocess
+import time
+import hashlib
+import random
+import tempfile
+from concurrent.futures import ThreadPoolExecutor, as_completed
+import genmanifest
+
+TEST_ROOT = "tests/"
+# {prx} is replaced by the test's path, and {timeout} by the timeout in seconds.
+EMULATOR = "PPSSPPHeadless {prx}"
+TIMEOUT = 10
+JOBS = os.cpu_count() or 1
+MANIFEST = genmanifest.MANIFEST
+# Outputs of earlier runs, keyed by the test's files and --cache-id.  Shared with buildcache.py.
+CACHE_DIR = os.path.join(os.environ.get("PSPAUTOTESTS_CACHE", os.path.join(os.path.expanduser("~"), ".cache", "pspautotests")), "results")
+CACHE_FORMAT = "1"
+cache_id = None
+rerun_cached = False
+verify_fraction = 0.0
+# Per test timeouts and data files from the manifest, unless -t was given.
+test_timeouts = {}
+test_data = {}
+
+def matches(test, filters):
+  # A filter matches the test itself, or everything in a directory.
+  return not filters or any(test == f or test.startswith(f.rstrip("/") + "/") for f in filters)
+
+def find_tests(filters):
+  manifest = genmanifest.load_manifest(MANIFEST)
+  if manifest != None:
+    tests = []
+    for test in sorted(manifest.keys()):
+      if matches(test, filters) and os.path.exists(TEST_ROOT + manifest[test]["prx"]):
+        tests.append(test)
+        test_timeouts[test] = manifest[test]["timeout"]
+        test_data[test] = manifest[test]["data"]
+    return tests
+
+  tests = []
+  for root, dirs, files in os.walk(TEST_ROOT):
+    dirs.sort()
+    for filename in sorted(files):
+      if not filename.endswith(".expected"):
+        continue
+      test = os.path.join(root, filename[:-len(".expected")])[len(TEST_ROOT):].replace("\\", "/")
+      if not os.path.exists(TEST_ROOT + test + ".prx"):
+        continue
+      if not matches(test, filters):
+        continue
+      tests.append(test)
+  return tests
+
+def read_test_list(path):
+  f = sys.stdin if path == "-" else open(path, "rt")
+  return [line.strip().replace("\\", "/") for line in f if line.strip() and not line.startswith("#")]
+
+def normalize(output):
+  # Compare without caring about line endings or trailing blank lines.
+  lines = output.replace("\r\n", "\n").split("\n")
+  return "\n".join(line.rstrip() for line in lines).rstrip("\n")
+
+def emulator_command(test, timeout):
+  prx_path = TEST_ROOT + test + ".prx"
+  template = EMULATOR if "{prx}" in EMULATOR else EMULATOR + " {prx}"
+  return [arg.replace("{prx}", prx_path).replace("{timeout}", str(timeout)) for arg in shlex.split(template)]
+
+def cache_key(test):
+  """Hashes what decides a test's output: the PRX, its data files, and the emulator."""
+  h = hashlib.sha256(("result|%s|%s|%s|" % (CACHE_FORMAT, cache_id, EMULATOR)).encode("utf-8"))
+  for path in [test + ".prx"] + sorted(test_data.get(test, [])):
+    h.update(path.encode("utf-8") + b"\0")
+    if os.path.exists(TEST_ROOT + path):
+      h.update(hashlib.sha256(open(TEST_ROOT + path, "rb").read()).digest())
+  return h.hexdigest()
+
+def cache_path(key):
+  return os.path.join(CACHE_DIR, key[0:2], key + ".json")
+
+def load_cached(key):
+  try:
+    return json.load(open(cache_path(key), "rt", encoding="utf-8"))
+  except (OSError, ValueError):
+    return None
+
+def store_cached(key, result):
+  path = cache_path(key)
+  os.makedirs(os.path.dirname(path), exist_ok=True)
+  fd, tmp = tempfile.mkstemp(dir=os.path.dirname(path))
+  with os.fdopen(fd, "wt", encoding="utf-8") as f:
+    f.write(json.dumps({"output": result["output"], "returncode": result.get("returncode")}))
+  os.replace(tmp, path)
+
+def check_expected(result):
+  expected = open(TEST_ROOT + result["test"] + ".expected", "rt", encoding="utf-8", errors="replace").read()
+  if normalize(result["output"]) == normalize(expected):
+    result["status"] = "pass"
+  else:
+    result["status"] = "fail"
+  return result
+
+def run_test(test):
+  key = cache_key(test) if cache_id != None else None
+  cached = load_cached(key) if key != None and not rerun_cached else None
+  if cached != None and random.random() >= verify_fraction:
+    # Checked against the current .expected, which may have changed since.
+    result = {"test": test, "status": "error", "time": 0.0, "output": cached["output"], "stderr": "", "cached": True}
+    if cached["returncode"] != None:
+      result["returncode"] = cached["returncode"]
+    return check_expected(result)
+
+  result = run_emulator(test)
+  if key != None and result["status"] != "timeout" and "returncode" in result:
+    if cached != None and normalize(cached["output"]) != normalize(result["output"]):
+      # A sampled rerun disagrees: the test is flaky, or the cache was wrong.  Trust the new run.
+      result["cache_mismatch"] = True
+    store_cached(key, result)
+  return result
+
+def run_emulator(test):
+  result = {"test": test, "status": "error", "time": 0.0, "output": "", "stderr": ""}
+  timeout = test_timeouts.get(test, TIMEOUT)
+  start = time.time()
+  try:
+    c = subprocess.run(emulator_command(test, timeout), stdin=subprocess.DEVNULL, stdout=subprocess.PIPE, stderr=subprocess.PIPE, timeout=timeout)
+    result["output"] = c.stdout.decode("utf-8", "replace")
+    result["stderr"] = c.stderr.decode("utf-8", "replace")
+    result["returncode"] = c.returncode
+  except subprocess.TimeoutExpired as e:
+    result["status"] = "timeout"
+    result["output"] = (e.stdout or b"").decode("utf-8", "replace")
+    result["time"] = time.time() - start
+    return result
+  except OSError as e:
+    result["stderr"] = str(e)
+    result["time"] = time.time() - start
+    return result
+  result["time"] = time.time() - start
+  return check_expected(result)
+
+def write_actual(result, actual_dir):
+  path = os.path.join(actual_dir, result["test"] + ".actual")
+  os.makedirs(os.path.dirname(path), exist_ok=True)
+  open(path, "wt", encoding="utf-8").write(result["output"])
+
+def print_summary(results, elapsed):
+  counts = {}
+  for result in results:
+    counts[result["status"]] = counts.get(result["status"], 0) + 1
+
+  failed = [r for r in results if r["status"] != "pass"]
+  if failed:
+    print("\nFailed tests:")
+    for result in sorted(failed, key=lambda r: r["test"]):
+      print("  %-8s %s" % (result["status"].upper(), result["test"]))
+
+  mismatched = [r for r in results if r.get("cache_mismatch")]
+  if mismatched:
+    print("\nOutput differed from the cached result (flaky, or a bad cache entry):")
+    for result in mismatched:
+      print("  %s" % (result["test"]))
+
+  cached = len([r for r in results if r.get("cached")])
+  if cached:
+    print("\n%d results reused from %s" % (cached, CACHE_DIR))
+  print("\n%d tests in %.1f seconds: %d passed, %d failed, %d timed out, %d errors" % (
+    len(results), elapsed, counts.get("pass", 0), counts.get("fail", 0), counts.get("timeout", 0), counts.get("error", 0)))
+
+def main():
+  global EMULATOR, TIMEOUT, JOBS, MANIFEST, CACHE_DIR, cache_id, rerun_cached, verify_fraction
+  filters = []
+  timeout_given = False
+  tests_from = None
+  results_path = None
+  actual_dir = None
+  verbose = False
+  it = iter(sys.argv[1:])
+  for arg in it:
+    if arg == "-h" or arg == "--help":
+      print("Usage: %s [options] cpu/icache/icache threads/mutex...\n" % (os.path.basename(sys.argv[0])))
+      print("Runs every test with a .expected under %s, or only those matching the filters." % (TEST_ROOT))
+      print("Tests must already be built (.prx.)\n")
+      print("Options:")
+      print("  -e, --emulator CMD    emulator command, default: %s" % (EMULATOR))
+      print("                        {prx} and {timeout} are replaced per test")
+      print("  -j, --jobs N          run N tests at once, default: %d" % (JOBS))
+      print("  -t, --timeout secs    set the timeout per test in seconds to secs")
+      print("                        (otherwise from the manifest, default %d)" % (TIMEOUT))
+      print("      --manifest FILE   read tests from FILE, default: %s" % (MANIFEST))
+      print("                        tests/ is searched instead if it doesn't exist")
+      print("      --tests-from FILE run the tests listed in FILE (- for stdin), like from affected.py")
+      print("      --results FILE    write results as JSON")
+      print("      --actual DIR      write the output of failed tests to DIR")
+      print("      --cache-id ID     reuse results of earlier runs with the same ID (like the")
+      print("                        emulator's build hash) when the PRX and data are unchanged")
+      print("      --cache-dir DIR   where results are kept, default: %s" % (CACHE_DIR))
+      print("      --rerun           run every test even if cached, and update the cache")
+      print("      --verify-cache F  rerun a random fraction F (like 0.05) of cached tests, and")
+      print("                        report any whose output changed")
+      print("  -v, --verbose         print every result, not just failures")
+      return 0
+    elif arg == "-e" or arg == "--emulator":
+      EMULATOR = next(it)
+    elif arg == "-j" or arg == "--jobs":
+      JOBS = max(1, int(next(it)))
+    elif arg == "-t" or arg == "--timeout":
+      TIMEOUT = int(next(it))
+      timeout_given = True
+    elif arg == "--manifest":
+      MANIFEST = next(it)
+    elif arg == "--tests-from":
+      tests_from = next(it)
+    elif arg == "--results":
+      results_path = next(it)
+    elif arg == "--actual":
+      actual_dir = next(it)
+    elif arg == "--cache-id":
+      cache_id = next(it)
+    elif arg == "--cache-dir":
+      CACHE_DIR = next(it)
+    elif arg == "--rerun":
+      rerun_cached = True
+    elif arg == "--verify-cache":
+      verify_fraction = float(next(it))
+    elif arg == "-v" or arg == "--verbose":
+      verbose = True
+    elif arg[0] == "-":
+      print("Unknown option: %s" % (arg))
+      return 1
+    else:
+      filters.append(arg.replace("\\", "/"))
+
+  if tests_from != None:
+    listed = read_test_list(tests_from)
+    if not listed:
+      # Nothing was affected.
+      print("No tests to run")
+      return 0
+    filters += listed
+  tests = find_tests(filters)
+  if timeout_given:
+    test_timeouts.clear()
+  if not tests:
+    print("No tests found")
+    return 1
+
+  print("Running %d tests, %d at a time..." % (len(tests), JOBS))
+  start = time.time()
+  results = []
+  with ThreadPoolExecutor(max_workers=JOBS) as executor:
+    futures = [executor.submit(run_test, test) for test in tests]
+    for future in as_completed(futures):
+      result = future.result()
+      results.append(result)
+      if verbose or result["status"] != "pass":
+        print("%-8s %s (%s)" % (result["status"].upper(), result["test"], "cached" if result.get("cached") else "%.2fs" % (result["time"])))
+      if actual_dir and result["status"] != "pass":
+        write_actual(result, actual_dir)
+  elapsed = time.time() - start
+
+  results.sort(key=lambda r: r["test"])
+  print_summary(results, elapsed)
+  if results_path:
+    # Output is only interesting when it didn't match.
+    for result in results:
+      if result["status"] == "pass":
+        del result["output"]
+    summary = {"elapsed": elapsed, "emulator": EMULATOR, "cache_id": cache_id, "timeout": TIMEOUT, "results": results}
+    open(results_path, "wt", encoding="utf-8").write(json.dumps(summary, indent=2))
+
+  return 0 if all(r["status"] == "pass" for r in results) else 1
+
+sys.exit(main())
@@ -14,8 +14,6 @@
 #include "atrac.h"
 #include "shared.h"
 
-// We log too much.
-extern unsigned int CHECKPOINT_OUTPUT_DIRECT;
 extern unsigned int HAS_DISPLAY;
 
 // NOTE: If you just run the binary plain in psplink (and started usbhostfs from the root), the output text files will be under host0:/
@@ -441,7 +439,6 @@ bool RunAtracTest(Atrac3File &file, AtracTestMode mode, int requestedBufSize, in
 }
 
 extern "C" int main(int argc, char *argv[]) {
-	CHECKPOINT_OUTPUT_DIRECT = 1;
 	HAS_DISPLAY = 0;  // don't waste time logging to the screen.
 
 	Atrac3File file("sample.at3");
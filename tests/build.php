@@ -27,9 +27,7 @@ if (count($params) > 0) {
 	}
 }
 
-foreach (recursive_directory_iterator($path) as $file) {
-	if (!endsWith($file, '.expected')) continue;
-	
+foreach (expected_files($path) as $file) {
 	//if (!preg_match('@kirk@', $file)) continue;
 	//if (!preg_match('@vfpu@', $file)) continue;
 	//if (!preg_match('@fonttest@', $file)) continue;
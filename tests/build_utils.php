@@ -88,4 +88,28 @@ function endsWith($str, $end) {
 
 function recursive_directory_iterator($dir) {
 	return new RecursiveIteratorIterator(new RecursiveDirectoryIterator($dir), RecursiveIteratorIterator::CHILD_FIRST);
+}
+
+// The .expected files under $dir, from manifest.json (see genmanifest.py) if there is one.
+function expected_files($dir) {
+	$manifest = __DIR__ . '/manifest.json';
+	if (is_file($manifest)) {
+		$info = json_decode(file_get_contents($manifest), true);
+		if ($info !== null && $info['version'] == 1) {
+			$root = str_replace('\\', '/', __DIR__);
+			$dir = rtrim(str_replace('\\', '/', realpath($dir)), '/') . '/';
+			$files = array();
+			foreach ($info['tests'] as $test) {
+				$file = "{$root}/{$test['expected']}";
+				if (strpos($file, $dir) === 0) $files[] = $file;
+			}
+			return $files;
+		}
+	}
+
+	$files = array();
+	foreach (recursive_directory_iterator($dir) as $file) {
+		if (endsWith($file, '.expected')) $files[] = (string)$file;
+	}
+	return $files;
 }
\ No newline at end of file
@@ -81,9 +81,9 @@ void testShadowGlyphImage(const char *title, FontHandle f, u16 charCode, GlyphIm
 				if (glyph->bytesPerLine > 2 && glyph->bytesPerLine <= 80) {
 					linesize = glyph->bytesPerLine;
 				}
-				for (int x = 0; x < linesize; ++x) {
-					schedf("%02x", *p++);
-				}
+				static const SchedfHexFormat format = { 2, NULL, NULL, 0 };
+				schedfHex8(p, linesize, &format);
+				p += linesize;
 				schedf("\n");
 			}
 		}
@@ -27,8 +27,6 @@ static u32 copybuf[512 * 272];
 u16 *copybuf16 = (u16 *)copybuf;
 u32 *drawbuf;
 
-extern int HAS_DISPLAY;
-
 void *getBufAddr(int i) {
 	int off = (i * 512 * 272 * 4);
 	return ((u8 *)sceGeEdramGetAddr() + off);
@@ -53,20 +51,13 @@ void displayBuffer(const char *reason) {
 	const u32 *buf = copybuf;
 
 	checkpoint(reason);
-	// This prevents drawing to the screen, which makes the test faster.
-	HAS_DISPLAY = 0;
+	// Like schedf("%x") for each pixel, but spaces for zero.
+	static const SchedfHexFormat format = { 0, NULL, " ", 0 };
 	for (int y = 0; y < 272; ++y) {
-		for (int x = 0; x < 480; ++x) {
-			if (buf[y * 512 + x] != 0) {
-				schedf("%x", buf[y * 512 + x]);
-			} else {
-				schedf(" ");
-			}
-		}
+		schedfHex32(buf + y * 512, 480, &format);
 		schedf("\n");
 		flushschedf();
 	}
-	HAS_DISPLAY = 1;
 
 	// Reset.
 	memset(copybuf, 0, sizeof(copybuf));
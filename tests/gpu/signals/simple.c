@@ -50,9 +50,6 @@ char* status_str(int status) {
 	return str[status];
 }
 
-extern char schedfBuffer[65536];
-extern unsigned int schedfBufferPos;
-
 inline void breakInfo(const char *format, ...) {
 	int result = sceGeBreak(1, NULL);
 	int flags = sceKernelCpuSuspendIntr();
@@ -62,7 +59,7 @@ inline void breakInfo(const char *format, ...) {
 
 	va_list args;
 	va_start(args, format);
-	schedfBufferPos += vsprintf(schedfBuffer + schedfBufferPos, format, args);
+	vschedf(format, args);
 	va_end(args);
 	sceKernelCpuResumeIntr(flags);
 }
@@ -76,7 +73,7 @@ inline void syncInfo(const char *format, ...) {
 
 	va_list args;
 	va_start(args, format);
-	schedfBufferPos += vsprintf(schedfBuffer + schedfBufferPos, format, args);
+	vschedf(format, args);
 	va_end(args);
 	sceKernelCpuResumeIntr(flags);
 }
@@ -95,7 +92,7 @@ inline void listInfo(int n, const char *format, ...) {
 
 	va_list args;
 	va_start(args, format);
-	schedfBufferPos += vsprintf(schedfBuffer + schedfBufferPos, format, args);
+	vschedf(format, args);
 	va_end(args);
 	sceKernelCpuResumeIntr(flags);
 }
@@ -112,7 +109,7 @@ inline void listInfoNosync(int n, const char *format, ...) {
 
 	va_list args;
 	va_start(args, format);
-	schedfBufferPos += vsprintf(schedfBuffer + schedfBufferPos, format, args);
+	vschedf(format, args);
 	va_end(args);
 	sceKernelCpuResumeIntr(flags);
 }
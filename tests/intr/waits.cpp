@@ -89,7 +89,7 @@ void safeCheckpoint(const char *format, ...) {
 	if (format != NULL) {
 		va_list args;
 		va_start(args, format);
-		schedfBufferPos += vsprintf(schedfBuffer + schedfBufferPos, format, args);
+		vschedf(format, args);
 		// This is easier to debug in the emulator, but printf() reschedules on the real PSP.
 		//vprintf(format, args);
 		va_end(args);
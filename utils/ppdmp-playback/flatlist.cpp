@@ -0,0 +1,163 @@
+#include <pspdisplay.h>
+#include <pspge.h>
+#include <pspiofilemgr.h>
+#include <pspthreadman.h>
+#include <psputils.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <string.h>
+#include "flatlist.h"
+
+extern "C" int sceDmacMemcpy(void *dest, const void *source, unsigned int size);
+
+static u32 Align16(u32 sz) {
+	return (sz + 15) & ~15;
+}
+
+bool IsFlatList(const char *filename) {
+	SceUID fd = sceIoOpen(filename, PSP_O_RDONLY, 0777);
+	if (fd < 0) {
+		return false;
+	}
+	char magic[8] = { 0 };
+	bool result = sceIoRead(fd, magic, sizeof(magic)) == sizeof(magic) && memcmp(magic, FLAT_MAGIC, sizeof(magic)) == 0;
+	sceIoClose(fd);
+	return result;
+}
+
+FlatList::FlatList() : file_(0), list_(0), ops_(0), data_(0) {
+	memset(&header_, 0, sizeof(header_));
+}
+
+FlatList::~FlatList() {
+	free(file_);
+}
+
+bool FlatList::Load(const char *filename) {
+	SceUID fd = sceIoOpen(filename, PSP_O_RDONLY, 0777);
+	if (fd < 0) {
+		return false;
+	}
+
+	bool valid = sceIoRead(fd, &header_, sizeof(header_)) == sizeof(header_);
+	valid = valid && memcmp(header_.magic, FLAT_MAGIC, sizeof(header_.magic)) == 0 && header_.version == FLAT_VERSION;
+	// Each section is aligned, and a list word can only be followed by so many.
+	valid = valid && header_.listWords != 0 && header_.listWords <= FLAT_RELOC_WORD_MASK;
+
+	const u32 headerSize = Align16(sizeof(FlatHeader));
+	const u32 listSize = Align16(header_.listWords * sizeof(u32));
+	const u32 relocSize = Align16(header_.relocCount * sizeof(FlatReloc));
+	const u32 opSize = Align16(header_.opCount * sizeof(FlatOp));
+	const u32 total = listSize + relocSize + opSize + header_.dataSize;
+	if (valid) {
+		file_ = (u8 *)memalign(16, total);
+		if (!file_) {
+			printf("ERROR: Unable to allocate %d bytes for flat list\n", total);
+		}
+	}
+	valid = valid && file_ != 0;
+	valid = valid && sceIoLseek32(fd, headerSize, PSP_SEEK_SET) == (int)headerSize;
+	valid = valid && sceIoRead(fd, file_, total) == (int)total;
+	sceIoClose(fd);
+	if (!valid) {
+		return false;
+	}
+
+	list_ = (u32 *)file_;
+	const FlatReloc *relocs = (const FlatReloc *)(file_ + listSize);
+	ops_ = (const FlatOp *)(file_ + listSize + relocSize);
+	data_ = file_ + listSize + relocSize + opSize;
+
+	for (u32 i = 0; i < header_.relocCount; ++i) {
+		const u32 index = relocs[i].word & FLAT_RELOC_WORD_MASK;
+		if (index >= header_.listWords || relocs[i].offset >= header_.dataSize) {
+			printf("ERROR: Bad relocation %d\n", i);
+			return false;
+		}
+
+		const uintptr_t addr = (uintptr_t)(data_ + relocs[i].offset);
+		if ((relocs[i].word >> FLAT_RELOC_TYPE_SHIFT) == FlatRelocType::HIGH) {
+			list_[index] |= (addr >> 8) & 0x00FF0000;
+		} else {
+			list_[index] |= addr & 0x00FFFFFF;
+		}
+	}
+	for (u32 i = 0; i < header_.opCount; ++i) {
+		if (ops_[i].listPos > header_.listWords || (i > 0 && ops_[i].listPos < ops_[i - 1].listPos)) {
+			printf("ERROR: Bad op %d\n", i);
+			return false;
+		}
+	}
+
+	sceKernelDcacheWritebackInvalidateRange(file_, total);
+	return true;
+}
+
+static void RunOp(const FlatOp &op, u8 *data) {
+	void *dest = (void *)(uintptr_t)op.args[0];
+	switch (op.type) {
+	case FlatOpType::MEMSET:
+		memset(dest, (u8)op.args[1], op.args[2]);
+		sceKernelDcacheWritebackInvalidateRange(dest, op.args[2]);
+		sceDmacMemcpy((void *)(uintptr_t)(op.args[0] ^ 0x00400000), dest, op.args[2]);
+		break;
+
+	case FlatOpType::MEMCPY:
+		sceDmacMemcpy(dest, data + op.args[1], op.args[2]);
+		sceKernelDcacheWritebackInvalidateRange(dest, op.args[2]);
+		break;
+
+	case FlatOpType::DISPLAY:
+		sceDisplaySetFrameBuf(dest, op.args[1], op.args[2], 1);
+		sceDisplaySetFrameBuf(dest, op.args[1], op.args[2], 0);
+		break;
+
+	case FlatOpType::EDRAMTRANS:
+		sceGeEdramSetAddrTranslation(op.args[0]);
+		break;
+
+	case FlatOpType::INIT:
+		sceGeRestoreContext((PspGeContext *)(data + op.args[0]));
+		break;
+
+	default:
+		printf("Unknown flat list op: %d\n", op.type);
+		break;
+	}
+}
+
+bool FlatList::Run() {
+	if (!list_) {
+		return false;
+	}
+
+	// Anything at the very start, like INIT, runs before there's a list.
+	u32 next = 0;
+	while (next < header_.opCount && ops_[next].listPos == 0) {
+		RunOp(ops_[next++], data_);
+	}
+
+	u32 *end = list_ + header_.listWords;
+	int listID = sceGeListEnQueue(list_, next < header_.opCount ? list_ + ops_[next].listPos : end, -1, NULL);
+	if (listID < 0) {
+		printf("ERROR: Unable to enqueue flat list: %08x\n", listID);
+		return false;
+	}
+
+	while (next < header_.opCount) {
+		// We specifically want to wait for 2 to clear, which is why we don't list sync.
+		while (sceGeListSync(listID, 1) == 2) {
+			sceKernelDelayThreadCB(200);
+		}
+
+		// Ops at the same spot run together, before the GE gets any further.
+		const u32 pos = ops_[next].listPos;
+		while (next < header_.opCount && ops_[next].listPos == pos) {
+			RunOp(ops_[next++], data_);
+		}
+		sceGeListUpdateStallAddr(listID, next < header_.opCount ? list_ + ops_[next].listPos : end);
+	}
+
+	sceGeListSync(listID, 0);
+	return true;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <pspge.h>
+#include <stdint.h>
+#include "ppdmp.h"
+
+// Plays a list written by ppdmp-flatten: no patching while the GE runs, the whole list is
+// enqueued at once and only stops where the CPU has to do something (see FlatOp.)
+class FlatList {
+public:
+	FlatList();
+	~FlatList();
+
+	bool Load(const char *filename);
+	bool Run();
+
+	int Prims() const {
+		return header_.prims;
+	}
+
+private:
+	FlatHeader header_;
+	u8 *file_;
+	u32 *list_;
+	const FlatOp *ops_;
+	u8 *data_;
+};
+
+// Checks for FLAT_MAGIC, to pick FlatList over Replay.
+bool IsFlatList(const char *filename);
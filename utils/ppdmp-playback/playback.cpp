@@ -1,10 +1,13 @@
 #include <pspdisplay.h>
+#include <pspge.h>
 #include <pspgu.h>
+#include <pspiofilemgr.h>
 #include <pspkernel.h>
 #include <psppower.h>
 #include <stdio.h>
 #include <string.h>
 #include <common.h>
+#include "flatlist.h"
 #include "replay.h"
 
 // Just to make IntelliSense happy, not attempting to compile.
@@ -19,6 +22,12 @@ extern "C" int sceDmacMemcpy(void *dest, const void *source, unsigned int size);
 #define SCR_HEIGHT 272
 
 static unsigned int __attribute__((aligned(16))) list[1024];
+// State right after init(), restored between dumps in a batch.
+static PspGeContext initialContext;
+static void *initialTopaddr;
+static int initialBufferwidth;
+static int initialPixelformat;
+static int initialEdramTrans;
 
 void init() {
 	void *fbp0 = 0;
@@ -38,56 +47,345 @@ void init() {
 
 	sceDisplayWaitVblankStart();
 	sceGuDisplay(1);
+
+	sceGeSaveContext(&initialContext);
+	sceDisplayGetFrameBuf(&initialTopaddr, &initialBufferwidth, &initialPixelformat, 0);
+	// There's no getter, but setting returns the previous value.
+	initialEdramTrans = sceGeEdramSetAddrTranslation(0);
+	sceGeEdramSetAddrTranslation(initialEdramTrans);
+}
+
+static void resetState() {
+	memset((void *)0x04000000, 0, 0x00200000);
+	sceKernelDcacheWritebackInvalidateAll();
+	sceGeRestoreContext(&initialContext);
+	// Dumps can change this with EDRAMTRANS.
+	sceGeEdramSetAddrTranslation(initialEdramTrans);
+	sceDisplaySetFrameBuf(initialTopaddr, initialBufferwidth, initialPixelformat, 1);
+	sceDisplaySetFrameBuf(initialTopaddr, initialBufferwidth, initialPixelformat, 0);
 }
 
 extern int HAS_DISPLAY;
 
+struct PlaybackOptions {
+	const char *filename;
+	int start;
+	int end;
+	u32 budget;
+	u32 profileEvents;
+	u32 bisectCheckpoints;
+	// Whether --start, --end, or --profile was given, since flat lists ignore them.
+	bool rangeOrProfile;
+};
+
+static bool parseOption(PlaybackOptions &opts, const char *arg) {
+	if (!strncmp(arg, "--start=", strlen("--start="))) {
+		opts.start = atoi(arg + strlen("--start="));
+		opts.rangeOrProfile = true;
+		return true;
+	}
+	if (!strncmp(arg, "--end=", strlen("--end="))) {
+		opts.end = atoi(arg + strlen("--end="));
+		opts.rangeOrProfile = true;
+		return true;
+	}
+	if (!strncmp(arg, "--budget=", strlen("--budget="))) {
+		opts.budget = atoi(arg + strlen("--budget=")) * 1024;
+		return true;
+	}
+	if (!strcmp(arg, "--bisect")) {
+		opts.bisectCheckpoints = 4;
+		return true;
+	}
+	if (!strncmp(arg, "--bisect=", strlen("--bisect="))) {
+		opts.bisectCheckpoints = atoi(arg + strlen("--bisect="));
+		return true;
+	}
+	if (!strcmp(arg, "--profile")) {
+		opts.profileEvents = 32768;
+		opts.rangeOrProfile = true;
+		return true;
+	}
+	if (!strncmp(arg, "--profile=", strlen("--profile="))) {
+		opts.profileEvents = atoi(arg + strlen("--profile="));
+		opts.rangeOrProfile = true;
+		return true;
+	}
+	return false;
+}
+
+static bool runFlatList(const PlaybackOptions &opts) {
+	FlatList flat;
+	bool valid = flat.Load(opts.filename);
+	printf("VALID: %d\n", valid);
+	if (opts.rangeOrProfile) {
+		printf("WARNING: --start, --end, and --profile are ignored for flat lists\n");
+	}
+
+	u64 start = sceKernelGetSystemTimeWide();
+	bool result = valid && flat.Run();
+	printf("RUN: %d\n", result);
+	printf("FLAT: %d prims, %d us\n", flat.Prims(), (int)(sceKernelGetSystemTimeWide() - start));
+	return result;
+}
+
+static bool runReplay(const PlaybackOptions &opts, const char *profile) {
+	Replay replay(opts.filename, opts.budget);
+	replay.SetRange(opts.start, opts.end);
+	if (opts.profileEvents != 0) {
+		replay.EnableProfile(opts.profileEvents);
+	}
+	printf("VALID: %d\n", replay.Valid());
+	printf("STREAMING: %d\n", replay.Streaming());
+	bool result = replay.Run();
+	printf("RUN: %d\n", result);
+
+	const ReplayStats &stats = replay.Stats();
+	printf("GE SYNC: %d waits, %d us\n", stats.syncStalls, (int)stats.syncStallUs);
+	printf("GE RING: %d waits, %d us, %d segments\n", stats.ringWaits, (int)stats.ringWaitUs, stats.segments);
+	if (opts.profileEvents != 0) {
+		printf("PROFILE: %d\n", replay.WriteProfile(profile));
+	}
+	return result;
+}
+
+static bool runDump(const PlaybackOptions &opts, const char *screenshot, const char *profile) {
+	bool result = IsFlatList(opts.filename) ? runFlatList(opts) : runReplay(opts, profile);
+
+	uint topaddr;
+	int bufferwidth;
+	int pixelformat;
+
+	sceDisplayGetFrameBuf((void **)&topaddr, &bufferwidth, &pixelformat, 0);
+	printf("SCREENSHOT: %08x, %d, %d\n", topaddr, bufferwidth, pixelformat);
+
+	emulatorEmitScreenshotTo(screenshot);
+	return result;
+}
+
+static bool writeText(const char *filename, const char *text) {
+	SceUID fd = sceIoOpen(filename, PSP_O_WRONLY | PSP_O_CREAT | PSP_O_TRUNC, 0777);
+	if (fd < 0) {
+		return false;
+	}
+	int len = strlen(text);
+	bool success = sceIoWrite(fd, text, len) == len;
+	sceIoClose(fd);
+	return success;
+}
+
+static const int BISECT_TIMEOUT_SECONDS = 120;
+
+// Writes the screenshot and waits for ppdmp-bisect (in utils/ppdmp-tools) to compare it.
+// Returns 1 if it matched the reference, 0 if not, or -1 if there was no answer.
+static int askBisect(int end) {
+	char screenshot[64];
+	char answer[64];
+	char text[32];
+	snprintf(screenshot, sizeof(screenshot), "host0:/__bisect_%d.bmp", end);
+	snprintf(answer, sizeof(answer), "host0:/__bisect_%d.txt", end);
+	snprintf(text, sizeof(text), "%d\n", end);
+
+	sceIoRemove(answer);
+	emulatorEmitScreenshotTo(screenshot);
+	// Only written once the screenshot is complete.
+	writeText("host0:/__bisect_next.txt", text);
+
+	for (int i = 0; i < BISECT_TIMEOUT_SECONDS * 10; ++i) {
+		SceUID fd = sceIoOpen(answer, PSP_O_RDONLY, 0777);
+		if (fd >= 0) {
+			char c = 0;
+			int len = sceIoRead(fd, &c, 1);
+			sceIoClose(fd);
+			if (len == 1) {
+				return c == 'g' ? 1 : 0;
+			}
+		}
+		sceKernelDelayThread(100000);
+	}
+
+	printf("ERROR: No answer for %s, is ppdmp-bisect running?\n", screenshot);
+	return -1;
+}
+
+// Prims up to good match the reference and up to bad don't, so the first wrong prim is
+// found in log2(prims) screenshots.  Each one starts from the nearest checkpoint.
+static int runBisect(const PlaybackOptions &opts) {
+	Replay replay(opts.filename, opts.budget);
+	printf("VALID: %d\n", replay.Valid());
+	if (!replay.Valid() || !replay.EnableCheckpoints(opts.bisectCheckpoints)) {
+		return 1;
+	}
+
+	// The first run draws everything and saves the checkpoints.
+	bool result = replay.Run();
+	printf("RUN: %d\n", result);
+	if (!result) {
+		return 1;
+	}
+
+	int good = 0;
+	int bad = replay.TotalPrims();
+	int answer = askBisect(bad);
+	if (answer < 0) {
+		return 1;
+	}
+
+	char text[32];
+	if (answer == 1) {
+		printf("BISECT: All %d prims match\n", bad);
+		writeText("host0:/__bisect_next.txt", "none\n");
+		return 0;
+	}
+
+	while (bad - good > 1) {
+		int mid = good + (bad - good) / 2;
+		if (!replay.RunPrefix(mid)) {
+			return 1;
+		}
+		printf("BISECT: %d-%d, drew to %d in %d us\n", good + 1, bad, mid, (int)replay.Stats().runUs);
+
+		answer = askBisect(mid);
+		if (answer < 0) {
+			return 1;
+		}
+		if (answer == 1) {
+			good = mid;
+		} else {
+			bad = mid;
+		}
+	}
+
+	printf("BISECT: First bad prim %d\n", bad);
+	snprintf(text, sizeof(text), "first %d\n", bad);
+	writeText("host0:/__bisect_next.txt", text);
+	return 0;
+}
+
+static char *readManifest(const char *filename) {
+	SceUID fd = sceIoOpen(filename, PSP_O_RDONLY, 0777);
+	if (fd < 0) {
+		return NULL;
+	}
+
+	int size = sceIoLseek32(fd, 0, PSP_SEEK_END);
+	sceIoLseek32(fd, 0, PSP_SEEK_SET);
+	char *text = size >= 0 ? (char *)malloc(size + 1) : NULL;
+	if (text != NULL && sceIoRead(fd, text, size) == size) {
+		text[size] = '\0';
+	} else {
+		free(text);
+		text = NULL;
+	}
+	sceIoClose(fd);
+	return text;
+}
+
+// Each line of the manifest is a dump filename, optionally followed by options.
+// Screenshots are numbered by line, skipping blank lines and # comments.
+static int runBatch(const char *manifest, const PlaybackOptions &defaults) {
+	char *text = readManifest(manifest);
+	if (text == NULL) {
+		printf("ERROR: Unable to read batch manifest %s\n", manifest);
+		return 1;
+	}
+
+	int count = 0;
+	int failed = 0;
+	for (char *line = strtok(text, "\r\n"); line != NULL; line = strtok(NULL, "\r\n")) {
+		// strtok can't be nested, so split the line by hand.
+		char *args[16];
+		int argCount = 0;
+		for (char *p = line; *p != '\0' && argCount < 16; ) {
+			while (*p == ' ' || *p == '\t') {
+				*p++ = '\0';
+			}
+			if (*p == '\0' || *p == '#') {
+				break;
+			}
+			args[argCount++] = p;
+			while (*p != '\0' && *p != ' ' && *p != '\t') {
+				++p;
+			}
+		}
+		if (argCount == 0) {
+			continue;
+		}
+
+		PlaybackOptions opts = defaults;
+		opts.filename = args[0];
+		for (int i = 1; i < argCount; ++i) {
+			if (!parseOption(opts, args[i])) {
+				printf("WARNING: Ignoring unknown option %s for %s\n", args[i], opts.filename);
+			}
+		}
+
+		++count;
+		char screenshot[64];
+		char profile[64];
+		snprintf(screenshot, sizeof(screenshot), "host0:/__screenshot_%03d.bmp", count);
+		snprintf(profile, sizeof(profile), "host0:/__profile_%03d.bin", count);
+
+		printf("BATCH %d: %s\n", count, opts.filename);
+		resetState();
+		if (!runDump(opts, screenshot, profile)) {
+			++failed;
+		}
+	}
+
+	free(text);
+	printf("BATCH DONE: %d dumps, %d failed\n", count, failed);
+	return failed == 0 ? 0 : 1;
+}
+
 extern "C" int main(int argc, char *argv[]) {
 	init();
 	HAS_DISPLAY = 0;
 
-	const char *filename = "host0:/framedump.ppdmp";
+	PlaybackOptions opts;
+	opts.filename = "host0:/framedump.ppdmp";
+	opts.start = 1;
+	opts.end = 0x7FFFFFFF;
+	opts.budget = REPLAY_DEFAULT_BUDGET;
+	opts.profileEvents = 0;
+	opts.bisectCheckpoints = 0;
+	opts.rangeOrProfile = false;
+	const char *batch = NULL;
 	bool set_filename = false;
-	int start = 1;
-	int end = 0x7FFFFFFF;
 
 	for (int i = 1; i < argc; ++i) {
 		if (argv[i][0] == '-') {
-			if (!strncmp(argv[i], "--start=", strlen("--start="))) {
-				start = atoi(argv[i] + strlen("--start="));
+			if (parseOption(opts, argv[i])) {
 				continue;
 			}
-			if (!strncmp(argv[i], "--end=", strlen("--end="))) {
-				end = atoi(argv[i] + strlen("--end="));
+			if (!strncmp(argv[i], "--batch=", strlen("--batch="))) {
+				batch = argv[i] + strlen("--batch=");
 				continue;
 			}
 		}
 
 		if (set_filename) {
 			printf("Unexpected argument %s\n", argv[i]);
-			printf("Usage: playback.prx filename [--start=1] [--end=1000]\n");
+			printf("Usage: playback.prx filename [--start=1] [--end=1000] [--budget=16384] [--profile=32768]\n");
+			printf("       playback.prx --batch=host0:/batch.txt [--budget=16384] [--profile=32768]\n");
+			printf("       playback.prx filename --bisect[=4]\n");
 			return 1;
 		}
 
-		filename = argv[i];
+		opts.filename = argv[i];
 		set_filename = true;
 	}
 
-	Replay replay(filename);
-	replay.SetRange(start, end);
-	printf("VALID: %d\n", replay.Valid());
-	printf("RUN: %d\n", replay.Run());
-
-	uint topaddr;
-	int bufferwidth;
-	int pixelformat;
-
-	sceDisplayGetFrameBuf((void **)&topaddr, &bufferwidth, &pixelformat, 0);
-	printf("SCREENSHOT: %08x, %d, %d\n", topaddr, bufferwidth, pixelformat);
-
-	emulatorEmitScreenshot();
+	int result = 0;
+	if (batch != NULL) {
+		result = runBatch(batch, opts);
+	} else if (opts.bisectCheckpoints != 0) {
+		result = runBisect(opts);
+	} else {
+		runDump(opts, "host0:/__screenshot.bmp", "host0:/__profile.bin");
+	}
 
 	sceGuTerm();
 
-	return 0;
-}
\ No newline at end of file
+	return result;
+}
@@ -0,0 +1,61 @@
+#include <string.h>
+#include "snappy/snappy-c.h"
+#include "zstd/lib/zstd.h"
+#include "commands.h"
+#include "ppdmp.h"
+
+bool ReadDumpHeader(DumpReadFunc read, void *ctx, DumpHeader &header) {
+	memset(&header, 0, sizeof(header));
+	if (read(ctx, &header.version, sizeof(header.version)) != sizeof(header.version)) {
+		return false;
+	}
+	if (header.version < DUMP_MIN_VERSION || header.version > DUMP_MAX_VERSION) {
+		return false;
+	}
+	if (header.version >= 4 && read(ctx, header.header2, sizeof(header.header2)) != sizeof(header.header2)) {
+		return false;
+	}
+	if (read(ctx, &header.cmdCount, sizeof(header.cmdCount)) != sizeof(header.cmdCount)) {
+		return false;
+	}
+	return read(ctx, &header.bufSize, sizeof(header.bufSize)) == sizeof(header.bufSize);
+}
+
+bool DecompressDumpData(int version, const void *src, uint32_t srcSize, void *dest, uint32_t destSize) {
+	size_t realSize = destSize;
+	if (version < 5) {
+		if (snappy_uncompress((const char *)src, srcSize, (char *)dest, &realSize) != SNAPPY_OK) {
+			return false;
+		}
+	} else {
+		realSize = ZSTD_decompress(dest, realSize, src, srcSize);
+	}
+	return realSize == destSize;
+}
+
+const char *CommandTypeName(uint8_t type) {
+	static const char *names[] = {
+		"INIT", "REGISTERS", "VERTICES", "INDICES", "CLUT", "TRANSFERSRC", "MEMSET", "MEMCPYDEST",
+		"MEMCPYDATA", "DISPLAY", "CLUTADDR", "EDRAMTRANS", NULL, NULL, NULL, NULL,
+		"TEXTURE0", "TEXTURE1", "TEXTURE2", "TEXTURE3", "TEXTURE4", "TEXTURE5", "TEXTURE6", "TEXTURE7",
+		"FRAMEBUF0", "FRAMEBUF1", "FRAMEBUF2", "FRAMEBUF3", "FRAMEBUF4", "FRAMEBUF5", "FRAMEBUF6", "FRAMEBUF7",
+	};
+	if (type < sizeof(names) / sizeof(names[0]) && names[type] != NULL) {
+		return names[type];
+	}
+	return "UNKNOWN";
+}
+
+bool IsPrimCommand(uint32_t op) {
+	return op == GE_CMD_PRIM || op == GE_CMD_BEZIER || op == GE_CMD_SPLINE || op == GE_CMD_VAP;
+}
+
+uint32_t CountPrims(const uint32_t *words, uint32_t count) {
+	uint32_t prims = 0;
+	for (uint32_t i = 0; i < count; ++i) {
+		if (IsPrimCommand(words[i] >> 24)) {
+			prims++;
+		}
+	}
+	return prims;
+}
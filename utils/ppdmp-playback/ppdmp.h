@@ -0,0 +1,203 @@
+#pragma once
+
+#include <stdint.h>
+
+// Frame dump file layout, shared by the playback PRX and host tools.
+
+#pragma pack(push, 1)
+
+struct CommandType {
+	enum Value {
+		INIT = 0,
+		REGISTERS = 1,
+		VERTICES = 2,
+		INDICES = 3,
+		CLUT = 4,
+		TRANSFERSRC = 5,
+		MEMSET = 6,
+		MEMCPYDEST = 7,
+		MEMCPYDATA = 8,
+		DISPLAY = 9,
+		CLUTADDR = 10,
+		EDRAMTRANS = 11,
+
+		TEXTURE0 = 0x10,
+		TEXTURE1 = 0x11,
+		TEXTURE2 = 0x12,
+		TEXTURE3 = 0x13,
+		TEXTURE4 = 0x14,
+		TEXTURE5 = 0x15,
+		TEXTURE6 = 0x16,
+		TEXTURE7 = 0x17,
+
+		FRAMEBUF0 = 0x18,
+		FRAMEBUF1 = 0x19,
+		FRAMEBUF2 = 0x1A,
+		FRAMEBUF3 = 0x1B,
+		FRAMEBUF4 = 0x1C,
+		FRAMEBUF5 = 0x1D,
+		FRAMEBUF6 = 0x1E,
+		FRAMEBUF7 = 0x1F,
+	};
+};
+
+struct Command {
+	uint8_t type;
+	uint32_t sz;
+	uint32_t ptr;
+};
+
+// Seekable dumps split the commands into chunks that can each be played alone.
+// The file starts with SeekableHeader and a SeekableChunk table.  Each stream is
+// a zstd compressed command table and buffer, laid out like in a regular dump.
+static const char SEEKABLE_MAGIC[8] = { 'P', 'P', 'G', 'E', 'S', 'E', 'E', 'K' };
+static const uint32_t SEEKABLE_VERSION = 1;
+
+struct SeekableHeader {
+	char magic[8];
+	uint32_t version;
+	// Version and extra header of the dump this was made from.
+	uint32_t dumpVersion;
+	uint8_t dumpHeader2[12];
+	uint32_t chunkCount;
+	uint32_t primCount;
+};
+
+struct SeekableChunk {
+	// Prims in all chunks before this one.
+	uint32_t primStart;
+	uint32_t primCount;
+	// Leading commands that restore the GE state and data from previous chunks.
+	uint32_t prologueCmds;
+
+	// All commands, used when any prim in the chunk is drawn.
+	uint32_t cmdCount;
+	uint32_t bufSize;
+	uint32_t offset;
+
+	// Only the commands that write memory or change the display, used otherwise.
+	uint32_t memCmdCount;
+	uint32_t memBufSize;
+	uint32_t memOffset;
+};
+
+// Written by playback.prx --profile, see ppdmp-profile in utils/ppdmp-tools.
+// A ProfileHeader, followed by eventCount ProfileEvents, one per command run.
+static const char PROFILE_MAGIC[8] = { 'P', 'P', 'G', 'E', 'P', 'R', 'O', 'F' };
+static const uint32_t PROFILE_VERSION = 1;
+
+struct ProfileHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t eventCount;
+	// Commands that ran after the event buffer was full.
+	uint32_t droppedEvents;
+	uint32_t prims;
+	uint64_t runUs;
+	uint32_t syncStalls;
+	uint64_t syncStallUs;
+	uint32_t ringWaits;
+	uint64_t ringWaitUs;
+	uint64_t dmaBytes;
+};
+
+struct ProfileEvent {
+	// In the order run, which includes chunk prologues for seekable dumps.
+	uint32_t index;
+	uint8_t type;
+	uint8_t syncs;
+	uint16_t pad;
+	uint32_t sz;
+	// Time in the handler, not counting waits for the GE.
+	uint32_t cpuUs;
+	// Time waiting for the GE to drain or free list space.
+	uint32_t syncUs;
+	// Time the GE took to draw this command's prims, measured by syncing after it.
+	uint32_t geUs;
+	uint32_t dmaBytes;
+	uint32_t primStart;
+	uint32_t primCount;
+};
+
+// Written by ppdmp-flatten in utils/ppdmp-tools: a regular dump resolved ahead of time into a
+// single GE display list, so it can be enqueued at once (see flatlist.h.)  A FlatHeader, then
+// listWords GE words, relocCount FlatRelocs, opCount FlatOps, and dataSize bytes of data.
+// Each section starts 16 byte aligned.
+static const char FLAT_MAGIC[8] = { 'P', 'P', 'G', 'E', 'F', 'L', 'A', 'T' };
+static const uint32_t FLAT_VERSION = 1;
+
+struct FlatHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t listWords;
+	uint32_t relocCount;
+	uint32_t opCount;
+	uint32_t dataSize;
+	uint32_t prims;
+};
+
+struct FlatRelocType {
+	enum Value {
+		// Adds the low 24 bits of the data address, for VADDR, TEXADDR, etc.
+		LOW = 0,
+		// Adds bits 24-31 of the data address at bit 16, for BASE, TEXBUFWIDTH, etc.
+		HIGH = 1,
+	};
+};
+
+static const uint32_t FLAT_RELOC_WORD_MASK = 0x0FFFFFFF;
+static const int FLAT_RELOC_TYPE_SHIFT = 28;
+
+struct FlatReloc {
+	// Index into the list, with the FlatRelocType in the top bits.
+	uint32_t word;
+	// Offset into the data.
+	uint32_t offset;
+};
+
+// Things the GE can't do itself, run by the CPU once the GE has drawn everything before listPos.
+struct FlatOpType {
+	enum Value {
+		// dest, value, sz.
+		MEMSET = 0,
+		// dest, data offset, sz.
+		MEMCPY = 1,
+		// topaddr, linesize, pixelFormat.
+		DISPLAY = 2,
+		// value.
+		EDRAMTRANS = 3,
+		// PspGeContext data offset, for sceGeRestoreContext.
+		INIT = 4,
+	};
+};
+
+struct FlatOp {
+	uint32_t type;
+	uint32_t listPos;
+	uint32_t args[3];
+};
+
+#pragma pack(pop)
+
+static const char DUMP_MAGIC[8] = { 'P', 'P', 'S', 'S', 'P', 'P', 'G', 'E' };
+static const int DUMP_MIN_VERSION = 2;
+static const int DUMP_MAX_VERSION = 6;
+
+// Everything after the magic, up to the compressed command table.
+struct DumpHeader {
+	int32_t version;
+	uint8_t header2[12];
+	uint32_t cmdCount;
+	uint32_t bufSize;
+};
+
+// Reads sz bytes into dest, and returns how many were read.
+typedef int (*DumpReadFunc)(void *ctx, void *dest, uint32_t sz);
+
+bool ReadDumpHeader(DumpReadFunc read, void *ctx, DumpHeader &header);
+// Snappy before version 5, zstd after.  Fails unless exactly destSize bytes come out.
+bool DecompressDumpData(int version, const void *src, uint32_t srcSize, void *dest, uint32_t destSize);
+
+const char *CommandTypeName(uint8_t type);
+bool IsPrimCommand(uint32_t op);
+uint32_t CountPrims(const uint32_t *words, uint32_t count);
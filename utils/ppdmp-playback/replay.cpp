@@ -3,9 +3,9 @@
 #include <pspiofilemgr.h>
 #include <pspthreadman.h>
 #include <psputils.h>
+#include <malloc.h>
 #include <stdio.h>
 #include <string.h>
-#include "snappy/snappy-c.h"
 #include "zstd/lib/zstd.h"
 #include "commands.h"
 #include "replay.h"
@@ -13,10 +13,47 @@
 extern "C" int sceDmacMemcpy(void *dest, const void *source, unsigned int size);
 
 static const int LIST_BUF_SIZE = 256 * 1024;
+// The CPU fills one segment while the GE runs the others.
+static const int LIST_SEGMENTS = 4;
+static const int LIST_SEGMENT_SIZE = LIST_BUF_SIZE / LIST_SEGMENTS;
+// Room to close a segment: SIGNAL, END, BASE, JUMP.
+static const int LIST_SEGMENT_RESERVE = 4 * 4;
+static const u32 SIGNAL_HANDLER_CONTINUE = 0x02;
+// Dumps can have their own signals, so the segment ends use an id to tell them apart.
+static const int SEGMENT_SIGNAL_ID = 0x5E61;
+static void *const VRAM_BASE = (void *)0x04000000;
+static const u32 VRAM_SIZE = 2 * 1024 * 1024;
+
+static void SegmentSignal(int id, void *arg) {
+	// Called from the GE interrupt, as each segment finishes.
+	if (id != SEGMENT_SIGNAL_ID) {
+		return;
+	}
+	volatile u32 *done = (volatile u32 *)arg;
+	*done = *done + 1;
+}
+
+static int ReadFile(void *ctx, void *dest, uint32_t sz) {
+	return sceIoRead(*(int *)ctx, dest, sz);
+}
 
-Replay::Replay(const char *filename)
-	: valid_(true), execMemcpyDest(0), execClutAddr(0), execListBuf(0), execListPos(0), execListID(0) {
+Replay::Replay(const char *filename, u32 budget)
+	: valid_(true), window_(0), windowStart_(0), windowEnd_(0), windowCapacity_(0), bufSize_(0), shared_(0), sharedSize_(0),
+	  dstream_(0), bufFileOffset_(0), bufCompressedSize_(0), compressedLeft_(0), inBuf_(0), inBufSize_(0), inBufPos_(0), inBufFill_(0),
+	  execMemcpyDest(0), execClutAddr(0), execListBuf(0), execListPos(0), execListID(0),
+	  geCallback_(-1), segmentsClosed_(0), segmentsDone_(0), segmentEnd_(0), listPublished_(0),
+	  profile_(0), profileCapacity_(0), profileCount_(0), profileDropped_(0), cmdIndex_(0),
+	  maxCheckpoints_(0), totalPrims_(0), checkpointInterval_(0), nextCheckpoint_(0) {
 	memset(lastBufw_, 0, sizeof(lastBufw_));
+	memset(&stats_, 0, sizeof(stats_));
+	memset(&liveVerts_, 0, sizeof(liveVerts_));
+	memset(&liveInds_, 0, sizeof(liveInds_));
+	memset(&liveClut_, 0, sizeof(liveClut_));
+	memset(&liveTransferSrc_, 0, sizeof(liveTransferSrc_));
+	memset(liveTex_, 0, sizeof(liveTex_));
+	primStart_ = 0;
+	primEnd_ = 0x7FFFFFFF;
+
 	fd_ = sceIoOpen(filename, PSP_O_RDONLY, 0777);
 	if (fd_ <= 0) {
 		valid_ = false;
@@ -24,38 +61,126 @@ Replay::Replay(const char *filename)
 	}
 
 	uint8_t header[8] = { 0 };
-	int32_t version = 0;
-	uint8_t header2[12] = { 0 };
 	valid_ = valid_ && sceIoRead(fd_, header, sizeof(header)) == sizeof(header);
-	valid_ = valid_ && sceIoRead(fd_, &version, sizeof(version)) == sizeof(version);
-	if (version >= 4) {
-		valid_ = valid_ && sceIoRead(fd_, header2, sizeof(header2)) == sizeof(header2);
+	if (valid_ && memcmp(SEEKABLE_MAGIC, header, sizeof(header)) == 0) {
+		valid_ = ReadSeekableIndex();
+		// Chunks are read from the file as Run() needs them.
+		return;
 	}
 
-	static const char *HEADER = "PPSSPPGE";
-	static const int MIN_VERSION = 2;
-	static const int MAX_VERSION = 6;
+	DumpHeader info;
+	memset(&info, 0, sizeof(info));
+	valid_ = valid_ && memcmp(DUMP_MAGIC, header, sizeof(header)) == 0;
+	valid_ = valid_ && ReadDumpHeader(&ReadFile, &fd_, info);
 
-	valid_ = valid_ && memcmp(HEADER, header, sizeof(header)) == 0;
-	valid_ = valid_ && version >= MIN_VERSION && version <= MAX_VERSION;
+	const int version = info.version;
+	const uint32_t bufsz = info.bufSize;
+	if (valid_) {
+		cmds_.resize(info.cmdCount);
+	}
+
+	valid_ = valid_ && ReadCompressed(cmds_.data(), sizeof(Command) * info.cmdCount, version);
+	bufSize_ = bufsz;
+
+	// Only zstd (version 5+) can be streamed, snappy dumps are always read whole.
+	if (valid_ && version >= 5 && bufsz > budget) {
+		valid_ = BeginStream(budget);
+		// Keep the file open, we read from it as Run() progresses.
+		return;
+	}
 
-	uint32_t cmdnum = 0, bufsz = 0;
-	valid_ = valid_ && sceIoRead(fd_, &cmdnum, sizeof(cmdnum)) == sizeof(cmdnum);
-	valid_ = valid_ && sceIoRead(fd_, &bufsz, sizeof(bufsz)) == sizeof(bufsz);
 	if (valid_) {
-		cmds_.resize(cmdnum);
 		buf_.resize(bufsz);
 	}
-
-	valid_ = valid_ && ReadCompressed(cmds_.data(), sizeof(Command) * cmdnum, version);
 	valid_ = valid_ && ReadCompressed(buf_.data(), bufsz, version);
 
 	sceKernelDcacheWritebackInvalidateRange(buf_.data(), bufsz);
 
+	window_ = buf_.data();
+	windowEnd_ = bufsz;
+	windowCapacity_ = bufsz;
+
 	sceIoClose(fd_);
+	fd_ = -1;
+}
 
-	primStart_ = 0;
-	primEnd_ = 0x7FFFFFFF;
+bool Replay::ReadSeekableIndex() {
+	SeekableHeader header;
+	const u32 rest = sizeof(header) - sizeof(header.magic);
+	if (sceIoRead(fd_, (u8 *)&header + sizeof(header.magic), rest) != (int)rest) {
+		return false;
+	}
+	if (header.version != SEEKABLE_VERSION) {
+		printf("ERROR: Unsupported seekable dump version %d\n", header.version);
+		return false;
+	}
+
+	chunks_.resize(header.chunkCount);
+	const u32 tableSize = sizeof(SeekableChunk) * header.chunkCount;
+	return sceIoRead(fd_, chunks_.data(), tableSize) == (int)tableSize;
+}
+
+bool Replay::LoadChunk(u32 offset, u32 cmdCount, u32 bufSize) {
+	// Anything pending or drawing may point into the previous chunk.
+	SubmitCmds(0, 0);
+	SyncStall();
+	DropLiveRef(liveVerts_);
+	DropLiveRef(liveInds_);
+	DropLiveRef(liveClut_);
+	DropLiveRef(liveTransferSrc_);
+	for (int level = 0; level < 8; ++level) {
+		DropLiveRef(liveTex_[level]);
+	}
+
+	if (sceIoLseek32(fd_, offset, PSP_SEEK_SET) != (int)offset) {
+		return false;
+	}
+
+	cmds_.resize(cmdCount);
+	buf_.resize(bufSize);
+	// Seekable streams are always zstd, which is version 5 and up.
+	if (!ReadCompressed(cmds_.data(), sizeof(Command) * cmdCount, 5) || !ReadCompressed(buf_.data(), bufSize, 5)) {
+		return false;
+	}
+	sceKernelDcacheWritebackInvalidateRange(buf_.data(), bufSize);
+
+	window_ = buf_.data();
+	windowStart_ = 0;
+	windowEnd_ = bufSize;
+	windowCapacity_ = bufSize;
+	bufSize_ = bufSize;
+	return true;
+}
+
+bool Replay::RunSeekable() {
+	prims_ = 0;
+	for (size_t i = 0; i < chunks_.size(); ++i) {
+		const SeekableChunk &chunk = chunks_[i];
+		const bool draw = chunk.primCount != 0 && (int)(chunk.primStart + chunk.primCount) >= primStart_ && (int)chunk.primStart < primEnd_;
+
+		// Outside the range, only the memory writes matter, just like NOPed prims.
+		bool loaded;
+		if (draw) {
+			loaded = LoadChunk(chunk.offset, chunk.cmdCount, chunk.bufSize);
+		} else {
+			loaded = LoadChunk(chunk.memOffset, chunk.memCmdCount, chunk.memBufSize);
+		}
+		if (!loaded) {
+			printf("ERROR: Unable to read chunk %d\n", (int)i);
+			return false;
+		}
+
+		prims_ = chunk.primStart;
+		for (size_t j = 0; j < cmds_.size(); ++j) {
+			if (!RunCommand(cmds_[j])) {
+				return false;
+			}
+		}
+		prims_ = chunk.primStart + chunk.primCount;
+	}
+
+	SubmitListEnd();
+	return true;
 }
 
 bool Replay::ReadCompressed(void *dest, size_t sz, uint32_t version) {
@@ -70,117 +195,579 @@ bool Replay::ReadCompressed(void *dest, size_t sz, uint32_t version) {
 		return false;
 	}
 
-	size_t real_size = sz;
-	if (version < 5)
-		snappy_uncompress((const char *)compressed, compressed_size, (char *)dest, &real_size);
-	else
-		real_size = ZSTD_decompress(dest, real_size, compressed, compressed_size);
+	bool success = DecompressDumpData(version, compressed, compressed_size, dest, (uint32_t)sz);
 	delete [] compressed;
 
-	return real_size == sz;
+	return success;
 }
 
-bool Replay::Run() {
-	if (!Valid()) {
+u32 Replay::FindSharedEnd() const {
+	// Data used again after later data, like ppdmp-dedup writes at the start of the buffer.
+	u32 highest = 0;
+	u32 end = 0;
+	for (size_t i = 0; i < cmds_.size(); ++i) {
+		const Command &cmd = cmds_[i];
+		if (cmd.sz != 0 && cmd.ptr < highest && cmd.ptr + cmd.sz > end) {
+			end = cmd.ptr + cmd.sz;
+		}
+		if (cmd.ptr > highest) {
+			highest = cmd.ptr;
+		}
+	}
+
+	// Nothing may straddle the end, BufPtr() only checks the start.
+	for (bool grew = end != 0; grew; ) {
+		grew = false;
+		for (size_t i = 0; i < cmds_.size(); ++i) {
+			const Command &cmd = cmds_[i];
+			if (cmd.ptr < end && cmd.ptr + cmd.sz > end) {
+				end = cmd.ptr + cmd.sz;
+				grew = true;
+			}
+		}
+	}
+	return end;
+}
+
+bool Replay::BeginStream(u32 budget) {
+	if (sceIoRead(fd_, &bufCompressedSize_, sizeof(bufCompressedSize_)) != sizeof(bufCompressedSize_)) {
 		return false;
 	}
+	bufFileOffset_ = sceIoLseek32(fd_, 0, PSP_SEEK_CUR);
 
-	prims_ = 0;
-	for (size_t i = 0; i < cmds_.size(); ++i) {
-		const Command &cmd = cmds_[i];
-		switch (cmd.type) {
-		case CommandType::INIT:
-			Init(cmd.ptr, cmd.sz);
-			break;
+	// Going back to shared data would restart the stream, so keep it if it's small enough.
+	u32 shared = FindSharedEnd();
+	if (shared > budget / 2) {
+		shared = 0;
+	}
 
-		case CommandType::REGISTERS:
-			Registers(cmd.ptr, cmd.sz);
-			break;
+	// Keep 16 byte alignment the same as in the dump, textures and CLUTs need it.
+	windowCapacity_ = (budget - shared) & ~15;
+	window_ = (u8 *)memalign(16, windowCapacity_);
+	inBufSize_ = (u32)ZSTD_DStreamInSize();
+	inBuf_ = new u8[inBufSize_];
+	dstream_ = ZSTD_createDStream();
+	if (shared != 0) {
+		shared_ = (u8 *)memalign(16, shared);
+	}
+	if (window_ == 0 || dstream_ == 0 || (shared != 0 && shared_ == 0)) {
+		printf("ERROR: Unable to allocate %d bytes for streaming\n", budget);
+		return false;
+	}
 
-		case CommandType::VERTICES:
-			Vertices(cmd.ptr, cmd.sz);
-			break;
+	if (!RestartStream()) {
+		return false;
+	}
 
-		case CommandType::INDICES:
-			Indices(cmd.ptr, cmd.sz);
-			break;
+	// Copy the shared data out as it streams past, then the window moves on as usual.
+	for (u32 pos = 0; pos < shared; pos = windowEnd_ < shared ? windowEnd_ : shared) {
+		if (!SlideWindow(pos) || !DecompressTo(pos + 1)) {
+			return false;
+		}
+		u32 end = windowEnd_ < shared ? windowEnd_ : shared;
+		memcpy(shared_ + pos, window_ + (pos - windowStart_), end - pos);
+	}
+	sceKernelDcacheWritebackInvalidateRange(shared_, shared);
+	sharedSize_ = shared;
+	return true;
+}
 
-		case CommandType::CLUTADDR:
-			ClutAddr(cmd.ptr, cmd.sz);
-			break;
+bool Replay::RestartStream() {
+	if (sceIoLseek32(fd_, bufFileOffset_, PSP_SEEK_SET) != bufFileOffset_) {
+		return false;
+	}
+	if (ZSTD_isError(ZSTD_initDStream(dstream_))) {
+		return false;
+	}
 
-		case CommandType::CLUT:
-			Clut(cmd.ptr, cmd.sz);
-			break;
+	compressedLeft_ = bufCompressedSize_;
+	inBufPos_ = 0;
+	inBufFill_ = 0;
+	windowStart_ = 0;
+	windowEnd_ = 0;
+	return true;
+}
 
-		case CommandType::TRANSFERSRC:
-			TransferSrc(cmd.ptr, cmd.sz);
-			break;
+bool Replay::DecompressTo(u32 end) {
+	// Avoid tiny reads, but never past the window or the buffer.
+	static const u32 MIN_DECOMPRESS = 64 * 1024;
+	u32 target = end < windowEnd_ + MIN_DECOMPRESS ? windowEnd_ + MIN_DECOMPRESS : end;
+	if (target > windowStart_ + windowCapacity_)
+		target = windowStart_ + windowCapacity_;
+	if (target > bufSize_)
+		target = bufSize_;
+
+	ZSTD_outBuffer output = { window_ + (windowEnd_ - windowStart_), target - windowEnd_, 0 };
+	while (output.pos < output.size) {
+		if (inBufPos_ == inBufFill_) {
+			if (compressedLeft_ == 0) {
+				break;
+			}
+			u32 chunk = compressedLeft_ < inBufSize_ ? compressedLeft_ : inBufSize_;
+			if (sceIoRead(fd_, inBuf_, chunk) != (int)chunk) {
+				break;
+			}
+			compressedLeft_ -= chunk;
+			inBufPos_ = 0;
+			inBufFill_ = chunk;
+		}
 
-		case CommandType::MEMSET:
-			Memset(cmd.ptr, cmd.sz);
+		ZSTD_inBuffer input = { inBuf_, inBufFill_, inBufPos_ };
+		size_t result = ZSTD_decompressStream(dstream_, &output, &input);
+		inBufPos_ = (u32)input.pos;
+		if (ZSTD_isError(result)) {
+			printf("ERROR: Decompression failed: %s\n", ZSTD_getErrorName(result));
 			break;
+		}
+	}
 
-		case CommandType::MEMCPYDEST:
-			MemcpyDest(cmd.ptr, cmd.sz);
-			break;
+	sceKernelDcacheWritebackInvalidateRange(window_ + (windowEnd_ - windowStart_), output.pos);
+	windowEnd_ += (u32)output.pos;
+	return windowEnd_ >= end;
+}
 
-		case CommandType::MEMCPYDATA:
-			Memcpy(cmd.ptr, cmd.sz);
-			break;
+bool Replay::SlideWindow(u32 start) {
+	if (start < windowStart_ && !RestartStream()) {
+		return false;
+	}
 
-		case CommandType::EDRAMTRANS:
-			EdramTrans(cmd.ptr, cmd.sz);
-			break;
+	// Skip over anything before start entirely.
+	while (windowEnd_ < start) {
+		windowStart_ = windowEnd_;
+		if (!DecompressTo(start < windowStart_ + windowCapacity_ ? start : windowStart_ + windowCapacity_)) {
+			return false;
+		}
+	}
 
-		case CommandType::TEXTURE0:
-		case CommandType::TEXTURE1:
-		case CommandType::TEXTURE2:
-		case CommandType::TEXTURE3:
-		case CommandType::TEXTURE4:
-		case CommandType::TEXTURE5:
-		case CommandType::TEXTURE6:
-		case CommandType::TEXTURE7:
-			Texture((int)cmd.type - (int)CommandType::TEXTURE0, cmd.ptr, cmd.sz);
-			break;
+	if (start > windowStart_) {
+		memmove(window_, window_ + (start - windowStart_), windowEnd_ - start);
+		windowStart_ = start;
+		sceKernelDcacheWritebackInvalidateRange(window_, windowEnd_ - windowStart_);
+	}
+	return true;
+}
 
-		case CommandType::FRAMEBUF0:
-		case CommandType::FRAMEBUF1:
-		case CommandType::FRAMEBUF2:
-		case CommandType::FRAMEBUF3:
-		case CommandType::FRAMEBUF4:
-		case CommandType::FRAMEBUF5:
-		case CommandType::FRAMEBUF6:
-		case CommandType::FRAMEBUF7:
-			Framebuf((int)cmd.type - (int)CommandType::FRAMEBUF0, cmd.ptr, cmd.sz);
-			break;
+bool Replay::EnsureResident(u32 ptr, u32 sz) {
+	if (ptr + sz <= sharedSize_ || (ptr >= windowStart_ && ptr + sz <= windowEnd_)) {
+		return true;
+	}
+	if (!Streaming() || ptr + sz > bufSize_ || sz > windowCapacity_) {
+		printf("ERROR: Buffer data %08x (%d bytes) does not fit in memory budget\n", ptr, sz);
+		return false;
+	}
 
-		case CommandType::DISPLAY:
-			Display(cmd.ptr, cmd.sz);
-			break;
+	if (ptr >= windowStart_ && ptr + sz <= windowStart_ + windowCapacity_) {
+		return DecompressTo(ptr + sz);
+	}
+
+	// Keep anything the GE may still read in the window if possible, or else copy it out.
+	u32 start = ptr & ~15;
+	LiveRef *refs[] = { &liveVerts_, &liveInds_, &liveClut_, &liveTransferSrc_, &liveTex_[0], &liveTex_[1], &liveTex_[2], &liveTex_[3], &liveTex_[4], &liveTex_[5], &liveTex_[6], &liveTex_[7] };
+	const size_t refCount = sizeof(refs) / sizeof(refs[0]);
+	for (size_t i = 0; i < refCount; ++i) {
+		if (refs[i]->valid && !refs[i]->copy && refs[i]->ptr >= sharedSize_ && refs[i]->ptr < start && ptr + sz - (refs[i]->ptr & ~15) <= windowCapacity_) {
+			start = refs[i]->ptr & ~15;
+		}
+	}
+	for (size_t i = 0; i < refCount; ++i) {
+		LiveRef &ref = *refs[i];
+		if (!ref.valid || ref.copy || ref.ptr < sharedSize_ || (ref.ptr >= start && ref.ptr + ref.sz <= start + windowCapacity_)) {
+			continue;
+		}
+
+		if (ref.ptr >= windowStart_ && ref.ptr + ref.sz <= windowEnd_) {
+			ref.copy = (u8 *)memalign(16, ref.sz);
+		}
+		if (ref.copy) {
+			memcpy(ref.copy, BufPtr(ref.ptr), ref.sz);
+			sceKernelDcacheWritebackInvalidateRange(ref.copy, ref.sz);
+		} else {
+			printf("WARNING: Out of memory, dropping buffer data at %08x\n", ref.ptr);
+			DropLiveRef(ref);
+		}
+	}
+
+	// The refs kept in the window may end after this data, and they're requeued right away.
+	u32 end = ptr + sz;
+	for (size_t i = 0; i < refCount; ++i) {
+		const LiveRef &ref = *refs[i];
+		if (ref.valid && !ref.copy && ref.ptr >= sharedSize_ && ref.ptr + ref.sz > end) {
+			end = ref.ptr + ref.sz;
+		}
+	}
+
+	// Everything pending refers to the current window, so flush and let the GE finish with it.
+	SubmitCmds(0, 0);
+	SyncStall();
+
+	if (!SlideWindow(start) || !DecompressTo(end)) {
+		return false;
+	}
 
-		default:
-			printf("ERROR: Unsupported GE dump command: %d\n", (int)cmd.type);
+	RequeueLiveRefs();
+	return true;
+}
+
+void Replay::RequeueLiveRefs() {
+	// The data moved, so point the GE state at the new addresses.
+	if (liveVerts_.valid)
+		Vertices(liveVerts_.ptr, liveVerts_.sz);
+	if (liveInds_.valid)
+		Indices(liveInds_.ptr, liveInds_.sz);
+	if (liveClut_.valid) {
+		uintptr_t psp = (uintptr_t)LiveAddr(liveClut_);
+		execListQueue.push_back((GE_CMD_CLUTADDRUPPER << 24) | ((psp >> 8) & 0x00FF0000));
+		execListQueue.push_back((GE_CMD_CLUTADDR << 24) | (psp & 0x00FFFFFF));
+	}
+	if (liveTransferSrc_.valid)
+		TransferSrc(liveTransferSrc_.ptr, liveTransferSrc_.sz);
+
+	bool anyTex = false;
+	for (int level = 0; level < 8; ++level) {
+		if (liveTex_[level].valid) {
+			Texture(level, liveTex_[level].ptr, liveTex_[level].sz);
+			anyTex = true;
+		}
+	}
+	if (anyTex) {
+		execListQueue.push_back(GE_CMD_TEXFLUSH << 24);
+	}
+}
+
+void Replay::SetLiveRef(LiveRef &ref, u32 ptr, u32 sz) {
+	// Requeuing after a slide, or the same data again, keeps any copy.
+	if (ref.valid && ref.ptr == ptr && ref.sz == sz) {
+		return;
+	}
+
+	DropLiveRef(ref);
+	ref.ptr = ptr;
+	ref.sz = sz;
+	ref.valid = true;
+}
+
+void Replay::DropLiveRef(LiveRef &ref) {
+	if (ref.copy) {
+		// The GE might still be reading from it.
+		SyncStall();
+		free(ref.copy);
+	}
+	ref.copy = 0;
+	ref.valid = false;
+}
+
+bool Replay::Run() {
+	if (!Valid()) {
+		return false;
+	}
+
+	u64 start = sceKernelGetSystemTimeWide();
+	bool result = chunks_.empty() ? RunAll() : RunSeekable();
+	stats_.runUs = sceKernelGetSystemTimeWide() - start;
+	return result;
+}
+
+bool Replay::RunAll() {
+	prims_ = 0;
+	if (maxCheckpoints_ != 0) {
+		SaveCheckpoint(0);
+	}
+	for (size_t i = 0; i < cmds_.size(); ++i) {
+		if (!RunCommand(cmds_[i])) {
 			return false;
 		}
+		// Prims are only counted in Registers(), which also flushes the queue, so this is a clean point.
+		if (maxCheckpoints_ != 0 && prims_ >= nextCheckpoint_) {
+			SaveCheckpoint(i + 1);
+		}
+	}
+
+	SubmitListEnd();
+	return true;
+}
+
+bool Replay::RunPrefix(int end) {
+	if (checkpoints_.empty()) {
+		printf("ERROR: No checkpoints to run from, use EnableCheckpoints() and Run() first\n");
+		return false;
+	}
+
+	size_t best = 0;
+	for (size_t i = 1; i < checkpoints_.size(); ++i) {
+		if (checkpoints_[i].prims <= end) {
+			best = i;
+		}
+	}
+
+	u64 start = sceKernelGetSystemTimeWide();
+	RestoreCheckpoint(checkpoints_[best]);
+	primEnd_ = end;
+	for (size_t i = checkpoints_[best].cmdIndex; i < cmds_.size(); ++i) {
+		if (!RunCommand(cmds_[i])) {
+			return false;
+		}
+	}
+
+	SubmitListEnd();
+	stats_.runUs = sceKernelGetSystemTimeWide() - start;
+	return true;
+}
+
+bool Replay::EnableCheckpoints(u32 maxCheckpoints) {
+	// Checkpoints keep pointing into the buffer, so it all has to stay in memory.
+	if (!chunks_.empty() || Streaming()) {
+		printf("ERROR: Checkpoints need a regular dump that fits in the budget\n");
+		return false;
+	}
+
+	totalPrims_ = 0;
+	for (size_t i = 0; i < cmds_.size(); ++i) {
+		if (cmds_[i].type == CommandType::REGISTERS) {
+			totalPrims_ += CountPrims((const u32 *)BufPtr(cmds_[i].ptr), cmds_[i].sz / 4);
+		}
+	}
+
+	// The first one is taken before any commands run.
+	maxCheckpoints_ = maxCheckpoints < 1 ? 1 : maxCheckpoints;
+	checkpointInterval_ = totalPrims_ / maxCheckpoints_;
+	if (checkpointInterval_ < 1) {
+		checkpointInterval_ = 1;
+	}
+	nextCheckpoint_ = checkpointInterval_;
+	return true;
+}
+
+void Replay::SaveCheckpoint(u32 cmdIndex) {
+	nextCheckpoint_ = prims_ + checkpointInterval_;
+	if (checkpoints_.size() >= maxCheckpoints_) {
+		return;
+	}
+
+	u8 *vram = (u8 *)memalign(64, VRAM_SIZE);
+	if (vram == 0) {
+		printf("WARNING: Unable to allocate checkpoint %d, bisecting will be slower\n", (int)checkpoints_.size());
+		maxCheckpoints_ = checkpoints_.size();
+		return;
 	}
 
+	// Finish the list, so the GE is idle and everything has been drawn.
 	SubmitListEnd();
+
+	checkpoints_.resize(checkpoints_.size() + 1);
+	Checkpoint &checkpoint = checkpoints_.back();
+	checkpoint.cmdIndex = cmdIndex;
+	checkpoint.prims = prims_;
+	checkpoint.vram = vram;
+	sceGeSaveContext(&checkpoint.context);
+	sceDisplayGetFrameBuf(&checkpoint.topaddr, &checkpoint.bufferwidth, &checkpoint.pixelformat, 0);
+	memcpy(checkpoint.lastBufw, lastBufw_, sizeof(lastBufw_));
+	checkpoint.memcpyDest = execMemcpyDest;
+	checkpoint.clutAddr = execClutAddr;
+	checkpoint.clutFlags = execClutFlags;
+
+	sceKernelDcacheWritebackInvalidateRange(vram, VRAM_SIZE);
+	sceDmacMemcpy(vram, VRAM_BASE, VRAM_SIZE);
+	stats_.dmaBytes += VRAM_SIZE;
+}
+
+void Replay::RestoreCheckpoint(const Checkpoint &checkpoint) {
+	// Anything still cached would overwrite the copy later.
+	sceKernelDcacheWritebackInvalidateRange(VRAM_BASE, VRAM_SIZE);
+	sceDmacMemcpy(VRAM_BASE, checkpoint.vram, VRAM_SIZE);
+	stats_.dmaBytes += VRAM_SIZE;
+
+	sceGeRestoreContext(&checkpoint.context);
+	sceDisplaySetFrameBuf(checkpoint.topaddr, checkpoint.bufferwidth, checkpoint.pixelformat, 1);
+	sceDisplaySetFrameBuf(checkpoint.topaddr, checkpoint.bufferwidth, checkpoint.pixelformat, 0);
+	memcpy(lastBufw_, checkpoint.lastBufw, sizeof(lastBufw_));
+	execMemcpyDest = checkpoint.memcpyDest;
+	execClutAddr = checkpoint.clutAddr;
+	execClutFlags = checkpoint.clutFlags;
+	prims_ = checkpoint.prims;
+	cmdIndex_ = checkpoint.cmdIndex;
+}
+
+bool Replay::RunCommand(const Command &cmd) {
+	cmdIndex_++;
+	if (profile_ != 0) {
+		return ProfileCommand(cmd);
+	}
+	return ExecCommand(cmd);
+}
+
+bool Replay::ProfileCommand(const Command &cmd) {
+	const ReplayStats before = stats_;
+	int primsBefore = prims_;
+	u64 start = sceKernelGetSystemTimeWide();
+	bool result = ExecCommand(cmd);
+	u64 end = sceKernelGetSystemTimeWide();
+	const ReplayStats after = stats_;
+
+	// Wait for the GE to draw the prims now, so its time isn't mixed up with later commands.
+	u64 geUs = 0;
+	if (prims_ != primsBefore) {
+		SyncStall();
+		geUs = sceKernelGetSystemTimeWide() - end;
+	}
+
+	if (profileCount_ >= profileCapacity_) {
+		profileDropped_++;
+		return result;
+	}
+
+	u32 syncs = after.syncStalls - before.syncStalls + after.ringWaits - before.ringWaits;
+	u64 syncUs = after.syncStallUs - before.syncStallUs + after.ringWaitUs - before.ringWaitUs;
+	ProfileEvent &event = profile_[profileCount_++];
+	event.index = cmdIndex_ - 1;
+	event.type = cmd.type;
+	event.syncs = syncs > 255 ? 255 : syncs;
+	event.pad = 0;
+	event.sz = cmd.sz;
+	event.cpuUs = (u32)(end - start - syncUs);
+	event.syncUs = (u32)syncUs;
+	event.geUs = (u32)geUs;
+	event.dmaBytes = (u32)(after.dmaBytes - before.dmaBytes);
+	event.primStart = primsBefore;
+	event.primCount = prims_ - primsBefore;
+	return result;
+}
+
+bool Replay::ExecCommand(const Command &cmd) {
+	if (!EnsureResident(cmd.ptr, cmd.sz)) {
+		return false;
+	}
+
+	switch (cmd.type) {
+	case CommandType::INIT:
+		Init(cmd.ptr, cmd.sz);
+		break;
+
+	case CommandType::REGISTERS:
+		Registers(cmd.ptr, cmd.sz);
+		break;
+
+	case CommandType::VERTICES:
+		Vertices(cmd.ptr, cmd.sz);
+		break;
+
+	case CommandType::INDICES:
+		Indices(cmd.ptr, cmd.sz);
+		break;
+
+	case CommandType::CLUTADDR:
+		ClutAddr(cmd.ptr, cmd.sz);
+		break;
+
+	case CommandType::CLUT:
+		Clut(cmd.ptr, cmd.sz);
+		break;
+
+	case CommandType::TRANSFERSRC:
+		TransferSrc(cmd.ptr, cmd.sz);
+		break;
+
+	case CommandType::MEMSET:
+		Memset(cmd.ptr, cmd.sz);
+		break;
+
+	case CommandType::MEMCPYDEST:
+		MemcpyDest(cmd.ptr, cmd.sz);
+		break;
+
+	case CommandType::MEMCPYDATA:
+		Memcpy(cmd.ptr, cmd.sz);
+		break;
+
+	case CommandType::EDRAMTRANS:
+		EdramTrans(cmd.ptr, cmd.sz);
+		break;
+
+	case CommandType::TEXTURE0:
+	case CommandType::TEXTURE1:
+	case CommandType::TEXTURE2:
+	case CommandType::TEXTURE3:
+	case CommandType::TEXTURE4:
+	case CommandType::TEXTURE5:
+	case CommandType::TEXTURE6:
+	case CommandType::TEXTURE7:
+		Texture((int)cmd.type - (int)CommandType::TEXTURE0, cmd.ptr, cmd.sz);
+		break;
+
+	case CommandType::FRAMEBUF0:
+	case CommandType::FRAMEBUF1:
+	case CommandType::FRAMEBUF2:
+	case CommandType::FRAMEBUF3:
+	case CommandType::FRAMEBUF4:
+	case CommandType::FRAMEBUF5:
+	case CommandType::FRAMEBUF6:
+	case CommandType::FRAMEBUF7:
+		Framebuf((int)cmd.type - (int)CommandType::FRAMEBUF0, cmd.ptr, cmd.sz);
+		break;
+
+	case CommandType::DISPLAY:
+		Display(cmd.ptr, cmd.sz);
+		break;
+
+	default:
+		printf("ERROR: Unsupported GE dump command: %d\n", (int)cmd.type);
+		return false;
+	}
+
 	return true;
 }
 
 void Replay::SyncStall() {
-	if (execListBuf == 0) {
+	if (execListPos == 0) {
 		return;
 	}
 
-	sceKernelDcacheWritebackInvalidateRange(execListBuf, LIST_BUF_SIZE);
-	sceGeListUpdateStallAddr(execListID, execListPos);
+	PublishStall();
 
 	// We specifically want to wait for 2 to clear, which is why we don't list sync.
+	u64 start = sceKernelGetSystemTimeWide();
 	while (sceGeListSync(execListID, 1) == 2) {
 		sceKernelDelayThreadCB(200);
 	}
+	stats_.syncStalls++;
+	stats_.syncStallUs += sceKernelGetSystemTimeWide() - start;
+}
+
+void Replay::PublishStall() {
+	if (execListPos > listPublished_) {
+		sceKernelDcacheWritebackRange(listPublished_, (execListPos - listPublished_) * sizeof(u32));
+	}
+	listPublished_ = execListPos;
+	sceGeListUpdateStallAddr(execListID, execListPos);
+}
+
+void Replay::NextSegment() {
+	*execListPos++ = (GE_CMD_SIGNAL << 24) | (SIGNAL_HANDLER_CONTINUE << 16) | SEGMENT_SIGNAL_ID;
+	*execListPos++ = GE_CMD_END << 24;
+	segmentsClosed_++;
+	stats_.segments++;
+
+	// Wait until the GE has left the segment we're about to overwrite.  This happens before
+	// publishing, so the GE can't already be stalled where the new stall address points.
+	if (segmentsClosed_ - segmentsDone_ >= (u32)LIST_SEGMENTS) {
+		u64 start = sceKernelGetSystemTimeWide();
+		while (segmentsClosed_ - segmentsDone_ >= (u32)LIST_SEGMENTS) {
+			sceKernelDelayThreadCB(100);
+		}
+		stats_.ringWaits++;
+		stats_.ringWaitUs += sceKernelGetSystemTimeWide() - start;
+	}
+
+	// Every segment starts at its own slot in the ring.
+	u32 *next = execListBuf + (segmentsClosed_ % LIST_SEGMENTS) * (LIST_SEGMENT_SIZE / sizeof(u32));
+	*execListPos++ = (GE_CMD_BASE << 24) | (((uintptr_t)next >> 8) & 0x00FF0000);
+	*execListPos++ = (GE_CMD_JUMP << 24) | ((uintptr_t)next & 0x00FFFFFF);
+	sceKernelDcacheWritebackRange(listPublished_, (execListPos - listPublished_) * sizeof(u32));
+
+	// The GE stops right after the jump until the next segment is published.
+	execListPos = next;
+	listPublished_ = next;
+	PublishStall();
+	segmentEnd_ = next + (LIST_SEGMENT_SIZE - LIST_SEGMENT_RESERVE) / sizeof(u32);
 }
 
 bool Replay::SubmitCmds(void *p, u32 sz) {
@@ -193,29 +780,70 @@ bool Replay::SubmitCmds(void *p, u32 sz) {
 		memset(execListBuf, 0, LIST_BUF_SIZE);
 		sceKernelDcacheWritebackInvalidateRange(execListBuf, LIST_BUF_SIZE);
 
+		PspGeCallbackData callback;
+		memset(&callback, 0, sizeof(callback));
+		callback.signal_func = &SegmentSignal;
+		callback.signal_arg = (void *)&segmentsDone_;
+		geCallback_ = sceGeSetCallback(&callback);
+	}
+
+	// A new list is started after SubmitListEnd(), always at the first segment.
+	if (execListPos == 0) {
+		segmentsClosed_ = 0;
+		segmentsDone_ = 0;
 		execListPos = execListBuf;
 		*execListPos++ = GE_CMD_NOP << 24;
+		segmentEnd_ = execListBuf + (LIST_SEGMENT_SIZE - LIST_SEGMENT_RESERVE) / sizeof(u32);
 
-		execListID = sceGeListEnQueue(execListBuf, execListPos, -1, NULL);
+		sceKernelDcacheWritebackRange(execListBuf, sizeof(u32));
+		listPublished_ = execListPos;
+		execListID = sceGeListEnQueue(execListBuf, execListPos, geCallback_, NULL);
 	}
 
 	u32 pendingSize = (int)execListQueue.size() * sizeof(u32);
-	// Validate space for jump.
-	u32 allocSize = pendingSize + sz + 8;
-	if ((uintptr_t)execListPos + allocSize >= (uintptr_t)execListBuf + LIST_BUF_SIZE) {
-		*execListPos++ = (GE_CMD_BASE << 24) | (((uintptr_t)execListBuf >> 8) & 0x00FF0000);
-		*execListPos++ = (GE_CMD_JUMP << 24) | ((uintptr_t)execListBuf & 0x00FFFFFF);
+	// Larger blocks are split across segments, every command is a single word.
+	const u32 segmentSpace = LIST_SEGMENT_SIZE - LIST_SEGMENT_RESERVE - sizeof(u32);
+
+	// A long run of data commands can queue more than a segment, so that goes first on its own.
+	while (pendingSize >= segmentSpace) {
+		size_t part = segmentSpace / sizeof(u32);
+		// The segment's jump sets BASE, so keep BASE with the address after it.
+		if ((execListQueue[part - 1] >> 24) == GE_CMD_BASE) {
+			part--;
+		}
+		if (execListPos + part > segmentEnd_) {
+			NextSegment();
+		}
+		memcpy(execListPos, execListQueue.data(), part * sizeof(u32));
+		execListPos += part;
+		execListQueue.erase(execListQueue.begin(), execListQueue.begin() + part);
+		pendingSize = (u32)execListQueue.size() * sizeof(u32);
+	}
 
-		execListPos = execListBuf;
+	while (pendingSize + sz > segmentSpace) {
+		u32 part = pendingSize < segmentSpace ? (segmentSpace - pendingSize) & ~3 : 0;
+		// Same as above, the dump's BASE has to stay with what uses it.
+		if (part != 0 && (((const u32 *)p)[part / 4 - 1] >> 24) == GE_CMD_BASE) {
+			part -= 4;
+		}
+		if (!SubmitCmds(p, part)) {
+			return false;
+		}
+		p = (u8 *)p + part;
+		sz -= part;
+		pendingSize = 0;
+	}
 
-		// Don't continue until we've stalled.
-		SyncStall();
+	if (execListPos + (pendingSize + sz) / sizeof(u32) > segmentEnd_) {
+		NextSegment();
 	}
 
 	memcpy(execListPos, execListQueue.data(), pendingSize);
 	execListPos += pendingSize / 4;
 	u32 *writePos = execListPos;
-	memcpy(execListPos, p, sz);
+	if (sz != 0) {
+		memcpy(execListPos, p, sz);
+	}
 	execListPos += sz / 4;
 
 	// TODO: Unfortunate.  Maybe Texture commands should contain the bufw instead.
@@ -234,7 +862,7 @@ bool Replay::SubmitCmds(void *p, u32 sz) {
 			lastBufw_[level] = bufw;
 		}
 
-		if (cmd == GE_CMD_PRIM || cmd == GE_CMD_BEZIER || cmd == GE_CMD_SPLINE || cmd == 0xF7) {
+		if (IsPrimCommand(cmd)) {
 			prims_++;
 
 			// Nuke the command if it's outside the range.
@@ -266,10 +894,11 @@ void Replay::SubmitListEnd() {
 
 	SyncStall();
 	sceGeListSync(execListID, 0);
+	execListPos = 0;
 }
 
 void Replay::Init(u32 ptr, u32 sz) {
-	PspGeContext *ctx = (PspGeContext *)(buf_.data() + ptr);
+	PspGeContext *ctx = (PspGeContext *)BufPtr(ptr);
 	bool isOldState = true;
 	for (int i = 17; i < 512; ++i) {
 		if (ctx->context[i] == GE_CMD_END << 24) {
@@ -288,11 +917,12 @@ void Replay::Init(u32 ptr, u32 sz) {
 }
 
 void Replay::Registers(u32 ptr, u32 sz) {
-	SubmitCmds(buf_.data() + ptr, sz);
+	SubmitCmds(BufPtr(ptr), sz);
 }
 
 void Replay::Vertices(u32 ptr, u32 sz) {
-	uintptr_t psp = (uintptr_t)(buf_.data() + ptr);
+	SetLiveRef(liveVerts_, ptr, sz);
+	uintptr_t psp = (uintptr_t)LiveAddr(liveVerts_);
 	if (psp & 0x3) {
 		printf("Vertices: uh oh, alignment %d\n", psp & 0x3);
 	}
@@ -302,7 +932,8 @@ void Replay::Vertices(u32 ptr, u32 sz) {
 }
 
 void Replay::Indices(u32 ptr, u32 sz) {
-	uintptr_t psp = (uintptr_t)(buf_.data() + ptr);
+	SetLiveRef(liveInds_, ptr, sz);
+	uintptr_t psp = (uintptr_t)LiveAddr(liveInds_);
 	if (psp & 0x3) {
 		printf("Indices: uh oh, alignment %d\n", psp & 0x3);
 	}
@@ -311,7 +942,7 @@ void Replay::Indices(u32 ptr, u32 sz) {
 }
 
 void Replay::ClutAddr(u32 ptr, u32 sz) {
-	const u8 *data = (const u8 *)(buf_.data() + ptr);
+	const u8 *data = (const u8 *)BufPtr(ptr);
 	memcpy(&execClutAddr, data, sizeof(execClutAddr));
 	memcpy(&execClutFlags, data + 4, sizeof(execClutFlags));
 }
@@ -321,13 +952,15 @@ void Replay::Clut(u32 ptr, u32 sz) {
 		const bool isTarget = (execClutFlags & 1) != 0;
 
 		if (!isTarget) {
-			sceDmacMemcpy(execClutAddr, buf_.data() + ptr, sz);
+			sceDmacMemcpy(execClutAddr, BufPtr(ptr), sz);
+			stats_.dmaBytes += sz;
 			sceKernelDcacheWritebackInvalidateRange(execClutAddr, sz);
 		}
 
 		execClutAddr = 0;
 	} else {
-		uintptr_t psp = (uintptr_t)(buf_.data() + ptr);
+		SetLiveRef(liveClut_, ptr, sz);
+		uintptr_t psp = (uintptr_t)LiveAddr(liveClut_);
 		if (psp & 0xF) {
 			printf("Clut: uh oh, alignment %d\n", psp & 0xF);
 		}
@@ -337,7 +970,8 @@ void Replay::Clut(u32 ptr, u32 sz) {
 }
 
 void Replay::TransferSrc(u32 ptr, u32 sz) {
-	uintptr_t psp = (uintptr_t)(buf_.data() + ptr);
+	SetLiveRef(liveTransferSrc_, ptr, sz);
+	uintptr_t psp = (uintptr_t)LiveAddr(liveTransferSrc_);
 
 	// Need to sync in order to access gstate.transfersrcw.
 	SyncStall();
@@ -358,30 +992,33 @@ void Replay::Memset(u32 ptr, u32 sz) {
 		u32 sz;
 	};
 
-	const MemsetCommand *data = (const MemsetCommand *)(buf_.data() + ptr);
+	const MemsetCommand *data = (const MemsetCommand *)BufPtr(ptr);
 
 	if (IsVRAMAddress(data->dest)) {
 		SyncStall();
 		memset(data->dest, (uint8_t)data->value, data->sz);
 		sceKernelDcacheWritebackInvalidateRange(data->dest, data->sz);
 		sceDmacMemcpy((void *)((uintptr_t)data->dest ^ 0x00400000), data->dest, data->sz);
+		stats_.dmaBytes += data->sz;
 	}
 }
 
 void Replay::MemcpyDest(u32 ptr, u32 sz) {
-	execMemcpyDest = *(void **)(buf_.data() + ptr);
+	execMemcpyDest = *(void **)BufPtr(ptr);
 }
 
 void Replay::Memcpy(u32 ptr, u32 sz) {
 	if (IsVRAMAddress(execMemcpyDest)) {
 		SyncStall();
-		sceDmacMemcpy(execMemcpyDest, buf_.data() + ptr, sz);
+		sceDmacMemcpy(execMemcpyDest, BufPtr(ptr), sz);
+		stats_.dmaBytes += sz;
 		sceKernelDcacheWritebackInvalidateRange(execMemcpyDest, sz);
 	}
 }
 
 void Replay::Texture(int level, u32 ptr, u32 sz) {
-	uintptr_t psp = (uintptr_t)(buf_.data() + ptr);
+	SetLiveRef(liveTex_[level], ptr, sz);
+	uintptr_t psp = (uintptr_t)LiveAddr(liveTex_[level]);
 
 	if (psp & 0xF) {
 		printf("Texture: uh oh, alignment %d\n", psp & 0xF);
@@ -401,12 +1038,13 @@ void Replay::Framebuf(int level, u32 ptr, u32 sz) {
 		u32 pad;
 	};
 
-	FramebufData *framebuf = (FramebufData *)(buf_.data() + ptr);
+	FramebufData *framebuf = (FramebufData *)BufPtr(ptr);
 	uintptr_t headerSize = (uintptr_t)sizeof(FramebufData);
 	uintptr_t pspSize = sz - headerSize;
-	const uint8_t *psp = buf_.data() + ptr + headerSize;
+	const uint8_t *psp = BufPtr(ptr) + headerSize;
 	if ((framebuf->flags & 1) == 0) {
 		sceDmacMemcpy(framebuf->addr, psp, pspSize);
+		stats_.dmaBytes += pspSize;
 		sceKernelDcacheWritebackInvalidateRange(framebuf->addr, pspSize);
 	}
 
@@ -419,6 +1057,7 @@ void Replay::Framebuf(int level, u32 ptr, u32 sz) {
 	execListQueue.push_back((bufwCmd << 24) | (((uintptr_t)framebuf->addr >> 8) & 0x00FF0000) | framebuf->bufw);
 	execListQueue.push_back((addrCmd << 24) | ((uintptr_t)framebuf->addr & 0x00FFFFFF));
 	lastBufw_[level] = framebuf->bufw;
+	DropLiveRef(liveTex_[level]);
 }
 
 void Replay::Display(u32 ptr, u32 sz) {
@@ -427,7 +1066,7 @@ void Replay::Display(u32 ptr, u32 sz) {
 		u32 linesize, pixelFormat;
 	};
 
-	DisplayBufData *disp = (DisplayBufData *)(buf_.data() + ptr);
+	DisplayBufData *disp = (DisplayBufData *)BufPtr(ptr);
 
 	// Sync up drawing.
 	SyncStall();
@@ -438,13 +1077,79 @@ void Replay::Display(u32 ptr, u32 sz) {
 
 void Replay::EdramTrans(u32 ptr, u32 sz) {
 	uint32_t value;
-	memcpy(&value, buf_.data() + ptr, 4);
+	memcpy(&value, BufPtr(ptr), 4);
 
 	SyncStall();
 
 	sceGeEdramSetAddrTranslation(value);
 }
 
+bool Replay::EnableProfile(u32 maxEvents) {
+	// Allocated up front, so recording doesn't disturb the timing.
+	profile_ = (ProfileEvent *)malloc(maxEvents * sizeof(ProfileEvent));
+	if (profile_ == 0) {
+		printf("ERROR: Unable to allocate %d profile events\n", maxEvents);
+		return false;
+	}
+	profileCapacity_ = maxEvents;
+	profileCount_ = 0;
+	profileDropped_ = 0;
+	return true;
+}
+
+bool Replay::WriteProfile(const char *filename) {
+	if (profile_ == 0) {
+		return false;
+	}
+
+	ProfileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, PROFILE_MAGIC, sizeof(header.magic));
+	header.version = PROFILE_VERSION;
+	header.eventCount = profileCount_;
+	header.droppedEvents = profileDropped_;
+	header.prims = prims_;
+	header.runUs = stats_.runUs;
+	header.syncStalls = stats_.syncStalls;
+	header.syncStallUs = stats_.syncStallUs;
+	header.ringWaits = stats_.ringWaits;
+	header.ringWaitUs = stats_.ringWaitUs;
+	header.dmaBytes = stats_.dmaBytes;
+
+	SceUID fd = sceIoOpen(filename, PSP_O_WRONLY | PSP_O_CREAT | PSP_O_TRUNC, 0777);
+	if (fd < 0) {
+		return false;
+	}
+	const int eventsSize = profileCount_ * sizeof(ProfileEvent);
+	bool success = sceIoWrite(fd, &header, sizeof(header)) == sizeof(header);
+	success = success && sceIoWrite(fd, profile_, eventsSize) == eventsSize;
+	sceIoClose(fd);
+	return success;
+}
+
 Replay::~Replay() {
 	delete [] execListBuf;
+	if (geCallback_ >= 0) {
+		sceGeUnsetCallback(geCallback_);
+	}
+	DropLiveRef(liveVerts_);
+	DropLiveRef(liveInds_);
+	DropLiveRef(liveClut_);
+	DropLiveRef(liveTransferSrc_);
+	for (int level = 0; level < 8; ++level) {
+		DropLiveRef(liveTex_[level]);
+	}
+	if (window_ != buf_.data()) {
+		free(window_);
+	}
+	free(shared_);
+	free(profile_);
+	for (size_t i = 0; i < checkpoints_.size(); ++i) {
+		free(checkpoints_[i].vram);
+	}
+	ZSTD_freeDStream(dstream_);
+	delete [] inBuf_;
+	if (fd_ > 0) {
+		sceIoClose(fd_);
+	}
 }
@@ -1,56 +1,32 @@
 #pragma once
 
+#include <pspge.h>
 #include <stdint.h>
 #include <vector>
-
-#pragma pack(push, 1)
-
-struct CommandType {
-	enum Value {
-		INIT = 0,
-		REGISTERS = 1,
-		VERTICES = 2,
-		INDICES = 3,
-		CLUT = 4,
-		TRANSFERSRC = 5,
-		MEMSET = 6,
-		MEMCPYDEST = 7,
-		MEMCPYDATA = 8,
-		DISPLAY = 9,
-		CLUTADDR = 10,
-		EDRAMTRANS = 11,
-
-		TEXTURE0 = 0x10,
-		TEXTURE1 = 0x11,
-		TEXTURE2 = 0x12,
-		TEXTURE3 = 0x13,
-		TEXTURE4 = 0x14,
-		TEXTURE5 = 0x15,
-		TEXTURE6 = 0x16,
-		TEXTURE7 = 0x17,
-
-		FRAMEBUF0 = 0x18,
-		FRAMEBUF1 = 0x19,
-		FRAMEBUF2 = 0x1A,
-		FRAMEBUF3 = 0x1B,
-		FRAMEBUF4 = 0x1C,
-		FRAMEBUF5 = 0x1D,
-		FRAMEBUF6 = 0x1E,
-		FRAMEBUF7 = 0x1F,
-	};
+#include "ppdmp.h"
+
+struct ZSTD_DCtx_s;
+
+// Default memory allowed for decompressed buffer data.  Larger dumps are streamed.
+static const u32 REPLAY_DEFAULT_BUDGET = 16 * 1024 * 1024;
+
+// Time spent waiting on the GE, to see how well the CPU and GE overlap.
+struct ReplayStats {
+	// Waiting for the GE to run everything submitted, e.g. before buffer data moves.
+	u32 syncStalls;
+	u64 syncStallUs;
+	// Waiting for the GE to finish a list segment, so it can be refilled.
+	u32 ringWaits;
+	u64 ringWaitUs;
+	u32 segments;
+	// Copied with sceDmacMemcpy: CLUTs, framebuffers, memory writes.
+	u64 dmaBytes;
+	u64 runUs;
 };
 
-struct Command {
-	uint8_t type;
-	uint32_t sz;
-	uint32_t ptr;
-};
-
-#pragma pack(pop)
-
 class Replay {
 public:
-	Replay(const char *filename);
+	Replay(const char *filename, u32 budget = REPLAY_DEFAULT_BUDGET);
 	~Replay();
 
 	bool Run();
@@ -64,10 +40,81 @@ public:
 		return valid_;
 	}
 
+	bool Streaming() {
+		return dstream_ != 0;
+	}
+
+	const ReplayStats &Stats() const {
+		return stats_;
+	}
+
+	// Times each command into a buffer of maxEvents, which costs some speed (see ProfileEvent.)
+	bool EnableProfile(u32 maxEvents);
+	bool WriteProfile(const char *filename);
+
+	// For bisecting: Run() saves the GE state and VRAM every so many prims, up to maxCheckpoints
+	// times (each takes 2 MB.)  Afterward, RunPrefix() draws only prims up to end, like SetRange(),
+	// but starts from the last checkpoint before end instead of the beginning.
+	bool EnableCheckpoints(u32 maxCheckpoints);
+	bool RunPrefix(int end);
+	int TotalPrims() const {
+		return totalPrims_;
+	}
+
 protected:
+	struct Checkpoint {
+		// The next command to run, and the prims drawn before it.
+		u32 cmdIndex;
+		int prims;
+		PspGeContext context;
+		u8 *vram;
+		void *topaddr;
+		int bufferwidth;
+		int pixelformat;
+		u16 lastBufw[8];
+		void *memcpyDest;
+		void *clutAddr;
+		u32 clutFlags;
+	};
+
+	struct LiveRef {
+		u32 ptr;
+		u32 sz;
+		bool valid;
+		// Set when the data had to be copied out of the window to keep it.
+		u8 *copy;
+	};
+
 	bool ReadCompressed(void *dest, size_t sz, uint32_t version);
+	bool ReadSeekableIndex();
+	bool LoadChunk(u32 offset, u32 cmdCount, u32 bufSize);
+	bool RunAll();
+	bool RunSeekable();
+	bool RunCommand(const Command &cmd);
+	bool ProfileCommand(const Command &cmd);
+	bool ExecCommand(const Command &cmd);
+	u32 FindSharedEnd() const;
+	bool BeginStream(u32 budget);
+	bool RestartStream();
+	bool DecompressTo(u32 end);
+	bool SlideWindow(u32 start);
+	bool EnsureResident(u32 ptr, u32 sz);
+	void SetLiveRef(LiveRef &ref, u32 ptr, u32 sz);
+	void DropLiveRef(LiveRef &ref);
+	void RequeueLiveRefs();
+	u8 *BufPtr(u32 ptr) {
+		return ptr < sharedSize_ ? shared_ + ptr : window_ + (ptr - windowStart_);
+	}
+	u8 *LiveAddr(const LiveRef &ref) {
+		return ref.copy ? ref.copy : BufPtr(ref.ptr);
+	}
+
+	void SaveCheckpoint(u32 cmdIndex);
+	void RestoreCheckpoint(const Checkpoint &checkpoint);
 
 	void SyncStall();
+	void PublishStall();
+	void NextSegment();
 	bool SubmitCmds(void *p, u32 sz);
 	void SubmitListEnd();
 
@@ -94,6 +141,35 @@ protected:
 
 	std::vector<Command> cmds_;
 	std::vector<uint8_t> buf_;
+	// Only for seekable dumps, cmds_ and buf_ then hold the current chunk.
+	std::vector<SeekableChunk> chunks_;
+
+	// Decompressed buffer data lives in [windowStart_, windowEnd_) of window_.
+	// Without streaming, this is simply all of buf_.
+	u8 *window_;
+	u32 windowStart_;
+	u32 windowEnd_;
+	u32 windowCapacity_;
+	u32 bufSize_;
+	// While streaming, [0, sharedSize_) stays resident because later commands refer back to it.
+	u8 *shared_;
+	u32 sharedSize_;
+
+	ZSTD_DCtx_s *dstream_;
+	int bufFileOffset_;
+	u32 bufCompressedSize_;
+	u32 compressedLeft_;
+	u8 *inBuf_;
+	u32 inBufSize_;
+	u32 inBufPos_;
+	u32 inBufFill_;
+
+	// Buffer data the GE may still read after its command, kept across window slides.
+	LiveRef liveVerts_;
+	LiveRef liveInds_;
+	LiveRef liveClut_;
+	LiveRef liveTransferSrc_;
+	LiveRef liveTex_[8];
 
 	void *execMemcpyDest;
 	void *execClutAddr;
@@ -103,4 +179,25 @@ protected:
 	u32 execListID;
 	std::vector<u32> execListQueue;
 	u16 lastBufw_[8];
+
+	// execListBuf is a ring of segments, each ending in a signal so we know when the GE is done with it.
+	int geCallback_;
+	u32 segmentsClosed_;
+	volatile u32 segmentsDone_;
+	u32 *segmentEnd_;
+	// The GE may run up to here, everything before it has been written back.
+	u32 *listPublished_;
+	ReplayStats stats_;
+
+	ProfileEvent *profile_;
+	u32 profileCapacity_;
+	u32 profileCount_;
+	u32 profileDropped_;
+	u32 cmdIndex_;
+
+	std::vector<Checkpoint> checkpoints_;
+	u32 maxCheckpoints_;
+	int totalPrims_;
+	int checkpointInterval_;
+	int nextCheckpoint_;
 };
\ No newline at end of file
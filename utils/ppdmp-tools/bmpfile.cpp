@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <string.h>
+#include "bmpfile.h"
+
+static uint32_t ReadLE32(const uint8_t *p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t ReadLE16(const uint8_t *p) {
+	return p[0] | (p[1] << 8);
+}
+
+bool ReadBmp(const char *filename, Bitmap &bmp) {
+	FILE *fp = fopen(filename, "rb");
+	if (!fp) {
+		return false;
+	}
+
+	uint8_t header[54];
+	bool valid = fread(header, sizeof(header), 1, fp) == 1 && header[0] == 'B' && header[1] == 'M';
+	const uint32_t offset = valid ? ReadLE32(header + 10) : 0;
+	const int32_t width = valid ? (int32_t)ReadLE32(header + 18) : 0;
+	const int32_t height = valid ? (int32_t)ReadLE32(header + 22) : 0;
+	const uint16_t bpp = valid ? ReadLE16(header + 28) : 0;
+	const uint32_t compression = valid ? ReadLE32(header + 30) : 0;
+	// BI_BITFIELDS is fine too, as long as it's the usual BGRA order.
+	valid = valid && width > 0 && height != 0 && (bpp == 24 || bpp == 32) && (compression == 0 || compression == 3);
+	valid = valid && fseek(fp, offset, SEEK_SET) == 0;
+
+	if (valid) {
+		// A negative height means top row first.
+		const bool topDown = height < 0;
+		bmp.width = width;
+		bmp.height = topDown ? -height : height;
+		bmp.pixels.resize(bmp.width * bmp.height);
+
+		const int bytesPerPixel = bpp / 8;
+		const size_t stride = (bmp.width * bytesPerPixel + 3) & ~3;
+		std::vector<uint8_t> row(stride);
+		for (int y = 0; valid && y < bmp.height; ++y) {
+			valid = fread(row.data(), stride, 1, fp) == 1;
+			uint32_t *dest = &bmp.pixels[(topDown ? y : bmp.height - 1 - y) * bmp.width];
+			for (int x = 0; valid && x < bmp.width; ++x) {
+				const uint8_t *p = &row[x * bytesPerPixel];
+				uint32_t alpha = bytesPerPixel == 4 ? p[3] : 0xFF;
+				dest[x] = p[0] | (p[1] << 8) | (p[2] << 16) | (alpha << 24);
+			}
+		}
+	}
+
+	fclose(fp);
+	return valid;
+}
+
+static void WriteLE32(uint8_t *p, uint32_t v) {
+	p[0] = v & 0xFF;
+	p[1] = (v >> 8) & 0xFF;
+	p[2] = (v >> 16) & 0xFF;
+	p[3] = v >> 24;
+}
+
+static void WriteLE16(uint8_t *p, uint16_t v) {
+	p[0] = v & 0xFF;
+	p[1] = v >> 8;
+}
+
+bool WriteBmp(const char *filename, const Bitmap &bmp) {
+	FILE *fp = fopen(filename, "wb");
+	if (!fp) {
+		return false;
+	}
+
+	// Same header as emulatorEmitScreenshot() writes.
+	const uint32_t imageSize = bmp.width * bmp.height * 4;
+	uint8_t header[54];
+	memset(header, 0, sizeof(header));
+	header[0] = 'B';
+	header[1] = 'M';
+	WriteLE32(header + 2, sizeof(header) + imageSize);
+	WriteLE32(header + 10, sizeof(header));
+	WriteLE32(header + 14, 40);
+	WriteLE32(header + 18, bmp.width);
+	WriteLE32(header + 22, bmp.height);
+	WriteLE16(header + 26, 1);
+	WriteLE16(header + 28, 32);
+	// The screenshot header says 2 more, keep that so identical pictures are identical files.
+	WriteLE32(header + 34, imageSize + 2);
+	WriteLE32(header + 38, 0x0B12);
+	WriteLE32(header + 42, 0x0B12);
+	bool valid = fwrite(header, sizeof(header), 1, fp) == 1;
+
+	std::vector<uint8_t> row(bmp.width * 4);
+	for (int y = bmp.height - 1; valid && y >= 0; --y) {
+		for (int x = 0; x < bmp.width; ++x) {
+			WriteLE32(&row[x * 4], bmp.At(x, y));
+		}
+		valid = fwrite(row.data(), row.size(), 1, fp) == 1;
+	}
+
+	valid = fclose(fp) == 0 && valid;
+	return valid;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// 32-bit BGRA pixels, top row first (BMP files store the bottom row first.)
+struct Bitmap {
+	int width;
+	int height;
+	std::vector<uint32_t> pixels;
+
+	uint32_t At(int x, int y) const {
+		return pixels[y * width + x];
+	}
+};
+
+// Uncompressed 24 or 32-bit BMPs, like the playback screenshots.
+bool ReadBmp(const char *filename, Bitmap &bmp);
+// 32-bit, bottom row first, with the same header as the playback screenshots.
+bool WriteBmp(const char *filename, const Bitmap &bmp);
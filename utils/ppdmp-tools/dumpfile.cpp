@@ -0,0 +1,156 @@
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "snappy/snappy-c.h"
+#include "zstd/lib/zstd.h"
+#include "dumpfile.h"
+
+struct MemoryReader {
+	const uint8_t *pos;
+	const uint8_t *end;
+};
+
+static int ReadMemory(void *ctx, void *dest, uint32_t sz) {
+	MemoryReader *reader = (MemoryReader *)ctx;
+	if ((size_t)(reader->end - reader->pos) < sz) {
+		return -1;
+	}
+	memcpy(dest, reader->pos, sz);
+	reader->pos += sz;
+	return (int)sz;
+}
+
+MappedDump::MappedDump()
+	: data_(NULL), size_(0), seekable_(NULL), cmdsOffset_(0), cmdsSize_(0), bufOffset_(0), bufSize_(0) {
+	memset(&header_, 0, sizeof(header_));
+}
+
+MappedDump::~MappedDump() {
+	if (data_ != NULL) {
+		munmap((void *)data_, size_);
+	}
+}
+
+bool MappedDump::Open(const char *filename) {
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(DUMP_MAGIC)) {
+		close(fd);
+		return false;
+	}
+
+	void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) {
+		return false;
+	}
+	data_ = (const uint8_t *)p;
+	size_ = st.st_size;
+
+	if (memcmp(data_, SEEKABLE_MAGIC, sizeof(SEEKABLE_MAGIC)) == 0) {
+		if (size_ < sizeof(SeekableHeader)) {
+			return false;
+		}
+		seekable_ = (const SeekableHeader *)data_;
+		return seekable_->version == SEEKABLE_VERSION && sizeof(SeekableHeader) + sizeof(SeekableChunk) * (uint64_t)seekable_->chunkCount <= size_;
+	}
+
+	if (memcmp(data_, DUMP_MAGIC, sizeof(DUMP_MAGIC)) != 0) {
+		return false;
+	}
+
+	MemoryReader reader = { data_ + sizeof(DUMP_MAGIC), data_ + size_ };
+	if (!ReadDumpHeader(&ReadMemory, &reader, header_) || ReadMemory(&reader, &cmdsSize_, sizeof(cmdsSize_)) < 0) {
+		return false;
+	}
+	cmdsOffset_ = reader.pos - data_;
+	reader.pos += cmdsSize_;
+	if (reader.pos > reader.end || ReadMemory(&reader, &bufSize_, sizeof(bufSize_)) < 0) {
+		return false;
+	}
+	bufOffset_ = reader.pos - data_;
+	return bufOffset_ + bufSize_ <= size_;
+}
+
+bool MappedDump::ReadBlock(size_t offset, uint32_t compressedSize, void *dest, uint32_t sz) const {
+	return DecompressDumpData(header_.version, data_ + offset, compressedSize, dest, sz);
+}
+
+bool MappedDump::ReadCommands(std::vector<Command> &cmds) const {
+	cmds.resize(header_.cmdCount);
+	return ReadBlock(cmdsOffset_, cmdsSize_, cmds.data(), sizeof(Command) * header_.cmdCount);
+}
+
+bool MappedDump::ReadBuffer(std::vector<uint8_t> &buf) const {
+	buf.resize(header_.bufSize);
+	return ReadBlock(bufOffset_, bufSize_, buf.data(), header_.bufSize);
+}
+
+bool MappedDump::ReadChunk(uint32_t offset, uint32_t cmdCount, uint32_t bufSize, std::vector<Command> &cmds, std::vector<uint8_t> &buf) const {
+	// Each stream is the compressed size and data, twice.
+	uint32_t cmdsSize, bufDataSize;
+	if ((uint64_t)offset + 4 > size_) {
+		return false;
+	}
+	memcpy(&cmdsSize, data_ + offset, 4);
+	size_t bufPos = (size_t)offset + 4 + cmdsSize;
+	if (bufPos + 4 > size_) {
+		return false;
+	}
+	memcpy(&bufDataSize, data_ + bufPos, 4);
+	if (bufPos + 4 + bufDataSize > size_) {
+		return false;
+	}
+
+	cmds.resize(cmdCount);
+	buf.resize(bufSize);
+	// Seekable streams are always zstd.
+	return DecompressDumpData(5, data_ + offset + 4, cmdsSize, cmds.data(), sizeof(Command) * cmdCount) && DecompressDumpData(5, data_ + bufPos + 4, bufDataSize, buf.data(), bufSize);
+}
+
+bool WriteDumpBlock(FILE *fp, int version, const void *data, uint32_t sz, int level) {
+	std::vector<char> compressed;
+	size_t compressedSize;
+	if (version < 5) {
+		compressedSize = snappy_max_compressed_length(sz);
+		compressed.resize(compressedSize);
+		if (snappy_compress((const char *)data, sz, compressed.data(), &compressedSize) != SNAPPY_OK) {
+			return false;
+		}
+	} else {
+		compressed.resize(ZSTD_compressBound(sz));
+		compressedSize = ZSTD_compress(compressed.data(), compressed.size(), data, sz, level);
+		if (ZSTD_isError(compressedSize)) {
+			return false;
+		}
+	}
+
+	uint32_t size32 = (uint32_t)compressedSize;
+	return fwrite(&size32, sizeof(size32), 1, fp) == 1 && fwrite(compressed.data(), 1, compressedSize, fp) == compressedSize;
+}
+
+bool WriteDump(const char *filename, const DumpHeader &header, const std::vector<Command> &cmds, const std::vector<uint8_t> &buf, int level) {
+	FILE *fp = fopen(filename, "wb");
+	if (!fp) {
+		return false;
+	}
+
+	uint32_t cmdCount = (uint32_t)cmds.size();
+	uint32_t bufSize = (uint32_t)buf.size();
+	bool success = fwrite(DUMP_MAGIC, sizeof(DUMP_MAGIC), 1, fp) == 1;
+	success = success && fwrite(&header.version, sizeof(header.version), 1, fp) == 1;
+	if (header.version >= 4) {
+		success = success && fwrite(header.header2, sizeof(header.header2), 1, fp) == 1;
+	}
+	success = success && fwrite(&cmdCount, sizeof(cmdCount), 1, fp) == 1;
+	success = success && fwrite(&bufSize, sizeof(bufSize), 1, fp) == 1;
+	success = success && WriteDumpBlock(fp, header.version, cmds.data(), sizeof(Command) * cmdCount, level);
+	success = success && WriteDumpBlock(fp, header.version, buf.data(), bufSize, level);
+	return fclose(fp) == 0 && success;
+}
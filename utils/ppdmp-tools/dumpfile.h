@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include "ppdmp.h"
+
+// A frame dump mapped into memory, regular or seekable.
+class MappedDump {
+public:
+	MappedDump();
+	~MappedDump();
+
+	bool Open(const char *filename);
+
+	bool IsSeekable() const {
+		return seekable_ != NULL;
+	}
+	const DumpHeader &Header() const {
+		return header_;
+	}
+	size_t FileSize() const {
+		return size_;
+	}
+	uint32_t CompressedCommandsSize() const {
+		return cmdsSize_;
+	}
+	uint32_t CompressedBufferSize() const {
+		return bufSize_;
+	}
+
+	// Regular dumps only.
+	bool ReadCommands(std::vector<Command> &cmds) const;
+	bool ReadBuffer(std::vector<uint8_t> &buf) const;
+
+	// Seekable dumps only.
+	const SeekableHeader &SeekableInfo() const {
+		return *seekable_;
+	}
+	const SeekableChunk *Chunks() const {
+		return (const SeekableChunk *)(seekable_ + 1);
+	}
+	bool ReadChunk(uint32_t offset, uint32_t cmdCount, uint32_t bufSize, std::vector<Command> &cmds, std::vector<uint8_t> &buf) const;
+
+private:
+	bool ReadBlock(size_t offset, uint32_t compressedSize, void *dest, uint32_t sz) const;
+
+	const uint8_t *data_;
+	size_t size_;
+	DumpHeader header_;
+	const SeekableHeader *seekable_;
+	size_t cmdsOffset_;
+	uint32_t cmdsSize_;
+	size_t bufOffset_;
+	uint32_t bufSize_;
+};
+
+// Compresses a block as the dump version expects and writes its size and data.
+bool WriteDumpBlock(FILE *fp, int version, const void *data, uint32_t sz, int level);
+bool WriteDump(const char *filename, const DumpHeader &header, const std::vector<Command> &cmds, const std::vector<uint8_t> &buf, int level);
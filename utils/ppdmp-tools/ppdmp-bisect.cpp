@@ -0,0 +1,177 @@
+// Answers playback.prx --bisect: compares each screenshot it writes to a reference, until
+// it finds the first prim that draws differently.  Run this in the usbhostfs_pc directory.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include "bmpfile.h"
+
+// The PSP screenshots are 512 wide, but only 480 columns are displayed.
+static const int VISIBLE_WIDTH = 480;
+static const int POLL_US = 50000;
+
+struct CompareOptions {
+	int tolerance;
+	int maxPixels;
+};
+
+// Replaces %d with the prim and %s with the path, without treating the pattern as a format.
+static std::string FormatPattern(const char *pattern, int prim, const std::string &path) {
+	std::string result;
+	char num[16];
+	snprintf(num, sizeof(num), "%d", prim);
+	for (const char *p = pattern; *p != '\0'; ++p) {
+		if (p[0] == '%' && p[1] == 'd') {
+			result += num;
+			++p;
+		} else if (p[0] == '%' && p[1] == 's') {
+			result += path;
+			++p;
+		} else {
+			result += *p;
+		}
+	}
+	return result;
+}
+
+static bool ReadText(const std::string &filename, std::string &text) {
+	FILE *fp = fopen(filename.c_str(), "rb");
+	if (!fp) {
+		return false;
+	}
+	char buf[64];
+	size_t len = fread(buf, 1, sizeof(buf) - 1, fp);
+	fclose(fp);
+	buf[len] = '\0';
+	text = buf;
+	return true;
+}
+
+static bool WriteText(const std::string &filename, const char *text) {
+	FILE *fp = fopen(filename.c_str(), "wb");
+	if (!fp) {
+		return false;
+	}
+	bool success = fputs(text, fp) >= 0;
+	success = fclose(fp) == 0 && success;
+	return success;
+}
+
+static bool Channel(uint32_t a, uint32_t b, int shift, int tolerance) {
+	int diff = (int)((a >> shift) & 0xFF) - (int)((b >> shift) & 0xFF);
+	return diff > tolerance || diff < -tolerance;
+}
+
+// Counts pixels with any color channel off by more than the tolerance.  Alpha is ignored,
+// since screenshots show whatever is in the stencil bits.
+static int CountDiffs(const Bitmap &a, const Bitmap &b, int tolerance) {
+	int width = std::min(std::min(a.width, b.width), VISIBLE_WIDTH);
+	int height = std::min(a.height, b.height);
+	int diffs = 0;
+	for (int y = 0; y < height; ++y) {
+		for (int x = 0; x < width; ++x) {
+			uint32_t pa = a.At(x, y);
+			uint32_t pb = b.At(x, y);
+			if (Channel(pa, pb, 0, tolerance) || Channel(pa, pb, 8, tolerance) || Channel(pa, pb, 16, tolerance)) {
+				diffs++;
+			}
+		}
+	}
+	return diffs;
+}
+
+static bool LoadReference(const char *pattern, const char *command, int prim, Bitmap &bmp) {
+	const std::string path = FormatPattern(pattern, prim, "");
+	if (ReadBmp(path.c_str(), bmp)) {
+		return true;
+	}
+	if (!command) {
+		fprintf(stderr, "Unable to read reference %s\n", path.c_str());
+		return false;
+	}
+
+	const std::string cmd = FormatPattern(command, prim, path);
+	if (system(cmd.c_str()) != 0 || !ReadBmp(path.c_str(), bmp)) {
+		fprintf(stderr, "Reference command did not produce %s: %s\n", path.c_str(), cmd.c_str());
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	const char *reference = NULL;
+	const char *command = NULL;
+	std::string dir = ".";
+	CompareOptions compare = { 0, 0 };
+
+	for (int i = 1; i < argc; ++i) {
+		if (!strncmp(argv[i], "--reference=", strlen("--reference="))) {
+			reference = argv[i] + strlen("--reference=");
+		} else if (!strncmp(argv[i], "--reference-cmd=", strlen("--reference-cmd="))) {
+			command = argv[i] + strlen("--reference-cmd=");
+		} else if (!strncmp(argv[i], "--dir=", strlen("--dir="))) {
+			dir = argv[i] + strlen("--dir=");
+		} else if (!strncmp(argv[i], "--tolerance=", strlen("--tolerance="))) {
+			compare.tolerance = atoi(argv[i] + strlen("--tolerance="));
+		} else if (!strncmp(argv[i], "--max-pixels=", strlen("--max-pixels="))) {
+			compare.maxPixels = atoi(argv[i] + strlen("--max-pixels="));
+		} else {
+			reference = NULL;
+			break;
+		}
+	}
+
+	if (!reference) {
+		fprintf(stderr, "Usage: ppdmp-bisect --reference=ref/prim_%%d.bmp [--reference-cmd=\"cmd %%d %%s\"] [--dir=.] [--tolerance=0] [--max-pixels=0]\n");
+		return 1;
+	}
+
+	// Anything left from a previous run would look like a new question.
+	const std::string nextFile = dir + "/__bisect_next.txt";
+	remove(nextFile.c_str());
+	printf("Waiting for playback.prx --bisect...\n");
+
+	std::string last;
+	int steps = 0;
+	while (true) {
+		std::string next;
+		if (!ReadText(nextFile, next) || next == last || next.empty() || next[next.size() - 1] != '\n') {
+			usleep(POLL_US);
+			continue;
+		}
+		last = next;
+
+		if (!strncmp(next.c_str(), "first ", strlen("first "))) {
+			printf("First different prim: %d (%d screenshots)\n", atoi(next.c_str() + strlen("first ")), steps);
+			return 0;
+		}
+		if (next == "none\n") {
+			printf("No differences (%d screenshots)\n", steps);
+			return 0;
+		}
+
+		const int prim = atoi(next.c_str());
+		char name[64];
+		snprintf(name, sizeof(name), "/__bisect_%d", prim);
+		Bitmap shot, ref;
+		if (!ReadBmp((dir + name + ".bmp").c_str(), shot)) {
+			fprintf(stderr, "Unable to read screenshot %s%s.bmp\n", dir.c_str(), name);
+			return 1;
+		}
+		if (!LoadReference(reference, command, prim, ref)) {
+			return 1;
+		}
+
+		const int diffs = CountDiffs(shot, ref, compare.tolerance);
+		const bool good = diffs <= compare.maxPixels;
+		printf("Prims 1-%d: %d pixels differ, %s\n", prim, diffs, good ? "good" : "bad");
+		steps++;
+		if (!WriteText(dir + name + ".txt", good ? "good\n" : "bad\n")) {
+			fprintf(stderr, "Unable to write answer %s%s.txt\n", dir.c_str(), name);
+			return 1;
+		}
+	}
+}
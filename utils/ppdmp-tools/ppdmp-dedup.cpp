@@ -0,0 +1,186 @@
+// Rewrites a frame dump so identical data is only stored once.
+//
+// Commands that upload the same bytes (textures, vertices, framebuffers, etc.)
+// are pointed at a single copy.  Data used more than once goes first in the
+// buffer, so streaming playback can keep it resident (see Replay::FindSharedEnd.)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <vector>
+#include "zstd/lib/common/xxhash.h"
+#include "dumpfile.h"
+
+struct Blob {
+	uint32_t ptr;
+	uint32_t sz;
+	uint32_t uses;
+	uint32_t newPtr;
+};
+
+struct BlobKey {
+	uint64_t hash;
+	uint32_t sz;
+
+	bool operator <(const BlobKey &other) const {
+		return hash < other.hash || (hash == other.hash && sz < other.sz);
+	}
+};
+
+typedef std::multimap<BlobKey, uint32_t> BlobMap;
+
+static std::vector<Command> cmds;
+static std::vector<uint8_t> buf;
+
+static uint32_t AlignLike(uint32_t pos, uint32_t ptr) {
+	// Keep the same 16 byte alignment the data had, textures and CLUTs need it.
+	uint32_t aligned = (pos & ~15) | (ptr & 15);
+	return aligned < pos ? aligned + 16 : aligned;
+}
+
+static uint32_t Place(std::vector<Blob> &blobs, bool shared, uint32_t pos) {
+	for (size_t i = 0; i < blobs.size(); ++i) {
+		Blob &blob = blobs[i];
+		if ((blob.uses > 1) == shared) {
+			blob.newPtr = AlignLike(pos, blob.ptr);
+			pos = blob.newPtr + blob.sz;
+		}
+	}
+	return pos;
+}
+
+static bool Verify(const char *filename, const std::vector<Command> &newCmds) {
+	MappedDump dump;
+	std::vector<Command> checkCmds;
+	std::vector<uint8_t> checkBuf;
+	if (!dump.Open(filename) || !dump.ReadCommands(checkCmds) || !dump.ReadBuffer(checkBuf)) {
+		fprintf(stderr, "Unable to read back %s\n", filename);
+		return false;
+	}
+	if (checkCmds.size() != cmds.size() || memcmp(checkCmds.data(), newCmds.data(), sizeof(Command) * cmds.size()) != 0) {
+		fprintf(stderr, "Commands differ after writing\n");
+		return false;
+	}
+
+	for (size_t i = 0; i < cmds.size(); ++i) {
+		const Command &before = cmds[i];
+		const Command &after = checkCmds[i];
+		if (before.type != after.type || before.sz != after.sz) {
+			fprintf(stderr, "Command %d changed type or size\n", (int)i);
+			return false;
+		}
+		if (after.ptr + (uint64_t)after.sz > checkBuf.size() || memcmp(buf.data() + before.ptr, checkBuf.data() + after.ptr, before.sz) != 0) {
+			fprintf(stderr, "Command %d (%s) data differs\n", (int)i, CommandTypeName(before.type));
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	const char *input = NULL;
+	const char *output = NULL;
+	int level = 9;
+	bool verify = false;
+
+	for (int i = 1; i < argc; ++i) {
+		if (!strncmp(argv[i], "--level=", strlen("--level="))) {
+			level = atoi(argv[i] + strlen("--level="));
+		} else if (!strcmp(argv[i], "--verify")) {
+			verify = true;
+		} else if (!input) {
+			input = argv[i];
+		} else if (!output) {
+			output = argv[i];
+		} else {
+			input = NULL;
+			break;
+		}
+	}
+
+	if (!input || !output) {
+		fprintf(stderr, "Usage: ppdmp-dedup in.ppdmp out.ppdmp [--level=9] [--verify]\n");
+		return 1;
+	}
+
+	MappedDump dump;
+	if (!dump.Open(input) || dump.IsSeekable()) {
+		fprintf(stderr, "Not a valid frame dump: %s\n", input);
+		return 1;
+	}
+	if (!dump.ReadCommands(cmds) || !dump.ReadBuffer(buf)) {
+		fprintf(stderr, "Unable to decompress %s\n", input);
+		return 1;
+	}
+
+	// Find each distinct blob, in order of first use.
+	std::vector<Blob> blobs;
+	std::vector<uint32_t> cmdBlob(cmds.size());
+	BlobMap byHash;
+	for (size_t i = 0; i < cmds.size(); ++i) {
+		const Command &cmd = cmds[i];
+		if (cmd.ptr + (uint64_t)cmd.sz > buf.size()) {
+			fprintf(stderr, "Command %d (%s) is out of bounds\n", (int)i, CommandTypeName(cmd.type));
+			return 1;
+		}
+
+		const uint8_t *data = buf.data() + cmd.ptr;
+		BlobKey key = { XXH64(data, cmd.sz, 0), cmd.sz };
+		uint32_t found = (uint32_t)blobs.size();
+		std::pair<BlobMap::const_iterator, BlobMap::const_iterator> range = byHash.equal_range(key);
+		for (BlobMap::const_iterator it = range.first; it != range.second; ++it) {
+			const Blob &blob = blobs[it->second];
+			if ((blob.ptr & 15) == (cmd.ptr & 15) && memcmp(buf.data() + blob.ptr, data, cmd.sz) == 0) {
+				found = it->second;
+				break;
+			}
+		}
+
+		if (found == blobs.size()) {
+			Blob blob = { cmd.ptr, cmd.sz, 0, 0 };
+			blobs.push_back(blob);
+			byHash.insert(std::make_pair(key, found));
+		}
+		blobs[found].uses++;
+		cmdBlob[i] = found;
+	}
+
+	uint32_t sharedEnd = Place(blobs, true, 0);
+	uint32_t newSize = Place(blobs, false, (sharedEnd + 15) & ~15);
+
+	std::vector<uint8_t> newBuf(newSize);
+	for (size_t i = 0; i < blobs.size(); ++i) {
+		memcpy(newBuf.data() + blobs[i].newPtr, buf.data() + blobs[i].ptr, blobs[i].sz);
+	}
+	std::vector<Command> newCmds(cmds);
+	for (size_t i = 0; i < cmds.size(); ++i) {
+		newCmds[i].ptr = blobs[cmdBlob[i]].newPtr;
+	}
+
+	if (!WriteDump(output, dump.Header(), newCmds, newBuf, level)) {
+		fprintf(stderr, "Unable to write %s\n", output);
+		return 1;
+	}
+
+	MappedDump written;
+	size_t newFileSize = written.Open(output) ? written.FileSize() : 0;
+	uint32_t sharedBlobs = 0;
+	for (size_t i = 0; i < blobs.size(); ++i) {
+		if (blobs[i].uses > 1) {
+			sharedBlobs++;
+		}
+	}
+
+	printf("%d commands, %d distinct blobs, %d used more than once (%u bytes)\n", (int)cmds.size(), (int)blobs.size(), sharedBlobs, sharedEnd);
+	printf("Buffer: %u -> %u bytes, saved %lld\n", (uint32_t)buf.size(), newSize, (long long)buf.size() - newSize);
+	printf("File: %u -> %u bytes, saved %lld\n", (uint32_t)dump.FileSize(), (uint32_t)newFileSize, (long long)dump.FileSize() - (long long)newFileSize);
+
+	if (verify) {
+		if (!Verify(output, newCmds)) {
+			return 1;
+		}
+		printf("Verified %d commands\n", (int)cmds.size());
+	}
+	return 0;
+}
@@ -0,0 +1,488 @@
+// Exports a frame dump as one flat GE display list with a relocation table, see FlatHeader in
+// ppdmp.h.  Everything playback's Replay does while running is resolved here instead: data
+// pointers become relocations, and memory copies become GE block transfers where possible.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <vector>
+#include "commands.h"
+#include "dumpfile.h"
+
+// Block transfers are split into rows of this many pixels.
+static const uint32_t TRANSFER_WIDTH = 512;
+static const uint32_t TRANSFER_MAX_ROWS = 1024;
+
+class Flattener {
+public:
+	Flattener(const std::vector<uint8_t> &buf);
+
+	bool Run(const std::vector<Command> &cmds);
+	bool Write(const char *filename) const;
+
+	uint32_t ListWords() const {
+		return (uint32_t)list_.size();
+	}
+	uint32_t Relocs() const {
+		return (uint32_t)relocs_.size();
+	}
+	uint32_t Ops() const {
+		return (uint32_t)ops_.size();
+	}
+	uint32_t DataSize() const {
+		return (uint32_t)data_.size();
+	}
+	uint32_t Transfers() const {
+		return transfers_;
+	}
+	uint32_t Prims() const {
+		return prims_;
+	}
+
+private:
+	// The last word written for each register, so it can be put back after a transfer.
+	struct RegWord {
+		bool set;
+		bool relocated;
+		FlatRelocType::Value type;
+		uint32_t word;
+		uint32_t offset;
+	};
+
+	void Emit(uint32_t word);
+	void EmitReloc(uint32_t word, FlatRelocType::Value type, uint32_t offset);
+	void Restore(uint32_t op, const RegWord &saved);
+	uint32_t AddData(uint32_t ptr, uint32_t sz);
+	uint32_t AppendData(const void *p, uint32_t sz);
+	void AddOp(FlatOpType::Value type, uint32_t a, uint32_t b, uint32_t c);
+	void Copy(uint32_t dest, uint32_t offset, uint32_t sz);
+
+	void Init(const Command &cmd);
+	void Registers(const Command &cmd);
+	void Texture(int level, const Command &cmd);
+	void Framebuf(int level, const Command &cmd);
+
+	uint32_t ReadU32(uint32_t ptr) const {
+		uint32_t v;
+		memcpy(&v, &buf_[ptr], sizeof(v));
+		return v;
+	}
+
+	const std::vector<uint8_t> &buf_;
+	std::vector<uint32_t> list_;
+	std::vector<FlatReloc> relocs_;
+	std::vector<FlatOp> ops_;
+	std::vector<uint8_t> data_;
+	// Buffer range -> data offset, so data used more than once is only stored once.
+	std::map<uint64_t, uint32_t> dataOffsets_;
+
+	RegWord regs_[256];
+	uint16_t lastBufw_[8];
+	uint32_t clutAddr_;
+	uint32_t clutFlags_;
+	uint32_t memcpyDest_;
+	uint32_t transfers_;
+	uint32_t prims_;
+};
+
+Flattener::Flattener(const std::vector<uint8_t> &buf) : buf_(buf), clutAddr_(0), clutFlags_(0), memcpyDest_(0), transfers_(0), prims_(0) {
+	memset(regs_, 0, sizeof(regs_));
+	memset(lastBufw_, 0, sizeof(lastBufw_));
+}
+
+void Flattener::Emit(uint32_t word) {
+	RegWord &reg = regs_[word >> 24];
+	reg.set = true;
+	reg.relocated = false;
+	reg.word = word;
+	list_.push_back(word);
+}
+
+void Flattener::EmitReloc(uint32_t word, FlatRelocType::Value type, uint32_t offset) {
+	FlatReloc reloc;
+	reloc.word = (uint32_t)list_.size() | ((uint32_t)type << FLAT_RELOC_TYPE_SHIFT);
+	reloc.offset = offset;
+	relocs_.push_back(reloc);
+
+	Emit(word);
+	RegWord &reg = regs_[word >> 24];
+	reg.relocated = true;
+	reg.type = type;
+	reg.offset = offset;
+}
+
+void Flattener::Restore(uint32_t op, const RegWord &saved) {
+	if (!saved.set) {
+		// Never set by the dump, so nothing can depend on it.
+		regs_[op] = saved;
+		return;
+	}
+	if (saved.relocated) {
+		EmitReloc(saved.word, saved.type, saved.offset);
+	} else {
+		Emit(saved.word);
+	}
+}
+
+uint32_t Flattener::AddData(uint32_t ptr, uint32_t sz) {
+	const uint64_t key = ((uint64_t)ptr << 32) | sz;
+	std::map<uint64_t, uint32_t>::const_iterator it = dataOffsets_.find(key);
+	if (it != dataOffsets_.end()) {
+		return it->second;
+	}
+
+	const uint32_t offset = AppendData(&buf_[ptr], sz);
+	dataOffsets_[key] = offset;
+	return offset;
+}
+
+uint32_t Flattener::AppendData(const void *p, uint32_t sz) {
+	// Textures and CLUTs need 16 byte alignment.
+	const uint32_t offset = (uint32_t)((data_.size() + 15) & ~15);
+	data_.resize(offset + sz);
+	memcpy(&data_[offset], p, sz);
+	return offset;
+}
+
+void Flattener::AddOp(FlatOpType::Value type, uint32_t a, uint32_t b, uint32_t c) {
+	FlatOp op;
+	op.type = type;
+	op.listPos = (uint32_t)list_.size();
+	op.args[0] = a;
+	op.args[1] = b;
+	op.args[2] = c;
+	ops_.push_back(op);
+}
+
+void Flattener::Copy(uint32_t dest, uint32_t offset, uint32_t sz) {
+	// Block transfers work in 16 or 32-bit pixels, from 16 byte aligned addresses.
+	const uint32_t bpp = ((dest | sz) & 3) == 0 ? 4 : (((dest | sz) & 1) == 0 ? 2 : 0);
+	if (bpp == 0 || sz == 0) {
+		AddOp(FlatOpType::MEMCPY, dest, offset, sz);
+		return;
+	}
+
+	// The transfer below overwrites these, so keep what the dump had set.
+	static const uint8_t transferRegs[] = {
+		GE_CMD_TRANSFERSRC, GE_CMD_TRANSFERSRCW, GE_CMD_TRANSFERDST, GE_CMD_TRANSFERDSTW,
+		GE_CMD_TRANSFERSRCPOS, GE_CMD_TRANSFERDSTPOS, GE_CMD_TRANSFERSIZE,
+	};
+	RegWord saved[sizeof(transferRegs)];
+	for (size_t i = 0; i < sizeof(transferRegs); ++i) {
+		saved[i] = regs_[transferRegs[i]];
+	}
+
+	const uint32_t pixels = sz / bpp;
+	const uint32_t dstX = (dest & 0xF) / bpp;
+	uint32_t done = 0;
+	while (done < pixels) {
+		uint32_t width = TRANSFER_WIDTH;
+		uint32_t rows = std::min((pixels - done) / TRANSFER_WIDTH, TRANSFER_MAX_ROWS);
+		if (rows == 0) {
+			width = pixels - done;
+			rows = 1;
+		}
+
+		// Always a multiple of TRANSFER_WIDTH pixels in, so still aligned.
+		const uint32_t src = offset + done * bpp;
+		const uint32_t dst = (dest & ~0xF) + done * bpp;
+		EmitReloc(GE_CMD_TRANSFERSRC << 24, FlatRelocType::LOW, src);
+		EmitReloc((GE_CMD_TRANSFERSRCW << 24) | TRANSFER_WIDTH, FlatRelocType::HIGH, src);
+		Emit((GE_CMD_TRANSFERDST << 24) | (dst & 0x00FFFFF0));
+		Emit((GE_CMD_TRANSFERDSTW << 24) | ((dst >> 8) & 0x00FF0000) | TRANSFER_WIDTH);
+		Emit(GE_CMD_TRANSFERSRCPOS << 24);
+		Emit((GE_CMD_TRANSFERDSTPOS << 24) | dstX);
+		Emit((GE_CMD_TRANSFERSIZE << 24) | (width - 1) | ((rows - 1) << 10));
+		Emit((GE_CMD_TRANSFERSTART << 24) | (bpp == 4 ? 1 : 0));
+		transfers_++;
+		done += width * rows;
+	}
+	Emit(GE_CMD_TEXFLUSH << 24);
+
+	// Put back what the dump had set, in case a transfer of its own uses them later.
+	for (size_t i = 0; i < sizeof(transferRegs); ++i) {
+		Restore(transferRegs[i], saved[i]);
+	}
+}
+
+static bool IsFlowCommand(uint32_t op) {
+	switch (op) {
+	case GE_CMD_JUMP:
+	case GE_CMD_BJUMP:
+	case GE_CMD_CALL:
+	case GE_CMD_RET:
+	case GE_CMD_END:
+	case GE_CMD_SIGNAL:
+	case GE_CMD_FINISH:
+		return true;
+	}
+	return false;
+}
+
+void Flattener::Init(const Command &cmd) {
+	// Restored by the CPU like playback does, since the context has more than registers.
+	uint32_t context[512];
+	memset(context, 0, sizeof(context));
+	memcpy(context, &buf_[cmd.ptr], std::min(cmd.sz, (uint32_t)sizeof(context)));
+
+	bool isOldState = true;
+	for (int i = 17; i < 512; ++i) {
+		if (context[i] == (uint32_t)GE_CMD_END << 24) {
+			isOldState = false;
+		}
+	}
+	if (isOldState) {
+		for (int i = 234; i < 512; ++i) {
+			context[i] = GE_CMD_END << 24;
+		}
+	}
+	AddOp(FlatOpType::INIT, AppendData(context, sizeof(context)), 0, 0);
+
+	// Remember what it set, so transfers can put the registers back.
+	for (int i = 17; i < 512 && context[i] != (uint32_t)GE_CMD_END << 24; ++i) {
+		RegWord &reg = regs_[context[i] >> 24];
+		reg.set = true;
+		reg.relocated = false;
+		reg.word = context[i];
+	}
+}
+
+void Flattener::Registers(const Command &cmd) {
+	for (uint32_t i = 0; i < cmd.sz / 4; ++i) {
+		const uint32_t word = ReadU32(cmd.ptr + i * 4);
+		const uint32_t op = word >> 24;
+
+		if (op >= GE_CMD_TEXBUFWIDTH0 && op <= GE_CMD_TEXBUFWIDTH7) {
+			// Like playback, keep the upper address bits of the current texture.
+			const int level = op - GE_CMD_TEXBUFWIDTH0;
+			const uint16_t bufw = word & 0xFFFF;
+			if (bufw != lastBufw_[level]) {
+				lastBufw_[level] = bufw;
+				RegWord reg = regs_[op];
+				const uint32_t updated = (op << 24) | (reg.set ? reg.word & 0x00FF0000 : 0) | bufw;
+				if (reg.set && reg.relocated) {
+					EmitReloc(updated, reg.type, reg.offset);
+				} else {
+					Emit(updated);
+				}
+			}
+			continue;
+		}
+		if (op >= GE_CMD_TEXADDR0 && op <= GE_CMD_TEXADDR7) {
+			// Playback NOPs these, textures come from TEXTURE and FRAMEBUF commands.
+			continue;
+		}
+		if (IsFlowCommand(op)) {
+			// Already followed when the dump was recorded.
+			continue;
+		}
+		if (IsPrimCommand(op)) {
+			prims_++;
+		}
+		Emit(word);
+	}
+}
+
+void Flattener::Texture(int level, const Command &cmd) {
+	const uint32_t offset = AddData(cmd.ptr, cmd.sz);
+	EmitReloc(((GE_CMD_TEXBUFWIDTH0 + level) << 24) | lastBufw_[level], FlatRelocType::HIGH, offset);
+	EmitReloc((GE_CMD_TEXADDR0 + level) << 24, FlatRelocType::LOW, offset);
+}
+
+void Flattener::Framebuf(int level, const Command &cmd) {
+	// Address, bufw, flags, pad, and then the data.
+	const uint32_t addr = ReadU32(cmd.ptr);
+	const uint32_t bufw = ReadU32(cmd.ptr + 4);
+	const uint32_t flags = ReadU32(cmd.ptr + 8);
+	if ((flags & 1) == 0) {
+		Copy(addr, AddData(cmd.ptr + 16, cmd.sz - 16), cmd.sz - 16);
+	}
+
+	Emit(((GE_CMD_TEXBUFWIDTH0 + level) << 24) | ((addr >> 8) & 0x00FF0000) | (bufw & 0xFFFF));
+	Emit(((GE_CMD_TEXADDR0 + level) << 24) | (addr & 0x00FFFFFF));
+	lastBufw_[level] = bufw & 0xFFFF;
+}
+
+static bool IsVRAMAddress(uint32_t addr) {
+	return (addr & 0x3F800000) == 0x04000000;
+}
+
+bool Flattener::Run(const std::vector<Command> &cmds) {
+	for (size_t i = 0; i < cmds.size(); ++i) {
+		const Command &cmd = cmds[i];
+		if (cmd.ptr + (uint64_t)cmd.sz > buf_.size()) {
+			fprintf(stderr, "Command %d (%s) is out of bounds\n", (int)i, CommandTypeName(cmd.type));
+			return false;
+		}
+
+		switch (cmd.type) {
+		case CommandType::INIT:
+			Init(cmd);
+			break;
+
+		case CommandType::REGISTERS:
+			Registers(cmd);
+			break;
+
+		case CommandType::VERTICES:
+		case CommandType::INDICES: {
+			const uint32_t offset = AddData(cmd.ptr, cmd.sz);
+			EmitReloc(GE_CMD_BASE << 24, FlatRelocType::HIGH, offset);
+			EmitReloc((cmd.type == CommandType::VERTICES ? GE_CMD_VADDR : GE_CMD_IADDR) << 24, FlatRelocType::LOW, offset);
+			break;
+		}
+
+		case CommandType::CLUTADDR:
+			clutAddr_ = ReadU32(cmd.ptr);
+			clutFlags_ = ReadU32(cmd.ptr + 4);
+			break;
+
+		case CommandType::CLUT:
+			if (clutAddr_ != 0) {
+				// Otherwise the palette was drawn, and is already in memory.
+				if ((clutFlags_ & 1) == 0) {
+					Copy(clutAddr_, AddData(cmd.ptr, cmd.sz), cmd.sz);
+				}
+				clutAddr_ = 0;
+			} else {
+				const uint32_t offset = AddData(cmd.ptr, cmd.sz);
+				EmitReloc(GE_CMD_CLUTADDRUPPER << 24, FlatRelocType::HIGH, offset);
+				EmitReloc(GE_CMD_CLUTADDR << 24, FlatRelocType::LOW, offset);
+			}
+			break;
+
+		case CommandType::TRANSFERSRC: {
+			const uint32_t offset = AddData(cmd.ptr, cmd.sz);
+			const RegWord &srcw = regs_[GE_CMD_TRANSFERSRCW];
+			const uint32_t stride = srcw.set ? srcw.word & 0x0000FFFF : 0;
+			EmitReloc((GE_CMD_TRANSFERSRCW << 24) | stride, FlatRelocType::HIGH, offset);
+			EmitReloc(GE_CMD_TRANSFERSRC << 24, FlatRelocType::LOW, offset);
+			break;
+		}
+
+		case CommandType::MEMSET:
+			// Only VRAM, like playback.
+			if (IsVRAMAddress(ReadU32(cmd.ptr))) {
+				AddOp(FlatOpType::MEMSET, ReadU32(cmd.ptr), ReadU32(cmd.ptr + 4), ReadU32(cmd.ptr + 8));
+			}
+			break;
+
+		case CommandType::MEMCPYDEST:
+			memcpyDest_ = ReadU32(cmd.ptr);
+			break;
+
+		case CommandType::MEMCPYDATA:
+			if (IsVRAMAddress(memcpyDest_)) {
+				Copy(memcpyDest_, AddData(cmd.ptr, cmd.sz), cmd.sz);
+			}
+			break;
+
+		case CommandType::DISPLAY:
+			AddOp(FlatOpType::DISPLAY, ReadU32(cmd.ptr), ReadU32(cmd.ptr + 4), ReadU32(cmd.ptr + 8));
+			break;
+
+		case CommandType::EDRAMTRANS:
+			AddOp(FlatOpType::EDRAMTRANS, ReadU32(cmd.ptr), 0, 0);
+			break;
+
+		default:
+			if (cmd.type >= CommandType::TEXTURE0 && cmd.type <= CommandType::TEXTURE7) {
+				Texture(cmd.type - CommandType::TEXTURE0, cmd);
+			} else if (cmd.type >= CommandType::FRAMEBUF0 && cmd.type <= CommandType::FRAMEBUF7 && cmd.sz >= 16) {
+				Framebuf(cmd.type - CommandType::FRAMEBUF0, cmd);
+			} else {
+				fprintf(stderr, "Unsupported GE dump command: %d\n", (int)cmd.type);
+				return false;
+			}
+			break;
+		}
+	}
+
+	Emit(GE_CMD_FINISH << 24);
+	Emit(GE_CMD_END << 24);
+	return true;
+}
+
+static bool WritePadded(FILE *fp, const void *data, size_t sz) {
+	static const uint8_t zeros[16] = { 0 };
+	const size_t pad = (16 - (sz & 15)) & 15;
+	return (sz == 0 || fwrite(data, sz, 1, fp) == 1) && (pad == 0 || fwrite(zeros, pad, 1, fp) == 1);
+}
+
+bool Flattener::Write(const char *filename) const {
+	FILE *fp = fopen(filename, "wb");
+	if (!fp) {
+		fprintf(stderr, "Unable to create %s\n", filename);
+		return false;
+	}
+
+	FlatHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, FLAT_MAGIC, sizeof(header.magic));
+	header.version = FLAT_VERSION;
+	header.listWords = (uint32_t)list_.size();
+	header.relocCount = (uint32_t)relocs_.size();
+	header.opCount = (uint32_t)ops_.size();
+	header.dataSize = (uint32_t)data_.size();
+	header.prims = prims_;
+
+	bool success = WritePadded(fp, &header, sizeof(header));
+	success = success && WritePadded(fp, list_.data(), list_.size() * sizeof(uint32_t));
+	success = success && WritePadded(fp, relocs_.data(), relocs_.size() * sizeof(FlatReloc));
+	success = success && WritePadded(fp, ops_.data(), ops_.size() * sizeof(FlatOp));
+	success = success && WritePadded(fp, data_.data(), data_.size());
+	success = fclose(fp) == 0 && success;
+	if (!success) {
+		fprintf(stderr, "Unable to write %s\n", filename);
+	}
+	return success;
+}
+
+int main(int argc, char *argv[]) {
+	const char *input = NULL;
+	const char *output = NULL;
+
+	for (int i = 1; i < argc; ++i) {
+		if (!input) {
+			input = argv[i];
+		} else if (!output) {
+			output = argv[i];
+		} else {
+			output = NULL;
+			break;
+		}
+	}
+
+	if (!input || !output) {
+		fprintf(stderr, "Usage: ppdmp-flatten framedump.ppdmp framedump.ppflat\n");
+		return 1;
+	}
+
+	MappedDump dump;
+	if (!dump.Open(input)) {
+		fprintf(stderr, "Not a valid frame dump: %s\n", input);
+		return 1;
+	}
+	if (dump.IsSeekable()) {
+		fprintf(stderr, "Seekable dumps can't be flattened, use the original dump\n");
+		return 1;
+	}
+
+	std::vector<Command> cmds;
+	std::vector<uint8_t> buf;
+	if (!dump.ReadCommands(cmds) || !dump.ReadBuffer(buf)) {
+		fprintf(stderr, "Unable to decompress dump\n");
+		return 1;
+	}
+
+	Flattener flat(buf);
+	if (!flat.Run(cmds) || !flat.Write(output)) {
+		return 1;
+	}
+
+	printf("%u commands, %u prims -> %u list words, %u relocations, %u block transfers\n", (uint32_t)cmds.size(), flat.Prims(), flat.ListWords(), flat.Relocs(), flat.Transfers());
+	printf("Data: %u bytes (from %u), CPU stops: %u\n", flat.DataSize(), (uint32_t)buf.size(), flat.Ops());
+	return 0;
+}
@@ -0,0 +1,193 @@
+// Prints a summary of what's in a frame dump, without running it.
+
+#include <stdio.h>
+#include <string.h>
+#include <map>
+#include <vector>
+#include "dumpfile.h"
+
+struct TypeStats {
+	uint32_t count;
+	uint64_t bytes;
+};
+
+struct FramebufKey {
+	uint32_t addr;
+	uint32_t bufw;
+
+	bool operator <(const FramebufKey &other) const {
+		return addr < other.addr || (addr == other.addr && bufw < other.bufw);
+	}
+};
+
+struct FramebufStats {
+	uint32_t count;
+	uint32_t copied;
+	uint32_t maxBytes;
+};
+
+static double MB(uint64_t bytes) {
+	return bytes / (1024.0 * 1024.0);
+}
+
+static void PrintTypes(const TypeStats stats[256]) {
+	printf("\n%-12s %10s %14s\n", "Command", "Count", "Bytes");
+	for (int type = 0; type < 256; ++type) {
+		if (stats[type].count != 0) {
+			printf("%-12s %10u %14llu\n", CommandTypeName(type), stats[type].count, (unsigned long long)stats[type].bytes);
+		}
+	}
+}
+
+static bool PrintSummary(const std::vector<Command> &cmds, const std::vector<uint8_t> &buf) {
+	TypeStats stats[256];
+	memset(stats, 0, sizeof(stats));
+	uint32_t prims = 0;
+	uint32_t registerWords = 0;
+	uint32_t texLevels[8] = { 0 };
+	uint64_t texBytes = 0;
+	uint32_t texMax = 0;
+	std::map<uint64_t, uint32_t> texUnique;
+	std::map<FramebufKey, FramebufStats> framebufs;
+	std::map<FramebufKey, uint32_t> displays;
+
+	for (size_t i = 0; i < cmds.size(); ++i) {
+		const Command &cmd = cmds[i];
+		if (cmd.ptr + (uint64_t)cmd.sz > buf.size()) {
+			fprintf(stderr, "Command %d (%s) is out of bounds\n", (int)i, CommandTypeName(cmd.type));
+			return false;
+		}
+
+		stats[cmd.type].count++;
+		stats[cmd.type].bytes += cmd.sz;
+		const uint8_t *data = buf.data() + cmd.ptr;
+
+		if (cmd.type == CommandType::REGISTERS) {
+			prims += CountPrims((const uint32_t *)data, cmd.sz / 4);
+			registerWords += cmd.sz / 4;
+		} else if (cmd.type >= CommandType::TEXTURE0 && cmd.type <= CommandType::TEXTURE7) {
+			texLevels[cmd.type - CommandType::TEXTURE0]++;
+			texBytes += cmd.sz;
+			if (cmd.sz > texMax) {
+				texMax = cmd.sz;
+			}
+			texUnique[((uint64_t)cmd.ptr << 32) | cmd.sz]++;
+		} else if (cmd.type >= CommandType::FRAMEBUF0 && cmd.type <= CommandType::FRAMEBUF7 && cmd.sz >= 16) {
+			// Address, bufw, flags, pad, and then the data.
+			uint32_t header[4];
+			memcpy(header, data, sizeof(header));
+			FramebufKey key = { header[0], header[1] };
+			FramebufStats &fb = framebufs[key];
+			fb.count++;
+			if ((header[2] & 1) == 0) {
+				fb.copied++;
+			}
+			if (cmd.sz - 16 > fb.maxBytes) {
+				fb.maxBytes = cmd.sz - 16;
+			}
+		} else if (cmd.type == CommandType::DISPLAY && cmd.sz >= 12) {
+			// Address, linesize, pixel format.
+			uint32_t disp[3];
+			memcpy(disp, data, sizeof(disp));
+			FramebufKey key = { disp[0], (disp[1] << 8) | disp[2] };
+			displays[key]++;
+		}
+	}
+
+	PrintTypes(stats);
+
+	printf("\nPrims: %u in %u register words\n", prims, registerWords);
+	printf("Textures: %u uploads, %u distinct, %.2f MB total, largest %u bytes\n", stats[CommandType::TEXTURE0].count + stats[CommandType::TEXTURE1].count + stats[CommandType::TEXTURE2].count + stats[CommandType::TEXTURE3].count + stats[CommandType::TEXTURE4].count + stats[CommandType::TEXTURE5].count + stats[CommandType::TEXTURE6].count + stats[CommandType::TEXTURE7].count, (uint32_t)texUnique.size(), MB(texBytes), texMax);
+	for (int level = 0; level < 8; ++level) {
+		if (texLevels[level] != 0) {
+			printf("  level %d: %u\n", level, texLevels[level]);
+		}
+	}
+
+	if (!framebufs.empty()) {
+		printf("Framebuffers:\n");
+		for (std::map<FramebufKey, FramebufStats>::const_iterator it = framebufs.begin(); it != framebufs.end(); ++it) {
+			printf("  %08x bufw %4u: %u uses, %u copied, %u bytes\n", it->first.addr, it->first.bufw, it->second.count, it->second.copied, it->second.maxBytes);
+		}
+	}
+	if (!displays.empty()) {
+		printf("Displays:\n");
+		for (std::map<FramebufKey, uint32_t>::const_iterator it = displays.begin(); it != displays.end(); ++it) {
+			printf("  %08x linesize %4u format %u: %u times\n", it->first.addr, it->first.bufw >> 8, it->first.bufw & 0xFF, it->second);
+		}
+	}
+	return true;
+}
+
+static bool PrintDump(const MappedDump &dump) {
+	const DumpHeader &header = dump.Header();
+	printf("Version %d, %u commands, %.2f MB buffer (%.2f MB compressed)\n", header.version, header.cmdCount, MB(header.bufSize), MB(dump.CompressedBufferSize()));
+
+	std::vector<Command> cmds;
+	std::vector<uint8_t> buf;
+	if (!dump.ReadCommands(cmds) || !dump.ReadBuffer(buf)) {
+		fprintf(stderr, "Unable to decompress dump\n");
+		return false;
+	}
+	return PrintSummary(cmds, buf);
+}
+
+static bool PrintSeekable(const MappedDump &dump) {
+	const SeekableHeader &header = dump.SeekableInfo();
+	const SeekableChunk *chunks = dump.Chunks();
+	printf("Seekable version %u (from version %u), %u chunks, %u prims\n", header.version, header.dumpVersion, header.chunkCount, header.primCount);
+
+	printf("\n%6s %10s %8s %10s %12s %10s %12s\n", "Chunk", "Prims", "Prologue", "Commands", "Bytes", "MemCmds", "MemBytes");
+	for (uint32_t i = 0; i < header.chunkCount; ++i) {
+		const SeekableChunk &chunk = chunks[i];
+		if (chunk.primCount == 0) {
+			printf("%6u %10s %8u %10u %12u %10u %12u\n", i, "none", chunk.prologueCmds, chunk.cmdCount, chunk.bufSize, chunk.memCmdCount, chunk.memBufSize);
+		} else {
+			printf("%6u %4u-%-5u %8u %10u %12u %10u %12u\n", i, chunk.primStart + 1, chunk.primStart + chunk.primCount, chunk.prologueCmds, chunk.cmdCount, chunk.bufSize, chunk.memCmdCount, chunk.memBufSize);
+		}
+	}
+
+	TypeStats stats[256];
+	memset(stats, 0, sizeof(stats));
+	std::vector<Command> cmds;
+	std::vector<uint8_t> buf;
+	for (uint32_t i = 0; i < header.chunkCount; ++i) {
+		if (!dump.ReadChunk(chunks[i].offset, chunks[i].cmdCount, chunks[i].bufSize, cmds, buf)) {
+			fprintf(stderr, "Unable to decompress chunk %u\n", i);
+			return false;
+		}
+		for (size_t j = chunks[i].prologueCmds; j < cmds.size(); ++j) {
+			stats[cmds[j].type].count++;
+			stats[cmds[j].type].bytes += cmds[j].sz;
+		}
+	}
+
+	PrintTypes(stats);
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 2) {
+		fprintf(stderr, "Usage: ppdmp-info dump.ppdmp [dump2.ppdmp ...]\n");
+		return 1;
+	}
+
+	int result = 0;
+	for (int i = 1; i < argc; ++i) {
+		if (argc > 2) {
+			printf("%s%s:\n", i > 1 ? "\n" : "", argv[i]);
+		}
+
+		MappedDump dump;
+		if (!dump.Open(argv[i])) {
+			fprintf(stderr, "Not a valid frame dump: %s\n", argv[i]);
+			result = 1;
+			continue;
+		}
+
+		if (!(dump.IsSeekable() ? PrintSeekable(dump) : PrintDump(dump))) {
+			result = 1;
+		}
+	}
+	return result;
+}
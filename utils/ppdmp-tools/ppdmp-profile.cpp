@@ -0,0 +1,184 @@
+// Summarizes a profile written by playback.prx --profile (see ProfileHeader in ppdmp.h.)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "ppdmp.h"
+
+struct TypeTotals {
+	uint8_t type;
+	uint32_t count;
+	uint64_t cpuUs;
+	uint64_t syncUs;
+	uint64_t geUs;
+	uint64_t dmaBytes;
+
+	uint64_t Total() const {
+		return cpuUs + syncUs + geUs;
+	}
+};
+
+struct PrimRange {
+	uint32_t start;
+	uint32_t count;
+	uint64_t geUs;
+	uint32_t batches;
+};
+
+static uint64_t EventTotal(const ProfileEvent &event) {
+	return (uint64_t)event.cpuUs + event.syncUs + event.geUs;
+}
+
+static bool ByTotal(const TypeTotals &a, const TypeTotals &b) {
+	return a.Total() > b.Total();
+}
+
+static bool ByEventTotal(const ProfileEvent &a, const ProfileEvent &b) {
+	return EventTotal(a) > EventTotal(b);
+}
+
+static bool ByRangeGE(const PrimRange &a, const PrimRange &b) {
+	return a.geUs > b.geUs;
+}
+
+static double Ms(uint64_t us) {
+	return us / 1000.0;
+}
+
+static bool ReadProfile(const char *filename, ProfileHeader &header, std::vector<ProfileEvent> &events) {
+	FILE *fp = fopen(filename, "rb");
+	if (!fp) {
+		fprintf(stderr, "Unable to open %s\n", filename);
+		return false;
+	}
+
+	bool valid = fread(&header, sizeof(header), 1, fp) == 1;
+	valid = valid && memcmp(header.magic, PROFILE_MAGIC, sizeof(header.magic)) == 0 && header.version == PROFILE_VERSION;
+	if (valid) {
+		events.resize(header.eventCount);
+		valid = fread(events.data(), sizeof(ProfileEvent), events.size(), fp) == events.size();
+	}
+	fclose(fp);
+
+	if (!valid) {
+		fprintf(stderr, "Not a valid profile: %s\n", filename);
+	}
+	return valid;
+}
+
+static void PrintTypes(const std::vector<ProfileEvent> &events) {
+	std::vector<TypeTotals> types(256);
+	for (size_t i = 0; i < types.size(); ++i) {
+		memset(&types[i], 0, sizeof(types[i]));
+		types[i].type = (uint8_t)i;
+	}
+	for (size_t i = 0; i < events.size(); ++i) {
+		TypeTotals &totals = types[events[i].type];
+		totals.count++;
+		totals.cpuUs += events[i].cpuUs;
+		totals.syncUs += events[i].syncUs;
+		totals.geUs += events[i].geUs;
+		totals.dmaBytes += events[i].dmaBytes;
+	}
+	std::stable_sort(types.begin(), types.end(), ByTotal);
+
+	printf("\n%-12s %8s %10s %10s %10s %10s %12s\n", "Command", "Count", "Total ms", "CPU ms", "Sync ms", "GE ms", "DMA bytes");
+	for (size_t i = 0; i < types.size() && types[i].count != 0; ++i) {
+		const TypeTotals &t = types[i];
+		printf("%-12s %8u %10.2f %10.2f %10.2f %10.2f %12llu\n", CommandTypeName(t.type), t.count, Ms(t.Total()), Ms(t.cpuUs), Ms(t.syncUs), Ms(t.geUs), (unsigned long long)t.dmaBytes);
+	}
+}
+
+static void PrintCommands(std::vector<ProfileEvent> events, size_t top) {
+	std::stable_sort(events.begin(), events.end(), ByEventTotal);
+
+	printf("\nSlowest commands:\n");
+	printf("%8s %-12s %10s %8s %8s %8s %6s %s\n", "Index", "Command", "Bytes", "CPU us", "Sync us", "GE us", "Syncs", "Prims");
+	for (size_t i = 0; i < events.size() && i < top; ++i) {
+		const ProfileEvent &e = events[i];
+		printf("%8u %-12s %10u %8u %8u %8u %6u", e.index, CommandTypeName(e.type), e.sz, e.cpuUs, e.syncUs, e.geUs, e.syncs);
+		if (e.primCount != 0) {
+			printf(" %u-%u", e.primStart + 1, e.primStart + e.primCount);
+		}
+		printf("\n");
+	}
+}
+
+static void PrintPrimRanges(const std::vector<ProfileEvent> &events, uint32_t rangeSize, size_t top) {
+	// Prims are numbered from 1, like --start and --end.
+	std::vector<PrimRange> ranges;
+	for (size_t i = 0; i < events.size(); ++i) {
+		const ProfileEvent &e = events[i];
+		if (e.primCount == 0) {
+			continue;
+		}
+
+		// Batches are counted where they start, GE time can't be split up any further.
+		size_t bucket = e.primStart / rangeSize;
+		while (ranges.size() <= bucket) {
+			PrimRange range = { (uint32_t)ranges.size() * rangeSize, rangeSize, 0, 0 };
+			ranges.push_back(range);
+		}
+		ranges[bucket].geUs += e.geUs;
+		ranges[bucket].batches++;
+	}
+	std::stable_sort(ranges.begin(), ranges.end(), ByRangeGE);
+
+	printf("\nSlowest prim ranges (use with --start/--end):\n");
+	printf("%-24s %10s %8s\n", "Prims", "GE ms", "Batches");
+	for (size_t i = 0; i < ranges.size() && i < top && ranges[i].geUs != 0; ++i) {
+		char name[32];
+		snprintf(name, sizeof(name), "--start=%u --end=%u", ranges[i].start + 1, ranges[i].start + ranges[i].count);
+		printf("%-24s %10.2f %8u\n", name, Ms(ranges[i].geUs), ranges[i].batches);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	const char *filename = NULL;
+	size_t top = 20;
+	uint32_t rangeSize = 100;
+
+	for (int i = 1; i < argc; ++i) {
+		if (!strncmp(argv[i], "--top=", strlen("--top="))) {
+			top = atoi(argv[i] + strlen("--top="));
+		} else if (!strncmp(argv[i], "--range=", strlen("--range="))) {
+			rangeSize = atoi(argv[i] + strlen("--range="));
+		} else if (!filename) {
+			filename = argv[i];
+		} else {
+			filename = NULL;
+			break;
+		}
+	}
+
+	if (!filename || rangeSize == 0) {
+		fprintf(stderr, "Usage: ppdmp-profile __profile.bin [--top=20] [--range=100]\n");
+		return 1;
+	}
+
+	ProfileHeader header;
+	std::vector<ProfileEvent> events;
+	if (!ReadProfile(filename, header, events)) {
+		return 1;
+	}
+
+	uint64_t cpuUs = 0, geUs = 0;
+	for (size_t i = 0; i < events.size(); ++i) {
+		cpuUs += events[i].cpuUs;
+		geUs += events[i].geUs;
+	}
+
+	printf("Run: %.2f ms, %u commands, %u prims\n", Ms(header.runUs), header.eventCount + header.droppedEvents, header.prims);
+	printf("Handlers: %.2f ms, GE drawing: %.2f ms\n", Ms(cpuUs), Ms(geUs));
+	printf("Syncs: %u (%.2f ms), ring waits: %u (%.2f ms), DMA: %llu bytes\n", header.syncStalls, Ms(header.syncStallUs), header.ringWaits, Ms(header.ringWaitUs), (unsigned long long)header.dmaBytes);
+	if (header.droppedEvents != 0) {
+		printf("WARNING: %u commands were not recorded, raise --profile\n", header.droppedEvents);
+	}
+
+	PrintTypes(events);
+	PrintCommands(events, top);
+	PrintPrimRanges(events, rangeSize, top);
+	return 0;
+}
@@ -0,0 +1,331 @@
+// Draws a frame dump on the host with a software GE, and writes the displayed framebuffer
+// like playback.prx's __screenshot.bmp.  Useful as a reference without a PSP, for example
+// with ppdmp-bisect --reference-cmd.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "bmpfile.h"
+#include "commands.h"
+#include "dumpfile.h"
+#include "softgpu.h"
+
+// The screenshot is always this size, like emulatorEmitScreenshot().
+static const int SCREENSHOT_WIDTH = 512;
+static const int SCREENSHOT_HEIGHT = 272;
+
+struct DisplayState {
+	uint32_t topaddr;
+	uint32_t linesize;
+	uint32_t pixelFormat;
+};
+
+// Playback state between commands, like Replay::execClutAddr and friends.
+struct RenderContext {
+	SoftGPU *gpu;
+	DisplayState display;
+	uint32_t memcpyDest;
+	uint32_t clutAddr;
+	uint32_t clutFlags;
+	bool warnedEdram;
+};
+
+static uint32_t ReadU32(const uint8_t *p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static bool IsVRAMAddress(uint32_t addr) {
+	return (addr & 0x3F800000) == VRAM_BASE;
+}
+
+static void WriteMemory(RenderContext &ctx, uint32_t addr, const uint8_t *data, uint32_t sz) {
+	ctx.gpu->Flush();
+	uint8_t *dest = ctx.gpu->Memory().WritePointer(addr, sz);
+	if (dest) {
+		memcpy(dest, data, sz);
+	} else {
+		fprintf(stderr, "WARNING: Invalid write of %u bytes to %08x\n", sz, addr);
+	}
+}
+
+static bool RunCommand(RenderContext &ctx, const Command &cmd, const uint8_t *buf) {
+	SoftGPU &gpu = *ctx.gpu;
+	const uint8_t *data = buf + cmd.ptr;
+	const uint32_t addr = DUMP_BUFFER_BASE + cmd.ptr;
+
+	switch (cmd.type) {
+	case CommandType::INIT:
+		gpu.RestoreContext((const uint32_t *)data, cmd.sz / 4);
+		break;
+
+	case CommandType::REGISTERS:
+		gpu.Execute((const uint32_t *)data, cmd.sz / 4);
+		break;
+
+	case CommandType::VERTICES:
+		gpu.SetVertexAddr(addr);
+		break;
+
+	case CommandType::INDICES:
+		gpu.SetIndexAddr(addr);
+		break;
+
+	case CommandType::CLUTADDR:
+		ctx.clutAddr = ReadU32(data);
+		ctx.clutFlags = ReadU32(data + 4);
+		break;
+
+	case CommandType::CLUT:
+		if (ctx.clutAddr != 0) {
+			// Otherwise the palette was drawn, and is already in memory.
+			if ((ctx.clutFlags & 1) == 0) {
+				WriteMemory(ctx, ctx.clutAddr, data, cmd.sz);
+			}
+			ctx.clutAddr = 0;
+		} else {
+			gpu.SetClutAddr(addr);
+		}
+		break;
+
+	case CommandType::TRANSFERSRC:
+		gpu.SetTransferSrc(addr);
+		break;
+
+	case CommandType::MEMSET: {
+		const uint32_t dest = ReadU32(data);
+		const uint32_t value = ReadU32(data + 4);
+		const uint32_t sz = ReadU32(data + 8);
+		if (IsVRAMAddress(dest)) {
+			gpu.Flush();
+			uint8_t *p = gpu.Memory().WritePointer(dest, sz);
+			if (p) {
+				memset(p, (uint8_t)value, sz);
+			}
+		}
+		break;
+	}
+
+	case CommandType::MEMCPYDEST:
+		ctx.memcpyDest = ReadU32(data);
+		break;
+
+	case CommandType::MEMCPYDATA:
+		if (IsVRAMAddress(ctx.memcpyDest)) {
+			WriteMemory(ctx, ctx.memcpyDest, data, cmd.sz);
+		}
+		break;
+
+	case CommandType::EDRAMTRANS:
+		if (!ctx.warnedEdram) {
+			fprintf(stderr, "WARNING: EDRAM address translation is ignored\n");
+			ctx.warnedEdram = true;
+		}
+		break;
+
+	case CommandType::DISPLAY:
+		gpu.Flush();
+		ctx.display.topaddr = ReadU32(data);
+		ctx.display.linesize = ReadU32(data + 4);
+		ctx.display.pixelFormat = ReadU32(data + 8);
+		break;
+
+	default:
+		if (cmd.type >= CommandType::TEXTURE0 && cmd.type <= CommandType::TEXTURE7) {
+			gpu.SetTextureAddr(cmd.type - CommandType::TEXTURE0, addr);
+		} else if (cmd.type >= CommandType::FRAMEBUF0 && cmd.type <= CommandType::FRAMEBUF7 && cmd.sz >= 16) {
+			// Address, bufw, flags, pad, and then the data.
+			const int level = cmd.type - CommandType::FRAMEBUF0;
+			const uint32_t fbAddr = ReadU32(data);
+			const uint32_t bufw = ReadU32(data + 4);
+			const uint32_t flags = ReadU32(data + 8);
+			if ((flags & 1) == 0) {
+				WriteMemory(ctx, fbAddr, data + 16, cmd.sz - 16);
+			}
+			const uint32_t bufwCmd = ((GE_CMD_TEXBUFWIDTH0 + level) << 24) | (bufw & 0xFFFF);
+			gpu.Execute(&bufwCmd, 1);
+			gpu.SetTextureAddr(level, fbAddr);
+		} else {
+			fprintf(stderr, "ERROR: Unsupported GE dump command: %d\n", (int)cmd.type);
+			return false;
+		}
+		break;
+	}
+	return true;
+}
+
+static bool RunCommands(RenderContext &ctx, const std::vector<Command> &cmds, const std::vector<uint8_t> &buf) {
+	ctx.gpu->Memory().SetBuffer(buf.data(), (uint32_t)buf.size());
+	for (size_t i = 0; i < cmds.size(); ++i) {
+		if (cmds[i].ptr + (uint64_t)cmds[i].sz > buf.size()) {
+			fprintf(stderr, "Command %d (%s) is out of bounds\n", (int)i, CommandTypeName(cmds[i].type));
+			return false;
+		}
+		if (!RunCommand(ctx, cmds[i], buf.data())) {
+			return false;
+		}
+	}
+	// The buffer is about to go away.
+	ctx.gpu->Flush();
+	return true;
+}
+
+static bool RunSeekable(RenderContext &ctx, const MappedDump &dump, int start, int end) {
+	const SeekableHeader &header = dump.SeekableInfo();
+	const SeekableChunk *chunks = dump.Chunks();
+	std::vector<Command> cmds;
+	std::vector<uint8_t> buf;
+	for (uint32_t i = 0; i < header.chunkCount; ++i) {
+		const SeekableChunk &chunk = chunks[i];
+		const bool draw = chunk.primCount != 0 && (int)(chunk.primStart + chunk.primCount) >= start && (int)chunk.primStart < end;
+
+		// Like playback, chunks outside the range only need their memory writes.
+		bool loaded;
+		if (draw) {
+			loaded = dump.ReadChunk(chunk.offset, chunk.cmdCount, chunk.bufSize, cmds, buf);
+		} else {
+			loaded = dump.ReadChunk(chunk.memOffset, chunk.memCmdCount, chunk.memBufSize, cmds, buf);
+		}
+		if (!loaded) {
+			fprintf(stderr, "Unable to decompress chunk %u\n", i);
+			return false;
+		}
+
+		ctx.gpu->SetPrims(chunk.primStart);
+		if (!RunCommands(ctx, cmds, buf)) {
+			return false;
+		}
+		ctx.gpu->SetPrims(chunk.primStart + chunk.primCount);
+	}
+	return true;
+}
+
+// Same conversions as emulatorEmitScreenshot(), into BGRA.
+static uint32_t ScreenshotPixel(uint32_t format, const uint8_t *p) {
+	const uint32_t c = format == 3 ? ReadU32(p) : (uint32_t)(p[0] | (p[1] << 8));
+	uint32_t r, g, b, a;
+	switch (format) {
+	case 0:
+		r = ((c & 0x1F) << 3) | ((c >> 2) & 7);
+		g = (((c >> 5) & 0x3F) << 2) | ((c >> 9) & 3);
+		b = (((c >> 11) & 0x1F) << 3) | ((c >> 13) & 7);
+		a = 0xFF;
+		break;
+	case 1:
+		r = ((c & 0x1F) << 3) | ((c >> 2) & 7);
+		g = (((c >> 5) & 0x1F) << 3) | ((c >> 7) & 7);
+		b = (((c >> 10) & 0x1F) << 3) | ((c >> 12) & 7);
+		a = (c & 0x8000) ? 0xFF : 0;
+		break;
+	case 2:
+		r = (c & 0xF) * 0x11;
+		g = ((c >> 4) & 0xF) * 0x11;
+		b = ((c >> 8) & 0xF) * 0x11;
+		a = ((c >> 12) & 0xF) * 0x11;
+		break;
+	default:
+		r = c & 0xFF;
+		g = (c >> 8) & 0xFF;
+		b = (c >> 16) & 0xFF;
+		a = c >> 24;
+		break;
+	}
+	return b | (g << 8) | (r << 16) | (a << 24);
+}
+
+static bool WriteScreenshot(GEMemory &mem, const DisplayState &display, const char *filename) {
+	if (display.pixelFormat > 3) {
+		fprintf(stderr, "ERROR: Invalid format %u\n", display.pixelFormat);
+		return false;
+	}
+
+	Bitmap bmp;
+	bmp.width = SCREENSHOT_WIDTH;
+	bmp.height = SCREENSHOT_HEIGHT;
+	bmp.pixels.resize(bmp.width * bmp.height);
+	const uint32_t bpp = display.pixelFormat == 3 ? 4 : 2;
+	for (int y = 0; y < bmp.height; ++y) {
+		for (int x = 0; x < bmp.width; ++x) {
+			const uint8_t *p = mem.ReadPointer(display.topaddr + (y * display.linesize + x) * bpp, bpp);
+			bmp.pixels[y * bmp.width + x] = p ? ScreenshotPixel(display.pixelFormat, p) : 0;
+		}
+	}
+
+	if (!WriteBmp(filename, bmp)) {
+		fprintf(stderr, "Unable to write %s\n", filename);
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	const char *input = NULL;
+	const char *output = "__screenshot.bmp";
+	bool hasOutput = false;
+	int start = 0;
+	int end = 0x7FFFFFFF;
+	int threads = std::thread::hardware_concurrency();
+
+	for (int i = 1; i < argc; ++i) {
+		if (!strncmp(argv[i], "--start=", strlen("--start="))) {
+			start = atoi(argv[i] + strlen("--start="));
+		} else if (!strncmp(argv[i], "--end=", strlen("--end="))) {
+			end = atoi(argv[i] + strlen("--end="));
+		} else if (!strncmp(argv[i], "--threads=", strlen("--threads="))) {
+			threads = atoi(argv[i] + strlen("--threads="));
+		} else if (!input) {
+			input = argv[i];
+		} else if (!hasOutput) {
+			output = argv[i];
+			hasOutput = true;
+		} else {
+			input = NULL;
+			break;
+		}
+	}
+
+	if (!input) {
+		fprintf(stderr, "Usage: ppdmp-render framedump.ppdmp [__screenshot.bmp] [--start=1] [--end=1000] [--threads=N]\n");
+		return 1;
+	}
+
+	MappedDump dump;
+	if (!dump.Open(input)) {
+		fprintf(stderr, "Not a valid frame dump: %s\n", input);
+		return 1;
+	}
+
+	SoftGPU gpu(threads > 0 ? threads : 1);
+	gpu.SetPrimRange(start, end);
+	// Playback starts with the display at the start of VRAM.
+	RenderContext ctx = { &gpu, { VRAM_BASE, 512, 3 }, 0, 0, 0, false };
+
+	const auto startTime = std::chrono::steady_clock::now();
+	bool success;
+	if (dump.IsSeekable()) {
+		success = RunSeekable(ctx, dump, start, end);
+	} else {
+		std::vector<Command> cmds;
+		std::vector<uint8_t> buf;
+		success = dump.ReadCommands(cmds) && dump.ReadBuffer(buf);
+		if (!success) {
+			fprintf(stderr, "Unable to decompress dump\n");
+		}
+		success = success && RunCommands(ctx, cmds, buf);
+	}
+	if (!success) {
+		return 1;
+	}
+	const auto endTime = std::chrono::steady_clock::now();
+
+	if (!WriteScreenshot(gpu.Memory(), ctx.display, output)) {
+		return 1;
+	}
+	const double ms = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+	printf("%d prims in %.2f ms, wrote %s\n", gpu.Prims(), ms, output);
+	return 0;
+}
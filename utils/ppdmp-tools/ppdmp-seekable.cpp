@@ -0,0 +1,491 @@
+// Rewrites a frame dump as a seekable dump, see SeekableHeader in ppdmp.h.
+//
+// Each chunk starts with a prologue that restores the GE state and any data
+// from earlier chunks still in use, so playback can start at any chunk.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <vector>
+#include "commands.h"
+#include "dumpfile.h"
+
+struct Stream {
+	std::vector<Command> cmds;
+	std::vector<uint8_t> buf;
+	// Original buffer offset -> offset in this stream, so repeated data is only stored once.
+	std::map<uint64_t, uint32_t> copied;
+};
+
+struct DataRef {
+	uint8_t type;
+	uint32_t ptr;
+	uint32_t sz;
+	bool valid;
+};
+
+struct GEState {
+	uint32_t regs[256];
+	bool regSet[256];
+	DataRef init;
+
+	uint32_t bone[96];
+	uint32_t world[12];
+	uint32_t view[12];
+	uint32_t proj[16];
+	uint32_t tgen[12];
+	int boneNum, worldNum, viewNum, projNum, tgenNum;
+	bool matrixSet;
+
+	DataRef verts;
+	DataRef inds;
+	DataRef clut;
+	DataRef transferSrc;
+	DataRef tex[8];
+	uint32_t loadClut;
+	bool loadClutSet;
+};
+
+static std::vector<Command> cmds;
+static std::vector<uint8_t> buf;
+static DumpHeader dumpHeader;
+
+static bool ReadDump(const char *filename) {
+	MappedDump dump;
+	if (!dump.Open(filename) || dump.IsSeekable()) {
+		fprintf(stderr, "Not a valid frame dump: %s\n", filename);
+		return false;
+	}
+
+	dumpHeader = dump.Header();
+	if (!dump.ReadCommands(cmds) || !dump.ReadBuffer(buf)) {
+		fprintf(stderr, "Unable to decompress %s\n", filename);
+		return false;
+	}
+	return true;
+}
+
+static bool IsMemoryCommand(uint8_t type) {
+	switch (type) {
+	case CommandType::INIT:
+	case CommandType::MEMSET:
+	case CommandType::MEMCPYDEST:
+	case CommandType::MEMCPYDATA:
+	case CommandType::DISPLAY:
+	case CommandType::CLUTADDR:
+	case CommandType::EDRAMTRANS:
+		return true;
+	default:
+		return type >= CommandType::FRAMEBUF0 && type <= CommandType::FRAMEBUF7;
+	}
+}
+
+static void AddCommand(Stream &stream, uint8_t type, const uint8_t *data, uint32_t sz, uint64_t key) {
+	Command cmd;
+	cmd.type = type;
+	cmd.sz = sz;
+
+	std::map<uint64_t, uint32_t>::iterator it = stream.copied.find(key);
+	if (key != 0 && it != stream.copied.end()) {
+		cmd.ptr = it->second;
+	} else {
+		// Keep 16 byte alignment, textures and CLUTs need it.
+		cmd.ptr = (uint32_t)((stream.buf.size() + 15) & ~15);
+		stream.buf.resize(cmd.ptr + sz);
+		memcpy(stream.buf.data() + cmd.ptr, data, sz);
+		if (key != 0) {
+			stream.copied[key] = cmd.ptr;
+		}
+	}
+	stream.cmds.push_back(cmd);
+}
+
+static void CopyCommand(Stream &stream, uint8_t type, uint32_t ptr, uint32_t sz) {
+	// Registers are modified by playback, and Init as well, so never share those.
+	uint64_t key = 0;
+	if (type != CommandType::REGISTERS && type != CommandType::INIT) {
+		key = ((uint64_t)ptr << 32) | sz;
+	}
+	AddCommand(stream, type, buf.data() + ptr, sz, key);
+}
+
+static void CopyRef(Stream &stream, const DataRef &ref) {
+	if (ref.valid) {
+		CopyCommand(stream, ref.type, ref.ptr, ref.sz);
+	}
+}
+
+static void AddRegisters(Stream &stream, const std::vector<uint32_t> &words) {
+	if (!words.empty()) {
+		AddCommand(stream, CommandType::REGISTERS, (const uint8_t *)words.data(), (uint32_t)(words.size() * 4), 0);
+	}
+}
+
+static void AddMatrix(std::vector<uint32_t> &words, uint32_t numCmd, uint32_t dataCmd, const uint32_t *data, int count, int num) {
+	words.push_back(numCmd << 24);
+	for (int i = 0; i < count; ++i) {
+		words.push_back((dataCmd << 24) | data[i]);
+	}
+	words.push_back((numCmd << 24) | num);
+}
+
+static void AddPrologue(Stream &stream, const GEState &state) {
+	CopyRef(stream, state.init);
+
+	std::vector<uint32_t> words;
+	for (int op = 0; op < 256; ++op) {
+		if (state.regSet[op]) {
+			words.push_back(state.regs[op]);
+		}
+	}
+	if (state.matrixSet) {
+		AddMatrix(words, GE_CMD_BONEMATRIXNUMBER, GE_CMD_BONEMATRIXDATA, state.bone, 96, state.boneNum);
+		AddMatrix(words, GE_CMD_WORLDMATRIXNUMBER, GE_CMD_WORLDMATRIXDATA, state.world, 12, state.worldNum);
+		AddMatrix(words, GE_CMD_VIEWMATRIXNUMBER, GE_CMD_VIEWMATRIXDATA, state.view, 12, state.viewNum);
+		AddMatrix(words, GE_CMD_PROJMATRIXNUMBER, GE_CMD_PROJMATRIXDATA, state.proj, 16, state.projNum);
+		AddMatrix(words, GE_CMD_TGENMATRIXNUMBER, GE_CMD_TGENMATRIXDATA, state.tgen, 12, state.tgenNum);
+	}
+	AddRegisters(stream, words);
+
+	// Playback queues these and sends them with the next registers.
+	CopyRef(stream, state.verts);
+	CopyRef(stream, state.inds);
+	CopyRef(stream, state.clut);
+	CopyRef(stream, state.transferSrc);
+	for (int level = 0; level < 8; ++level) {
+		CopyRef(stream, state.tex[level]);
+	}
+
+	words.clear();
+	if (state.loadClutSet) {
+		words.push_back(state.loadClut);
+	}
+	words.push_back(GE_CMD_TEXFLUSH << 24);
+	AddRegisters(stream, words);
+}
+
+static void SetRef(DataRef &ref, const Command &cmd) {
+	ref.type = cmd.type;
+	ref.ptr = cmd.ptr;
+	ref.sz = cmd.sz;
+	ref.valid = true;
+}
+
+static void MatrixData(uint32_t *data, int &num, int count, uint32_t word) {
+	data[num % count] = word & 0x00FFFFFF;
+	num = (num + 1) % count;
+}
+
+static void AddStateRegisters(std::vector<uint32_t> &words, const GEState &state, const uint8_t *ops, int count) {
+	for (int i = 0; i < count; ++i) {
+		if (state.regSet[ops[i]]) {
+			words.push_back(state.regs[ops[i]]);
+		}
+	}
+}
+
+// Block transfers and CLUT loads write memory, so chunks outside the range still need them.
+// Only the registers they use are kept, with their data, and never any prims.
+static void AddTransfer(Stream &stream, const GEState &state, uint32_t word) {
+	static const uint8_t ops[] = {
+		GE_CMD_TRANSFERSRC, GE_CMD_TRANSFERSRCW, GE_CMD_TRANSFERDST, GE_CMD_TRANSFERDSTW,
+		GE_CMD_TRANSFERSRCPOS, GE_CMD_TRANSFERDSTPOS, GE_CMD_TRANSFERSIZE,
+	};
+
+	std::vector<uint32_t> words;
+	AddStateRegisters(words, state, ops, sizeof(ops));
+	AddRegisters(stream, words);
+	// Playback queues this, so it's sent right before the start.
+	CopyRef(stream, state.transferSrc);
+
+	words.clear();
+	words.push_back(word);
+	AddRegisters(stream, words);
+}
+
+static void AddClutLoad(Stream &stream, const GEState &state, uint32_t word) {
+	static const uint8_t ops[] = { GE_CMD_CLUTFORMAT, GE_CMD_CLUTADDRUPPER, GE_CMD_CLUTADDR };
+
+	std::vector<uint32_t> words;
+	AddStateRegisters(words, state, ops, sizeof(ops));
+	AddRegisters(stream, words);
+	CopyRef(stream, state.clut);
+
+	words.clear();
+	words.push_back(word);
+	AddRegisters(stream, words);
+}
+
+// Tracks the state left behind by a registers block, returns the number of prims.
+// Any transfers or CLUT loads are also added to mem, if given.
+static uint32_t TrackRegisters(GEState &state, const Command &cmd, Stream *mem) {
+	uint32_t prims = 0;
+	const uint32_t *words = (const uint32_t *)(buf.data() + cmd.ptr);
+	for (uint32_t i = 0; i < cmd.sz / 4; ++i) {
+		uint32_t word = words[i];
+		uint32_t op = word >> 24;
+		if (IsPrimCommand(op)) {
+			prims++;
+			continue;
+		}
+
+		switch (op) {
+		case GE_CMD_NOP:
+		case GE_CMD_BOUNDINGBOX:
+		case GE_CMD_JUMP:
+		case GE_CMD_BJUMP:
+		case GE_CMD_CALL:
+		case GE_CMD_RET:
+		case GE_CMD_END:
+		case GE_CMD_SIGNAL:
+		case GE_CMD_FINISH:
+		case GE_CMD_BASE:
+		case GE_CMD_ORIGIN:
+		case GE_CMD_TEXFLUSH:
+		case GE_CMD_TEXSYNC:
+			break;
+
+		case GE_CMD_TRANSFERSTART:
+			if (mem) {
+				AddTransfer(*mem, state, word);
+			}
+			break;
+
+		case GE_CMD_VADDR:
+			state.verts.valid = false;
+			break;
+		case GE_CMD_IADDR:
+			state.inds.valid = false;
+			break;
+		case GE_CMD_TRANSFERSRC:
+			state.transferSrc.valid = false;
+			state.regs[op] = word;
+			state.regSet[op] = true;
+			break;
+		case GE_CMD_CLUTADDR:
+		case GE_CMD_CLUTADDRUPPER:
+			state.clut.valid = false;
+			state.regs[op] = word;
+			state.regSet[op] = true;
+			break;
+		case GE_CMD_LOADCLUT:
+			state.loadClut = word;
+			state.loadClutSet = true;
+			if (mem) {
+				AddClutLoad(*mem, state, word);
+			}
+			break;
+
+		case GE_CMD_BONEMATRIXNUMBER:
+			state.boneNum = (word & 0x7F) % 96;
+			break;
+		case GE_CMD_BONEMATRIXDATA:
+			MatrixData(state.bone, state.boneNum, 96, word);
+			state.matrixSet = true;
+			break;
+		case GE_CMD_WORLDMATRIXNUMBER:
+			state.worldNum = (word & 0xF) % 12;
+			break;
+		case GE_CMD_WORLDMATRIXDATA:
+			MatrixData(state.world, state.worldNum, 12, word);
+			state.matrixSet = true;
+			break;
+		case GE_CMD_VIEWMATRIXNUMBER:
+			state.viewNum = (word & 0xF) % 12;
+			break;
+		case GE_CMD_VIEWMATRIXDATA:
+			MatrixData(state.view, state.viewNum, 12, word);
+			state.matrixSet = true;
+			break;
+		case GE_CMD_PROJMATRIXNUMBER:
+			state.projNum = word & 0xF;
+			break;
+		case GE_CMD_PROJMATRIXDATA:
+			MatrixData(state.proj, state.projNum, 16, word);
+			state.matrixSet = true;
+			break;
+		case GE_CMD_TGENMATRIXNUMBER:
+			state.tgenNum = (word & 0xF) % 12;
+			break;
+		case GE_CMD_TGENMATRIXDATA:
+			MatrixData(state.tgen, state.tgenNum, 12, word);
+			state.matrixSet = true;
+			break;
+
+		default:
+			// Playback NOPs texture addresses, and the immediate draw registers aren't state.
+			if ((op >= GE_CMD_TEXADDR0 && op <= GE_CMD_TEXADDR7) || (op >= GE_CMD_VSCX && op <= GE_CMD_VSCV)) {
+				break;
+			}
+			state.regs[op] = word;
+			state.regSet[op] = true;
+			break;
+		}
+	}
+	return prims;
+}
+
+static void TrackCommand(GEState &state, const Command &cmd) {
+	switch (cmd.type) {
+	case CommandType::INIT:
+		// The context replaces everything set by registers so far.
+		memset(state.regSet, 0, sizeof(state.regSet));
+		state.matrixSet = false;
+		state.loadClutSet = false;
+		SetRef(state.init, cmd);
+		break;
+	case CommandType::VERTICES:
+		SetRef(state.verts, cmd);
+		break;
+	case CommandType::INDICES:
+		SetRef(state.inds, cmd);
+		break;
+	case CommandType::CLUT:
+		SetRef(state.clut, cmd);
+		break;
+	case CommandType::TRANSFERSRC:
+		SetRef(state.transferSrc, cmd);
+		break;
+	default:
+		if (cmd.type >= CommandType::TEXTURE0 && cmd.type <= CommandType::TEXTURE7) {
+			SetRef(state.tex[cmd.type - CommandType::TEXTURE0], cmd);
+		} else if (cmd.type >= CommandType::FRAMEBUF0 && cmd.type <= CommandType::FRAMEBUF7) {
+			state.tex[cmd.type - CommandType::FRAMEBUF0].valid = false;
+		}
+		break;
+	}
+}
+
+static bool WriteStream(FILE *fp, const Stream &stream, uint32_t &offset, uint32_t &cmdCount, uint32_t &bufSize, int level) {
+	offset = (uint32_t)ftell(fp);
+	cmdCount = (uint32_t)stream.cmds.size();
+	bufSize = (uint32_t)stream.buf.size();
+	// Seekable streams are always zstd.
+	return WriteDumpBlock(fp, 5, stream.cmds.data(), sizeof(Command) * cmdCount, level) && WriteDumpBlock(fp, 5, stream.buf.data(), bufSize, level);
+}
+
+int main(int argc, char *argv[]) {
+	const char *input = NULL;
+	const char *output = NULL;
+	uint32_t chunkPrims = 1000;
+	uint32_t chunkBytes = 4 * 1024 * 1024;
+	int level = 9;
+
+	for (int i = 1; i < argc; ++i) {
+		if (!strncmp(argv[i], "--prims=", strlen("--prims="))) {
+			chunkPrims = atoi(argv[i] + strlen("--prims="));
+		} else if (!strncmp(argv[i], "--chunk-size=", strlen("--chunk-size="))) {
+			chunkBytes = atoi(argv[i] + strlen("--chunk-size=")) * 1024;
+		} else if (!strncmp(argv[i], "--level=", strlen("--level="))) {
+			level = atoi(argv[i] + strlen("--level="));
+		} else if (!input) {
+			input = argv[i];
+		} else if (!output) {
+			output = argv[i];
+		} else {
+			input = NULL;
+			break;
+		}
+	}
+
+	if (!input || !output) {
+		fprintf(stderr, "Usage: ppdmp-seekable in.ppdmp out.ppdmp [--prims=1000] [--chunk-size=4096] [--level=9]\n");
+		return 1;
+	}
+	if (!ReadDump(input)) {
+		return 1;
+	}
+
+	FILE *fp = fopen(output, "wb");
+	if (!fp) {
+		fprintf(stderr, "Unable to create %s\n", output);
+		return 1;
+	}
+
+	GEState state;
+	memset(&state, 0, sizeof(state));
+
+	// Count chunks first, the table goes before the streams.
+	std::vector<SeekableChunk> chunks;
+	uint32_t prims = 0;
+	for (size_t i = 0; i < cmds.size(); ) {
+		SeekableChunk chunk;
+		memset(&chunk, 0, sizeof(chunk));
+		uint32_t bytes = 0;
+		for (bool split = false; i < cmds.size() && !split; ++i) {
+			const Command &cmd = cmds[i];
+			if (cmd.ptr + (uint64_t)cmd.sz > buf.size()) {
+				fprintf(stderr, "Command %d is out of bounds\n", (int)i);
+				return 1;
+			}
+			bytes += cmd.sz;
+			if (cmd.type == CommandType::REGISTERS) {
+				chunk.primCount += TrackRegisters(state, cmd, NULL);
+				split = chunk.primCount >= chunkPrims || bytes >= chunkBytes;
+			}
+		}
+		chunk.primStart = prims;
+		prims += chunk.primCount;
+		chunks.push_back(chunk);
+	}
+
+	SeekableHeader header;
+	memcpy(header.magic, SEEKABLE_MAGIC, sizeof(header.magic));
+	header.version = SEEKABLE_VERSION;
+	header.dumpVersion = dumpHeader.version;
+	memcpy(header.dumpHeader2, dumpHeader.header2, sizeof(header.dumpHeader2));
+	header.chunkCount = (uint32_t)chunks.size();
+	header.primCount = prims;
+
+	bool success = fwrite(&header, sizeof(header), 1, fp) == 1;
+	success = success && fwrite(chunks.data(), sizeof(SeekableChunk), chunks.size(), fp) == chunks.size();
+
+	memset(&state, 0, sizeof(state));
+	size_t i = 0;
+	for (size_t c = 0; success && c < chunks.size(); ++c) {
+		SeekableChunk &chunk = chunks[c];
+		Stream full;
+		Stream mem;
+		AddPrologue(full, state);
+		chunk.prologueCmds = (uint32_t)full.cmds.size();
+
+		// Same split points as above, always after registers so ClutAddr + Clut stay together.
+		uint32_t chunkPrimCount = 0;
+		uint32_t bytes = 0;
+		for (bool split = false; i < cmds.size() && !split; ++i) {
+			const Command &cmd = cmds[i];
+			CopyCommand(full, cmd.type, cmd.ptr, cmd.sz);
+			bytes += cmd.sz;
+
+			// A Clut right after ClutAddr is a memory copy, otherwise it's a CLUT address.
+			bool clutCopy = cmd.type == CommandType::CLUT && i > 0 && cmds[i - 1].type == CommandType::CLUTADDR;
+			if (IsMemoryCommand(cmd.type) || clutCopy) {
+				CopyCommand(mem, cmd.type, cmd.ptr, cmd.sz);
+			}
+
+			if (cmd.type == CommandType::REGISTERS) {
+				chunkPrimCount += TrackRegisters(state, cmd, &mem);
+				split = chunkPrimCount >= chunkPrims || bytes >= chunkBytes;
+			} else if (!clutCopy) {
+				TrackCommand(state, cmd);
+			}
+		}
+
+		success = WriteStream(fp, full, chunk.offset, chunk.cmdCount, chunk.bufSize, level);
+		success = success && WriteStream(fp, mem, chunk.memOffset, chunk.memCmdCount, chunk.memBufSize, level);
+	}
+
+	// Now that the offsets are known.
+	success = success && fseek(fp, sizeof(header), SEEK_SET) == 0;
+	success = success && fwrite(chunks.data(), sizeof(SeekableChunk), chunks.size(), fp) == chunks.size();
+	fclose(fp);
+
+	if (!success) {
+		fprintf(stderr, "Unable to write %s\n", output);
+		return 1;
+	}
+
+	printf("%d prims in %d chunks\n", (int)prims, (int)chunks.size());
+	return 0;
+}
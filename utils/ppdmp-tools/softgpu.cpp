@@ -0,0 +1,1371 @@
+// Command processing for the software GE: registers, vertex decoding, transform and lighting,
+// clipping, and batching prims into tiles for softraster.cpp.
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include "commands.h"
+#include "ppdmp.h"
+#include "softgpu.h"
+
+enum {
+	PRIM_POINTS = 0,
+	PRIM_LINES = 1,
+	PRIM_LINE_STRIP = 2,
+	PRIM_TRIANGLES = 3,
+	PRIM_TRIANGLE_STRIP = 4,
+	PRIM_TRIANGLE_FAN = 5,
+	PRIM_RECTANGLES = 6,
+};
+
+// Drawn before flushing, so the states and bins don't grow without bound.
+static const size_t MAX_BATCH_PRIMS = 65536;
+
+GEMemory::GEMemory() : vram_(VRAM_SIZE), ram_(RAM_SIZE), buf_(NULL), bufSize_(0) {
+}
+
+const uint8_t *GEMemory::ReadPointer(uint32_t addr, uint32_t size) const {
+	if (addr >= DUMP_BUFFER_BASE) {
+		const uint32_t offset = addr - DUMP_BUFFER_BASE;
+		if (offset > bufSize_ || size > bufSize_ - offset) {
+			return NULL;
+		}
+		return buf_ + offset;
+	}
+	return const_cast<GEMemory *>(this)->WritePointer(addr, size);
+}
+
+uint8_t *GEMemory::WritePointer(uint32_t addr, uint32_t size) {
+	if (addr >= DUMP_BUFFER_BASE) {
+		return NULL;
+	}
+	// Ignore the uncached and kernel bits.
+	addr &= 0x0FFFFFFF;
+	if ((addr & 0x0F800000) == VRAM_BASE) {
+		// VRAM is mirrored, but a read can't wrap around.
+		const uint32_t offset = addr & (VRAM_SIZE - 1);
+		return size <= VRAM_SIZE - offset ? &vram_[offset] : NULL;
+	}
+	if (addr >= RAM_BASE && addr < RAM_BASE + RAM_SIZE) {
+		const uint32_t offset = addr - RAM_BASE;
+		return size <= RAM_SIZE - offset ? &ram_[offset] : NULL;
+	}
+	return NULL;
+}
+
+uint32_t GEMemory::ValidSize(uint32_t addr) const {
+	if (addr >= DUMP_BUFFER_BASE) {
+		const uint32_t offset = addr - DUMP_BUFFER_BASE;
+		return offset < bufSize_ ? bufSize_ - offset : 0;
+	}
+	addr &= 0x0FFFFFFF;
+	if ((addr & 0x0F800000) == VRAM_BASE) {
+		return VRAM_SIZE - (addr & (VRAM_SIZE - 1));
+	}
+	if (addr >= RAM_BASE && addr < RAM_BASE + RAM_SIZE) {
+		return RAM_BASE + RAM_SIZE - addr;
+	}
+	return 0;
+}
+
+// Runs a function over a range of indices on a few threads, including the caller.
+class WorkerPool {
+public:
+	WorkerPool(int threads) : func_(NULL), count_(0), next_(0), active_(0), generation_(0), quit_(false) {
+		for (int i = 1; i < threads; ++i) {
+			threads_.push_back(std::thread(&WorkerPool::Work, this));
+		}
+	}
+
+	~WorkerPool() {
+		{
+			std::lock_guard<std::mutex> guard(mutex_);
+			quit_ = true;
+		}
+		start_.notify_all();
+		for (size_t i = 0; i < threads_.size(); ++i) {
+			threads_[i].join();
+		}
+	}
+
+	void Run(int count, const std::function<void(int)> &func) {
+		{
+			std::lock_guard<std::mutex> guard(mutex_);
+			func_ = &func;
+			count_ = count;
+			next_ = 0;
+			active_ = (int)threads_.size();
+			generation_++;
+		}
+		start_.notify_all();
+
+		RunItems(func, count);
+
+		std::unique_lock<std::mutex> lock(mutex_);
+		done_.wait(lock, [this] { return active_ == 0; });
+		func_ = NULL;
+	}
+
+private:
+	void RunItems(const std::function<void(int)> &func, int count) {
+		for (int i = next_++; i < count; i = next_++) {
+			func(i);
+		}
+	}
+
+	void Work() {
+		uint64_t seen = 0;
+		while (true) {
+			const std::function<void(int)> *func;
+			int count;
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				start_.wait(lock, [&] { return quit_ || generation_ != seen; });
+				if (quit_) {
+					return;
+				}
+				seen = generation_;
+				func = func_;
+				count = count_;
+			}
+
+			RunItems(*func, count);
+
+			std::lock_guard<std::mutex> guard(mutex_);
+			if (--active_ == 0) {
+				done_.notify_one();
+			}
+		}
+	}
+
+	std::vector<std::thread> threads_;
+	std::mutex mutex_;
+	std::condition_variable start_;
+	std::condition_variable done_;
+	const std::function<void(int)> *func_;
+	int count_;
+	std::atomic<int> next_;
+	int active_;
+	uint64_t generation_;
+	bool quit_;
+};
+
+static float ToFloat24(uint32_t data) {
+	const uint32_t bits = data << 8;
+	float f;
+	memcpy(&f, &bits, sizeof(f));
+	return f;
+}
+
+static void RegColor(uint32_t value, float *c) {
+	c[0] = (float)(value & 0xFF);
+	c[1] = (float)((value >> 8) & 0xFF);
+	c[2] = (float)((value >> 16) & 0xFF);
+}
+
+static void Transform43(const float *m, const float *v, float *out) {
+	for (int i = 0; i < 3; ++i) {
+		out[i] = v[0] * m[i] + v[1] * m[3 + i] + v[2] * m[6 + i] + m[9 + i];
+	}
+}
+
+static void Rotate43(const float *m, const float *v, float *out) {
+	for (int i = 0; i < 3; ++i) {
+		out[i] = v[0] * m[i] + v[1] * m[3 + i] + v[2] * m[6 + i];
+	}
+}
+
+static void Transform44(const float *m, const float *v, float *out) {
+	for (int i = 0; i < 4; ++i) {
+		out[i] = v[0] * m[i] + v[1] * m[4 + i] + v[2] * m[8 + i] + m[12 + i];
+	}
+}
+
+static float Dot(const float *a, const float *b) {
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static void Normalize(float *v) {
+	const float len = sqrtf(Dot(v, v));
+	if (len > 0.0f) {
+		v[0] /= len;
+		v[1] /= len;
+		v[2] /= len;
+	}
+}
+
+static uint32_t VRAMOffset(uint32_t addr) {
+	addr &= 0x0FFFFFFF;
+	return (addr & 0x0F800000) == VRAM_BASE ? (addr & (VRAM_SIZE - 1)) : 0xFFFFFFFF;
+}
+
+// Where each component is in a vertex, see GE_CMD_VERTEXTYPE.
+struct VertexLayout {
+	int tc, col, nrm, pos, weight, idx;
+	int weightCount, morphCount;
+	int weightOffset, tcOffset, colOffset, nrmOffset, posOffset;
+	// One morph frame.
+	int size;
+
+	explicit VertexLayout(uint32_t vtype) {
+		tc = vtype & 3;
+		col = (vtype >> 2) & 7;
+		nrm = (vtype >> 5) & 3;
+		pos = (vtype >> 7) & 3;
+		weight = (vtype >> 9) & 3;
+		idx = (vtype >> 11) & 3;
+		weightCount = ((vtype >> 14) & 7) + 1;
+		morphCount = ((vtype >> 18) & 7) + 1;
+
+		// Each component is aligned to its own size, and the vertex to the largest.
+		static const int componentSize[4] = { 0, 1, 2, 4 };
+		static const int colorSize[8] = { 0, 0, 0, 0, 2, 2, 2, 4 };
+		int offset = 0, align = 1;
+		Place(weightOffset, offset, align, componentSize[weight], weight ? weightCount : 0);
+		Place(tcOffset, offset, align, componentSize[tc], tc ? 2 : 0);
+		Place(colOffset, offset, align, colorSize[col], col ? 1 : 0);
+		Place(nrmOffset, offset, align, componentSize[nrm], nrm ? 3 : 0);
+		Place(posOffset, offset, align, componentSize[pos], 3);
+		size = (offset + align - 1) & ~(align - 1);
+	}
+
+private:
+	static void Place(int &where, int &offset, int &align, int size, int count) {
+		if (size == 0 || count == 0) {
+			where = -1;
+			return;
+		}
+		offset = (offset + size - 1) & ~(size - 1);
+		where = offset;
+		offset += size * count;
+		align = std::max(align, size);
+	}
+};
+
+static int IndexSize(int idx) {
+	static const int sizes[4] = { 0, 1, 2, 4 };
+	return sizes[idx];
+}
+
+// Reads a component as a float.  Normalized unless raw, as in through mode.
+static float ReadComponent(const uint8_t *p, int format, int i, bool isSigned, bool raw) {
+	switch (format) {
+	case 1:
+		if (isSigned) {
+			return (int8_t)p[i] * (raw ? 1.0f : 1.0f / 128.0f);
+		}
+		return p[i] * (raw ? 1.0f : 1.0f / 128.0f);
+	case 2: {
+		uint16_t v;
+		memcpy(&v, p + i * 2, 2);
+		if (isSigned) {
+			return (int16_t)v * (raw ? 1.0f : 1.0f / 32768.0f);
+		}
+		return v * (raw ? 1.0f : 1.0f / 32768.0f);
+	}
+	case 3: {
+		float f;
+		memcpy(&f, p + i * 4, 4);
+		return f;
+	}
+	}
+	return 0.0f;
+}
+
+static void ReadVertexColor(const uint8_t *p, int format, float *c) {
+	uint32_t raw = 0;
+	memcpy(&raw, p, format == 7 ? 4 : 2);
+	switch (format) {
+	case 4:
+		c[0] = (float)(((raw & 0x1F) << 3) | ((raw >> 2) & 7));
+		c[1] = (float)((((raw >> 5) & 0x3F) << 2) | ((raw >> 9) & 3));
+		c[2] = (float)((((raw >> 11) & 0x1F) << 3) | ((raw >> 13) & 7));
+		c[3] = 255.0f;
+		break;
+	case 5:
+		c[0] = (float)(((raw & 0x1F) << 3) | ((raw >> 2) & 7));
+		c[1] = (float)((((raw >> 5) & 0x1F) << 3) | ((raw >> 7) & 7));
+		c[2] = (float)((((raw >> 10) & 0x1F) << 3) | ((raw >> 12) & 7));
+		c[3] = (raw & 0x8000) ? 255.0f : 0.0f;
+		break;
+	case 6:
+		c[0] = (float)((raw & 0xF) * 17);
+		c[1] = (float)(((raw >> 4) & 0xF) * 17);
+		c[2] = (float)(((raw >> 8) & 0xF) * 17);
+		c[3] = (float)(((raw >> 12) & 0xF) * 17);
+		break;
+	default:
+		c[0] = (float)(raw & 0xFF);
+		c[1] = (float)((raw >> 8) & 0xFF);
+		c[2] = (float)((raw >> 16) & 0xFF);
+		c[3] = (float)(raw >> 24);
+		break;
+	}
+}
+
+SoftGPU::SoftGPU(int threads) : pool_(new WorkerPool(std::max(threads, 1))) {
+	memset(regs_, 0, sizeof(regs_));
+	vertexAddr_ = 0;
+	indexAddr_ = 0;
+	memset(texAddr_, 0, sizeof(texAddr_));
+	clutAddr_ = 0;
+	transferSrc_ = 0;
+	memset(clut_, 0, sizeof(clut_));
+	memset(boneMatrix_, 0, sizeof(boneMatrix_));
+	memset(worldMatrix_, 0, sizeof(worldMatrix_));
+	memset(viewMatrix_, 0, sizeof(viewMatrix_));
+	memset(projMatrix_, 0, sizeof(projMatrix_));
+	memset(texMatrix_, 0, sizeof(texMatrix_));
+	boneNum_ = 0;
+	worldNum_ = 0;
+	viewNum_ = 0;
+	projNum_ = 0;
+	texNum_ = 0;
+	prims_ = 0;
+	primStart_ = 0;
+	primEnd_ = 0x7FFFFFFF;
+	stateDirty_ = true;
+	batchMaxY_ = 0;
+}
+
+SoftGPU::~SoftGPU() {
+	delete pool_;
+}
+
+float SoftGPU::Float24(int op) const {
+	return ToFloat24(Reg(op));
+}
+
+bool SoftGPU::IsThrough() const {
+	return (Reg(GE_CMD_VERTEXTYPE) & 0x00800000) != 0;
+}
+
+void SoftGPU::Execute(const uint32_t *words, uint32_t count) {
+	for (uint32_t i = 0; i < count; ++i) {
+		ExecuteCommand(words[i]);
+	}
+}
+
+void SoftGPU::RestoreContext(const uint32_t *context, uint32_t count) {
+	// Like sceGeRestoreContext: the registers start at word 17 and run until an END.
+	// Old dumps have no END, and only the first part is usable, like in playback.
+	bool isOldState = true;
+	for (uint32_t i = 17; i < count; ++i) {
+		if (context[i] == (uint32_t)GE_CMD_END << 24) {
+			isOldState = false;
+		}
+	}
+
+	const uint32_t end = isOldState ? std::min(count, 234U) : count;
+	for (uint32_t i = 17; i < end; ++i) {
+		const uint32_t op = context[i] >> 24;
+		if (op == GE_CMD_END) {
+			break;
+		}
+		switch (op) {
+		case GE_CMD_PRIM:
+		case GE_CMD_BEZIER:
+		case GE_CMD_SPLINE:
+		case GE_CMD_VAP:
+		case GE_CMD_TRANSFERSTART:
+		case GE_CMD_LOADCLUT:
+		case GE_CMD_JUMP:
+		case GE_CMD_BJUMP:
+		case GE_CMD_CALL:
+		case GE_CMD_RET:
+		case GE_CMD_FINISH:
+		case GE_CMD_SIGNAL:
+		case GE_CMD_BOUNDINGBOX:
+			break;
+		default:
+			ExecuteCommand(context[i]);
+			break;
+		}
+	}
+}
+
+void SoftGPU::SetVertexAddr(uint32_t addr) {
+	vertexAddr_ = addr;
+}
+
+void SoftGPU::SetIndexAddr(uint32_t addr) {
+	indexAddr_ = addr;
+}
+
+void SoftGPU::SetTextureAddr(int level, uint32_t addr) {
+	texAddr_[level & 7] = addr;
+	stateDirty_ = true;
+}
+
+void SoftGPU::SetClutAddr(uint32_t addr) {
+	clutAddr_ = addr;
+}
+
+void SoftGPU::SetTransferSrc(uint32_t addr) {
+	transferSrc_ = addr;
+}
+
+void SoftGPU::ExecuteCommand(uint32_t cmd) {
+	const uint32_t op = cmd >> 24;
+	const uint32_t data = cmd & 0x00FFFFFF;
+
+	if (IsPrimCommand(op)) {
+		// Like playback, prims outside the range are NOPs.
+		prims_++;
+		if (prims_ < primStart_ || prims_ > primEnd_) {
+			return;
+		}
+		if (op == GE_CMD_PRIM) {
+			DrawPrim((data >> 16) & 7, data & 0xFFFF);
+		} else if (op == GE_CMD_BEZIER) {
+			DrawBezier(data);
+		} else if (op == GE_CMD_SPLINE) {
+			static bool warned = false;
+			if (!warned) {
+				fprintf(stderr, "WARNING: Splines are not drawn\n");
+				warned = true;
+			}
+		}
+		return;
+	}
+
+	switch (op) {
+	case GE_CMD_NOP:
+	case GE_CMD_JUMP:
+	case GE_CMD_BJUMP:
+	case GE_CMD_CALL:
+	case GE_CMD_RET:
+	case GE_CMD_END:
+	case GE_CMD_SIGNAL:
+	case GE_CMD_FINISH:
+	case GE_CMD_BOUNDINGBOX:
+	case GE_CMD_TEXFLUSH:
+	case GE_CMD_TEXSYNC:
+		break;
+
+	case GE_CMD_VADDR:
+		vertexAddr_ = ((Reg(GE_CMD_BASE) & 0x0F0000) << 8) | data;
+		break;
+	case GE_CMD_IADDR:
+		indexAddr_ = ((Reg(GE_CMD_BASE) & 0x0F0000) << 8) | data;
+		break;
+
+	case GE_CMD_TEXADDR0:
+	case GE_CMD_TEXADDR1:
+	case GE_CMD_TEXADDR2:
+	case GE_CMD_TEXADDR3:
+	case GE_CMD_TEXADDR4:
+	case GE_CMD_TEXADDR5:
+	case GE_CMD_TEXADDR6:
+	case GE_CMD_TEXADDR7:
+		// Playback NOPs these too, textures always come from TEXTURE or FRAMEBUF commands.
+		break;
+
+	case GE_CMD_CLUTADDR:
+	case GE_CMD_CLUTADDRUPPER:
+		regs_[op] = cmd;
+		clutAddr_ = ((Reg(GE_CMD_CLUTADDRUPPER) & 0x0F0000) << 8) | Reg(GE_CMD_CLUTADDR);
+		break;
+	case GE_CMD_TRANSFERSRC:
+	case GE_CMD_TRANSFERSRCW:
+		regs_[op] = cmd;
+		transferSrc_ = ((Reg(GE_CMD_TRANSFERSRCW) & 0xFF0000) << 8) | Reg(GE_CMD_TRANSFERSRC);
+		break;
+	case GE_CMD_LOADCLUT:
+		LoadClut(data);
+		break;
+	case GE_CMD_TRANSFERSTART:
+		BlockTransfer(data);
+		break;
+
+	case GE_CMD_BONEMATRIXNUMBER:
+		boneNum_ = (data & 0x7F) % 96;
+		break;
+	case GE_CMD_BONEMATRIXDATA:
+		boneMatrix_[boneNum_] = ToFloat24(data);
+		boneNum_ = (boneNum_ + 1) % 96;
+		break;
+	case GE_CMD_WORLDMATRIXNUMBER:
+		worldNum_ = (data & 0xF) % 12;
+		break;
+	case GE_CMD_WORLDMATRIXDATA:
+		worldMatrix_[worldNum_] = ToFloat24(data);
+		worldNum_ = (worldNum_ + 1) % 12;
+		break;
+	case GE_CMD_VIEWMATRIXNUMBER:
+		viewNum_ = (data & 0xF) % 12;
+		break;
+	case GE_CMD_VIEWMATRIXDATA:
+		viewMatrix_[viewNum_] = ToFloat24(data);
+		viewNum_ = (viewNum_ + 1) % 12;
+		break;
+	case GE_CMD_PROJMATRIXNUMBER:
+		projNum_ = data & 0xF;
+		break;
+	case GE_CMD_PROJMATRIXDATA:
+		projMatrix_[projNum_] = ToFloat24(data);
+		projNum_ = (projNum_ + 1) % 16;
+		break;
+	case GE_CMD_TGENMATRIXNUMBER:
+		texNum_ = (data & 0xF) % 12;
+		break;
+	case GE_CMD_TGENMATRIXDATA:
+		texMatrix_[texNum_] = ToFloat24(data);
+		texNum_ = (texNum_ + 1) % 12;
+		break;
+
+	default:
+		regs_[op] = cmd;
+		stateDirty_ = true;
+		break;
+	}
+}
+
+void SoftGPU::LoadClut(uint32_t data) {
+	const uint32_t bytes = std::min((data & 0x3F) * 32, (uint32_t)sizeof(clut_));
+	if (VRAMOffset(clutAddr_) != 0xFFFFFFFF) {
+		// The palette might have been drawn by prims still in the batch.
+		Flush();
+	}
+	const uint8_t *src = mem_.ReadPointer(clutAddr_, bytes);
+	if (src) {
+		memcpy(clut_, src, bytes);
+	} else if (bytes != 0) {
+		fprintf(stderr, "WARNING: Invalid CLUT address %08x\n", clutAddr_);
+	}
+	stateDirty_ = true;
+}
+
+void SoftGPU::BlockTransfer(uint32_t data) {
+	Flush();
+
+	const uint32_t bpp = (data & 1) ? 4 : 2;
+	const uint32_t srcStride = Reg(GE_CMD_TRANSFERSRCW) & 0x7F8;
+	const uint32_t dst = ((Reg(GE_CMD_TRANSFERDSTW) & 0xFF0000) << 8) | Reg(GE_CMD_TRANSFERDST);
+	const uint32_t dstStride = Reg(GE_CMD_TRANSFERDSTW) & 0x7F8;
+	const uint32_t srcX = Reg(GE_CMD_TRANSFERSRCPOS) & 0x3FF;
+	const uint32_t srcY = (Reg(GE_CMD_TRANSFERSRCPOS) >> 10) & 0x3FF;
+	const uint32_t dstX = Reg(GE_CMD_TRANSFERDSTPOS) & 0x3FF;
+	const uint32_t dstY = (Reg(GE_CMD_TRANSFERDSTPOS) >> 10) & 0x3FF;
+	const uint32_t width = (Reg(GE_CMD_TRANSFERSIZE) & 0x3FF) + 1;
+	const uint32_t height = ((Reg(GE_CMD_TRANSFERSIZE) >> 10) & 0x3FF) + 1;
+
+	for (uint32_t y = 0; y < height; ++y) {
+		const uint8_t *src = mem_.ReadPointer(transferSrc_ + ((srcY + y) * srcStride + srcX) * bpp, width * bpp);
+		uint8_t *dest = mem_.WritePointer(dst + ((dstY + y) * dstStride + dstX) * bpp, width * bpp);
+		if (src && dest) {
+			memmove(dest, src, width * bpp);
+		}
+	}
+}
+
+bool SoftGPU::ReadIndex(int i, int &index) {
+	const int size = IndexSize((Reg(GE_CMD_VERTEXTYPE) >> 11) & 3);
+	if (size == 0) {
+		index = i;
+		return true;
+	}
+	const uint8_t *p = mem_.ReadPointer(indexAddr_ + i * size, size);
+	if (!p) {
+		return false;
+	}
+	uint32_t value = 0;
+	memcpy(&value, p, size);
+	index = (int)value;
+	return true;
+}
+
+bool SoftGPU::DecodeVertex(int index, Vertex &v) {
+	const VertexLayout layout(Reg(GE_CMD_VERTEXTYPE));
+	const bool through = IsThrough();
+	const uint32_t size = layout.size * layout.morphCount;
+	const uint8_t *p = mem_.ReadPointer(vertexAddr_ + index * size, size);
+	if (!p) {
+		return false;
+	}
+
+	memset(&v, 0, sizeof(v));
+	v.hasColor = layout.col != 0;
+	if (layout.weightOffset >= 0) {
+		for (int i = 0; i < layout.weightCount; ++i) {
+			v.weights[i] = ReadComponent(p + layout.weightOffset, layout.weight, i, false, false);
+		}
+	}
+
+	// Morph frames are stored one after another, and blended by the morph weights.
+	for (int n = 0; n < layout.morphCount; ++n) {
+		const uint8_t *frame = p + n * layout.size;
+		const float w = layout.morphCount == 1 ? 1.0f : Float24(GE_CMD_MORPHWEIGHT0 + n);
+		if (layout.tcOffset >= 0) {
+			for (int i = 0; i < 2; ++i) {
+				v.uv[i] += w * ReadComponent(frame + layout.tcOffset, layout.tc, i, false, through);
+			}
+		}
+		if (layout.colOffset >= 0) {
+			float c[4];
+			ReadVertexColor(frame + layout.colOffset, layout.col, c);
+			for (int i = 0; i < 4; ++i) {
+				v.color[i] += w * c[i];
+			}
+		}
+		if (layout.nrmOffset >= 0) {
+			for (int i = 0; i < 3; ++i) {
+				v.normal[i] += w * ReadComponent(frame + layout.nrmOffset, layout.nrm, i, true, false);
+			}
+		}
+		for (int i = 0; i < 3; ++i) {
+			// Through mode depth is unsigned.
+			const bool isSigned = !through || i != 2;
+			v.pos[i] += w * ReadComponent(frame + layout.posOffset, layout.pos, i, isSigned, through);
+		}
+	}
+	return true;
+}
+
+void SoftGPU::DrawPrim(int type, int count) {
+	const uint32_t vtype = Reg(GE_CMD_VERTEXTYPE);
+	const VertexLayout layout(vtype);
+
+	std::vector<Vertex> verts(count);
+	for (int i = 0; i < count; ++i) {
+		int index;
+		if (!ReadIndex(i, index) || !DecodeVertex(index, verts[i])) {
+			fprintf(stderr, "WARNING: Invalid vertex or index address, skipping prim %d\n", prims_);
+			return;
+		}
+	}
+	DrawVertices(type, verts.data(), count);
+
+	// Like the GE, the next prim continues where this one ended.
+	if (layout.idx != 0) {
+		indexAddr_ += count * IndexSize(layout.idx);
+	} else {
+		vertexAddr_ += count * layout.size * layout.morphCount;
+	}
+}
+
+static void Unproject(RasterVertex &v) {
+	// Rectangles aren't interpolated across w, so they take the values as is.
+	const float w = v.invW != 0.0f ? 1.0f / v.invW : 0.0f;
+	v.u *= w;
+	v.v *= w;
+	v.r *= w;
+	v.g *= w;
+	v.b *= w;
+	v.a *= w;
+	v.sr *= w;
+	v.sg *= w;
+	v.sb *= w;
+	v.fog *= w;
+	v.invW = 1.0f;
+}
+
+void SoftGPU::DrawVertices(int type, const Vertex *verts, int count) {
+	const bool through = IsThrough();
+	std::vector<ClipVertex> clip;
+	std::vector<RasterVertex> raster(count);
+	std::vector<bool> valid(count, true);
+	if (through) {
+		for (int i = 0; i < count; ++i) {
+			ToRasterThrough(verts[i], raster[i]);
+		}
+	} else {
+		clip.resize(count);
+		for (int i = 0; i < count; ++i) {
+			TransformVertex(verts[i], clip[i]);
+			// Triangles are clipped first, everything else is dropped if behind the camera.
+			valid[i] = ToRaster(clip[i], raster[i]);
+		}
+	}
+
+	switch (type) {
+	case PRIM_POINTS:
+		for (int i = 0; i < count; ++i) {
+			if (valid[i]) {
+				SubmitRaster(RASTER_POINT, &raster[i], 1);
+			}
+		}
+		break;
+
+	case PRIM_LINES:
+	case PRIM_LINE_STRIP: {
+		const int step = type == PRIM_LINES ? 2 : 1;
+		for (int i = 0; i + 1 < count; i += step) {
+			if (valid[i] && valid[i + 1]) {
+				SubmitRaster(RASTER_LINE, &raster[i], 2);
+			}
+		}
+		break;
+	}
+
+	case PRIM_TRIANGLES:
+	case PRIM_TRIANGLE_STRIP:
+	case PRIM_TRIANGLE_FAN: {
+		for (int i = 0; i + 2 < count; i += type == PRIM_TRIANGLES ? 3 : 1) {
+			int a = i, b = i + 1;
+			if (type == PRIM_TRIANGLE_FAN) {
+				a = 0;
+				b = i + 1;
+			} else if (type == PRIM_TRIANGLE_STRIP && (i & 1) != 0) {
+				// Keep the winding the same, and the last vertex last for flat shading.
+				std::swap(a, b);
+			}
+			const int c = i + 2;
+			if (through) {
+				const RasterVertex tri[3] = { raster[a], raster[b], raster[c] };
+				SubmitRaster(RASTER_TRIANGLE, tri, 3);
+			} else {
+				SubmitTriangle(clip[a], clip[b], clip[c]);
+			}
+		}
+		break;
+	}
+
+	case PRIM_RECTANGLES:
+		for (int i = 0; i + 1 < count; i += 2) {
+			if (!valid[i] || !valid[i + 1]) {
+				continue;
+			}
+			RasterVertex rect[2] = { raster[i], raster[i + 1] };
+			Unproject(rect[0]);
+			Unproject(rect[1]);
+			SubmitRaster(RASTER_RECT, rect, 2);
+		}
+		break;
+
+	default:
+		fprintf(stderr, "WARNING: Unknown prim type %d\n", type);
+		break;
+	}
+}
+
+void SoftGPU::DrawBezier(uint32_t data) {
+	const int ucount = data & 0xFF;
+	const int vcount = (data >> 8) & 0xFF;
+	const VertexLayout layout(Reg(GE_CMD_VERTEXTYPE));
+	if (ucount < 4 || vcount < 4) {
+		return;
+	}
+
+	std::vector<Vertex> points(ucount * vcount);
+	for (int i = 0; i < ucount * vcount; ++i) {
+		int index;
+		if (!ReadIndex(i, index) || !DecodeVertex(index, points[i])) {
+			fprintf(stderr, "WARNING: Invalid vertex or index address, skipping prim %d\n", prims_);
+			return;
+		}
+	}
+
+	const int udiv = std::max((int)(Reg(GE_CMD_PATCHDIVISION) & 0x7F), 1);
+	const int vdiv = std::max((int)((Reg(GE_CMD_PATCHDIVISION) >> 8) & 0x7F), 1);
+	const int upatches = (ucount - 1) / 3;
+	const int vpatches = (vcount - 1) / 3;
+	const int stride = udiv + 1;
+
+	std::vector<Vertex> grid(stride * (vdiv + 1));
+	std::vector<Vertex> tris;
+	for (int pv = 0; pv < vpatches; ++pv) {
+		for (int pu = 0; pu < upatches; ++pu) {
+			for (int j = 0; j <= vdiv; ++j) {
+				for (int i = 0; i <= udiv; ++i) {
+					const float s = (float)i / udiv, t = (float)j / vdiv;
+					const float bu[4] = { (1 - s) * (1 - s) * (1 - s), 3 * s * (1 - s) * (1 - s), 3 * s * s * (1 - s), s * s * s };
+					const float bv[4] = { (1 - t) * (1 - t) * (1 - t), 3 * t * (1 - t) * (1 - t), 3 * t * t * (1 - t), t * t * t };
+
+					Vertex &out = grid[j * stride + i];
+					memset(&out, 0, sizeof(out));
+					const Vertex &first = points[pv * 3 * ucount + pu * 3];
+					memcpy(out.weights, first.weights, sizeof(out.weights));
+					out.hasColor = first.hasColor;
+					for (int y = 0; y < 4; ++y) {
+						for (int x = 0; x < 4; ++x) {
+							const Vertex &cp = points[(pv * 3 + y) * ucount + pu * 3 + x];
+							const float w = bu[x] * bv[y];
+							for (int k = 0; k < 3; ++k) {
+								out.pos[k] += w * cp.pos[k];
+								out.normal[k] += w * cp.normal[k];
+							}
+							for (int k = 0; k < 4; ++k) {
+								out.color[k] += w * cp.color[k];
+							}
+							out.uv[0] += w * cp.uv[0];
+							out.uv[1] += w * cp.uv[1];
+						}
+					}
+					if (layout.tcOffset < 0) {
+						out.uv[0] = s;
+						out.uv[1] = t;
+					}
+				}
+			}
+
+			for (int j = 0; j < vdiv; ++j) {
+				for (int i = 0; i < udiv; ++i) {
+					const Vertex &v0 = grid[j * stride + i];
+					const Vertex &v1 = grid[j * stride + i + 1];
+					const Vertex &v2 = grid[(j + 1) * stride + i];
+					const Vertex &v3 = grid[(j + 1) * stride + i + 1];
+					tris.push_back(v0);
+					tris.push_back(v2);
+					tris.push_back(v1);
+					tris.push_back(v1);
+					tris.push_back(v2);
+					tris.push_back(v3);
+				}
+			}
+		}
+	}
+
+	// Lines and points are approximated by the vertices of the tessellation.
+	const bool triangles = (Reg(GE_CMD_PATCHPRIMITIVE) & 3) == 0;
+	DrawVertices(triangles ? PRIM_TRIANGLES : PRIM_POINTS, tris.data(), (int)tris.size());
+
+	if (layout.idx != 0) {
+		indexAddr_ += ucount * vcount * IndexSize(layout.idx);
+	} else {
+		vertexAddr_ += ucount * vcount * layout.size * layout.morphCount;
+	}
+}
+
+void SoftGPU::TransformVertex(const Vertex &in, ClipVertex &out) {
+	const VertexLayout layout(Reg(GE_CMD_VERTEXTYPE));
+	memset(&out, 0, sizeof(out));
+
+	float pos[3], normal[3];
+	if (layout.weight != 0) {
+		memset(pos, 0, sizeof(pos));
+		memset(normal, 0, sizeof(normal));
+		for (int i = 0; i < layout.weightCount; ++i) {
+			if (in.weights[i] == 0.0f) {
+				continue;
+			}
+			float p[3], n[3];
+			Transform43(boneMatrix_ + i * 12, in.pos, p);
+			Rotate43(boneMatrix_ + i * 12, in.normal, n);
+			for (int k = 0; k < 3; ++k) {
+				pos[k] += in.weights[i] * p[k];
+				normal[k] += in.weights[i] * n[k];
+			}
+		}
+	} else {
+		memcpy(pos, in.pos, sizeof(pos));
+		memcpy(normal, in.normal, sizeof(normal));
+	}
+	if (Reg(GE_CMD_REVERSENORMAL) & 1) {
+		normal[0] = -normal[0];
+		normal[1] = -normal[1];
+		normal[2] = -normal[2];
+	}
+
+	Transform43(worldMatrix_, pos, out.world);
+	Transform43(viewMatrix_, out.world, out.view);
+	Transform44(projMatrix_, out.view, out.clip);
+	Rotate43(worldMatrix_, normal, out.worldNormal);
+	Normalize(out.worldNormal);
+
+	if (Reg(GE_CMD_LIGHTINGENABLE) & 1) {
+		Light(out, in);
+	} else if (in.hasColor) {
+		memcpy(out.color0, in.color, sizeof(out.color0));
+	} else {
+		RegColor(Reg(GE_CMD_MATERIALAMBIENT), out.color0);
+		out.color0[3] = (float)(Reg(GE_CMD_MATERIALALPHA) & 0xFF);
+	}
+
+	out.q = 1.0f;
+	switch (Reg(GE_CMD_TEXMAPMODE) & 3) {
+	case 0:
+		out.uv[0] = in.uv[0] * Float24(GE_CMD_TEXSCALEU) + Float24(GE_CMD_TEXOFFSETU);
+		out.uv[1] = in.uv[1] * Float24(GE_CMD_TEXSCALEV) + Float24(GE_CMD_TEXOFFSETV);
+		break;
+	case 1: {
+		float src[3], stq[3];
+		switch ((Reg(GE_CMD_TEXMAPMODE) >> 8) & 3) {
+		case 0:
+			memcpy(src, pos, sizeof(src));
+			break;
+		case 1:
+			src[0] = in.uv[0];
+			src[1] = in.uv[1];
+			src[2] = 0.0f;
+			break;
+		case 2:
+			memcpy(src, normal, sizeof(src));
+			Normalize(src);
+			break;
+		default:
+			memcpy(src, normal, sizeof(src));
+			break;
+		}
+		Transform43(texMatrix_, src, stq);
+		out.uv[0] = stq[0];
+		out.uv[1] = stq[1];
+		out.q = stq[2];
+		break;
+	}
+	case 2: {
+		// Shade mapping, each coordinate from a light's direction.
+		const int ls[2] = { (int)(Reg(GE_CMD_TEXSHADELS) & 3), (int)((Reg(GE_CMD_TEXSHADELS) >> 8) & 3) };
+		for (int i = 0; i < 2; ++i) {
+			float light[3] = { Float24(GE_CMD_LX0 + ls[i] * 3), Float24(GE_CMD_LY0 + ls[i] * 3), Float24(GE_CMD_LZ0 + ls[i] * 3) };
+			Normalize(light);
+			out.uv[i] = (1.0f + Dot(light, out.worldNormal)) * 0.5f;
+		}
+		break;
+	}
+	default:
+		out.uv[0] = in.uv[0];
+		out.uv[1] = in.uv[1];
+		break;
+	}
+
+	out.fog = (out.view[2] + Float24(GE_CMD_FOG1)) * Float24(GE_CMD_FOG2);
+}
+
+void SoftGPU::Light(ClipVertex &v, const Vertex &in) {
+	const uint32_t update = Reg(GE_CMD_MATERIALUPDATE);
+	float matAmbient[4], matDiffuse[3], matSpecular[3], emissive[3], ambient[4];
+	RegColor(Reg(GE_CMD_MATERIALAMBIENT), matAmbient);
+	matAmbient[3] = (float)(Reg(GE_CMD_MATERIALALPHA) & 0xFF);
+	RegColor(Reg(GE_CMD_MATERIALDIFFUSE), matDiffuse);
+	RegColor(Reg(GE_CMD_MATERIALSPECULAR), matSpecular);
+	RegColor(Reg(GE_CMD_MATERIALEMISSIVE), emissive);
+	RegColor(Reg(GE_CMD_AMBIENTCOLOR), ambient);
+	ambient[3] = (float)(Reg(GE_CMD_AMBIENTALPHA) & 0xFF);
+	if (in.hasColor) {
+		// The vertex color replaces the material colors selected by MATERIALUPDATE.
+		if (update & 1) {
+			memcpy(matAmbient, in.color, sizeof(matAmbient));
+		}
+		if (update & 2) {
+			memcpy(matDiffuse, in.color, sizeof(matDiffuse));
+		}
+		if (update & 4) {
+			memcpy(matSpecular, in.color, sizeof(matSpecular));
+		}
+	}
+
+	const bool separate = (Reg(GE_CMD_LIGHTMODE) & 1) != 0;
+	const float specCoef = Float24(GE_CMD_MATERIALSPECULARCOEF);
+	for (int k = 0; k < 3; ++k) {
+		v.color0[k] = emissive[k] + ambient[k] * matAmbient[k] / 255.0f;
+		v.color1[k] = 0.0f;
+	}
+	v.color0[3] = ambient[3] * matAmbient[3] / 255.0f;
+
+	for (int i = 0; i < 4; ++i) {
+		if (!(Reg(GE_CMD_LIGHTENABLE0 + i) & 1)) {
+			continue;
+		}
+		const uint32_t type = Reg(GE_CMD_LIGHTTYPE0 + i);
+		const int comp = type & 3;
+		const int kind = (type >> 8) & 3;
+		float L[3] = { Float24(GE_CMD_LX0 + i * 3), Float24(GE_CMD_LY0 + i * 3), Float24(GE_CMD_LZ0 + i * 3) };
+		float att = 1.0f;
+		if (kind != 0) {
+			for (int k = 0; k < 3; ++k) {
+				L[k] -= v.world[k];
+			}
+			const float d = sqrtf(Dot(L, L));
+			const float denom = Float24(GE_CMD_LKA0 + i * 3) + Float24(GE_CMD_LKB0 + i * 3) * d + Float24(GE_CMD_LKC0 + i * 3) * d * d;
+			att = denom > 0.0f ? std::min(1.0f / denom, 1.0f) : 1.0f;
+		}
+		Normalize(L);
+		if (kind == 2) {
+			float dir[3] = { Float24(GE_CMD_LDX0 + i * 3), Float24(GE_CMD_LDY0 + i * 3), Float24(GE_CMD_LDZ0 + i * 3) };
+			Normalize(dir);
+			const float spot = -Dot(L, dir);
+			if (spot >= Float24(GE_CMD_LKO0 + i)) {
+				att *= powf(std::max(spot, 0.0f), Float24(GE_CMD_LKS0 + i));
+			} else {
+				att = 0.0f;
+			}
+		}
+
+		float lightAmbient[3], lightDiffuse[3], lightSpecular[3];
+		RegColor(Reg(GE_CMD_LAC0 + i * 3), lightAmbient);
+		RegColor(Reg(GE_CMD_LDC0 + i * 3), lightDiffuse);
+		RegColor(Reg(GE_CMD_LSC0 + i * 3), lightSpecular);
+
+		const float ndotl = Dot(v.worldNormal, L);
+		float diffuse = std::max(ndotl, 0.0f);
+		if (comp == 2) {
+			diffuse = powf(diffuse, specCoef);
+		}
+		float specular = 0.0f;
+		if (comp == 1 && ndotl >= 0.0f) {
+			float H[3] = { L[0], L[1], L[2] + 1.0f };
+			Normalize(H);
+			specular = powf(std::max(Dot(v.worldNormal, H), 0.0f), specCoef);
+		}
+
+		for (int k = 0; k < 3; ++k) {
+			const float lit = (lightAmbient[k] * matAmbient[k] + lightDiffuse[k] * matDiffuse[k] * diffuse) / 255.0f;
+			const float spec = lightSpecular[k] * matSpecular[k] * specular / 255.0f;
+			v.color0[k] += att * lit;
+			if (separate) {
+				v.color1[k] += att * spec;
+			} else {
+				v.color0[k] += att * spec;
+			}
+		}
+	}
+}
+
+bool SoftGPU::ToRaster(const ClipVertex &in, RasterVertex &out) {
+	const float w = in.clip[3];
+	if (!(w > 0.0f)) {
+		return false;
+	}
+	const float invW = 1.0f / w;
+	out.x = in.clip[0] * invW * Float24(GE_CMD_VIEWPORTXSCALE) + Float24(GE_CMD_VIEWPORTXCENTER) - (Reg(GE_CMD_OFFSETX) & 0xFFFF) / 16.0f;
+	out.y = in.clip[1] * invW * Float24(GE_CMD_VIEWPORTYSCALE) + Float24(GE_CMD_VIEWPORTYCENTER) - (Reg(GE_CMD_OFFSETY) & 0xFFFF) / 16.0f;
+	out.z = in.clip[2] * invW * Float24(GE_CMD_VIEWPORTZSCALE) + Float24(GE_CMD_VIEWPORTZCENTER);
+	out.invW = invW;
+
+	const float invQ = in.q != 0.0f ? 1.0f / in.q : 0.0f;
+	out.u = in.uv[0] * invQ * invW;
+	out.v = in.uv[1] * invQ * invW;
+	out.r = in.color0[0] * invW;
+	out.g = in.color0[1] * invW;
+	out.b = in.color0[2] * invW;
+	out.a = in.color0[3] * invW;
+	out.sr = in.color1[0] * invW;
+	out.sg = in.color1[1] * invW;
+	out.sb = in.color1[2] * invW;
+	out.fog = in.fog * invW;
+	return true;
+}
+
+void SoftGPU::ToRasterThrough(const Vertex &in, RasterVertex &out) {
+	out.x = in.pos[0];
+	out.y = in.pos[1];
+	out.z = in.pos[2];
+	out.invW = 1.0f;
+
+	// Texture coordinates are in texels.
+	const uint32_t texSize = Reg(GE_CMD_TEXSIZE0);
+	out.u = in.uv[0] / (float)(1 << std::min(texSize & 0xF, 10U));
+	out.v = in.uv[1] / (float)(1 << std::min((texSize >> 8) & 0xF, 10U));
+
+	if (in.hasColor) {
+		out.r = in.color[0];
+		out.g = in.color[1];
+		out.b = in.color[2];
+		out.a = in.color[3];
+	} else {
+		float c[3];
+		RegColor(Reg(GE_CMD_MATERIALAMBIENT), c);
+		out.r = c[0];
+		out.g = c[1];
+		out.b = c[2];
+		out.a = (float)(Reg(GE_CMD_MATERIALALPHA) & 0xFF);
+	}
+	out.sr = 0.0f;
+	out.sg = 0.0f;
+	out.sb = 0.0f;
+	out.fog = 1.0f;
+}
+
+static void Lerp(const float *a, const float *b, float t, float *out, int count) {
+	for (int i = 0; i < count; ++i) {
+		out[i] = a[i] + (b[i] - a[i]) * t;
+	}
+}
+
+// Clips a polygon to where dot(plane, clip) >= 0, and returns the new vertex count.
+template <typename V>
+static int ClipPolygon(const V *in, int count, const float *plane, V *out) {
+	int n = 0;
+	for (int i = 0; i < count; ++i) {
+		const V &a = in[i];
+		const V &b = in[(i + 1) % count];
+		const float da = a.clip[0] * plane[0] + a.clip[1] * plane[1] + a.clip[2] * plane[2] + a.clip[3] * plane[3];
+		const float db = b.clip[0] * plane[0] + b.clip[1] * plane[1] + b.clip[2] * plane[2] + b.clip[3] * plane[3];
+		if (da >= 0.0f) {
+			out[n++] = a;
+		}
+		if ((da >= 0.0f) != (db >= 0.0f)) {
+			// All the fields are floats, so they can be interpolated together.
+			const float t = da / (da - db);
+			Lerp((const float *)&a, (const float *)&b, t, (float *)&out[n], sizeof(V) / sizeof(float));
+			n++;
+		}
+	}
+	return n;
+}
+
+void SoftGPU::SubmitTriangle(const ClipVertex &a, const ClipVertex &b, const ClipVertex &c) {
+	// Three vertices, plus at most one more per plane.
+	ClipVertex poly[5], clipped[5];
+	poly[0] = a;
+	poly[1] = b;
+	poly[2] = c;
+
+	// The near plane, and w slightly above zero so the divide is safe.
+	static const float nearPlane[4] = { 0.0f, 0.0f, 1.0f, 1.0f };
+	static const float wPlane[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+	int count = ClipPolygon(poly, 3, nearPlane, clipped);
+	if (count < 3) {
+		return;
+	}
+	for (int i = 0; i < count; ++i) {
+		clipped[i].clip[3] -= 1e-5f;
+	}
+	count = ClipPolygon(clipped, count, wPlane, poly);
+	for (int i = 0; i < count; ++i) {
+		poly[i].clip[3] += 1e-5f;
+	}
+	if (count < 3) {
+		return;
+	}
+
+	RasterVertex raster[5];
+	for (int i = 0; i < count; ++i) {
+		if (!ToRaster(poly[i], raster[i])) {
+			return;
+		}
+	}
+
+	const bool cull = (Reg(GE_CMD_CULLFACEENABLE) & 1) != 0;
+	const bool cullClockwise = (Reg(GE_CMD_CULL) & 1) != 0;
+	for (int i = 1; i + 1 < count; ++i) {
+		const RasterVertex tri[3] = { raster[0], raster[i], raster[i + 1] };
+		if (cull) {
+			// With y down, a positive area is clockwise on screen.
+			const float area = (tri[1].x - tri[0].x) * (tri[2].y - tri[0].y) - (tri[1].y - tri[0].y) * (tri[2].x - tri[0].x);
+			if (cullClockwise ? area > 0.0f : area < 0.0f) {
+				continue;
+			}
+		}
+		SubmitRaster(RASTER_TRIANGLE, tri, 3);
+	}
+}
+
+void SoftGPU::BuildState(RenderState &s) {
+	memset(&s, 0, sizeof(s));
+	const bool through = IsThrough();
+
+	s.fbAddr = VRAM_BASE | (Reg(GE_CMD_FRAMEBUFPTR) & 0x1FFFF0);
+	s.fbStride = Reg(GE_CMD_FRAMEBUFWIDTH) & 0x7FC;
+	s.fbFormat = Reg(GE_CMD_FRAMEBUFPIXFORMAT) & 3;
+	s.zAddr = VRAM_BASE | (Reg(GE_CMD_ZBUFPTR) & 0x1FFFF0);
+	s.zStride = Reg(GE_CMD_ZBUFWIDTH) & 0x7FC;
+
+	// Tiles are drawn in parallel, so they must never touch the same row of another tile.
+	s.scissorX1 = Reg(GE_CMD_SCISSOR1) & 0x3FF;
+	s.scissorY1 = (Reg(GE_CMD_SCISSOR1) >> 10) & 0x3FF;
+	s.scissorX2 = std::min((int)(Reg(GE_CMD_SCISSOR2) & 0x3FF), (int)(Reg(GE_CMD_REGION2) & 0x3FF));
+	s.scissorY2 = std::min((int)((Reg(GE_CMD_SCISSOR2) >> 10) & 0x3FF), (int)((Reg(GE_CMD_REGION2) >> 10) & 0x3FF));
+	s.scissorX2 = std::min(s.scissorX2, std::min(s.fbStride, s.zStride != 0 ? s.zStride : s.fbStride) - 1);
+
+	const uint32_t clear = Reg(GE_CMD_CLEARMODE);
+	s.clearMode = (clear & 1) != 0;
+	s.clearColor = (clear & 0x100) != 0;
+	s.clearStencil = (clear & 0x200) != 0;
+	s.clearDepth = (clear & 0x400) != 0;
+	s.gouraud = (Reg(GE_CMD_SHADEMODE) & 1) != 0;
+
+	s.alphaTest = (Reg(GE_CMD_ALPHATESTENABLE) & 1) != 0;
+	s.alphaFunc = Reg(GE_CMD_ALPHATEST) & 7;
+	s.alphaRef = (Reg(GE_CMD_ALPHATEST) >> 8) & 0xFF;
+	s.alphaMask = (Reg(GE_CMD_ALPHATEST) >> 16) & 0xFF;
+	s.colorTest = (Reg(GE_CMD_COLORTESTENABLE) & 1) != 0;
+	s.colorFunc = Reg(GE_CMD_COLORTEST) & 3;
+	s.colorRef = Reg(GE_CMD_COLORREF);
+	s.colorMask = Reg(GE_CMD_COLORTESTMASK);
+	s.stencilTest = (Reg(GE_CMD_STENCILTESTENABLE) & 1) != 0 && s.fbFormat != 0;
+	s.stencilFunc = Reg(GE_CMD_STENCILTEST) & 7;
+	s.stencilRef = (Reg(GE_CMD_STENCILTEST) >> 8) & 0xFF;
+	s.stencilMask = (Reg(GE_CMD_STENCILTEST) >> 16) & 0xFF;
+	s.stencilFail = Reg(GE_CMD_STENCILOP) & 7;
+	s.stencilZFail = (Reg(GE_CMD_STENCILOP) >> 8) & 7;
+	s.stencilZPass = (Reg(GE_CMD_STENCILOP) >> 16) & 7;
+	s.depthTest = (Reg(GE_CMD_ZTESTENABLE) & 1) != 0;
+	s.depthFunc = Reg(GE_CMD_ZTEST) & 7;
+	s.depthWrite = (Reg(GE_CMD_ZWRITEDISABLE) & 1) == 0;
+	// The depth range only applies to transformed vertices.
+	s.minZ = through ? 0 : Reg(GE_CMD_MINZ) & 0xFFFF;
+	s.maxZ = through ? 0xFFFF : Reg(GE_CMD_MAXZ) & 0xFFFF;
+
+	s.blend = (Reg(GE_CMD_ALPHABLENDENABLE) & 1) != 0;
+	s.blendSrc = Reg(GE_CMD_BLENDMODE) & 0xF;
+	s.blendDst = (Reg(GE_CMD_BLENDMODE) >> 4) & 0xF;
+	s.blendEq = (Reg(GE_CMD_BLENDMODE) >> 8) & 7;
+	s.blendFixA = Reg(GE_CMD_BLENDFIXEDA);
+	s.blendFixB = Reg(GE_CMD_BLENDFIXEDB);
+	s.logicOpEnable = (Reg(GE_CMD_LOGICOPENABLE) & 1) != 0;
+	s.logicOp = Reg(GE_CMD_LOGICOP) & 0xF;
+	s.maskRGB = Reg(GE_CMD_MASKRGB);
+	s.maskAlpha = Reg(GE_CMD_MASKALPHA) & 0xFF;
+	s.dither = (Reg(GE_CMD_DITHERENABLE) & 1) != 0;
+	for (int i = 0; i < 16; ++i) {
+		const int value = (Reg(GE_CMD_DITH0 + i / 4) >> ((i % 4) * 4)) & 0xF;
+		s.ditherMatrix[i] = (int8_t)(value >= 8 ? value - 16 : value);
+	}
+	s.fog = (Reg(GE_CMD_FOGENABLE) & 1) != 0 && !through;
+	s.fogColor = Reg(GE_CMD_FOGCOLOR);
+	s.separateSpecular = (Reg(GE_CMD_LIGHTINGENABLE) & 1) != 0 && (Reg(GE_CMD_LIGHTMODE) & 1) != 0 && !through;
+
+	s.texture = (Reg(GE_CMD_TEXTUREMAPENABLE) & 1) != 0 && !s.clearMode;
+	if (!s.texture) {
+		return;
+	}
+	s.texFormat = Reg(GE_CMD_TEXFORMAT) & 0xF;
+	s.texSwizzle = (Reg(GE_CMD_TEXMODE) & 1) != 0;
+	s.texFunc = Reg(GE_CMD_TEXFUNC) & 7;
+	s.texAlpha = (Reg(GE_CMD_TEXFUNC) & 0x100) != 0;
+	s.texDouble = (Reg(GE_CMD_TEXFUNC) & 0x10000) != 0;
+	s.texEnvColor = Reg(GE_CMD_TEXENVCOLOR);
+	s.texMinLinear = (Reg(GE_CMD_TEXFILTER) & 1) != 0;
+	s.texMagLinear = (Reg(GE_CMD_TEXFILTER) & 0x100) != 0;
+	s.texClampU = (Reg(GE_CMD_TEXWRAP) & 1) != 0;
+	s.texClampV = (Reg(GE_CMD_TEXWRAP) & 0x100) != 0;
+
+	// No mipmapping, just level 0 or the constant level.
+	int level = 0;
+	if ((Reg(GE_CMD_TEXLEVEL) & 3) == 1) {
+		const int maxLevel = (Reg(GE_CMD_TEXMODE) >> 16) & 7;
+		level = std::max(0, std::min((int)(int8_t)(Reg(GE_CMD_TEXLEVEL) >> 16) / 16, maxLevel));
+	}
+	s.texAddr = texAddr_[level];
+	s.tex.size = mem_.ValidSize(s.texAddr);
+	s.tex.data = s.tex.size != 0 ? mem_.ReadPointer(s.texAddr, s.tex.size) : NULL;
+	s.tex.width = 1 << std::min(Reg(GE_CMD_TEXSIZE0 + level) & 0xF, 10U);
+	s.tex.height = 1 << std::min((Reg(GE_CMD_TEXSIZE0 + level) >> 8) & 0xF, 10U);
+	s.tex.bufw = Reg(GE_CMD_TEXBUFWIDTH0 + level) & 0x7FF;
+
+	if (s.texFormat >= 4 && s.texFormat <= 7) {
+		const uint32_t clut = Reg(GE_CMD_CLUTFORMAT);
+		s.clutFormat = clut & 3;
+		s.clutShift = (clut >> 2) & 0x1F;
+		s.clutMask = (clut >> 8) & 0xFF;
+		s.clutBase = (clut >> 16) & 0x1F;
+		memcpy(s.clut, clut_, sizeof(s.clut));
+	}
+}
+
+uint32_t SoftGPU::CurrentState() {
+	if (stateDirty_ || states_.empty()) {
+		RenderState state;
+		BuildState(state);
+		stateDirty_ = false;
+		if (states_.empty() || memcmp(&state, &states_.back(), sizeof(state)) != 0) {
+			states_.push_back(state);
+		}
+	}
+	return (uint32_t)states_.size() - 1;
+}
+
+bool SoftGPU::SameTarget(const RenderState &a, const RenderState &b) const {
+	return a.fbAddr == b.fbAddr && a.fbStride == b.fbStride && a.fbFormat == b.fbFormat && a.zAddr == b.zAddr && a.zStride == b.zStride;
+}
+
+bool SoftGPU::BatchWrites(uint32_t addr, uint32_t size) const {
+	const uint32_t offset = VRAMOffset(addr);
+	if (batch_.empty() || offset == 0xFFFFFFFF) {
+		return false;
+	}
+
+	const RenderState &s = states_[batch_[0].state];
+	const uint32_t rows = batchMaxY_ + 1;
+	const uint32_t fb = VRAMOffset(s.fbAddr);
+	const uint32_t fbSize = rows * s.fbStride * (s.fbFormat == 3 ? 4 : 2);
+	const uint32_t z = VRAMOffset(s.zAddr);
+	const uint32_t zSize = rows * s.zStride * 2;
+	return (offset < fb + fbSize && fb < offset + size) || (offset < z + zSize && z < offset + size);
+}
+
+void SoftGPU::SubmitRaster(RasterPrimType type, const RasterVertex *v, int count) {
+	uint32_t state = CurrentState();
+	if (!batch_.empty()) {
+		// Render to texture needs the previous prims drawn, and the tiles must share a target.
+		const RenderState &s = states_[state];
+		const uint32_t texBytes = s.tex.bufw * s.tex.height * 4;
+		if (!SameTarget(s, states_[batch_[0].state]) || (s.texture && BatchWrites(s.texAddr, texBytes))) {
+			Flush();
+			state = CurrentState();
+		}
+	}
+
+	RasterPrim prim;
+	prim.type = (uint8_t)type;
+	prim.state = state;
+	for (int i = 0; i < 3; ++i) {
+		prim.v[i] = v[std::min(i, count - 1)];
+	}
+	batch_.push_back(prim);
+	batchMaxY_ = std::max(batchMaxY_, states_[state].scissorY2);
+	BinPrim((uint32_t)batch_.size() - 1);
+
+	if (batch_.size() >= MAX_BATCH_PRIMS) {
+		Flush();
+	}
+}
+
+void SoftGPU::BinPrim(uint32_t index) {
+	const RasterPrim &prim = batch_[index];
+	const RenderState &s = states_[prim.state];
+	const int count = prim.type == RASTER_TRIANGLE ? 3 : (prim.type == RASTER_POINT ? 1 : 2);
+	for (int i = 0; i < count; ++i) {
+		if (!isfinite(prim.v[i].x) || !isfinite(prim.v[i].y)) {
+			return;
+		}
+	}
+
+	float minX = prim.v[0].x, maxX = prim.v[0].x;
+	float minY = prim.v[0].y, maxY = prim.v[0].y;
+	for (int i = 1; i < count; ++i) {
+		minX = std::min(minX, prim.v[i].x);
+		maxX = std::max(maxX, prim.v[i].x);
+		minY = std::min(minY, prim.v[i].y);
+		maxY = std::max(maxY, prim.v[i].y);
+	}
+
+	// Generous, the rasterizer clips to the tile exactly.
+	const int x1 = std::max((int)std::max(floorf(minX) - 1.0f, -1.0f), s.scissorX1);
+	const int y1 = std::max((int)std::max(floorf(minY) - 1.0f, -1.0f), s.scissorY1);
+	const int x2 = std::min((int)std::min(ceilf(maxX) + 1.0f, (float)RASTER_MAX_SIZE), s.scissorX2);
+	const int y2 = std::min((int)std::min(ceilf(maxY) + 1.0f, (float)RASTER_MAX_SIZE), s.scissorY2);
+	if (x1 > x2 || y1 > y2) {
+		return;
+	}
+
+	for (int ty = y1 / RASTER_TILE_SIZE; ty <= y2 / RASTER_TILE_SIZE; ++ty) {
+		for (int tx = x1 / RASTER_TILE_SIZE; tx <= x2 / RASTER_TILE_SIZE; ++tx) {
+			bins_[ty * RASTER_TILES + tx].push_back(index);
+		}
+	}
+}
+
+void SoftGPU::Flush() {
+	if (batch_.empty()) {
+		return;
+	}
+
+	std::vector<int> tiles;
+	for (int i = 0; i < RASTER_TILES * RASTER_TILES; ++i) {
+		if (!bins_[i].empty()) {
+			tiles.push_back(i);
+		}
+	}
+
+	pool_->Run((int)tiles.size(), [&](int n) {
+		const int tile = tiles[n];
+		DrawTile(mem_, states_, batch_, bins_[tile], tile % RASTER_TILES, tile / RASTER_TILES);
+	});
+
+	for (size_t i = 0; i < tiles.size(); ++i) {
+		bins_[tiles[i]].clear();
+	}
+	batch_.clear();
+	states_.clear();
+	stateDirty_ = true;
+	batchMaxY_ = 0;
+}
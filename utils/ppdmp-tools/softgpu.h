@@ -0,0 +1,255 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// A software GE for running frame dumps on the host, see ppdmp-render.cpp.
+
+// Memory the GE can see.  The dump's buffer data isn't copied into RAM like on the PSP,
+// it's addressed at DUMP_BUFFER_BASE + ptr, above anything a GE register can hold.
+static const uint32_t VRAM_BASE = 0x04000000;
+static const uint32_t VRAM_SIZE = 0x00200000;
+static const uint32_t RAM_BASE = 0x08000000;
+static const uint32_t RAM_SIZE = 0x04000000;
+static const uint32_t DUMP_BUFFER_BASE = 0x10000000;
+
+class GEMemory {
+public:
+	GEMemory();
+
+	void SetBuffer(const uint8_t *buf, uint32_t size) {
+		buf_ = buf;
+		bufSize_ = size;
+	}
+
+	// NULL unless all of [addr, addr + size) is readable.
+	const uint8_t *ReadPointer(uint32_t addr, uint32_t size) const;
+	// Only VRAM and RAM can be written.
+	uint8_t *WritePointer(uint32_t addr, uint32_t size);
+	// Bytes readable starting at addr, for textures where the size isn't known up front.
+	uint32_t ValidSize(uint32_t addr) const;
+
+private:
+	std::vector<uint8_t> vram_;
+	std::vector<uint8_t> ram_;
+	const uint8_t *buf_;
+	uint32_t bufSize_;
+};
+
+// The drawing area is at most 1024x1024, split into tiles that are drawn in parallel.
+static const int RASTER_MAX_SIZE = 1024;
+static const int RASTER_TILE_SIZE = 32;
+static const int RASTER_TILES = RASTER_MAX_SIZE / RASTER_TILE_SIZE;
+
+struct TextureInfo {
+	const uint8_t *data;
+	uint32_t size;
+	int width;
+	int height;
+	int bufw;
+};
+
+// Everything a prim needs from the GE registers once it's transformed.  Compared with memcmp
+// to share it between prims, so it's always memset first.
+struct RenderState {
+	uint32_t fbAddr;
+	int fbStride;
+	int fbFormat;
+	uint32_t zAddr;
+	int zStride;
+	int scissorX1, scissorY1, scissorX2, scissorY2;
+
+	bool clearMode;
+	bool clearColor, clearStencil, clearDepth;
+	bool gouraud;
+
+	bool alphaTest;
+	int alphaFunc;
+	int alphaRef, alphaMask;
+	bool colorTest;
+	int colorFunc;
+	uint32_t colorRef, colorMask;
+	bool stencilTest;
+	int stencilFunc;
+	int stencilRef, stencilMask;
+	int stencilFail, stencilZFail, stencilZPass;
+	bool depthTest;
+	int depthFunc;
+	bool depthWrite;
+	int minZ, maxZ;
+
+	bool blend;
+	int blendSrc, blendDst, blendEq;
+	uint32_t blendFixA, blendFixB;
+	bool logicOpEnable;
+	int logicOp;
+	// Bits set here are not written.
+	uint32_t maskRGB;
+	int maskAlpha;
+	bool dither;
+	int8_t ditherMatrix[16];
+	bool fog;
+	uint32_t fogColor;
+	bool separateSpecular;
+
+	bool texture;
+	int texFormat;
+	bool texSwizzle;
+	int texFunc;
+	bool texAlpha;
+	bool texDouble;
+	uint32_t texEnvColor;
+	bool texMagLinear, texMinLinear;
+	bool texClampU, texClampV;
+	uint32_t texAddr;
+	TextureInfo tex;
+	int clutFormat, clutShift, clutMask, clutBase;
+	uint32_t clut[256];
+};
+
+enum RasterPrimType {
+	RASTER_TRIANGLE,
+	RASTER_RECT,
+	RASTER_LINE,
+	RASTER_POINT,
+};
+
+// In drawing coordinates.  For perspective correct interpolation, everything after z is
+// divided by w, and invW is 1/w (1 for through mode.)
+struct RasterVertex {
+	float x, y, z;
+	float invW;
+	float u, v;
+	float r, g, b, a;
+	float sr, sg, sb;
+	float fog;
+};
+
+struct RasterPrim {
+	uint8_t type;
+	uint32_t state;
+	RasterVertex v[3];
+};
+
+// Draws the prims binned to one tile, in order.
+void DrawTile(GEMemory &mem, const std::vector<RenderState> &states, const std::vector<RasterPrim> &prims, const std::vector<uint32_t> &bin, int tileX, int tileY);
+
+class WorkerPool;
+
+class SoftGPU {
+public:
+	SoftGPU(int threads);
+	~SoftGPU();
+
+	GEMemory &Memory() {
+		return mem_;
+	}
+
+	// Runs GE commands.  Only register writes, prims, and block transfers do anything:
+	// flow control was already followed when the dump was recorded.
+	void Execute(const uint32_t *words, uint32_t count);
+	// A PspGeContext, as saved by sceGeSaveContext.
+	void RestoreContext(const uint32_t *context, uint32_t count);
+
+	// Like the commands playback queues: these point at data without changing registers.
+	void SetVertexAddr(uint32_t addr);
+	void SetIndexAddr(uint32_t addr);
+	void SetTextureAddr(int level, uint32_t addr);
+	void SetClutAddr(uint32_t addr);
+	void SetTransferSrc(uint32_t addr);
+
+	// Like playback's --start and --end, prims outside are skipped.
+	void SetPrimRange(int start, int end) {
+		primStart_ = start;
+		primEnd_ = end;
+	}
+	int Prims() const {
+		return prims_;
+	}
+	// Seekable chunks continue the count from where the chunk starts.
+	void SetPrims(int prims) {
+		prims_ = prims;
+	}
+
+	// Draws everything pending.  Must be called before memory is read or written outside the GE.
+	void Flush();
+
+private:
+	struct Vertex {
+		float weights[8];
+		float pos[3];
+		float normal[3];
+		float uv[2];
+		float color[4];
+		bool hasColor;
+	};
+	struct ClipVertex {
+		float clip[4];
+		float view[3];
+		float world[3];
+		float worldNormal[3];
+		float uv[2];
+		float q;
+		float color0[4];
+		float color1[3];
+		float fog;
+	};
+
+	void ExecuteCommand(uint32_t cmd);
+	void SetRegister(uint32_t cmd);
+	void DrawPrim(int type, int count);
+	void DrawVertices(int type, const Vertex *verts, int count);
+	void DrawBezier(uint32_t data);
+	void BlockTransfer(uint32_t data);
+	void LoadClut(uint32_t data);
+
+	bool ReadIndex(int i, int &index);
+	bool DecodeVertex(int index, Vertex &v);
+	void TransformVertex(const Vertex &in, ClipVertex &out);
+	void Light(ClipVertex &v, const Vertex &in);
+	bool ToRaster(const ClipVertex &in, RasterVertex &out);
+	void ToRasterThrough(const Vertex &in, RasterVertex &out);
+	void SubmitTriangle(const ClipVertex &a, const ClipVertex &b, const ClipVertex &c);
+	void SubmitRaster(RasterPrimType type, const RasterVertex *v, int count);
+
+	uint32_t CurrentState();
+	void BuildState(RenderState &state);
+	bool BatchWrites(uint32_t addr, uint32_t size) const;
+	bool SameTarget(const RenderState &a, const RenderState &b) const;
+	void BinPrim(uint32_t index);
+
+	uint32_t Reg(int op) const {
+		return regs_[op] & 0x00FFFFFF;
+	}
+	float Float24(int op) const;
+	bool IsThrough() const;
+
+	GEMemory mem_;
+	WorkerPool *pool_;
+
+	uint32_t regs_[256];
+	uint32_t vertexAddr_;
+	uint32_t indexAddr_;
+	uint32_t texAddr_[8];
+	uint32_t clutAddr_;
+	uint32_t transferSrc_;
+	uint32_t clut_[256];
+
+	float boneMatrix_[8 * 12];
+	float worldMatrix_[12];
+	float viewMatrix_[12];
+	float projMatrix_[16];
+	float texMatrix_[12];
+	int boneNum_, worldNum_, viewNum_, projNum_, texNum_;
+
+	int prims_;
+	int primStart_;
+	int primEnd_;
+
+	bool stateDirty_;
+	std::vector<RenderState> states_;
+	std::vector<RasterPrim> batch_;
+	// Rows drawn so far in the batch, to tell if a texture might read them.
+	int batchMaxY_;
+	std::vector<uint32_t> bins_[RASTER_TILES * RASTER_TILES];
+};
@@ -0,0 +1,683 @@
+// Per pixel work for the software GE: texturing, tests, blending, and framebuffer writes.
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include "softgpu.h"
+
+enum {
+	FORMAT_565 = 0,
+	FORMAT_5551 = 1,
+	FORMAT_4444 = 2,
+	FORMAT_8888 = 3,
+	FORMAT_CLUT4 = 4,
+	FORMAT_CLUT8 = 5,
+	FORMAT_CLUT16 = 6,
+	FORMAT_CLUT32 = 7,
+	FORMAT_DXT1 = 8,
+	FORMAT_DXT3 = 9,
+	FORMAT_DXT5 = 10,
+};
+
+struct Color {
+	int r, g, b, a;
+};
+
+static inline int Clamp255(int v) {
+	return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+static inline int Expand4(uint32_t v) {
+	return (v << 4) | v;
+}
+
+static inline int Expand5(uint32_t v) {
+	return (v << 3) | (v >> 2);
+}
+
+static inline int Expand6(uint32_t v) {
+	return (v << 2) | (v >> 4);
+}
+
+static inline uint32_t Pack(int r, int g, int b, int a) {
+	return r | (g << 8) | (b << 16) | ((uint32_t)a << 24);
+}
+
+static inline Color Unpack(uint32_t c) {
+	Color result = { (int)(c & 0xFF), (int)((c >> 8) & 0xFF), (int)((c >> 16) & 0xFF), (int)(c >> 24) };
+	return result;
+}
+
+// The PSP keeps red in the low bits for every format.
+static uint32_t DecodeColor(int format, uint32_t raw) {
+	switch (format) {
+	case FORMAT_565:
+		return Pack(Expand5(raw & 0x1F), Expand6((raw >> 5) & 0x3F), Expand5((raw >> 11) & 0x1F), 0xFF);
+	case FORMAT_5551:
+		return Pack(Expand5(raw & 0x1F), Expand5((raw >> 5) & 0x1F), Expand5((raw >> 10) & 0x1F), (raw & 0x8000) ? 0xFF : 0);
+	case FORMAT_4444:
+		return Pack(Expand4(raw & 0xF), Expand4((raw >> 4) & 0xF), Expand4((raw >> 8) & 0xF), Expand4((raw >> 12) & 0xF));
+	default:
+		return raw;
+	}
+}
+
+static uint32_t EncodeColor(int format, const Color &c) {
+	switch (format) {
+	case FORMAT_565:
+		return (c.r >> 3) | ((c.g >> 2) << 5) | ((c.b >> 3) << 11);
+	case FORMAT_5551:
+		return (c.r >> 3) | ((c.g >> 3) << 5) | ((c.b >> 3) << 10) | ((c.a >> 7) << 15);
+	case FORMAT_4444:
+		return (c.r >> 4) | ((c.g >> 4) << 4) | ((c.b >> 4) << 8) | ((c.a >> 4) << 12);
+	default:
+		return Pack(c.r, c.g, c.b, c.a);
+	}
+}
+
+static uint32_t ClutLookup(const RenderState &s, uint32_t index) {
+	index = ((index >> s.clutShift) & s.clutMask) | (s.clutBase << 4);
+	if (s.clutFormat == FORMAT_8888) {
+		return s.clut[index & 0xFF];
+	}
+	const uint16_t *clut16 = (const uint16_t *)s.clut;
+	return DecodeColor(s.clutFormat, clut16[index & 0x1FF]);
+}
+
+static uint32_t DecodeDXTColor(const uint8_t *block, int x, int y, bool alphaBlack) {
+	const uint16_t c1 = block[4] | (block[5] << 8);
+	const uint16_t c2 = block[6] | (block[7] << 8);
+	const int sel = (block[y] >> (x * 2)) & 3;
+
+	Color a = Unpack(DecodeColor(FORMAT_565, c1));
+	Color b = Unpack(DecodeColor(FORMAT_565, c2));
+	switch (sel) {
+	case 0:
+		return Pack(a.r, a.g, a.b, 0xFF);
+	case 1:
+		return Pack(b.r, b.g, b.b, 0xFF);
+	case 2:
+		if (c1 > c2 || !alphaBlack) {
+			return Pack((2 * a.r + b.r) / 3, (2 * a.g + b.g) / 3, (2 * a.b + b.b) / 3, 0xFF);
+		}
+		return Pack((a.r + b.r) / 2, (a.g + b.g) / 2, (a.b + b.b) / 2, 0xFF);
+	default:
+		if (c1 > c2 || !alphaBlack) {
+			return Pack((a.r + 2 * b.r) / 3, (a.g + 2 * b.g) / 3, (a.b + 2 * b.b) / 3, 0xFF);
+		}
+		return 0;
+	}
+}
+
+static uint32_t FetchDXT(const RenderState &s, int x, int y) {
+	const TextureInfo &t = s.tex;
+	const uint32_t blockSize = s.texFormat == FORMAT_DXT1 ? 8 : 16;
+	const uint32_t offset = ((y / 4) * (t.bufw / 4) + x / 4) * blockSize;
+	if (offset + blockSize > t.size) {
+		return 0;
+	}
+
+	// The color block comes first, then any alpha.
+	const uint8_t *block = t.data + offset;
+	const int bx = x & 3, by = y & 3;
+	uint32_t color = DecodeDXTColor(block, bx, by, s.texFormat == FORMAT_DXT1);
+	if (s.texFormat == FORMAT_DXT3) {
+		const uint8_t *alpha = block + 8;
+		uint16_t line = alpha[by * 2] | (alpha[by * 2 + 1] << 8);
+		color = (color & 0x00FFFFFF) | ((uint32_t)Expand4((line >> (bx * 4)) & 0xF) << 24);
+	} else if (s.texFormat == FORMAT_DXT5) {
+		const uint8_t *alpha = block + 8;
+		uint64_t bits = (uint64_t)(alpha[0] | (alpha[1] << 8) | (alpha[2] << 16) | ((uint32_t)alpha[3] << 24));
+		bits |= (uint64_t)(alpha[4] | (alpha[5] << 8)) << 32;
+		const int a1 = alpha[6], a2 = alpha[7];
+		const int sel = (int)((bits >> ((by * 4 + bx) * 3)) & 7);
+		int a;
+		if (sel == 0) {
+			a = a1;
+		} else if (sel == 1) {
+			a = a2;
+		} else if (a1 > a2) {
+			a = ((8 - sel) * a1 + (sel - 1) * a2) / 7;
+		} else if (sel < 6) {
+			a = ((6 - sel) * a1 + (sel - 1) * a2) / 5;
+		} else {
+			a = sel == 6 ? 0 : 255;
+		}
+		color = (color & 0x00FFFFFF) | ((uint32_t)a << 24);
+	}
+	return color;
+}
+
+static uint32_t FetchTexel(const RenderState &s, int x, int y) {
+	const TextureInfo &t = s.tex;
+	if (s.texFormat >= FORMAT_DXT1) {
+		return FetchDXT(s, x, y);
+	}
+
+	static const int bitsPerPixel[8] = { 16, 16, 16, 32, 4, 8, 16, 32 };
+	const int bits = bitsPerPixel[s.texFormat & 7];
+	const uint32_t xbits = x * bits;
+	uint32_t offset;
+	if (s.texSwizzle) {
+		// Blocks of 16 bytes by 8 rows.
+		const uint32_t rowBytes = t.bufw * bits / 8;
+		const uint32_t xb = xbits / 8;
+		offset = ((y / 8) * (rowBytes / 16) + xb / 16) * 128 + (y & 7) * 16 + (xb & 15);
+	} else {
+		offset = (y * t.bufw * bits + xbits) / 8;
+	}
+	if (offset + (bits < 8 ? 1 : bits / 8) > t.size) {
+		return 0;
+	}
+
+	const uint8_t *p = t.data + offset;
+	uint32_t raw;
+	switch (bits) {
+	case 4:
+		raw = (xbits & 4) ? (p[0] >> 4) : (p[0] & 0xF);
+		break;
+	case 8:
+		raw = p[0];
+		break;
+	case 16:
+		raw = p[0] | (p[1] << 8);
+		break;
+	default:
+		raw = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+		break;
+	}
+
+	if (s.texFormat >= FORMAT_CLUT4) {
+		return ClutLookup(s, raw);
+	}
+	return DecodeColor(s.texFormat, raw);
+}
+
+static int Wrap(int c, int size, bool clamp) {
+	if (clamp) {
+		return c < 0 ? 0 : (c >= size ? size - 1 : c);
+	}
+	return c & (size - 1);
+}
+
+static Color SampleTexture(const RenderState &s, float u, float v) {
+	const int w = s.tex.width, h = s.tex.height;
+	// Only the magnification filter is used, since we always sample level 0 (or a fixed level.)
+	if (!s.texMagLinear) {
+		int x = Wrap((int)floorf(u * w), w, s.texClampU);
+		int y = Wrap((int)floorf(v * h), h, s.texClampV);
+		return Unpack(FetchTexel(s, x, y));
+	}
+
+	float fu = u * w - 0.5f, fv = v * h - 0.5f;
+	int x0 = (int)floorf(fu), y0 = (int)floorf(fv);
+	int fracU = (int)((fu - x0) * 256.0f), fracV = (int)((fv - y0) * 256.0f);
+	int x1 = Wrap(x0 + 1, w, s.texClampU), y1 = Wrap(y0 + 1, h, s.texClampV);
+	x0 = Wrap(x0, w, s.texClampU);
+	y0 = Wrap(y0, h, s.texClampV);
+
+	Color c00 = Unpack(FetchTexel(s, x0, y0)), c10 = Unpack(FetchTexel(s, x1, y0));
+	Color c01 = Unpack(FetchTexel(s, x0, y1)), c11 = Unpack(FetchTexel(s, x1, y1));
+	Color result;
+#define LERP2(ch) (((c00.ch * (256 - fracU) + c10.ch * fracU) * (256 - fracV) + (c01.ch * (256 - fracU) + c11.ch * fracU) * fracV) >> 16)
+	result.r = LERP2(r);
+	result.g = LERP2(g);
+	result.b = LERP2(b);
+	result.a = LERP2(a);
+#undef LERP2
+	return result;
+}
+
+static Color TextureFunction(const RenderState &s, const Color &p, const Color &t) {
+	Color c;
+	const Color env = Unpack(s.texEnvColor);
+	switch (s.texFunc) {
+	case 0:
+		c.r = p.r * t.r / 255;
+		c.g = p.g * t.g / 255;
+		c.b = p.b * t.b / 255;
+		c.a = s.texAlpha ? p.a * t.a / 255 : p.a;
+		break;
+	case 1:
+		if (s.texAlpha) {
+			c.r = (p.r * (255 - t.a) + t.r * t.a) / 255;
+			c.g = (p.g * (255 - t.a) + t.g * t.a) / 255;
+			c.b = (p.b * (255 - t.a) + t.b * t.a) / 255;
+		} else {
+			c.r = t.r;
+			c.g = t.g;
+			c.b = t.b;
+		}
+		c.a = p.a;
+		break;
+	case 2:
+		c.r = (p.r * (255 - t.r) + env.r * t.r) / 255;
+		c.g = (p.g * (255 - t.g) + env.g * t.g) / 255;
+		c.b = (p.b * (255 - t.b) + env.b * t.b) / 255;
+		c.a = s.texAlpha ? p.a * t.a / 255 : p.a;
+		break;
+	case 3:
+		c.r = t.r;
+		c.g = t.g;
+		c.b = t.b;
+		c.a = s.texAlpha ? t.a : p.a;
+		break;
+	default:
+		c.r = p.r + t.r;
+		c.g = p.g + t.g;
+		c.b = p.b + t.b;
+		c.a = s.texAlpha ? p.a * t.a / 255 : p.a;
+		break;
+	}
+
+	if (s.texDouble) {
+		c.r *= 2;
+		c.g *= 2;
+		c.b *= 2;
+	}
+	c.r = Clamp255(c.r);
+	c.g = Clamp255(c.g);
+	c.b = Clamp255(c.b);
+	c.a = Clamp255(c.a);
+	return c;
+}
+
+static bool Compare(int func, int a, int b) {
+	switch (func) {
+	case 0: return false;
+	case 1: return true;
+	case 2: return a == b;
+	case 3: return a != b;
+	case 4: return a < b;
+	case 5: return a <= b;
+	case 6: return a > b;
+	default: return a >= b;
+	}
+}
+
+static int StencilOp(int op, int stencil, int ref) {
+	switch (op) {
+	case 0: return stencil;
+	case 1: return 0;
+	case 2: return ref;
+	case 3: return 255 - stencil;
+	case 4: return stencil < 255 ? stencil + 1 : 255;
+	case 5: return stencil > 0 ? stencil - 1 : 0;
+	default: return stencil;
+	}
+}
+
+static int BlendFactor(int factor, const Color &src, const Color &dst, int channel, bool isSrc, uint32_t fixed) {
+	const int *s = &src.r;
+	const int *d = &dst.r;
+	switch (factor) {
+	case 0: return isSrc ? d[channel] : s[channel];
+	case 1: return 255 - (isSrc ? d[channel] : s[channel]);
+	case 2: return src.a;
+	case 3: return 255 - src.a;
+	case 4: return dst.a;
+	case 5: return 255 - dst.a;
+	case 6: return 2 * src.a;
+	case 7: return 255 - std::min(2 * src.a, 255);
+	case 8: return 2 * dst.a;
+	case 9: return 255 - std::min(2 * dst.a, 255);
+	default: return (fixed >> (channel * 8)) & 0xFF;
+	}
+}
+
+static Color Blend(const RenderState &s, const Color &src, const Color &dst) {
+	Color out = src;
+	int *o = &out.r;
+	const int *sc = &src.r;
+	const int *dc = &dst.r;
+	for (int i = 0; i < 3; ++i) {
+		int sf = BlendFactor(s.blendSrc, src, dst, i, true, s.blendFixA);
+		int df = BlendFactor(s.blendDst, src, dst, i, false, s.blendFixB);
+		int v;
+		switch (s.blendEq) {
+		case 0: v = (sc[i] * sf + dc[i] * df) / 255; break;
+		case 1: v = (sc[i] * sf - dc[i] * df) / 255; break;
+		case 2: v = (dc[i] * df - sc[i] * sf) / 255; break;
+		case 3: v = std::min(sc[i], dc[i]); break;
+		case 4: v = std::max(sc[i], dc[i]); break;
+		default: v = abs(sc[i] - dc[i]); break;
+		}
+		o[i] = Clamp255(v);
+	}
+	return out;
+}
+
+static uint32_t LogicOp(int op, uint32_t src, uint32_t dst) {
+	switch (op) {
+	case 0: return 0;
+	case 1: return src & dst;
+	case 2: return src & ~dst;
+	case 3: return src;
+	case 4: return ~src & dst;
+	case 5: return dst;
+	case 6: return src ^ dst;
+	case 7: return src | dst;
+	case 8: return ~(src | dst);
+	case 9: return ~(src ^ dst);
+	case 10: return ~dst;
+	case 11: return src | ~dst;
+	case 12: return ~src;
+	case 13: return ~src | dst;
+	case 14: return ~(src & dst);
+	default: return 0xFFFFFFFF;
+	}
+}
+
+static void DrawPixel(GEMemory &mem, const RenderState &s, int x, int y, int z, Color c) {
+	const int bpp = s.fbFormat == FORMAT_8888 ? 4 : 2;
+	uint8_t *fb = mem.WritePointer(s.fbAddr + (y * s.fbStride + x) * bpp, bpp);
+	if (!fb) {
+		return;
+	}
+	uint8_t *depth = mem.WritePointer(s.zAddr + (y * s.zStride + x) * 2, 2);
+
+	const uint32_t oldRaw = bpp == 4 ? (fb[0] | (fb[1] << 8) | (fb[2] << 16) | ((uint32_t)fb[3] << 24)) : (fb[0] | (fb[1] << 8));
+	const Color dst = Unpack(DecodeColor(s.fbFormat, oldRaw));
+	// Stencil lives in the alpha bits, and there's none for 565.
+	const int oldStencil = s.fbFormat == FORMAT_565 ? 0 : dst.a;
+	const int oldZ = depth ? (depth[0] | (depth[1] << 8)) : 0;
+
+	Color out;
+	int stencil = oldStencil;
+	bool writeDepth = false;
+	if (s.clearMode) {
+		out = c;
+		if (!s.clearColor) {
+			out.r = dst.r;
+			out.g = dst.g;
+			out.b = dst.b;
+		}
+		stencil = s.clearStencil ? c.a : oldStencil;
+		writeDepth = s.clearDepth;
+	} else {
+		if (z < s.minZ || z > s.maxZ) {
+			return;
+		}
+		if (s.colorTest) {
+			const uint32_t rgb = Pack(c.r, c.g, c.b, 0) & s.colorMask;
+			if (!Compare(s.colorFunc, rgb, s.colorRef & s.colorMask)) {
+				return;
+			}
+		}
+		if (s.alphaTest && !Compare(s.alphaFunc, c.a & s.alphaMask, s.alphaRef & s.alphaMask)) {
+			return;
+		}
+		if (s.stencilTest && !Compare(s.stencilFunc, s.stencilRef & s.stencilMask, oldStencil & s.stencilMask)) {
+			stencil = StencilOp(s.stencilFail, oldStencil, s.stencilRef);
+			c = dst;
+		} else if (s.depthTest && !Compare(s.depthFunc, z, oldZ)) {
+			if (!s.stencilTest) {
+				return;
+			}
+			stencil = StencilOp(s.stencilZFail, oldStencil, s.stencilRef);
+			c = dst;
+		} else {
+			if (s.stencilTest) {
+				stencil = StencilOp(s.stencilZPass, oldStencil, s.stencilRef);
+			} else {
+				stencil = c.a;
+			}
+			writeDepth = s.depthTest && s.depthWrite;
+			if (s.blend) {
+				c = Blend(s, c, dst);
+			}
+			if (s.dither) {
+				int d = s.ditherMatrix[(y & 3) * 4 + (x & 3)];
+				c.r = Clamp255(c.r + d);
+				c.g = Clamp255(c.g + d);
+				c.b = Clamp255(c.b + d);
+			}
+		}
+		out = c;
+	}
+
+	if (writeDepth && depth) {
+		depth[0] = z & 0xFF;
+		depth[1] = (z >> 8) & 0xFF;
+	}
+
+	uint32_t color = Pack(out.r, out.g, out.b, 0);
+	if (!s.clearMode && s.logicOpEnable) {
+		color = LogicOp(s.logicOp, color, Pack(dst.r, dst.g, dst.b, 0)) & 0x00FFFFFF;
+	}
+	color = (color & ~s.maskRGB) | (Pack(dst.r, dst.g, dst.b, 0) & s.maskRGB);
+	stencil = (stencil & ~s.maskAlpha) | (oldStencil & s.maskAlpha);
+
+	Color final = Unpack(color);
+	final.a = stencil;
+	const uint32_t raw = EncodeColor(s.fbFormat, final);
+	fb[0] = raw & 0xFF;
+	fb[1] = (raw >> 8) & 0xFF;
+	if (bpp == 4) {
+		fb[2] = (raw >> 16) & 0xFF;
+		fb[3] = raw >> 24;
+	}
+}
+
+// Attributes at one pixel, already divided back by w.
+struct Interpolated {
+	float z;
+	float u, v;
+	float r, g, b, a;
+	float sr, sg, sb;
+	float fog;
+};
+
+static void ShadePixel(GEMemory &mem, const RenderState &s, int x, int y, const Interpolated &in) {
+	Color c = { Clamp255((int)in.r), Clamp255((int)in.g), Clamp255((int)in.b), Clamp255((int)in.a) };
+	if (!s.clearMode) {
+		if (s.texture && s.tex.data) {
+			c = TextureFunction(s, c, SampleTexture(s, in.u, in.v));
+		}
+		if (s.separateSpecular) {
+			c.r = Clamp255(c.r + (int)in.sr);
+			c.g = Clamp255(c.g + (int)in.sg);
+			c.b = Clamp255(c.b + (int)in.sb);
+		}
+		if (s.fog) {
+			const Color fog = Unpack(s.fogColor);
+			float f = in.fog < 0.0f ? 0.0f : (in.fog > 1.0f ? 1.0f : in.fog);
+			c.r = (int)(c.r * f + fog.r * (1.0f - f));
+			c.g = (int)(c.g * f + fog.g * (1.0f - f));
+			c.b = (int)(c.b * f + fog.b * (1.0f - f));
+		}
+	}
+
+	int z = (int)in.z;
+	z = z < 0 ? 0 : (z > 65535 ? 65535 : z);
+	DrawPixel(mem, s, x, y, z, c);
+}
+
+// Pixels to draw, already limited to the tile and scissor.
+struct PixelRect {
+	int x1, y1, x2, y2;
+};
+
+static void Interpolate(const RasterVertex *v, const float *w, bool flat, Interpolated &out) {
+	const float invW = w[0] * v[0].invW + w[1] * v[1].invW + w[2] * v[2].invW;
+	const float scale = invW != 0.0f ? 1.0f / invW : 0.0f;
+	out.z = w[0] * v[0].z + w[1] * v[1].z + w[2] * v[2].z;
+#define PERSP(f) ((w[0] * v[0].f + w[1] * v[1].f + w[2] * v[2].f) * scale)
+	out.u = PERSP(u);
+	out.v = PERSP(v);
+	out.fog = PERSP(fog);
+	if (flat) {
+		// The last vertex provides the color.
+		const float last = v[2].invW != 0.0f ? 1.0f / v[2].invW : 0.0f;
+		out.r = v[2].r * last;
+		out.g = v[2].g * last;
+		out.b = v[2].b * last;
+		out.a = v[2].a * last;
+		out.sr = v[2].sr * last;
+		out.sg = v[2].sg * last;
+		out.sb = v[2].sb * last;
+	} else {
+		out.r = PERSP(r);
+		out.g = PERSP(g);
+		out.b = PERSP(b);
+		out.a = PERSP(a);
+		out.sr = PERSP(sr);
+		out.sg = PERSP(sg);
+		out.sb = PERSP(sb);
+	}
+#undef PERSP
+}
+
+static inline bool IsTopLeft(int64_t dx, int64_t dy) {
+	return dy < 0 || (dy == 0 && dx > 0);
+}
+
+static void DrawTriangle(GEMemory &mem, const RenderState &s, const RasterPrim &prim, const PixelRect &rect) {
+	RasterVertex v[3] = { prim.v[0], prim.v[1], prim.v[2] };
+	// Positions in 1/16ths of a pixel, like the GE.
+	int64_t X[3], Y[3];
+	for (int i = 0; i < 3; ++i) {
+		X[i] = (int64_t)floorf(v[i].x * 16.0f + 0.5f);
+		Y[i] = (int64_t)floorf(v[i].y * 16.0f + 0.5f);
+	}
+
+	int64_t area = (X[1] - X[0]) * (Y[2] - Y[0]) - (Y[1] - Y[0]) * (X[2] - X[0]);
+	if (area == 0) {
+		return;
+	}
+	if (area < 0) {
+		// Keep the last vertex last for flat shading.
+		std::swap(v[0], v[1]);
+		std::swap(X[0], X[1]);
+		std::swap(Y[0], Y[1]);
+		area = -area;
+	}
+
+	int minX = (int)(std::min(X[0], std::min(X[1], X[2])) >> 4);
+	int minY = (int)(std::min(Y[0], std::min(Y[1], Y[2])) >> 4);
+	int maxX = (int)(std::max(X[0], std::max(X[1], X[2])) >> 4);
+	int maxY = (int)(std::max(Y[0], std::max(Y[1], Y[2])) >> 4);
+	minX = std::max(minX, rect.x1);
+	minY = std::max(minY, rect.y1);
+	maxX = std::min(maxX, rect.x2);
+	maxY = std::min(maxY, rect.y2);
+
+	const float invArea = 1.0f / (float)area;
+	for (int y = minY; y <= maxY; ++y) {
+		const int64_t sy = y * 16 + 8;
+		for (int x = minX; x <= maxX; ++x) {
+			const int64_t sx = x * 16 + 8;
+			int64_t e[3];
+			bool inside = true;
+			for (int i = 0; i < 3 && inside; ++i) {
+				const int a = (i + 1) % 3, b = (i + 2) % 3;
+				const int64_t dx = X[b] - X[a], dy = Y[b] - Y[a];
+				e[i] = dx * (sy - Y[a]) - dy * (sx - X[a]);
+				inside = e[i] > 0 || (e[i] == 0 && IsTopLeft(dx, dy));
+			}
+			if (!inside) {
+				continue;
+			}
+
+			const float w[3] = { e[0] * invArea, e[1] * invArea, e[2] * invArea };
+			Interpolated in;
+			Interpolate(v, w, !s.gouraud, in);
+			ShadePixel(mem, s, x, y, in);
+		}
+	}
+}
+
+static void DrawRect(GEMemory &mem, const RenderState &s, const RasterPrim &prim, const PixelRect &rect) {
+	const RasterVertex &a = prim.v[0];
+	const RasterVertex &b = prim.v[1];
+	const float x1 = std::min(a.x, b.x), x2 = std::max(a.x, b.x);
+	const float y1 = std::min(a.y, b.y), y2 = std::max(a.y, b.y);
+	const int minX = std::max((int)ceilf(x1 - 0.5f), rect.x1);
+	const int minY = std::max((int)ceilf(y1 - 0.5f), rect.y1);
+	const int maxX = std::min((int)ceilf(x2 - 0.5f) - 1, rect.x2);
+	const int maxY = std::min((int)ceilf(y2 - 0.5f) - 1, rect.y2);
+
+	// Color and depth come from the second vertex, texture coordinates are interpolated.
+	Interpolated in;
+	in.z = b.z;
+	in.r = b.r;
+	in.g = b.g;
+	in.b = b.b;
+	in.a = b.a;
+	in.sr = b.sr;
+	in.sg = b.sg;
+	in.sb = b.sb;
+	in.fog = b.fog;
+	const float du = b.x != a.x ? (b.u - a.u) / (b.x - a.x) : 0.0f;
+	const float dv = b.y != a.y ? (b.v - a.v) / (b.y - a.y) : 0.0f;
+	for (int y = minY; y <= maxY; ++y) {
+		in.v = a.v + (y + 0.5f - a.y) * dv;
+		for (int x = minX; x <= maxX; ++x) {
+			in.u = a.u + (x + 0.5f - a.x) * du;
+			ShadePixel(mem, s, x, y, in);
+		}
+	}
+}
+
+static void DrawLine(GEMemory &mem, const RenderState &s, const RasterPrim &prim, const PixelRect &rect) {
+	const RasterVertex &a = prim.v[0];
+	const RasterVertex &b = prim.v[1];
+	const float dx = b.x - a.x, dy = b.y - a.y;
+	const int steps = std::max(1, (int)ceilf(std::max(fabsf(dx), fabsf(dy))));
+	const RasterVertex v[3] = { a, b, b };
+	for (int i = 0; i < steps; ++i) {
+		const float t = (float)i / steps;
+		const int x = (int)floorf(a.x + dx * t);
+		const int y = (int)floorf(a.y + dy * t);
+		if (x < rect.x1 || x > rect.x2 || y < rect.y1 || y > rect.y2) {
+			continue;
+		}
+		const float w[3] = { 1.0f - t, t, 0.0f };
+		Interpolated in;
+		Interpolate(v, w, !s.gouraud, in);
+		ShadePixel(mem, s, x, y, in);
+	}
+}
+
+static void DrawPoint(GEMemory &mem, const RenderState &s, const RasterPrim &prim, const PixelRect &rect) {
+	const RasterVertex &a = prim.v[0];
+	const int x = (int)floorf(a.x), y = (int)floorf(a.y);
+	if (x < rect.x1 || x > rect.x2 || y < rect.y1 || y > rect.y2) {
+		return;
+	}
+	const RasterVertex v[3] = { a, a, a };
+	const float w[3] = { 1.0f, 0.0f, 0.0f };
+	Interpolated in;
+	Interpolate(v, w, false, in);
+	ShadePixel(mem, s, x, y, in);
+}
+
+void DrawTile(GEMemory &mem, const std::vector<RenderState> &states, const std::vector<RasterPrim> &prims, const std::vector<uint32_t> &bin, int tileX, int tileY) {
+	for (size_t i = 0; i < bin.size(); ++i) {
+		const RasterPrim &prim = prims[bin[i]];
+		const RenderState &s = states[prim.state];
+		PixelRect rect;
+		rect.x1 = std::max(tileX * RASTER_TILE_SIZE, s.scissorX1);
+		rect.y1 = std::max(tileY * RASTER_TILE_SIZE, s.scissorY1);
+		rect.x2 = std::min(tileX * RASTER_TILE_SIZE + RASTER_TILE_SIZE - 1, s.scissorX2);
+		rect.y2 = std::min(tileY * RASTER_TILE_SIZE + RASTER_TILE_SIZE - 1, s.scissorY2);
+		if (rect.x1 > rect.x2 || rect.y1 > rect.y2) {
+			continue;
+		}
+
+		switch (prim.type) {
+		case RASTER_TRIANGLE:
+			DrawTriangle(mem, s, prim, rect);
+			break;
+		case RASTER_RECT:
+			DrawRect(mem, s, prim, rect);
+			break;
+		case RASTER_LINE:
+			DrawLine(mem, s, prim, rect);
+			break;
+		default:
+			DrawPoint(mem, s, prim, rect);
+			break;
+		}
+	}
+}
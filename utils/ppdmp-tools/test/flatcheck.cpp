@@ -0,0 +1,113 @@
+// Checks that every block transfer in a frame dump starts with the same registers in its flat
+// list, in the same order, around the transfers flattening added for copies.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "commands.h"
+#include "dumpfile.h"
+
+// The source address is relocated in the flat list, so only its stride is compared.
+struct TransferRegs {
+	uint32_t srcw;
+	uint32_t dst;
+	uint32_t dstw;
+	uint32_t srcpos;
+	uint32_t dstpos;
+	uint32_t size;
+
+	bool operator ==(const TransferRegs &other) const {
+		return memcmp(this, &other, sizeof(*this)) == 0;
+	}
+};
+
+class TransferLog {
+public:
+	TransferLog() {
+		memset(regs_, 0, sizeof(regs_));
+	}
+
+	void Run(const uint32_t *words, size_t count) {
+		for (size_t i = 0; i < count; ++i) {
+			const uint32_t op = words[i] >> 24;
+			regs_[op] = words[i] & 0x00FFFFFF;
+			if (op == GE_CMD_TRANSFERSTART) {
+				TransferRegs t;
+				t.srcw = regs_[GE_CMD_TRANSFERSRCW] & 0xFFFF;
+				t.dst = regs_[GE_CMD_TRANSFERDST];
+				t.dstw = regs_[GE_CMD_TRANSFERDSTW];
+				t.srcpos = regs_[GE_CMD_TRANSFERSRCPOS];
+				t.dstpos = regs_[GE_CMD_TRANSFERDSTPOS];
+				t.size = regs_[GE_CMD_TRANSFERSIZE];
+				transfers.push_back(t);
+			}
+		}
+	}
+
+	std::vector<TransferRegs> transfers;
+
+private:
+	uint32_t regs_[256];
+};
+
+static bool ReadFlatList(const char *filename, std::vector<uint32_t> &list) {
+	FILE *fp = fopen(filename, "rb");
+	if (!fp) {
+		return false;
+	}
+	// The header is already a multiple of 16 bytes, and the list follows it.
+	FlatHeader header;
+	bool success = fread(&header, sizeof(header), 1, fp) == 1 && memcmp(header.magic, FLAT_MAGIC, sizeof(header.magic)) == 0;
+	if (success) {
+		fseek(fp, (sizeof(header) + 15) & ~15, SEEK_SET);
+		list.resize(header.listWords);
+		success = list.empty() || fread(list.data(), list.size() * sizeof(uint32_t), 1, fp) == 1;
+	}
+	fclose(fp);
+	return success;
+}
+
+int main(int argc, char *argv[]) {
+	if (argc != 3) {
+		fprintf(stderr, "Usage: flatcheck framedump.ppdmp framedump.ppflat\n");
+		return 1;
+	}
+
+	MappedDump dump;
+	std::vector<Command> cmds;
+	std::vector<uint8_t> buf;
+	if (!dump.Open(argv[1]) || dump.IsSeekable() || !dump.ReadCommands(cmds) || !dump.ReadBuffer(buf)) {
+		fprintf(stderr, "Not a valid frame dump: %s\n", argv[1]);
+		return 1;
+	}
+	std::vector<uint32_t> list;
+	if (!ReadFlatList(argv[2], list)) {
+		fprintf(stderr, "Not a valid flat list: %s\n", argv[2]);
+		return 1;
+	}
+
+	TransferLog expected;
+	for (size_t i = 0; i < cmds.size(); ++i) {
+		if (cmds[i].type == CommandType::REGISTERS) {
+			expected.Run((const uint32_t *)(buf.data() + cmds[i].ptr), cmds[i].sz / 4);
+		}
+	}
+	TransferLog flat;
+	flat.Run(list.data(), list.size());
+
+	size_t found = 0;
+	for (size_t i = 0; i < flat.transfers.size() && found < expected.transfers.size(); ++i) {
+		if (flat.transfers[i] == expected.transfers[found]) {
+			found++;
+		}
+	}
+
+	printf("%d dump transfers, %d in the flat list, %d matched\n", (int)expected.transfers.size(), (int)flat.transfers.size(), (int)found);
+	if (found != expected.transfers.size()) {
+		const TransferRegs &t = expected.transfers[found];
+		fprintf(stderr, "Transfer %d (dst %06x/%06x, pos %06x -> %06x, size %06x) isn't in the flat list\n", (int)found, t.dst, t.dstw, t.srcpos, t.dstpos, t.size);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,273 @@
+// Writes synthetic frame dumps for make check.
+//
+// transfer: a block transfer and a CLUT load, then prims drawing small rectangles,
+// so a range after the first chunk only sees the transfer through the memory stream.
+// stream: over 100 MB of textures and vertices, some used again much later, for streaming
+// playback with the mock GE (see mockge.h.)
+// flatten: block transfers that leave their registers for the next one, with CLUT and
+// framebuffer copies (which flattening turns into transfers of its own) in between.
+// signals: prims with their own SIGNALs, after long runs of vertex addresses that span segments,
+// and then registers longer than a segment, with a BASE right where playback splits them.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "commands.h"
+#include "dumpfile.h"
+#include "mockge.h"
+
+struct SpriteVertex {
+	uint32_t color;
+	int16_t x, y, z;
+	int16_t pad;
+};
+
+static const uint32_t VTYPE_THROUGH = 1 << 23;
+static const uint32_t VTYPE_COL8888 = 7 << 2;
+static const uint32_t VTYPE_POS16 = 2 << 7;
+
+static std::vector<Command> cmds;
+static std::vector<uint8_t> buf;
+
+static void AddCommand(uint8_t type, const void *data, uint32_t sz) {
+	Command cmd;
+	cmd.type = type;
+	cmd.sz = sz;
+	cmd.ptr = (uint32_t)((buf.size() + 15) & ~15);
+	buf.resize(cmd.ptr + sz);
+	memcpy(buf.data() + cmd.ptr, data, sz);
+	cmds.push_back(cmd);
+}
+
+static void AddRegisters(const std::vector<uint32_t> &words) {
+	AddCommand(CommandType::REGISTERS, words.data(), (uint32_t)(words.size() * 4));
+}
+
+// Data the mock GE can recognize, at a 256 byte boundary so the marks can address it.
+static Command AddData(uint8_t type, uint32_t sz) {
+	Command cmd;
+	cmd.type = type;
+	cmd.sz = sz;
+	cmd.ptr = (uint32_t)((buf.size() + 255) & ~255);
+	buf.resize(cmd.ptr + sz);
+	MockFillData(buf.data() + cmd.ptr, cmd.ptr, sz);
+	cmds.push_back(cmd);
+	return cmd;
+}
+
+static uint32_t Reg(uint32_t op, uint32_t data) {
+	return (op << 24) | (data & 0x00FFFFFF);
+}
+
+static void GenerateTransfer(int prims) {
+	std::vector<uint32_t> words;
+	words.push_back(Reg(GE_CMD_FRAMEBUFPTR, 0));
+	words.push_back(Reg(GE_CMD_FRAMEBUFWIDTH, 512));
+	words.push_back(Reg(GE_CMD_FRAMEBUFPIXFORMAT, 3));
+	words.push_back(Reg(GE_CMD_SCISSOR1, 0));
+	words.push_back(Reg(GE_CMD_SCISSOR2, 479 | (271 << 10)));
+	words.push_back(Reg(GE_CMD_REGION2, 479 | (271 << 10)));
+	words.push_back(Reg(GE_CMD_VERTEXTYPE, VTYPE_THROUGH | VTYPE_COL8888 | VTYPE_POS16));
+
+	// 16 pixels at (0, 205) from a 16 wide source.
+	words.push_back(Reg(GE_CMD_TRANSFERSRCW, 16));
+	words.push_back(Reg(GE_CMD_TRANSFERDST, 0));
+	words.push_back(Reg(GE_CMD_TRANSFERDSTW, (0x04 << 16) | 512));
+	words.push_back(Reg(GE_CMD_TRANSFERSRCPOS, 0));
+	words.push_back(Reg(GE_CMD_TRANSFERDSTPOS, 205 << 10));
+	words.push_back(Reg(GE_CMD_TRANSFERSIZE, 15));
+	AddRegisters(words);
+
+	uint32_t pixels[16];
+	for (int i = 0; i < 16; ++i) {
+		pixels[i] = 0xFF505050;
+	}
+	AddCommand(CommandType::TRANSFERSRC, pixels, sizeof(pixels));
+	words.clear();
+	words.push_back(Reg(GE_CMD_TRANSFERSTART, 1));
+	AddRegisters(words);
+
+	uint32_t palette[16];
+	for (int i = 0; i < 16; ++i) {
+		palette[i] = 0xFF000000 | (i * 0x111111);
+	}
+	AddCommand(CommandType::CLUT, palette, sizeof(palette));
+	words.clear();
+	words.push_back(Reg(GE_CMD_CLUTFORMAT, 3 | (0xFF << 8)));
+	words.push_back(Reg(GE_CMD_LOADCLUT, 2));
+	AddRegisters(words);
+
+	for (int i = 0; i < prims; ++i) {
+		SpriteVertex verts[2];
+		memset(verts, 0, sizeof(verts));
+		verts[0].color = verts[1].color = 0xFF000000 | (i * 0x030507);
+		verts[0].x = (int16_t)((i % 40) * 12);
+		verts[0].y = (int16_t)((i / 40) * 12);
+		verts[1].x = verts[0].x + 10;
+		verts[1].y = verts[0].y + 10;
+		AddCommand(CommandType::VERTICES, verts, sizeof(verts));
+
+		words.clear();
+		words.push_back(Reg(GE_CMD_PRIM, (6 << 16) | 2));
+		AddRegisters(words);
+	}
+}
+
+static void GenerateStream(int prims) {
+	std::vector<uint32_t> words;
+	words.push_back(Reg(GE_CMD_VERTEXTYPE, VTYPE_THROUGH | VTYPE_COL8888 | VTYPE_POS16));
+	AddRegisters(words);
+
+	std::vector<Command> textures;
+	std::vector<Command> verts;
+	for (int i = 0; i < prims; ++i) {
+		// Every 10 prims, go far back to restart the stream, so the window then starts at this prim's
+		// vertices.  Two prims later, go back before that with the texture still in the window, and
+		// then far back again, so the GE syncs before anything else is decompressed.
+		const int cycle = i % 10;
+		const bool goBack = i >= 20;
+
+		// The registers for that prim are placed before its texture, so they don't decompress it either.
+		Command regs;
+		regs.type = CommandType::REGISTERS;
+		regs.sz = 3 * sizeof(uint32_t);
+		regs.ptr = 0;
+		if (cycle == 2 && goBack) {
+			regs.ptr = (uint32_t)((buf.size() + 15) & ~15);
+			buf.resize(regs.ptr + regs.sz);
+		}
+
+		Command tex;
+		if ((cycle == 0 || cycle == 3) && goBack) {
+			tex = textures[i - 20];
+			cmds.push_back(tex);
+		} else {
+			tex = AddData(CommandType::TEXTURE0, 1024 * 1024);
+		}
+		textures.push_back(tex);
+
+		Command vert;
+		if (cycle == 2 && goBack) {
+			vert = verts[i - 3];
+			cmds.push_back(vert);
+		} else {
+			vert = AddData(CommandType::VERTICES, 64 * 1024);
+		}
+		verts.push_back(vert);
+
+		words.clear();
+		words.push_back(Reg(GE_CMD_NOP, MOCK_MARK_TEX0 | (tex.ptr >> 8)));
+		words.push_back(Reg(GE_CMD_NOP, MOCK_MARK_VERTS | (vert.ptr >> 8)));
+		words.push_back(Reg(GE_CMD_PRIM, (6 << 16) | 2));
+		if (regs.ptr != 0) {
+			memcpy(buf.data() + regs.ptr, words.data(), regs.sz);
+			cmds.push_back(regs);
+		} else {
+			AddRegisters(words);
+		}
+	}
+}
+
+static void GenerateFlatten(int copies) {
+	std::vector<uint32_t> words;
+	words.push_back(Reg(GE_CMD_TRANSFERSRCW, 16));
+	words.push_back(Reg(GE_CMD_TRANSFERDST, 0));
+	words.push_back(Reg(GE_CMD_TRANSFERDSTW, (0x04 << 16) | 256));
+	words.push_back(Reg(GE_CMD_TRANSFERSRCPOS, 0));
+	words.push_back(Reg(GE_CMD_TRANSFERDSTPOS, 0));
+	words.push_back(Reg(GE_CMD_TRANSFERSIZE, 15));
+	AddRegisters(words);
+
+	uint32_t pixels[16];
+	for (int i = 0; i < 16; ++i) {
+		pixels[i] = 0xFF505050;
+	}
+	AddCommand(CommandType::TRANSFERSRC, pixels, sizeof(pixels));
+
+	for (int i = 0; i < copies; ++i) {
+		words.clear();
+		words.push_back(Reg(GE_CMD_TRANSFERDSTPOS, i << 10));
+		words.push_back(Reg(GE_CMD_TRANSFERSTART, 1));
+		AddRegisters(words);
+
+		// Only DSTPOS changes, everything else is left from before the copy.
+		uint32_t data[4 + 64];
+		memset(data, 0, sizeof(data));
+		if (i & 1) {
+			data[0] = 0x04100000 + i * 256;
+			data[1] = 64;
+			AddCommand(CommandType::FRAMEBUF0, data, sizeof(data));
+		} else {
+			data[0] = 0x04180000 + i * 64;
+			AddCommand(CommandType::CLUTADDR, data, 2 * sizeof(uint32_t));
+			AddCommand(CommandType::CLUT, data + 4, 64);
+		}
+	}
+
+	words.clear();
+	words.push_back(Reg(GE_CMD_TRANSFERDSTPOS, copies << 10));
+	words.push_back(Reg(GE_CMD_TRANSFERSTART, 1));
+	AddRegisters(words);
+}
+
+static void GenerateSignals(int prims) {
+	std::vector<uint32_t> words;
+	words.push_back(Reg(GE_CMD_VERTEXTYPE, VTYPE_THROUGH | VTYPE_COL8888 | VTYPE_POS16));
+	AddRegisters(words);
+
+	for (int i = 0; i < prims; ++i) {
+		// The first run alone queues more commands than fit in a segment.
+		const int run = i == 0 ? 10000 : 1000;
+		Command vert;
+		for (int j = 0; j < run; ++j) {
+			vert = AddData(CommandType::VERTICES, 256);
+		}
+
+		words.clear();
+		words.push_back(Reg(GE_CMD_SIGNAL, (0x02 << 16) | i));
+		words.push_back(Reg(GE_CMD_END, 0));
+		words.push_back(Reg(GE_CMD_NOP, MOCK_MARK_VERTS | (vert.ptr >> 8)));
+		words.push_back(Reg(GE_CMD_PRIM, (6 << 16) | 2));
+		AddRegisters(words);
+	}
+
+	// Replay's room per segment, for a block with nothing queued before it.
+	const size_t segmentWords = (64 * 1024 - 16 - 4) / 4;
+	words.assign(segmentWords + 16, Reg(GE_CMD_NOP, 0));
+	words[segmentWords - 1] = Reg(GE_CMD_BASE, 0x0A << 16);
+	words[segmentWords] = Reg(GE_CMD_VADDR, 0);
+	words[segmentWords + 1] = Reg(GE_CMD_NOP, MOCK_MARK_BASE | 0x0A);
+	words[segmentWords + 2] = Reg(GE_CMD_PRIM, (6 << 16) | 2);
+	AddRegisters(words);
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 3) {
+		fprintf(stderr, "Usage: gendump transfer|stream|flatten|signals out.ppdmp [prims]\n");
+		return 1;
+	}
+
+	int prims = argc >= 4 ? atoi(argv[3]) : 50;
+	if (!strcmp(argv[1], "transfer")) {
+		GenerateTransfer(prims);
+	} else if (!strcmp(argv[1], "stream")) {
+		GenerateStream(prims);
+	} else if (!strcmp(argv[1], "flatten")) {
+		GenerateFlatten(prims);
+	} else if (!strcmp(argv[1], "signals")) {
+		GenerateSignals(prims);
+	} else {
+		fprintf(stderr, "Unknown dump type: %s\n", argv[1]);
+		return 1;
+	}
+
+	DumpHeader header;
+	memset(&header, 0, sizeof(header));
+	header.version = 5;
+	if (!WriteDump(argv[2], header, cmds, buf, 3)) {
+		fprintf(stderr, "Unable to write %s\n", argv[2]);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,277 @@
+// See mockge.h.  The list runs as soon as it's published, like a GE that's never busy,
+// so any data Replay moves or hasn't decompressed yet shows up at the prim that uses it.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pspdisplay.h>
+#include <pspge.h>
+#include <pspiofilemgr.h>
+#include <pspthreadman.h>
+#include <psputils.h>
+#include "commands.h"
+#include "mockge.h"
+
+static u32 regs[256];
+static const u32 *listPC;
+static const u32 *listStall;
+static bool listDone;
+static bool finishing;
+static int listSegments;
+static int idleWaits;
+static PspGeCallbackData callback;
+static MockGEStats stats;
+static const u8 *vertexAddr;
+static u32 expectVerts;
+static u32 expectTex0;
+
+const MockGEStats &MockGEGetStats() {
+	return stats;
+}
+
+static const u8 *Address(u32 upperCmd, u32 data) {
+	// Replay puts bits 24-31 of its pointers in bits 16-23, like BASE on the PSP.
+	return (const u8 *)(uintptr_t)(((regs[upperCmd] & 0x00FF0000) << 8) | (data & 0x00FFFFFF));
+}
+
+static bool CheckData(const char *what, const u8 *p, u32 expect) {
+	u32 header[3];
+	memcpy(header, p, sizeof(header));
+	if (header[0] != expect || header[2] != 0) {
+		printf("Prim %d: %s at %p has data from %08x, expected %08x\n", stats.prims, what, p, header[0], expect);
+		return false;
+	}
+	const u32 sz = header[1];
+	for (u32 page = 1; page * MOCK_PAGE_SIZE + 12 <= sz; ++page) {
+		memcpy(header, p + page * MOCK_PAGE_SIZE, sizeof(header));
+		if (header[0] != expect || header[1] != sz || header[2] != page) {
+			printf("Prim %d: %s at %p is wrong after %u bytes (from %08x)\n", stats.prims, what, p, page * MOCK_PAGE_SIZE, expect);
+			return false;
+		}
+	}
+	return true;
+}
+
+static void Prim() {
+	stats.prims++;
+	bool good = true;
+	if (expectVerts != 0) {
+		good = CheckData("Vertices", vertexAddr, expectVerts) && good;
+	}
+	if (expectTex0 != 0) {
+		good = CheckData("Texture", Address(GE_CMD_TEXBUFWIDTH0, regs[GE_CMD_TEXADDR0]), expectTex0) && good;
+	}
+	if (!good) {
+		stats.badPrims++;
+	}
+	expectVerts = 0;
+	expectTex0 = 0;
+}
+
+static void RunList() {
+	while (listPC != 0 && !listDone && listPC != listStall) {
+		idleWaits = 0;
+		const u32 word = *listPC++;
+		const u32 op = word >> 24;
+		const u32 data = word & 0x00FFFFFF;
+
+		switch (op) {
+		case GE_CMD_NOP:
+			if ((data & MOCK_MARK_MASK) == MOCK_MARK_VERTS) {
+				expectVerts = (data & ~MOCK_MARK_MASK) << 8;
+			} else if ((data & MOCK_MARK_MASK) == MOCK_MARK_TEX0) {
+				expectTex0 = (data & ~MOCK_MARK_MASK) << 8;
+			} else if ((data & MOCK_MARK_MASK) == MOCK_MARK_BASE && ((regs[GE_CMD_BASE] >> 16) & 0xFF) != (data & 0xFF)) {
+				printf("Prim %d: BASE is %06x, expected %02x0000\n", stats.prims, regs[GE_CMD_BASE] & 0x00FFFFFF, data & 0xFF);
+				stats.badPrims++;
+			}
+			break;
+		case GE_CMD_VADDR:
+			// BASE applies when it's set, and the segment jumps change BASE afterward.
+			vertexAddr = Address(GE_CMD_BASE, data);
+			break;
+		case GE_CMD_PRIM:
+			Prim();
+			break;
+		case GE_CMD_JUMP:
+			// Only Replay's segment ends jump.
+			stats.segments++;
+			listSegments++;
+			listPC = (const u32 *)Address(GE_CMD_BASE, data & ~3);
+			break;
+		case GE_CMD_SIGNAL:
+			if (callback.signal_func) {
+				callback.signal_func(data & 0xFFFF, callback.signal_arg);
+				// Replay counts finished segments there, and this one's jump is still ahead.
+				if (*(const u32 *)callback.signal_arg > (u32)listSegments + 1) {
+					stats.badSignals++;
+				}
+			}
+			break;
+		case GE_CMD_FINISH:
+			finishing = true;
+			break;
+		case GE_CMD_END:
+			// After a SIGNAL, the handler decides, and Replay's always continue.
+			listDone = finishing;
+			break;
+		default:
+			regs[op] = word;
+			break;
+		}
+	}
+}
+
+extern "C" {
+
+int sceGeListEnQueue(const void *list, void *stall, int cbid, void *arg) {
+	if ((uintptr_t)list > 0xFFFFFFFFULL) {
+		fprintf(stderr, "The display list must be in the low 4 GB, see mallopt() in replaytest.cpp\n");
+		abort();
+	}
+	listPC = (const u32 *)list;
+	listStall = (const u32 *)stall;
+	listDone = false;
+	finishing = false;
+	listSegments = 0;
+	RunList();
+	return 1;
+}
+
+int sceGeListUpdateStallAddr(int qid, void *stall) {
+	listStall = (const u32 *)stall;
+	RunList();
+	return 0;
+}
+
+int sceGeListSync(int qid, int syncType) {
+	RunList();
+	// Done, or stalled: never still drawing.
+	return listDone ? 0 : 3;
+}
+
+int sceGeDrawSync(int syncType) {
+	RunList();
+	return 0;
+}
+
+unsigned int sceGeGetCmd(int cmd) {
+	return regs[cmd & 0xFF];
+}
+
+int sceGeSetCallback(PspGeCallbackData *cb) {
+	callback = *cb;
+	return 1;
+}
+
+int sceGeUnsetCallback(int cbid) {
+	memset(&callback, 0, sizeof(callback));
+	return 0;
+}
+
+int sceGeSaveContext(PspGeContext *context) {
+	memset(context, 0, sizeof(*context));
+	return 0;
+}
+
+int sceGeRestoreContext(const PspGeContext *context) {
+	return 0;
+}
+
+unsigned int sceGeEdramGetAddr(void) {
+	return 0x04000000;
+}
+
+unsigned int sceGeEdramGetSize(void) {
+	return 0x00200000;
+}
+
+int sceGeEdramSetAddrTranslation(int width) {
+	return 0;
+}
+
+int sceDisplaySetFrameBuf(void *topaddr, int bufferwidth, int pixelformat, int sync) {
+	return 0;
+}
+
+int sceDisplayGetFrameBuf(void **topaddr, int *bufferwidth, int *pixelformat, int sync) {
+	*topaddr = 0;
+	*bufferwidth = 512;
+	*pixelformat = 3;
+	return 0;
+}
+
+int sceDisplayWaitVblankStart(void) {
+	return 0;
+}
+
+int sceDmacMemcpy(void *dest, const void *source, unsigned int size) {
+	memcpy(dest, source, size);
+	return 0;
+}
+
+SceUID sceIoOpen(const char *file, int flags, SceMode mode) {
+	int hostFlags = (flags & PSP_O_WRONLY) ? ((flags & PSP_O_RDONLY) ? O_RDWR : O_WRONLY) : O_RDONLY;
+	if (flags & PSP_O_CREAT)
+		hostFlags |= O_CREAT;
+	if (flags & PSP_O_TRUNC)
+		hostFlags |= O_TRUNC;
+	if (flags & PSP_O_APPEND)
+		hostFlags |= O_APPEND;
+	return open(file, hostFlags, mode);
+}
+
+int sceIoClose(SceUID fd) {
+	return close(fd);
+}
+
+int sceIoRead(SceUID fd, void *data, SceSize size) {
+	return (int)read(fd, data, size);
+}
+
+int sceIoWrite(SceUID fd, const void *data, SceSize size) {
+	return (int)write(fd, data, size);
+}
+
+int sceIoLseek32(SceUID fd, int offset, int whence) {
+	// Only restarting the stream seeks backward.
+	if (whence == PSP_SEEK_SET && offset < lseek(fd, 0, SEEK_CUR)) {
+		stats.restarts++;
+	}
+	return (int)lseek(fd, offset, whence);
+}
+
+int sceKernelDelayThread(SceUInt delay) {
+	RunList();
+	return 0;
+}
+
+int sceKernelDelayThreadCB(SceUInt delay) {
+	RunList();
+	// The list always runs up to the stall, so waiting longer can't change anything.
+	if (++idleWaits > 100000) {
+		fprintf(stderr, "Replay is still waiting for a GE that has nothing left to run\n");
+		abort();
+	}
+	return 0;
+}
+
+SceInt64 sceKernelGetSystemTimeWide(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (SceInt64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void sceKernelDcacheWritebackAll(void) {
+}
+
+void sceKernelDcacheWritebackRange(const void *p, unsigned int size) {
+}
+
+void sceKernelDcacheWritebackInvalidateRange(const void *p, unsigned int size) {
+}
+
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+// A mock of the PSPSDK functions Replay uses, so playback's streaming can be checked on the host.
+// The GE only follows the list and checks that each prim sees the data the dump meant.
+
+#include <stdint.h>
+#include <string.h>
+
+// A NOP before a prim, with the buffer offset (>> 8) of the data it should see.
+static const uint32_t MOCK_MARK_VERTS = 0x100000;
+static const uint32_t MOCK_MARK_TEX0 = 0x200000;
+// A NOP with the upper address bits BASE should have now (in its low 8 bits.)
+static const uint32_t MOCK_MARK_BASE = 0x300000;
+static const uint32_t MOCK_MARK_MASK = 0xF00000;
+
+// Each 4 KB page of data starts with its buffer offset, size, and page number.
+static const uint32_t MOCK_PAGE_SIZE = 4096;
+
+static inline void MockFillData(uint8_t *p, uint32_t ptr, uint32_t sz) {
+	memset(p, 0, sz);
+	for (uint32_t page = 0; page * MOCK_PAGE_SIZE + 12 <= sz; ++page) {
+		uint32_t words[3] = { ptr, sz, page };
+		memcpy(p + page * MOCK_PAGE_SIZE, words, sizeof(words));
+	}
+}
+
+struct MockGEStats {
+	int prims;
+	int badPrims;
+	int restarts;
+	int segments;
+	// Signals that counted more segments than the list had finished.
+	int badSignals;
+};
+
+const MockGEStats &MockGEGetStats();
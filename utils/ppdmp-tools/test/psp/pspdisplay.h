@@ -0,0 +1,15 @@
+#pragma once
+
+#include "pspkerneltypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int sceDisplaySetFrameBuf(void *topaddr, int bufferwidth, int pixelformat, int sync);
+int sceDisplayGetFrameBuf(void **topaddr, int *bufferwidth, int *pixelformat, int sync);
+int sceDisplayWaitVblankStart(void);
+
+#ifdef __cplusplus
+}
+#endif
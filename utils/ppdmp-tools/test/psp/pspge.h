@@ -0,0 +1,37 @@
+#pragma once
+
+#include "pspkerneltypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct PspGeContext {
+	unsigned int context[512];
+} PspGeContext;
+
+typedef void (*PspGeCallback)(int id, void *arg);
+
+typedef struct PspGeCallbackData {
+	PspGeCallback signal_func;
+	void *signal_arg;
+	PspGeCallback finish_func;
+	void *finish_arg;
+} PspGeCallbackData;
+
+unsigned int sceGeEdramGetAddr(void);
+unsigned int sceGeEdramGetSize(void);
+int sceGeEdramSetAddrTranslation(int width);
+unsigned int sceGeGetCmd(int cmd);
+int sceGeSaveContext(PspGeContext *context);
+int sceGeRestoreContext(const PspGeContext *context);
+int sceGeListEnQueue(const void *list, void *stall, int cbid, void *arg);
+int sceGeListUpdateStallAddr(int qid, void *stall);
+int sceGeListSync(int qid, int syncType);
+int sceGeDrawSync(int syncType);
+int sceGeSetCallback(PspGeCallbackData *cb);
+int sceGeUnsetCallback(int cbid);
+
+#ifdef __cplusplus
+}
+#endif
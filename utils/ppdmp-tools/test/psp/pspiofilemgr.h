@@ -0,0 +1,28 @@
+#pragma once
+
+#include "pspkerneltypes.h"
+
+#define PSP_O_RDONLY 0x0001
+#define PSP_O_WRONLY 0x0002
+#define PSP_O_RDWR (PSP_O_RDONLY | PSP_O_WRONLY)
+#define PSP_O_APPEND 0x0100
+#define PSP_O_CREAT 0x0200
+#define PSP_O_TRUNC 0x0400
+
+#define PSP_SEEK_SET 0
+#define PSP_SEEK_CUR 1
+#define PSP_SEEK_END 2
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+SceUID sceIoOpen(const char *file, int flags, SceMode mode);
+int sceIoClose(SceUID fd);
+int sceIoRead(SceUID fd, void *data, SceSize size);
+int sceIoWrite(SceUID fd, const void *data, SceSize size);
+int sceIoLseek32(SceUID fd, int offset, int whence);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,19 @@
+#pragma once
+// Just enough of the PSPSDK to build Replay on the host, see mockge.cpp.
+
+#include <stdint.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+typedef int SceUID;
+typedef unsigned int SceSize;
+typedef int SceMode;
+typedef int64_t SceOff;
+typedef unsigned int SceUInt;
+typedef int64_t SceInt64;
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "pspkerneltypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int sceKernelDelayThread(SceUInt delay);
+int sceKernelDelayThreadCB(SceUInt delay);
+SceInt64 sceKernelGetSystemTimeWide(void);
+
+#ifdef __cplusplus
+}
+#endif
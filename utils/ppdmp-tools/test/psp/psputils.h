@@ -0,0 +1,15 @@
+#pragma once
+
+#include "pspkerneltypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void sceKernelDcacheWritebackAll(void);
+void sceKernelDcacheWritebackRange(const void *p, unsigned int size);
+void sceKernelDcacheWritebackInvalidateRange(const void *p, unsigned int size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,82 @@
+// Plays a frame dump with playback's Replay against the mock GE in mockge.cpp, and checks
+// that every prim saw the right data, and that streaming kept memory use near the budget.
+
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mockge.h"
+#include "replay.h"
+
+// Peak resident memory in KB.
+static long PeakRSS() {
+	FILE *fp = fopen("/proc/self/status", "r");
+	if (!fp) {
+		return -1;
+	}
+	char line[256];
+	long kb = -1;
+	while (fgets(line, sizeof(line), fp)) {
+		if (!strncmp(line, "VmHWM:", strlen("VmHWM:"))) {
+			kb = atol(line + strlen("VmHWM:"));
+		}
+	}
+	fclose(fp);
+	return kb;
+}
+
+int main(int argc, char *argv[]) {
+	// Replay passes pointers to the GE as 32 bits, so keep the heap below 4 GB (see -no-pie.)
+	mallopt(M_MMAP_MAX, 0);
+
+	const char *filename = NULL;
+	u32 budget = REPLAY_DEFAULT_BUDGET;
+	long maxRSS = 0;
+	int minRestarts = 0;
+	for (int i = 1; i < argc; ++i) {
+		if (!strncmp(argv[i], "--budget=", strlen("--budget="))) {
+			budget = atoi(argv[i] + strlen("--budget=")) * 1024;
+		} else if (!strncmp(argv[i], "--max-rss=", strlen("--max-rss="))) {
+			maxRSS = atol(argv[i] + strlen("--max-rss="));
+		} else if (!strncmp(argv[i], "--min-restarts=", strlen("--min-restarts="))) {
+			minRestarts = atoi(argv[i] + strlen("--min-restarts="));
+		} else if (!filename) {
+			filename = argv[i];
+		} else {
+			filename = NULL;
+			break;
+		}
+	}
+
+	if (!filename) {
+		fprintf(stderr, "Usage: replaytest framedump.ppdmp [--budget=16384] [--max-rss=KB] [--min-restarts=N]\n");
+		return 1;
+	}
+
+	bool success;
+	{
+		Replay replay(filename, budget);
+		success = replay.Valid() && replay.Run();
+	}
+	if (!success) {
+		fprintf(stderr, "Unable to play %s\n", filename);
+		return 1;
+	}
+
+	const MockGEStats &stats = MockGEGetStats();
+	const long rss = PeakRSS();
+	printf("%d prims, %d wrong, %d segments, %d bad signals, %d stream restarts, peak RSS %ld KB\n", stats.prims, stats.badPrims, stats.segments, stats.badSignals, stats.restarts, rss);
+
+	if (stats.badPrims != 0 || stats.badSignals != 0 || stats.prims == 0) {
+		return 1;
+	}
+	if (stats.restarts < minRestarts) {
+		fprintf(stderr, "Expected at least %d stream restarts\n", minRestarts);
+		return 1;
+	}
+	if (maxRSS != 0 && rss > maxRSS) {
+		fprintf(stderr, "Peak RSS over %ld KB\n", maxRSS);
+		return 1;
+	}
+	return 0;
+}
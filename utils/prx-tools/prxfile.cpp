@@ -0,0 +1,308 @@
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "prxfile.h"
+
+static const uint8_t ELF_MAGIC[4] = { 0x7F, 'E', 'L', 'F' };
+static const uint8_t PBP_MAGIC[4] = { 0x00, 'P', 'B', 'P' };
+static const uint8_t PSP_MAGIC[4] = { '~', 'P', 'S', 'P' };
+
+static const uint16_t ET_PSP_PRX = 0xFFA0;
+static const uint32_t PT_LOAD = 1;
+static const uint32_t PT_PSP_REL = 0x700000A0;
+static const uint32_t PT_PSP_REL2 = 0x700000A1;
+static const uint32_t SHT_NOBITS = 8;
+static const uint32_t SHT_REL = 9;
+static const uint32_t SHT_PSP_REL = 0x700000A0;
+static const uint32_t SHT_PSP_REL2 = 0x700000A1;
+static const uint32_t SHF_WRITE = 1;
+static const uint32_t SHF_ALLOC = 2;
+static const uint32_t SHF_EXECINSTR = 4;
+
+static inline uint16_t Read16(const uint8_t *p) {
+	uint16_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint32_t Read32(const uint8_t *p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+const char *ModuleFormatName(ModuleFormat::Value format) {
+	switch (format) {
+	case ModuleFormat::PRX: return "PRX";
+	case ModuleFormat::ELF: return "ELF";
+	case ModuleFormat::ENCRYPTED: return "encrypted";
+	default: return "unknown";
+	}
+}
+
+MappedModule::MappedModule()
+	: map_(NULL), size_(0), elf_(NULL), elfSize_(0), error_(NULL), format_(ModuleFormat::UNKNOWN), inPBP_(false),
+	  attr_(0), version_(0), sdkVersion_(0), entry_(0), relocCount_(0), packedRelocBytes_(0),
+	  textSize_(0), rodataSize_(0), dataSize_(0), bssSize_(0) {
+	name_[0] = '\0';
+}
+
+MappedModule::~MappedModule() {
+	if (map_ != NULL) {
+		munmap((void *)map_, size_);
+	}
+}
+
+bool MappedModule::Open(const char *filename) {
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		return Fail("Could not open file");
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < 0x34) {
+		close(fd);
+		return Fail("File too small");
+	}
+
+	void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) {
+		return Fail("Could not map file");
+	}
+	map_ = (const uint8_t *)p;
+	size_ = st.st_size;
+	elf_ = map_;
+	elfSize_ = size_;
+
+	if (memcmp(map_, PBP_MAGIC, sizeof(PBP_MAGIC)) == 0) {
+		// Offsets of PARAM.SFO, ICON0.PNG, ICON1.PMF, PIC0.PNG, PIC1.PNG, SND0.AT3, DATA.PSP, DATA.PSAR.
+		uint32_t start = Read32(map_ + 8 + 6 * 4);
+		uint32_t end = Read32(map_ + 8 + 7 * 4);
+		if (end <= start || end > size_) {
+			end = (uint32_t)size_;
+		}
+		if (start >= end) {
+			return Fail("PBP has no DATA.PSP");
+		}
+		elf_ = map_ + start;
+		elfSize_ = end - start;
+		inPBP_ = true;
+	}
+
+	if (elfSize_ >= 0x26 && memcmp(elf_, PSP_MAGIC, sizeof(PSP_MAGIC)) == 0) {
+		format_ = ModuleFormat::ENCRYPTED;
+		attr_ = Read16(elf_ + 4);
+		memcpy(name_, elf_ + 0x0A, 28);
+		name_[28] = '\0';
+		return true;
+	}
+	if (elfSize_ < 0x34 || memcmp(elf_, ELF_MAGIC, sizeof(ELF_MAGIC)) != 0) {
+		return Fail("Not an ELF, PRX, or PBP");
+	}
+	return ParseElf();
+}
+
+bool MappedModule::ParseElf() {
+	if (elf_[4] != 1 || elf_[5] != 1) {
+		return Fail("Not a little endian ELF32 file");
+	}
+	uint16_t type = Read16(elf_ + 0x10);
+	format_ = type == ET_PSP_PRX ? ModuleFormat::PRX : ModuleFormat::ELF;
+	entry_ = Read32(elf_ + 0x18);
+	uint32_t phoff = Read32(elf_ + 0x1C);
+	uint32_t shoff = Read32(elf_ + 0x20);
+	uint16_t phentsize = Read16(elf_ + 0x2A);
+	uint16_t phnum = Read16(elf_ + 0x2C);
+	uint16_t shentsize = Read16(elf_ + 0x2E);
+	uint16_t shnum = Read16(elf_ + 0x30);
+	uint16_t shstrndx = Read16(elf_ + 0x32);
+
+	if (phentsize < 32 || phoff + (uint64_t)phnum * phentsize > elfSize_) {
+		return Fail("Program headers out of bounds");
+	}
+
+	// PRXs point at their module info from the first program header.
+	uint32_t infoOffset = 0;
+	uint32_t relocCount = 0;
+	for (uint16_t i = 0; i < phnum; ++i) {
+		const uint8_t *ph = elf_ + phoff + i * phentsize;
+		uint32_t ptype = Read32(ph);
+		uint32_t offset = Read32(ph + 4);
+		uint32_t filesz = Read32(ph + 16);
+		if (i == 0 && format_ == ModuleFormat::PRX) {
+			infoOffset = Read32(ph + 12) & 0x7FFFFFFF;
+		}
+		if (ptype == PT_LOAD) {
+			Segment seg = { Read32(ph + 8), offset, filesz };
+			if (offset + (uint64_t)filesz > elfSize_) {
+				return Fail("Segment out of bounds");
+			}
+			segments_.push_back(seg);
+			bssSize_ += Read32(ph + 20) - filesz;
+		} else if (ptype == PT_PSP_REL) {
+			relocCount += filesz / 8;
+		} else if (ptype == PT_PSP_REL2) {
+			packedRelocBytes_ += filesz;
+		}
+	}
+	if (segments_.empty()) {
+		return Fail("No loadable segments");
+	}
+
+	if (shoff != 0 && shentsize >= 40 && shstrndx < shnum && shoff + (uint64_t)shnum * shentsize <= elfSize_) {
+		ParseSections(shoff, shentsize, shnum, shstrndx);
+	}
+	if (sections_.empty()) {
+		// Stripped, so relocations are only in segments, and we can only tell bss apart.
+		relocCount_ = relocCount;
+	}
+
+	uint32_t infoAddr = 0;
+	for (size_t i = 0; i < sections_.size(); ++i) {
+		if (strcmp(sections_[i].name, ".rodata.sceModuleInfo") == 0) {
+			infoAddr = sections_[i].addr;
+			infoOffset = 0;
+			break;
+		}
+	}
+	return ParseModuleInfo(infoAddr, infoOffset);
+}
+
+void MappedModule::ParseSections(uint32_t shoff, uint16_t shentsize, uint16_t shnum, uint16_t shstrndx) {
+	const uint8_t *strtab = elf_ + shoff + shstrndx * shentsize;
+	uint32_t namesOffset = Read32(strtab + 16);
+	uint32_t namesSize = Read32(strtab + 20);
+	if (namesOffset + (uint64_t)namesSize > elfSize_ || namesSize == 0 || elf_[namesOffset + namesSize - 1] != '\0') {
+		return;
+	}
+	const char *names = (const char *)elf_ + namesOffset;
+
+	sections_.reserve(shnum);
+	bssSize_ = 0;
+	for (uint16_t i = 1; i < shnum; ++i) {
+		const uint8_t *sh = elf_ + shoff + i * shentsize;
+		uint32_t name = Read32(sh);
+		ModuleSection section = { name < namesSize ? names + name : "", Read32(sh + 4), Read32(sh + 12), Read32(sh + 20) };
+		uint32_t flags = Read32(sh + 8);
+		sections_.push_back(section);
+
+		if (section.type == SHT_REL || section.type == SHT_PSP_REL) {
+			relocCount_ += section.size / 8;
+		} else if (section.type == SHT_PSP_REL2) {
+			packedRelocBytes_ += section.size;
+		} else if ((flags & SHF_ALLOC) == 0) {
+			continue;
+		} else if (section.type == SHT_NOBITS) {
+			bssSize_ += section.size;
+		} else if (flags & SHF_EXECINSTR) {
+			textSize_ += section.size;
+		} else if (flags & SHF_WRITE) {
+			dataSize_ += section.size;
+		} else {
+			rodataSize_ += section.size;
+		}
+	}
+}
+
+const uint8_t *MappedModule::At(uint32_t addr, uint32_t sz) const {
+	for (size_t i = 0; i < segments_.size(); ++i) {
+		const Segment &seg = segments_[i];
+		if (addr >= seg.vaddr && (uint64_t)addr + sz <= (uint64_t)seg.vaddr + seg.filesz) {
+			return elf_ + seg.offset + (addr - seg.vaddr);
+		}
+	}
+	return NULL;
+}
+
+const char *MappedModule::StringAt(uint32_t addr) const {
+	const uint8_t *p = At(addr, 1);
+	if (p == NULL) {
+		return NULL;
+	}
+	// Only if it's terminated before the end of the file.
+	const uint8_t *end = elf_ + elfSize_;
+	return memchr(p, '\0', end - p) != NULL ? (const char *)p : NULL;
+}
+
+bool MappedModule::ParseModuleInfo(uint32_t infoAddr, uint32_t infoOffset) {
+	// attr, version, name[28], gp, ent_top, ent_end, stub_top, stub_end.
+	const uint32_t infoSize = 52;
+	const uint8_t *info = NULL;
+	if (infoOffset != 0) {
+		info = infoOffset + (uint64_t)infoSize <= elfSize_ ? elf_ + infoOffset : NULL;
+	} else if (infoAddr != 0 || format_ == ModuleFormat::PRX) {
+		info = At(infoAddr, infoSize);
+	}
+	if (info == NULL) {
+		return Fail("Module info out of bounds");
+	}
+	attr_ = Read16(info);
+	version_ = Read16(info + 2);
+	memcpy(name_, info + 4, 28);
+	name_[28] = '\0';
+
+	uint32_t entTop = Read32(info + 36);
+	uint32_t entEnd = Read32(info + 40);
+	uint32_t stubTop = Read32(info + 44);
+	uint32_t stubEnd = Read32(info + 48);
+
+	for (uint32_t addr = entTop; addr + 16 <= entEnd; ) {
+		const uint8_t *ent = At(addr, 16);
+		if (ent == NULL) {
+			return Fail("Export table out of bounds");
+		}
+		ModuleExport exp;
+		uint32_t nameAddr = Read32(ent);
+		exp.library = nameAddr != 0 ? StringAt(nameAddr) : NULL;
+		exp.version = Read16(ent + 4);
+		exp.attr = Read16(ent + 6);
+		uint8_t len = ent[8];
+		exp.varCount = ent[9];
+		exp.funcCount = Read16(ent + 10);
+		uint32_t total = exp.funcCount + exp.varCount;
+		exp.nids = (const uint32_t *)At(Read32(ent + 12), total * 8);
+		if (exp.nids == NULL && total != 0) {
+			return Fail("Export NIDs out of bounds");
+		}
+		exports_.push_back(exp);
+
+		if (nameAddr == 0) {
+			for (uint32_t i = exp.funcCount; i < total; ++i) {
+				if (exp.nids[i] == NID_MODULE_SDK_VERSION) {
+					const uint8_t *value = At(exp.nids[total + i], 4);
+					sdkVersion_ = value != NULL ? Read32(value) : 0;
+				}
+			}
+		}
+		addr += (len < 4 ? 4 : len) * 4;
+	}
+
+	for (uint32_t addr = stubTop; addr + 20 <= stubEnd; ) {
+		const uint8_t *stub = At(addr, 20);
+		if (stub == NULL) {
+			return Fail("Import table out of bounds");
+		}
+		ModuleImport imp;
+		imp.library = StringAt(Read32(stub));
+		imp.version = Read16(stub + 4);
+		imp.attr = Read16(stub + 6);
+		uint8_t len = stub[8];
+		imp.varCount = stub[9];
+		imp.funcCount = Read16(stub + 10);
+		imp.nids = (const uint32_t *)At(Read32(stub + 12), imp.funcCount * 4);
+		imp.vars = NULL;
+		if (len >= 6 && imp.varCount != 0) {
+			const uint8_t *vars = At(addr + 20, 4);
+			imp.vars = vars != NULL ? (const uint32_t *)At(Read32(vars), imp.varCount * 8) : NULL;
+		}
+		if (imp.library == NULL || (imp.nids == NULL && imp.funcCount != 0)) {
+			return Fail("Import NIDs out of bounds");
+		}
+		imports_.push_back(imp);
+		addr += (len < 5 ? 5 : len) * 4;
+	}
+	return true;
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Reads PSP modules (PRX, ELF, or the DATA.PSP in a PBP) mapped into memory.  Names, NID tables,
+// and sections point into the mapping rather than being copied, so they're only valid while the
+// MappedModule is open.  Assumes a little endian host, like the PSP.
+
+struct ModuleFormat {
+	enum Value {
+		UNKNOWN,
+		PRX,
+		ELF,
+		// Signed or encrypted (~PSP header), so only the name is known.
+		ENCRYPTED,
+	};
+};
+
+struct ModuleSection {
+	const char *name;
+	uint32_t type;
+	uint32_t addr;
+	uint32_t size;
+};
+
+struct ModuleImport {
+	const char *library;
+	uint16_t version;
+	uint16_t attr;
+	uint16_t funcCount;
+	uint16_t varCount;
+	// funcCount function NIDs.
+	const uint32_t *nids;
+	// varCount pairs of address and NID.
+	const uint32_t *vars;
+};
+
+struct ModuleExport {
+	// NULL for the module's own (syslib) exports, like module_start.
+	const char *library;
+	uint16_t version;
+	uint16_t attr;
+	uint16_t funcCount;
+	uint16_t varCount;
+	// funcCount function NIDs, then varCount variable NIDs, then their addresses in the same order.
+	const uint32_t *nids;
+};
+
+static const uint32_t NID_MODULE_SDK_VERSION = 0x11B97506;
+
+class MappedModule {
+public:
+	MappedModule();
+	~MappedModule();
+
+	// Returns false if the file can't be read or isn't a PSP module.  Error() says why.
+	bool Open(const char *filename);
+	const char *Error() const {
+		return error_;
+	}
+
+	ModuleFormat::Value Format() const {
+		return format_;
+	}
+	bool InPBP() const {
+		return inPBP_;
+	}
+	size_t FileSize() const {
+		return size_;
+	}
+	size_t ModuleSize() const {
+		return elfSize_;
+	}
+
+	const char *Name() const {
+		return name_;
+	}
+	uint16_t Attr() const {
+		return attr_;
+	}
+	uint16_t Version() const {
+		return version_;
+	}
+	// From the module_sdk_version export, or 0 if it has none.
+	uint32_t SdkVersion() const {
+		return sdkVersion_;
+	}
+	uint32_t Entry() const {
+		return entry_;
+	}
+
+	const std::vector<ModuleSection> &Sections() const {
+		return sections_;
+	}
+	const std::vector<ModuleImport> &Imports() const {
+		return imports_;
+	}
+	const std::vector<ModuleExport> &Exports() const {
+		return exports_;
+	}
+	// Entries in relocation sections (or segments, for stripped PRXs.)
+	uint32_t RelocCount() const {
+		return relocCount_;
+	}
+	// Bytes of the newer compressed relocation format, which doesn't say how many there are.
+	uint32_t PackedRelocBytes() const {
+		return packedRelocBytes_;
+	}
+	// Sizes of code, read-only data, writable data, and bss, from the section flags.
+	uint32_t TextSize() const {
+		return textSize_;
+	}
+	uint32_t RodataSize() const {
+		return rodataSize_;
+	}
+	uint32_t DataSize() const {
+		return dataSize_;
+	}
+	uint32_t BssSize() const {
+		return bssSize_;
+	}
+
+private:
+	bool Fail(const char *error) {
+		error_ = error;
+		return false;
+	}
+	bool ParseElf();
+	bool ParseModuleInfo(uint32_t infoAddr, uint32_t infoOffset);
+	void ParseSections(uint32_t shoff, uint16_t shentsize, uint16_t shnum, uint16_t shstrndx);
+
+	// Converts a module address to a pointer, or NULL if sz bytes there aren't in the file.
+	const uint8_t *At(uint32_t addr, uint32_t sz) const;
+	const char *StringAt(uint32_t addr) const;
+
+	struct Segment {
+		uint32_t vaddr;
+		uint32_t offset;
+		uint32_t filesz;
+	};
+
+	const uint8_t *map_;
+	size_t size_;
+	const uint8_t *elf_;
+	size_t elfSize_;
+	const char *error_;
+	ModuleFormat::Value format_;
+	bool inPBP_;
+
+	char name_[29];
+	uint16_t attr_;
+	uint16_t version_;
+	uint32_t sdkVersion_;
+	uint32_t entry_;
+
+	std::vector<Segment> segments_;
+	std::vector<ModuleSection> sections_;
+	std::vector<ModuleImport> imports_;
+	std::vector<ModuleExport> exports_;
+	uint32_t relocCount_;
+	uint32_t packedRelocBytes_;
+	uint32_t textSize_;
+	uint32_t rodataSize_;
+	uint32_t dataSize_;
+	uint32_t bssSize_;
+};
+
+const char *ModuleFormatName(ModuleFormat::Value format);
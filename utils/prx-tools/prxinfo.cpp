@@ -0,0 +1,223 @@
+// Prints what's inside PSP modules (PRX, ELF, or PBP): module info, SDK version, sizes,
+// relocations, and imported and exported NIDs.  Directories are searched for modules, which
+// are read in parallel.
+
+#include <dirent.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "prxfile.h"
+
+struct Options {
+	bool imports;
+	bool exports;
+	bool sections;
+	// One line per module, the default for more than one.
+	bool brief;
+};
+
+static void Appendf(std::string &out, const char *fmt, ...) {
+	char buf[1024];
+	va_list args;
+	va_start(args, fmt);
+	vsnprintf(buf, sizeof(buf), fmt, args);
+	va_end(args);
+	out += buf;
+}
+
+static bool IsModuleFilename(const char *name) {
+	const char *ext = strrchr(name, '.');
+	return ext != NULL && (!strcasecmp(ext, ".prx") || !strcasecmp(ext, ".elf") || !strcasecmp(ext, ".pbp"));
+}
+
+static void FindModules(const std::string &dir, std::vector<std::string> &files) {
+	DIR *d = opendir(dir.c_str());
+	if (d == NULL) {
+		fprintf(stderr, "Could not read directory: %s\n", dir.c_str());
+		return;
+	}
+	std::vector<std::string> found;
+	while (struct dirent *ent = readdir(d)) {
+		if (ent->d_name[0] == '.') {
+			continue;
+		}
+		std::string path = dir + "/" + ent->d_name;
+		struct stat st;
+		if (stat(path.c_str(), &st) != 0) {
+			continue;
+		}
+		if (S_ISDIR(st.st_mode)) {
+			FindModules(path, files);
+		} else if (IsModuleFilename(ent->d_name)) {
+			found.push_back(path);
+		}
+	}
+	closedir(d);
+	std::sort(found.begin(), found.end());
+	files.insert(files.end(), found.begin(), found.end());
+}
+
+static uint32_t CountFuncs(const std::vector<ModuleImport> &imports) {
+	uint32_t count = 0;
+	for (size_t i = 0; i < imports.size(); ++i) {
+		count += imports[i].funcCount;
+	}
+	return count;
+}
+
+static void DescribeBrief(const char *filename, const MappedModule &mod, std::string &out) {
+	Appendf(out, "%s: %s%s \"%s\"", filename, ModuleFormatName(mod.Format()), mod.InPBP() ? " in PBP" : "", mod.Name());
+	if (mod.Format() == ModuleFormat::ENCRYPTED) {
+		out += "\n";
+		return;
+	}
+	Appendf(out, " sdk=%08x imports=%u/%u exports=%u relocs=%u text=%u data=%u bss=%u\n",
+		mod.SdkVersion(), (uint32_t)mod.Imports().size(), CountFuncs(mod.Imports()), (uint32_t)mod.Exports().size(),
+		mod.RelocCount(), mod.TextSize(), mod.RodataSize() + mod.DataSize(), mod.BssSize());
+}
+
+static void Describe(const char *filename, const MappedModule &mod, const Options &opts, std::string &out) {
+	Appendf(out, "%s: %s%s, module \"%s\" version %d.%d, attr 0x%04x\n", filename, ModuleFormatName(mod.Format()), mod.InPBP() ? " in PBP" : "",
+		mod.Name(), mod.Version() >> 8, mod.Version() & 0xFF, mod.Attr());
+	if (mod.Format() == ModuleFormat::ENCRYPTED) {
+		return;
+	}
+
+	if (mod.SdkVersion() != 0) {
+		Appendf(out, "  SDK version: 0x%08x\n", mod.SdkVersion());
+	}
+	Appendf(out, "  Entry: 0x%08x\n", mod.Entry());
+	Appendf(out, "  Sizes: text %u, rodata %u, data %u, bss %u\n", mod.TextSize(), mod.RodataSize(), mod.DataSize(), mod.BssSize());
+	Appendf(out, "  Relocations: %u", mod.RelocCount());
+	if (mod.PackedRelocBytes() != 0) {
+		Appendf(out, " (and %u bytes packed)", mod.PackedRelocBytes());
+	}
+	Appendf(out, "\n  Imports: %u functions from %u libraries\n", CountFuncs(mod.Imports()), (uint32_t)mod.Imports().size());
+
+	if (opts.imports) {
+		for (size_t i = 0; i < mod.Imports().size(); ++i) {
+			const ModuleImport &imp = mod.Imports()[i];
+			Appendf(out, "    %s (version 0x%04x, attr 0x%04x)\n", imp.library, imp.version, imp.attr);
+			for (uint16_t j = 0; j < imp.funcCount; ++j) {
+				Appendf(out, "      0x%08X\n", imp.nids[j]);
+			}
+			for (uint16_t j = 0; imp.vars != NULL && j < imp.varCount; ++j) {
+				Appendf(out, "      0x%08X (variable)\n", imp.vars[j * 2 + 1]);
+			}
+		}
+	}
+
+	Appendf(out, "  Exports: %u libraries\n", (uint32_t)mod.Exports().size());
+	if (opts.exports) {
+		for (size_t i = 0; i < mod.Exports().size(); ++i) {
+			const ModuleExport &exp = mod.Exports()[i];
+			uint32_t total = exp.funcCount + exp.varCount;
+			Appendf(out, "    %s (version 0x%04x, attr 0x%04x)\n", exp.library != NULL ? exp.library : "syslib", exp.version, exp.attr);
+			for (uint32_t j = 0; j < total; ++j) {
+				Appendf(out, "      0x%08X at 0x%08x%s\n", exp.nids[j], exp.nids[total + j], j >= exp.funcCount ? " (variable)" : "");
+			}
+		}
+	}
+
+	if (opts.sections) {
+		Appendf(out, "  Sections:\n");
+		for (size_t i = 0; i < mod.Sections().size(); ++i) {
+			const ModuleSection &sec = mod.Sections()[i];
+			Appendf(out, "    %-24s type 0x%08x addr 0x%08x size %u\n", sec.name, sec.type, sec.addr, sec.size);
+		}
+	}
+}
+
+int main(int argc, char *argv[]) {
+	Options opts = { false, false, false, false };
+	bool detailed = false;
+	int threads = std::thread::hardware_concurrency();
+	std::vector<std::string> files;
+	bool searched = false;
+
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "--imports")) {
+			opts.imports = true;
+		} else if (!strcmp(argv[i], "--exports")) {
+			opts.exports = true;
+		} else if (!strcmp(argv[i], "--sections")) {
+			opts.sections = true;
+		} else if (!strcmp(argv[i], "--detail")) {
+			detailed = true;
+		} else if (!strncmp(argv[i], "--threads=", strlen("--threads="))) {
+			threads = atoi(argv[i] + strlen("--threads="));
+		} else if (argv[i][0] == '-') {
+			files.clear();
+			break;
+		} else {
+			struct stat st;
+			if (stat(argv[i], &st) == 0 && S_ISDIR(st.st_mode)) {
+				std::string dir = argv[i];
+				while (dir.size() > 1 && dir[dir.size() - 1] == '/') {
+					dir.resize(dir.size() - 1);
+				}
+				FindModules(dir, files);
+				searched = true;
+			} else {
+				files.push_back(argv[i]);
+			}
+		}
+	}
+
+	if (files.empty()) {
+		fprintf(stderr, "Usage: prxinfo [--imports] [--exports] [--sections] [--detail] [--threads=N] file.prx|file.elf|EBOOT.PBP|dir ...\n");
+		return 1;
+	}
+	opts.brief = !detailed && !opts.imports && !opts.exports && !opts.sections && (files.size() > 1 || searched);
+	if (threads < 1) {
+		threads = 1;
+	}
+
+	auto startTime = std::chrono::steady_clock::now();
+	std::vector<std::string> outputs(files.size());
+	// Not vector<bool>, which packs bits that the threads would share.
+	std::vector<char> failed(files.size());
+	std::atomic<size_t> next(0);
+	auto worker = [&]() {
+		for (size_t i = next++; i < files.size(); i = next++) {
+			MappedModule mod;
+			if (!mod.Open(files[i].c_str())) {
+				Appendf(outputs[i], "%s: %s\n", files[i].c_str(), mod.Error());
+				failed[i] = true;
+			} else if (opts.brief) {
+				DescribeBrief(files[i].c_str(), mod, outputs[i]);
+			} else {
+				Describe(files[i].c_str(), mod, opts, outputs[i]);
+			}
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (int t = 1; t < threads && (size_t)t < files.size(); ++t) {
+		workers.push_back(std::thread(worker));
+	}
+	worker();
+	for (size_t t = 0; t < workers.size(); ++t) {
+		workers[t].join();
+	}
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+	int errors = 0;
+	for (size_t i = 0; i < files.size(); ++i) {
+		fputs(outputs[i].c_str(), failed[i] ? stderr : stdout);
+		errors += failed[i] ? 1 : 0;
+	}
+	if (files.size() > 1) {
+		fprintf(stderr, "%d modules, %d errors, in %.1f ms\n", (int)files.size(), errors, ms);
+	}
+	return errors != 0 ? 1 : 0;
+}